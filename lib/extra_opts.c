@@ -24,6 +24,7 @@
 #include "utils_base.h"
 #include "parse_ini.h"
 #include "extra_opts.h"
+#include "utils_output.h"
 
 /* FIXME: copied from utils.h; we should move a bunch of libs! */
 int
@@ -37,8 +38,16 @@ is_option2 (char *str)
 		return FALSE;
 }
 
+static char **_np_extra_opts(int *, char **, const char *);
+
 /* this is the externally visible function used by plugins */
 char **np_extra_opts(int *argc, char **argv, const char *plugin_name){
+	/* --output-format may come from an ini file too */
+	argv=_np_extra_opts(argc, argv, plugin_name);
+	return np_output_opts(argc, argv, plugin_name);
+}
+
+static char **_np_extra_opts(int *argc, char **argv, const char *plugin_name){
 	np_arg_list *extra_args=NULL, *ea1=NULL, *ea_tmp=NULL;
 	char **argv_new=NULL;
 	char *argptr=NULL;
@@ -16,6 +16,8 @@
  *
  * The new array can be easily freed as long as a pointer to the original one
  * is kept. See my_free() in lib/tests/test_opts1.c for an example.
+ *
+ * --output-format is handled here too, see utils_output.h.
  */
 char **np_extra_opts(int *argc, char **argv, const char *plugin_name);
 
@@ -30,6 +30,11 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <stdint.h>
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
 
 /* np_ini_info contains the result of parsing a "locator" in the format
  * [stanza_name][@config_filename] (check_foo@/etc/foo.ini, for example)
@@ -66,6 +71,9 @@ static char *default_ini_path_names[] = {
 	NULL
 };
 
+/* cached_defaults() when the stanza has to be read from the file */
+#define INI_CACHE_MISS -1
+
 /* eat all characters from a FILE pointer until n is encountered */
 #define GOBBLE_TO(f, c, n) do { (c)=fgetc((f)); } while((c)!=EOF && (c)!=(n))
 
@@ -73,6 +81,9 @@ static char *default_ini_path_names[] = {
 static int read_defaults(FILE *f, const char *stanza, np_arg_list **opts);
 /* internal function that converts a single line into options format */
 static int add_option(FILE *f, np_arg_list **optlst);
+static int line_to_option(const char *linebuf, size_t read_pos, char **arg);
+/* internal function that looks the stanza up in the compiled index */
+static int cached_defaults(FILE *f, const char *file, const char *stanza, np_arg_list **opts);
 /* internal functions to find default file */
 static char* default_file(void);
 static char* default_file_in_path(void);
@@ -121,6 +132,7 @@ np_arg_list* np_get_defaults(const char *locator, const char *default_section){
 	np_ini_info i = {NULL, NULL};
 	struct stat fstat;
 	bool is_suid_set = np_suid();
+	int status;
 
 	if (is_suid_set && idpriv_temp_drop() == -1) 
 		die(STATE_UNKNOWN, "%s %s\n", _("Can't drop user permissions."), strerror(errno));
@@ -149,7 +161,10 @@ np_arg_list* np_get_defaults(const char *locator, const char *default_section){
 		if (inifile == NULL)
 			die(STATE_UNKNOWN, "%s %s\n", _("Can't read config file:"), strerror(errno));
 		/* inifile points to an open FILE our ruid/rgid can access, parse its contents. */
-		if (read_defaults(inifile, i.stanza, &defaults) == FALSE)
+		status = (inifile != stdin && !is_suid_set) ? cached_defaults(inifile, i.file, i.stanza, &defaults) : INI_CACHE_MISS;
+		if (status == INI_CACHE_MISS)
+			status = read_defaults(inifile, i.stanza, &defaults);
+		if (status == FALSE)
 			die(STATE_UNKNOWN,"%s%s%s%s'\n", _("Invalid section '"), i.stanza, _("' in config file '"), i.file);
 		if (inifile != stdin) fclose(inifile);
 	}
@@ -249,11 +264,9 @@ static int read_defaults(FILE *f, const char *stanza, np_arg_list **opts){
  */
 static int add_option(FILE *f, np_arg_list **optlst){
 	np_arg_list *opttmp=*optlst, *optnew;
-	char *linebuf=NULL, *lineend=NULL, *optptr=NULL, *optend=NULL;
-	char *eqptr=NULL, *valptr=NULL, *valend=NULL;
-	short done_reading=0, equals=0, value=0;
-	size_t cfg_len=0, read_sz=8, linebuf_sz=0, read_pos=0;
-	size_t opt_len=0, val_len=0;
+	char *linebuf=NULL, *arg=NULL;
+	short done_reading=0;
+	size_t read_sz=8, linebuf_sz=0, read_pos=0;
 
 	/* read one line from the file */
 	while(!done_reading){
@@ -272,8 +285,44 @@ static int add_option(FILE *f, np_arg_list **optlst){
 			}
 		}
 	}
-	lineend=&linebuf[read_pos];
 	/* all that to read one line.  isn't C fun? :) now comes the parsing :/ */
+	if(line_to_option(linebuf, read_pos, &arg))
+		die(STATE_UNKNOWN, "%s\n", _("Config file error"));
+
+	/* okay, now we have all the info we need, so we create a new np_arg_list
+	 * element and set the argument...
+	 */
+	optnew=malloc(sizeof(np_arg_list));
+	optnew->next=NULL;
+	optnew->arg=arg;
+
+	/* ...and put that to the end of the list */
+	if(*optlst==NULL) {
+		*optlst=optnew;
+	}	else {
+		while(opttmp->next!=NULL) {
+			opttmp=opttmp->next;
+		}
+		opttmp->next = optnew;
+	}
+
+	free(linebuf);
+	return 0;
+}
+
+/*
+ * converts the line in linebuf (of length read_pos, without the newline)
+ * into a newly allocated --option[=value] in *arg.  Returns 1 on a syntax
+ * error.
+ */
+static int line_to_option(const char *linebuf, size_t read_pos, char **arg){
+	const char *lineend=NULL, *optptr=NULL, *optend=NULL;
+	const char *eqptr=NULL, *valptr=NULL, *valend=NULL;
+	short equals=0, value=0;
+	size_t cfg_len=0, opt_len=0, val_len=0;
+	char *optstr;
+
+	lineend=&linebuf[read_pos];
 
 	/* skip leading whitespace */
 	for(optptr=linebuf; optptr<lineend && isspace(*optptr); optptr++);
@@ -285,7 +334,7 @@ static int add_option(FILE *f, np_arg_list **optlst){
 	if(optend==NULL) optend=eqptr;
 	--optend;
 	/* ^[[:space:]]*=foo is a syntax error */
-	if(optptr==eqptr) die(STATE_UNKNOWN, "%s\n", _("Config file error"));
+	if(optptr==eqptr) return 1;
 	/* continue from '=' to start of value or EOL */
 	for(valptr=eqptr+1; valptr<lineend && isspace(*valptr); valptr++);
 	/* continue to the end of value */
@@ -312,44 +361,29 @@ static int add_option(FILE *f, np_arg_list **optlst){
 		cfg_len+=1;
 	}
 	/* A line with no equal sign isn't valid */
-	if(equals==0) die(STATE_UNKNOWN, "%s\n", _("Config file error"));
-
-	/* okay, now we have all the info we need, so we create a new np_arg_list
-	 * element and set the argument...
-	 */
-	optnew=malloc(sizeof(np_arg_list));
-	optnew->next=NULL;
+	if(equals==0) return 1;
 
 	read_pos=0;
-	optnew->arg=malloc(cfg_len+1);
+	optstr=malloc(cfg_len+1);
+	if(optstr==NULL) die(STATE_UNKNOWN, "%s\n", _("malloc() failed!"));
 	/* 1-character params needs only one dash */
 	if(opt_len==1) {
-		optnew->arg[read_pos]='-';
+		optstr[read_pos]='-';
 		++read_pos;
 	} else {
-		optnew->arg[read_pos]='-';
+		optstr[read_pos]='-';
 		++read_pos;
-		optnew->arg[read_pos]='-';
+		optstr[read_pos]='-';
 		++read_pos;
 	}
-	strncpy(&optnew->arg[read_pos], optptr, opt_len); read_pos+=opt_len;
+	strncpy(&optstr[read_pos], optptr, opt_len); read_pos+=opt_len;
 	if(value) {
-		optnew->arg[read_pos++]='=';
-		strncpy(&optnew->arg[read_pos], valptr, val_len); read_pos+=val_len;
-	}
-	optnew->arg[read_pos]='\0';
-
-	/* ...and put that to the end of the list */
-	if(*optlst==NULL) {
-		*optlst=optnew;
-	}	else {
-		while(opttmp->next!=NULL) {
-			opttmp=opttmp->next;
-		}
-		opttmp->next = optnew;
+		optstr[read_pos++]='=';
+		strncpy(&optstr[read_pos], valptr, val_len); read_pos+=val_len;
 	}
+	optstr[read_pos]='\0';
 
-	free(linebuf);
+	*arg=optstr;
 	return 0;
 }
 
@@ -386,3 +420,363 @@ static char *default_file(void){
 			return *p;
 	return NULL;
 }
+
+/*
+ * The compiled index of an ini file, so that --extra-opts does not parse
+ * the whole file on every run.  It holds every stanza of the file with its
+ * options already converted, in a hash table that is read in place from
+ * the mapped index.  There is one index per ini file and user, in the
+ * state directory, and it is used as long as the ini file has the device,
+ * inode, size, mtime and ctime it had when it was compiled.  Files the
+ * index can not describe exactly, such as lines before the first stanza,
+ * are parsed by read_defaults() every time.
+ */
+
+#define INI_CACHE_MAGIC    "NPINIDX"
+#define INI_CACHE_VERSION  1
+#define INI_CACHE_BROKEN   0xffffffffU  /* options of a stanza with an error */
+/* a file changed twice in one second can keep its size and mtime, so only
+ * files older than this are compiled */
+#define INI_CACHE_SETTLE   2
+
+typedef struct {
+	char     magic[8];
+	uint32_t version;
+	uint32_t buckets;   /* a power of two, each the offset of a stanza or 0 */
+	uint64_t dev;
+	uint64_t ino;
+	uint64_t size;
+	int64_t  mtime;
+	int64_t  ctime;
+	uint64_t length;    /* of the whole index */
+} ini_cache_header;
+/* followed by the buckets, then for each stanza its name length, number
+ * of options (or INI_CACHE_BROKEN), name and options, NUL terminated */
+
+typedef struct {
+	const char *name;
+	size_t namelen;
+	char **args;
+	uint32_t nargs, size;
+	int broken;
+} ini_stanza;
+
+static uint32_t ini_hash(const char *name, size_t len){
+	uint32_t hash=2166136261U;
+
+	while(len--) hash=(hash ^ (unsigned char)*name++) * 16777619U;
+	return hash;
+}
+
+static uint32_t get_u32(const char *p){
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static char *ini_cache_file(const char *file){
+	struct sha1_ctx ctx;
+	unsigned char result[20];
+	char name[41], *real, *cache;
+	int i;
+
+	/* named after the ini file, wherever it is found from */
+	if((real=realpath(file, NULL))==NULL)
+		return NULL;
+	sha1_init_ctx(&ctx);
+	sha1_process_bytes(real, strlen(real), &ctx);
+	sha1_finish_ctx(&ctx, &result);
+	free(real);
+	for(i=0; i<20; i++) sprintf(&name[2*i], "%02x", result[i]);
+	if(asprintf(&cache, "%s/%lu/ini/%s", _np_state_calculate_location_prefix(),
+	            (unsigned long)geteuid(), name)<0)
+		return NULL;
+	return cache;
+}
+
+static int ini_cache_matches(const ini_cache_header *h, const struct stat *st){
+	return !memcmp(h->magic, INI_CACHE_MAGIC, sizeof(h->magic)) &&
+		h->version==INI_CACHE_VERSION &&
+		h->dev==(uint64_t)st->st_dev && h->ino==(uint64_t)st->st_ino &&
+		h->size==(uint64_t)st->st_size &&
+		h->mtime==(int64_t)st->st_mtime && h->ctime==(int64_t)st->st_ctime;
+}
+
+/*
+ * looks stanza up in an index of len bytes: TRUE with its options in opts,
+ * FALSE if it is not there or has no options, INI_CACHE_MISS if the index
+ * is damaged.  dies on a stanza with a syntax error, like read_defaults().
+ */
+static int ini_cache_lookup(const char *index, size_t len, const char *stanza, np_arg_list **opts){
+	const ini_cache_header *h=(const ini_cache_header *)index;
+	size_t stanza_len=strlen(stanza), table=sizeof(ini_cache_header);
+	uint32_t mask, slot, offset, namelen, nargs, n;
+	np_arg_list *tail=NULL, *opt;
+	const char *p;
+
+	if(h->buckets==0 || (h->buckets & (h->buckets-1)) ||
+	   h->buckets>(len-table)/sizeof(uint32_t))
+		return INI_CACHE_MISS;
+	mask=h->buckets-1;
+	for(slot=ini_hash(stanza, stanza_len) & mask, n=0; n<h->buckets; slot=(slot+1) & mask, n++){
+		if((offset=get_u32(index+table+slot*sizeof(uint32_t)))==0)
+			return FALSE;
+		if(offset>len-8)
+			return INI_CACHE_MISS;
+		namelen=get_u32(index+offset);
+		nargs=get_u32(index+offset+4);
+		if(namelen>=len-offset-8)
+			return INI_CACHE_MISS;
+		p=index+offset+8;
+		if(namelen!=stanza_len || memcmp(p, stanza, namelen))
+			continue;
+
+		if(nargs==INI_CACHE_BROKEN)
+			die(STATE_UNKNOWN, "%s\n", _("Config file error"));
+		for(p+=namelen+1; nargs>0; nargs--, p+=strlen(p)+1){
+			if(memchr(p, '\0', index+len-p)==NULL)
+				return INI_CACHE_MISS;
+			if((opt=malloc(sizeof(np_arg_list)))==NULL || (opt->arg=strdup(p))==NULL)
+				die(STATE_UNKNOWN, "%s\n", _("malloc() failed!"));
+			opt->next=NULL;
+			if(tail) tail->next=opt;
+			else *opts=opt;
+			tail=opt;
+		}
+		return tail ? TRUE : FALSE;
+	}
+	return FALSE;
+}
+
+/*
+ * parses the ini file in buf into stanzas, the same way as read_defaults()
+ * does.  NULL if a file needs read_defaults() to report an error or has
+ * stanza names it may match differently.
+ */
+static ini_stanza *ini_cache_parse(const char *buf, size_t len, uint32_t *count, uint32_t *buckets, uint32_t **table){
+	const char *p=buf, *end=buf+len, *eol, *name, *close;
+	ini_stanza *stanzas, *current=NULL;
+	uint32_t max=1, slot, *t;
+	char *arg;
+
+	if(memchr(buf, '\0', len))
+		return NULL;
+	/* every stanza starts with a '[' */
+	for(eol=buf; (eol=memchr(eol, '[', end-eol))!=NULL; eol++) max++;
+	for(*buckets=2; *buckets<2*max; *buckets<<=1);
+	stanzas=calloc(max, sizeof(ini_stanza));
+	t=calloc(*buckets, sizeof(uint32_t));
+	if(stanzas==NULL || t==NULL)
+		die(STATE_UNKNOWN, "%s\n", _("malloc() failed!"));
+	*table=t;
+	*count=0;
+
+	while(p<end){
+		if(isspace((unsigned char)*p)) { p++; continue; }
+		if((eol=memchr(p, '\n', end-p))==NULL) eol=end;
+		switch(*p){
+			case ';':
+			case '#':
+				break;
+			case '[':
+				/* [ name ] and nothing else on the line */
+				if((close=memchr(p, ']', eol-p))==NULL)
+					goto unindexable;
+				for(name=close+1; name<eol && isspace((unsigned char)*name); name++);
+				if(name<eol)
+					goto unindexable;
+				for(name=p+1; name<close && isspace((unsigned char)*name); name++);
+				while(close>name && isspace((unsigned char)close[-1])) close--;
+				for(slot=ini_hash(name, close-name) & (*buckets-1); t[slot]; slot=(slot+1) & (*buckets-1)){
+					current=&stanzas[t[slot]-1];
+					if(current->namelen==(size_t)(close-name) && !memcmp(current->name, name, close-name))
+						break;
+				}
+				if(t[slot]==0){
+					current=&stanzas[*count];
+					current->name=name;
+					current->namelen=close-name;
+					t[slot]=++*count;
+				}
+				break;
+			default:
+				if(current==NULL)
+					goto unindexable;
+				if(current->broken)
+					break;
+				if(line_to_option(p, eol-p, &arg)){
+					current->broken=TRUE;
+					break;
+				}
+				if(current->nargs==current->size){
+					current->size=current->size ? current->size*2 : 8;
+					current->args=realloc(current->args, current->size*sizeof(char *));
+					if(current->args==NULL)
+						die(STATE_UNKNOWN, "%s\n", _("malloc() failed!"));
+				}
+				current->args[current->nargs++]=arg;
+				break;
+		}
+		p=eol;
+	}
+	return stanzas;
+
+unindexable:
+	for(slot=0; slot<*count; slot++){
+		while(stanzas[slot].nargs>0) free(stanzas[slot].args[--stanzas[slot].nargs]);
+		free(stanzas[slot].args);
+	}
+	free(stanzas);
+	free(t);
+	return NULL;
+}
+
+/* lays the stanzas out as an index, and with save writes it to cache */
+static char *ini_cache_write(const char *cache, int save, const struct stat *st, ini_stanza *stanzas,
+                             uint32_t count, uint32_t buckets, const uint32_t *table, size_t *length){
+	ini_cache_header h;
+	ini_stanza *s;
+	size_t len, pos, n;
+	uint32_t i, j, *offsets, v;
+	char *index, *tmp, *p;
+	int fd;
+
+	len=sizeof(h)+buckets*sizeof(uint32_t);
+	for(i=0; i<count; i++){
+		len+=8+stanzas[i].namelen+1;
+		for(j=0; j<stanzas[i].nargs; j++) len+=strlen(stanzas[i].args[j])+1;
+	}
+	if((index=calloc(1, len))==NULL)
+		die(STATE_UNKNOWN, "%s\n", _("malloc() failed!"));
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, INI_CACHE_MAGIC, sizeof(h.magic));
+	h.version=INI_CACHE_VERSION;
+	h.buckets=buckets;
+	h.dev=st->st_dev;
+	h.ino=st->st_ino;
+	h.size=st->st_size;
+	h.mtime=st->st_mtime;
+	h.ctime=st->st_ctime;
+	h.length=len;
+	memcpy(index, &h, sizeof(h));
+
+	/* the records, then the buckets pointing at them */
+	offsets=(uint32_t *)(index+sizeof(h));
+	pos=sizeof(h)+buckets*sizeof(uint32_t);
+	for(i=0; i<buckets; i++){
+		if(table[i]==0) continue;
+		v=pos;
+		memcpy(&offsets[i], &v, sizeof(v));
+		s=&stanzas[table[i]-1];
+		v=s->namelen;
+		memcpy(index+pos, &v, sizeof(v));
+		v=s->broken ? INI_CACHE_BROKEN : s->nargs;
+		memcpy(index+pos+4, &v, sizeof(v));
+		memcpy(index+pos+8, s->name, s->namelen);
+		pos+=8+s->namelen+1;
+		for(j=0; j<s->nargs; j++){
+			n=strlen(s->args[j])+1;
+			memcpy(index+pos, s->args[j], n);
+			pos+=n;
+		}
+	}
+	*length=len;
+	if(!save)
+		return index;
+
+	/* create the directories like np_state_write_string() */
+	if(asprintf(&tmp, "%s.XXXXXX", cache)<0)
+		return index;
+	for(p=tmp+1; *p; p++){
+		if(*p=='/'){
+			*p='\0';
+			if(access(tmp, F_OK)) mkdir(tmp, S_IRWXU);
+			*p='/';
+		}
+	}
+	/* the options can hold passwords, so the index is only for its user */
+	if((fd=mkstemp(tmp))>=0){
+		fchmod(fd, S_IRUSR|S_IWUSR);
+		n=(write(fd, index, len)==(ssize_t)len);
+		if(close(fd)==0 && n)
+			rename(tmp, cache);
+		unlink(tmp);
+	}
+	free(tmp);
+	return index;
+}
+
+/*
+ * read_defaults() from the compiled index of the ini file open as f,
+ * compiling it first if there is none or it is out of date.  Returns
+ * INI_CACHE_MISS if the file has to be parsed by read_defaults().
+ */
+static int cached_defaults(FILE *f, const char *file, const char *stanza, np_arg_list **opts){
+	struct stat st, cst;
+	char *cache, *buf=NULL, *index=NULL, *env;
+	size_t len=0, n, stanza_len=strlen(stanza);
+	ini_stanza *stanzas;
+	uint32_t count, buckets, *table, i;
+	int fd, status=INI_CACHE_MISS;
+
+	env=getenv("NAGIOS_PLUGIN_INI_CACHE");
+	if(env && !strcmp(env, "no"))
+		return INI_CACHE_MISS;
+	/* a name with blanks at either end is matched by read_defaults() */
+	if(stanza_len==0 || isspace((unsigned char)stanza[0]) || isspace((unsigned char)stanza[stanza_len-1]))
+		return INI_CACHE_MISS;
+	if(fstat(fileno(f), &st)<0 || (cache=ini_cache_file(file))==NULL)
+		return INI_CACHE_MISS;
+
+#ifdef HAVE_SYS_MMAN_H
+	/* only our own index, which nobody else could have written */
+	if((fd=open(cache, O_RDONLY))>=0){
+		if(fstat(fd, &cst)==0 && cst.st_uid==geteuid() && !(cst.st_mode & (S_IWGRP|S_IWOTH)) &&
+		   (size_t)cst.st_size>sizeof(ini_cache_header)){
+			index=mmap(NULL, cst.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if(index!=MAP_FAILED){
+				if(ini_cache_matches((ini_cache_header *)index, &st) &&
+				   ((ini_cache_header *)index)->length==(uint64_t)cst.st_size)
+					status=ini_cache_lookup(index, cst.st_size, stanza, opts);
+				munmap(index, cst.st_size);
+			}
+		}
+		close(fd);
+		if(status!=INI_CACHE_MISS){
+			free(cache);
+			return status;
+		}
+	}
+#endif
+
+	/* compile the file, from the same open file read_defaults() gets */
+	do {
+		if((buf=realloc(buf, len+8192))==NULL)
+			die(STATE_UNKNOWN, "%s\n", _("malloc() failed!"));
+		n=fread(buf+len, 1, 8192, f);
+		len+=n;
+	} while(n>0);
+	rewind(f);
+	if(ferror(f) || (off_t)len!=st.st_size ||
+	   (stanzas=ini_cache_parse(buf, len, &count, &buckets, &table))==NULL){
+		free(buf);
+		free(cache);
+		return INI_CACHE_MISS;
+	}
+
+	index=ini_cache_write(cache, time(NULL)-st.st_mtime>=INI_CACHE_SETTLE && time(NULL)-st.st_ctime>=INI_CACHE_SETTLE,
+	                      &st, stanzas, count, buckets, table, &n);
+	status=ini_cache_lookup(index, n, stanza, opts);
+	free(index);
+	for(i=0; i<count; i++){
+		while(stanzas[i].nargs>0) free(stanzas[i].args[--stanzas[i].nargs]);
+		free(stanzas[i].args);
+	}
+	free(stanzas);
+	free(table);
+	free(buf);
+	free(cache);
+	return status;
+}
@@ -0,0 +1,130 @@
+/*****************************************************************************
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*
+*****************************************************************************/
+
+#include "common.h"
+#include "utils_dns.h"
+#include "tap.h"
+
+/* response to "example.com. ANY": header, question, then A, AAAA, MX,
+ * TXT and SOA answers using compression pointers to the question name
+ * at offset 12 */
+static const unsigned char response[] = {
+	0x12, 0x34, 0x85, 0x80, 0x00, 0x01, 0x00, 0x05, 0x00, 0x00, 0x00, 0x00,
+	7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 3, 'c', 'o', 'm', 0,
+	0x00, 0xff, 0x00, 0x01,
+	/* A 192.0.2.1 */
+	0xc0, 0x0c, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x0e, 0x10, 0x00, 0x04,
+	192, 0, 2, 1,
+	/* AAAA 2001:db8::1 */
+	0xc0, 0x0c, 0x00, 0x1c, 0x00, 0x01, 0x00, 0x00, 0x0e, 0x10, 0x00, 0x10,
+	0x20, 0x01, 0x0d, 0xb8, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1,
+	/* MX 10 mail.example.com. */
+	0xc0, 0x0c, 0x00, 0x0f, 0x00, 0x01, 0x00, 0x00, 0x0e, 0x10, 0x00, 0x09,
+	0x00, 0x0a, 4, 'm', 'a', 'i', 'l', 0xc0, 0x0c,
+	/* TXT "v=1" "a\"b" */
+	0xc0, 0x0c, 0x00, 0x10, 0x00, 0x01, 0x00, 0x00, 0x0e, 0x10, 0x00, 0x08,
+	3, 'v', '=', '1', 3, 'a', '"', 'b',
+	/* SOA ns.example.com. admin.example.com. 2018010101 7200 3600 1209600 300 */
+	0xc0, 0x0c, 0x00, 0x06, 0x00, 0x01, 0x00, 0x00, 0x0e, 0x10, 0x00, 0x21,
+	2, 'n', 's', 0xc0, 0x0c, 5, 'a', 'd', 'm', 'i', 'n', 0xc0, 0x0c,
+	0x78, 0x48, 0x63, 0xf5, 0x00, 0x00, 0x1c, 0x20, 0x00, 0x00, 0x0e, 0x10,
+	0x00, 0x12, 0x75, 0x00, 0x00, 0x00, 0x01, 0x2c
+};
+
+/* a WKS answer for TCP ports 25 and 80 on 192.0.2.1 */
+static const unsigned char wks_response[] = {
+	0x00, 0x01, 0x85, 0x80, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00,
+	7, 'e', 'x', 'a', 'm', 'p', 'l', 'e', 3, 'c', 'o', 'm', 0,
+	0x00, 0x0b, 0x00, 0x01,
+	0xc0, 0x0c, 0x00, 0x0b, 0x00, 0x01, 0x00, 0x00, 0x0e, 0x10, 0x00, 0x10,
+	192, 0, 2, 1, 6,
+	0, 0, 0, 0x40, 0, 0, 0, 0, 0, 0, 0x80
+};
+
+int
+main(void)
+{
+	unsigned char buf[512], bad[sizeof(response)];
+	np_dns_response r;
+	char *name;
+	int len;
+
+	plan_tests(25);
+
+	len = np_dns_build_query(buf, sizeof(buf), 0xbeef, "www.example.com", NP_DNS_AAAA);
+	ok(len == 12 + 17 + 4, "query has header, name and type/class");
+	ok(buf[0] == 0xbe && buf[1] == 0xef && buf[2] == 0x01 && buf[5] == 1,
+	   "query id, RD flag and QDCOUNT set");
+	ok(memcmp(buf + 12, "\3www\7example\3com\0\0\34\0\1", 21) == 0,
+	   "query name encoded as labels, type AAAA class IN");
+	ok(np_dns_build_query(buf, sizeof(buf), 1, "www.example.com.", NP_DNS_A) == len,
+	   "trailing dot makes no difference");
+	ok(np_dns_build_query(buf, sizeof(buf), 1, "a..b", NP_DNS_A) == -1,
+	   "empty label rejected");
+	ok(np_dns_build_query(buf, sizeof(buf), 1,
+	   "0123456789012345678901234567890123456789012345678901234567890123.com", NP_DNS_A) == -1,
+	   "label longer than 63 rejected");
+
+	ok(np_dns_parse_response(response, sizeof(response), &r) == 0, "response parsed");
+	ok(r.id == 0x1234 && r.rcode == NP_DNS_NOERROR && r.aa && r.ra && !r.tc,
+	   "header flags");
+	ok(r.nanswer == 5, "five answers");
+	ok(strcmp(r.answer[0].name, "example.com.") == 0 && r.answer[0].ttl == 3600,
+	   "compressed owner name and ttl");
+	ok(r.answer[0].type == NP_DNS_A && strcmp(r.answer[0].data, "192.0.2.1") == 0,
+	   "A record");
+	ok(r.answer[1].type == NP_DNS_AAAA && strcmp(r.answer[1].data, "2001:db8::1") == 0,
+	   "AAAA record");
+	ok(strcmp(r.answer[2].data, "10 mail.example.com.") == 0, "MX record");
+	ok(strcmp(r.answer[3].data, "\"v=1\" \"a\\\"b\"") == 0, "TXT record");
+	ok(strcmp(r.answer[4].data,
+	   "ns.example.com. admin.example.com. 2018010101 7200 3600 1209600 300") == 0,
+	   "SOA record");
+	np_dns_response_free(&r);
+
+	ok(np_dns_parse_response(wks_response, sizeof(wks_response), &r) == 0 &&
+	   r.nanswer == 1 && strcmp(r.answer[0].data, "192.0.2.1 6 25 80") == 0,
+	   "WKS record");
+	np_dns_response_free(&r);
+
+	memcpy(bad, response, sizeof(response));
+	bad[30] = 29;     /* point the first answer's name at itself */
+	ok(np_dns_parse_response(bad, sizeof(bad), &r) == -1, "pointer loop rejected");
+	ok(np_dns_parse_response(response, sizeof(response) - 3, &r) == -1,
+	   "truncated packet rejected");
+	bad[2] &= ~0x80;
+	ok(np_dns_parse_response(bad, sizeof(bad), &r) == -1, "query rejected as response");
+
+	name = np_dns_reverse_name("192.0.2.1");
+	ok(name && strcmp(name, "1.2.0.192.in-addr.arpa.") == 0, "IPv4 reverse name");
+	free(name);
+	name = np_dns_reverse_name("2001:db8::1");
+	ok(name && strcmp(name, "1.0.0.0.0.0.0.0.0.0.0.0.0.0.0.0."
+	   "0.0.0.0.0.0.0.0.8.b.d.0.1.0.0.2.ip6.arpa.") == 0, "IPv6 reverse name");
+	free(name);
+	ok(np_dns_reverse_name("www.example.com") == NULL, "no reverse name for host names");
+
+	ok(np_dns_type("aaaa") == NP_DNS_AAAA && np_dns_type("MX") == NP_DNS_MX,
+	   "type names are case insensitive");
+	ok(np_dns_type("BOGUS") == -1, "unknown type name");
+	ok(strcmp(np_dns_type_name(NP_DNS_SRV), "SRV") == 0 &&
+	   strcmp(np_dns_rcode_name(NP_DNS_NXDOMAIN), "NXDOMAIN") == 0,
+	   "type and rcode names");
+
+	return exit_status();
+}
@@ -22,6 +22,9 @@
 
 #include "tap.h"
 
+#include <dirent.h>
+#include <sys/wait.h>
+
 void my_free(char *string) {
 	if (string != NULL) {
 		printf("string:\n\t|%s|\n", string);
@@ -49,12 +52,78 @@ list2str(np_arg_list *optlst)
 	return optstr;
 }
 
+/* the same sections through the compiled index */
+struct {
+	char *locator, *section, *expected;
+} cached[] = {
+	{ "section@./config-tiny.ini", "check_disk", "--one=two --Foo=Bar --this=Your Mother! --blank" },
+	{ "@./config-tiny.ini", "section", "--one=two --Foo=Bar --this=Your Mother! --blank" },
+	{ "Section Two@./config-tiny.ini", "check_disk", "--something else=blah --remove=whitespace" },
+	{ "/path/to/file.txt@./config-tiny.ini", "check_disk", "--this=that" },
+	{ "section2@./config-tiny.ini", "check_disk", "--this=that" },
+	{ "section3@./config-tiny.ini", "check_disk", "--this=that" },
+	{ "check_mysql@./plugin.ini", "check_disk", "--username=operator --password=secret" },
+	{ "check_mysql2@./plugin.ini", "check_disk", "-u=admin -p=secret" },
+	{ "check space_and_flags@./plugin.ini", "check_disk", "--foo=bar -a -b --bar" },
+	{ "Section Two@./config-dos.ini", "check_disk", "--something else=blah --remove=whitespace" },
+	{ "section_twice@./plugin.ini", "check_disk", "--foo=bar --bar=foo" },
+};
+
+void
+write_ini(const char *file, const char *content)
+{
+	FILE *fp = fopen(file, "w");
+
+	fputs(content, fp);
+	fclose(fp);
+}
+
+int
+count_files(const char *dir)
+{
+	struct dirent *de;
+	DIR *d;
+	int n = 0;
+
+	if ((d = opendir(dir)) == NULL)
+		return 0;
+	while ((de = readdir(d)) != NULL)
+		if (de->d_name[0] != '.')
+			n++;
+	closedir(d);
+	return n;
+}
+
+/* the exit status of np_get_defaults() in a child */
+int
+get_defaults_status(char *locator)
+{
+	int status;
+	pid_t pid;
+
+	if ((pid = fork()) == 0) {
+		freopen("/dev/null", "w", stdout);
+		freopen("/dev/null", "w", stderr);
+		np_get_defaults(locator, "check_disk");
+		_exit(0);
+	}
+	waitpid(pid, &status, 0);
+	return WEXITSTATUS(status);
+}
+
 int
 main (int argc, char **argv)
 {
 	char *optstr=NULL;
+	char dir[] = "/tmp/test_ini1.XXXXXX", path[256], inidir[256], locator[300];
+	int i, pass, bad;
+
+	plan_tests(19);
 
-	plan_tests(12);
+	if (mkdtemp(dir) == NULL)
+		return exit_status();
+	setenv("NAGIOS_PLUGIN_STATE_DIRECTORY", dir, 1);
+	setenv("NAGIOS_PLUGIN_INI_CACHE", "no", 1);
 
 	optstr=list2str(np_get_defaults("section@./config-tiny.ini", "check_disk"));
 	ok( !strcmp(optstr, "--one=two --Foo=Bar --this=Your Mother! --blank"), "config-tiny.ini's section as expected");
@@ -104,6 +173,48 @@ main (int argc, char **argv)
 	ok( !strcmp(optstr, "--escape --send=Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda --expect=Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda Foo bar BAZ yadda yadda yadda --jail"), "Long options");
 	my_free(optstr);
 
+	/* the first pass compiles the files, the second reads the index */
+	unsetenv("NAGIOS_PLUGIN_INI_CACHE");
+	for (pass = 0; pass < 2; pass++) {
+		for (i = 0, bad = 0; i < sizeof(cached) / sizeof(cached[0]); i++) {
+			optstr = list2str(np_get_defaults(cached[i].locator, cached[i].section));
+			bad += strcmp(optstr, cached[i].expected) != 0;
+			free(optstr);
+		}
+		ok( bad == 0, pass ? "sections read from the index" : "sections read while compiling the index");
+	}
+
+	snprintf(inidir, sizeof(inidir), "%s/%lu/ini", dir, (unsigned long)geteuid());
+	snprintf(path, sizeof(path), "%s/copy.ini", dir);
+	snprintf(locator, sizeof(locator), "section@%s", path);
+	write_ini(path, "[section]\nfoo=bar\n");
+	/* only files that have not changed for a while are compiled */
+	sleep(2);
+	i = count_files(inidir);
+	optstr = list2str(np_get_defaults(locator, "check_disk"));
+	ok( !strcmp(optstr, "--foo=bar") && count_files(inidir) == i + 1, "index written for a new file");
+	free(optstr);
+
+	write_ini(path, "[section]\nfoo=bar\n[new]\nx=y\n");
+	snprintf(locator, sizeof(locator), "new@%s", path);
+	optstr = list2str(np_get_defaults(locator, "check_disk"));
+	ok( !strcmp(optstr, "-x=y") && count_files(inidir) == i + 1, "index replaced when the file changes");
+	free(optstr);
+
+	write_ini(path, "[good]\nfoo=bar\n[bad]\nbroken\n");
+	snprintf(locator, sizeof(locator), "good@%s", path);
+	optstr = list2str(np_get_defaults(locator, "check_disk"));
+	ok( !strcmp(optstr, "--foo=bar"), "an error in another section is ignored");
+	free(optstr);
+	snprintf(locator, sizeof(locator), "bad@%s", path);
+	ok( get_defaults_status(locator) == STATE_UNKNOWN, "an error in the section still dies");
+
+	write_ini(path, "foo=bar\n[good]\nfoo=bar\n");
+	snprintf(locator, sizeof(locator), "good@%s", path);
+	ok( get_defaults_status(locator) == STATE_UNKNOWN, "options before the first section still die");
+
+	snprintf(path, sizeof(path), "rm -rf %s", dir);
+	system(path);
 	return exit_status();
 }
 
@@ -0,0 +1,130 @@
+/*****************************************************************************
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+* 
+* 
+*****************************************************************************/
+
+#include "common.h"
+#include "utils_mrtg.h"
+#include "tap.h"
+
+#define NEWEST 1700000000L
+#define SAMPLES 5000
+
+/* A log of text, open on a file descriptor */
+static int
+log_of(const char *text)
+{
+	FILE *fp = tmpfile();
+
+	fputs(text, fp);
+	fflush(fp);
+	return dup(fileno(fp));
+}
+
+int
+main(void)
+{
+	np_mrtg_sample *s;
+	long windows[] = { 1, 299, 300, 301, 900, 3599, 86400, 86401, 1000000, 1499700, 10000000 };
+	double pct;
+	FILE *fp;
+	int fd, i, n, expect, bad;
+
+	plan_tests(23);
+
+	/* a sample every five minutes, the average of variable 1 counting down */
+	fp = tmpfile();
+	fprintf(fp, "%ld 123456 654321\n", NEWEST + 10);
+	for (i = 0; i < SAMPLES; i++)
+		fprintf(fp, "%ld %d 100 %d 200\n", NEWEST - 300L * i, i, 2 * i);
+	fflush(fp);
+	fd = fileno(fp);
+
+	n = np_mrtg_window(fd, 0, &s);
+	ok(n == 1 && s[0].time == NEWEST && s[0].avg[0] == 0 && s[0].max[1] == 200,
+	   "newest sample without a window");
+	free(s);
+
+	n = np_mrtg_window(fd, 900, &s);
+	ok(n == 3 && s[2].time == NEWEST - 600, "15 minutes hold three samples");
+	ok(s[0].span == 300 && s[1].span == 300 && s[2].span == 300, "five minutes each");
+	ok(np_mrtg_aggregate(s, n, 0, NP_MRTG_AVG, 0) == 1, "average");
+	ok(np_mrtg_aggregate(s, n, 0, NP_MRTG_MAX, 0) == 4, "maximum");
+	ok(np_mrtg_aggregate(s, n, 1, NP_MRTG_AVG, 0) == 100, "average of variable 2");
+	ok(np_mrtg_aggregate(s, n, 0, NP_MRTG_PCT, 0) == 0, "0th percentile");
+	ok(np_mrtg_aggregate(s, n, 0, NP_MRTG_PCT, 50) == 1, "median");
+	ok(np_mrtg_aggregate(s, n, 0, NP_MRTG_PCT, 100) == 2, "100th percentile");
+	free(s);
+
+	/* the window ends where a line by line read would stop */
+	for (i = 0, bad = 0; i < (int)(sizeof(windows) / sizeof(windows[0])); i++) {
+		expect = (windows[i] + 299) / 300;
+		if (expect > SAMPLES)
+			expect = SAMPLES;
+		n = np_mrtg_window(fd, windows[i], &s);
+		if (n != expect || s[n - 1].time != NEWEST - 300L * (n - 1)) {
+			diag("window %ld: %d samples, not %d", windows[i], n, expect);
+			bad++;
+		}
+		free(s);
+	}
+	ok(bad == 0, "windows across the whole log");
+
+	n = np_mrtg_window(fd, 10000000, &s);
+	ok(n == SAMPLES && s[n - 1].span == 300, "oldest sample as long as the one after it");
+	free(s);
+	fclose(fp);
+
+	/* samples consolidated to half hours weigh six times as much */
+	fd = log_of("1700000000 1 2\n"
+	            "1700000000 10 0 10 0\n"
+	            "1699999700 10 0 10 0\n"
+	            "1699998200 40 0 90 0\n"
+	            "1699996400 40 0 90 0\n");
+	n = np_mrtg_window(fd, 3000, &s);
+	ok(n == 3 && s[1].span == 1500 && s[2].span == 1200, "spans of mixed samples");
+	ok(np_mrtg_aggregate(s, n, 0, NP_MRTG_AVG, 0) == 22, "average weighted by time");
+	ok(np_mrtg_aggregate(s, n, 0, NP_MRTG_PCT, 50) == 10, "median weighted by time");
+	ok(np_mrtg_aggregate(s, n, 0, NP_MRTG_MAX, 0) == 90, "maximum of consolidated samples");
+	free(s);
+	close(fd);
+
+	fd = log_of("1700000000 1 2\n1700000000 7 8 9 10");
+	n = np_mrtg_window(fd, 600, &s);
+	ok(n == 1 && s[0].avg[1] == 8 && s[0].max[1] == 10, "last line without a newline");
+	free(s);
+	close(fd);
+
+	fd = log_of("1700000000 1 2\n");
+	ok(np_mrtg_window(fd, 0, &s) == -1 && s == NULL, "no samples");
+	close(fd);
+
+	fd = log_of("");
+	ok(np_mrtg_window(fd, 600, &s) == -1, "empty log");
+	close(fd);
+
+	fd = log_of("not an MRTG log\nat all\n");
+	ok(np_mrtg_window(fd, 600, &s) == -1, "not a log");
+	close(fd);
+
+	ok(np_mrtg_aggregation("MAX", &pct) == NP_MRTG_MAX, "MAX");
+	ok(np_mrtg_aggregation("AVG", &pct) == NP_MRTG_AVG, "AVG");
+	ok(np_mrtg_aggregation("P95", &pct) == NP_MRTG_PCT && pct == 95, "P95");
+	ok(np_mrtg_aggregation("P101", &pct) == NP_MRTG_AVG &&
+	   np_mrtg_aggregation("P", &pct) == NP_MRTG_AVG, "no percentile outside 0 to 100");
+
+	return exit_status();
+}
@@ -63,14 +63,12 @@ int array_diff(int i1, char **a1, int i2, char **a2) {
 	return 1;
 }
 
-int
-main (int argc, char **argv)
+static void
+test_extra_opts (void)
 {
 	char **argv_new=NULL;
 	int i, argc_test;
 
-	plan_tests(5);
-
 	{
 		char *argv_test[] = {"prog_name", "arg1", "--extra-opts", "--arg3", "val2", (char *) NULL};
 		argc_test=5;
@@ -115,7 +113,28 @@ main (int argc, char **argv)
 		ok(array_diff(argc_test, argv_new, 6, argv_known), "Long lines test");
 		my_free(&argc_test, argv_new, argv_test);
 	}
+}
+
+int
+main (int argc, char **argv)
+{
+	char dir[] = "/tmp/test_opts2.XXXXXX", cmd[64];
+
+	plan_tests(10);
+
+	if (mkdtemp(dir) == NULL)
+		return exit_status();
+	setenv("NAGIOS_PLUGIN_STATE_DIRECTORY", dir, 1);
+
+	/* through the compiled ini index, which the first lookups compile */
+	unsetenv("NAGIOS_PLUGIN_INI_CACHE");
+	test_extra_opts();
+	/* and parsing the ini files */
+	setenv("NAGIOS_PLUGIN_INI_CACHE", "no", 1);
+	test_extra_opts();
 
+	snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+	system(cmd);
 	return exit_status();
 }
 
@@ -2,6 +2,7 @@
 use Test::More;
 use strict;
 use warnings;
+use File::Temp qw(tempdir);
 
 if (! -e "./test_opts3") {
 	plan skip_all => "./test_opts3 not compiled - please enable libtap library and/or extra-opts to test";
@@ -23,18 +24,27 @@ my @TESTS = (
 	[0, '/usr/local/nagios/etc:.:/etc', 'check_missing', 'arg1', '--extra-opts=check_tcp', '--arg3', 'val2'],
 );
 
-plan tests => scalar(@TESTS);
+plan tests => 2 * scalar(@TESTS);
 
-my $count=1;
-
-foreach my $args (@TESTS) {
-	my $rc = shift(@$args);
-	if (my $env = shift(@$args)) {
-		$ENV{"NAGIOS_CONFIG_PATH"} = $env;
+# through the compiled ini index, then parsing the ini files
+$ENV{"NAGIOS_PLUGIN_STATE_DIRECTORY"} = tempdir(CLEANUP => 1);
+foreach my $cache (undef, "no") {
+	if (defined $cache) {
+		$ENV{"NAGIOS_PLUGIN_INI_CACHE"} = $cache;
 	} else {
-		delete($ENV{"NAGIOS_CONFIG_PATH"});
+		delete($ENV{"NAGIOS_PLUGIN_INI_CACHE"});
+	}
+	my $count=1;
+	foreach my $test (@TESTS) {
+		my @args = @$test;
+		my $rc = shift(@args);
+		if (my $env = shift(@args)) {
+			$ENV{"NAGIOS_CONFIG_PATH"} = $env;
+		} else {
+			delete($ENV{"NAGIOS_CONFIG_PATH"});
+		}
+		system {'./test_opts3'} @args;
+		cmp_ok($?>>8, '==', $rc, "Extra-opts die " . $count++ . (defined $cache ? " without the index" : ""));
 	}
-	system {'./test_opts3'} @$args;
-	cmp_ok($?>>8, '==', $rc, "Extra-opts die " . $count++);
 }
 
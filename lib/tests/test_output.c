@@ -0,0 +1,132 @@
+/*****************************************************************************
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*
+*****************************************************************************/
+
+#include "common.h"
+#include "utils_base.h"
+#include "utils_output.h"
+#include "tap.h"
+
+/* np_output_render() into a string */
+static char *
+render(int format, int result, const char *text)
+{
+	static char buf[4096];
+	FILE *fp = tmpfile();
+	size_t n;
+
+	np_output_render(fp, format, "check_test", result, text);
+	rewind(fp);
+	n = fread(buf, 1, sizeof(buf) - 1, fp);
+	buf[n] = '\0';
+	fclose(fp);
+	return buf;
+}
+
+int
+main(void)
+{
+	char *argv[] = { "check_test", "-w", "5", "--output-format=classic", "-c", "--output-format", "classic", "10", NULL };
+	int argc = 8;
+	char **av;
+
+	plan_tests(15);
+
+	ok(np_output_format_value("json") == NP_OUTPUT_JSON, "json");
+	ok(np_output_format_value("openmetrics") == NP_OUTPUT_OPENMETRICS, "openmetrics");
+	ok(np_output_format_value("xml") == -1, "unknown format");
+
+	av = np_output_opts(&argc, argv, "check_test");
+	ok(argc == 5 && !strcmp(av[3], "-c") && !strcmp(av[4], "10") && av[5] == NULL, "--output-format removed from argv");
+
+	ok(!strcmp(render(NP_OUTPUT_CLASSIC, 0, "OK - fine | a=1\n"), "OK - fine | a=1\n"), "classic unchanged");
+
+	ok(!strcmp(render(NP_OUTPUT_JSON, 0, "LOAD OK - load average: 0.10\n"),
+	   "{\"plugin\":\"check_test\",\"state\":0,\"status\":\"OK\",\"output\":\"LOAD OK - load average: 0.10\",\"long_output\":null,\"perfdata\":[]}\n"),
+	   "json without perfdata");
+
+	ok(!strcmp(render(NP_OUTPUT_JSON, 1, "DISK WARNING - free space: / 10 MB | /=90MB;80;95;0;100\n"),
+	   "{\"plugin\":\"check_test\",\"state\":1,\"status\":\"WARNING\",\"output\":\"DISK WARNING - free space: / 10 MB\",\"long_output\":null,"
+	   "\"perfdata\":[{\"label\":\"/\",\"value\":90,\"uom\":\"MB\",\"warn\":{\"range\":\"80\",\"start\":0,\"end\":80,\"inside\":false},"
+	   "\"crit\":{\"range\":\"95\",\"start\":0,\"end\":95,\"inside\":false},\"min\":0,\"max\":100}]}\n"),
+	   "json with perfdata");
+
+	ok(!strcmp(render(NP_OUTPUT_JSON, 2, "CRIT \"quoted | bar\"|'a b'=1s;;@5:10 'it''s'=U\nline 2\\\nline 3|c=2%\nd=3\n"),
+	   "{\"plugin\":\"check_test\",\"state\":2,\"status\":\"CRITICAL\",\"output\":\"CRIT \\\"quoted | bar\\\"\",\"long_output\":\"line 2\\\\\\nline 3\","
+	   "\"perfdata\":[{\"label\":\"a b\",\"value\":1,\"uom\":\"s\",\"warn\":null,"
+	   "\"crit\":{\"range\":\"@5:10\",\"start\":5,\"end\":10,\"inside\":true},\"min\":null,\"max\":null},"
+	   "{\"label\":\"it's\",\"value\":null,\"uom\":\"\",\"warn\":null,\"crit\":null,\"min\":null,\"max\":null},"
+	   "{\"label\":\"c\",\"value\":2,\"uom\":\"%\",\"warn\":null,\"crit\":null,\"min\":null,\"max\":null},"
+	   "{\"label\":\"d\",\"value\":3,\"uom\":\"\",\"warn\":null,\"crit\":null,\"min\":null,\"max\":null}]}\n"),
+	   "json with long output, quoted labels and multi-line perfdata");
+
+	ok(!strcmp(render(NP_OUTPUT_JSON, 7, "strange\n"),
+	   "{\"plugin\":\"check_test\",\"state\":3,\"status\":\"UNKNOWN\",\"output\":\"strange\",\"long_output\":null,\"perfdata\":[]}\n"),
+	   "out of range result is UNKNOWN");
+
+	ok(!strcmp(render(NP_OUTPUT_JSON, 0, ""),
+	   "{\"plugin\":\"check_test\",\"state\":0,\"status\":\"OK\",\"output\":\"\",\"long_output\":null,\"perfdata\":[]}\n"),
+	   "json of no output");
+
+	ok(!strcmp(render(NP_OUTPUT_OPENMETRICS, 0, "OK\n"),
+	   "# TYPE nagios_plugin_state gauge\n"
+	   "# HELP nagios_plugin_state 0 OK, 1 WARNING, 2 CRITICAL, 3 UNKNOWN\n"
+	   "nagios_plugin_state{plugin=\"check_test\"} 0\n"
+	   "# TYPE nagios_plugin_output info\n"
+	   "nagios_plugin_output_info{plugin=\"check_test\",output=\"OK\"} 1\n"
+	   "# EOF\n"),
+	   "openmetrics without perfdata");
+
+	ok(!strcmp(render(NP_OUTPUT_OPENMETRICS, 1, "WARN \"x\" | time=0.5s;0.3;1:2;0 size=U\n"),
+	   "# TYPE nagios_plugin_state gauge\n"
+	   "# HELP nagios_plugin_state 0 OK, 1 WARNING, 2 CRITICAL, 3 UNKNOWN\n"
+	   "nagios_plugin_state{plugin=\"check_test\"} 1\n"
+	   "# TYPE nagios_plugin_output info\n"
+	   "nagios_plugin_output_info{plugin=\"check_test\",output=\"WARN \\\"x\\\"\"} 1\n"
+	   "# TYPE nagios_perfdata gauge\n"
+	   "# HELP nagios_perfdata Performance data value\n"
+	   "nagios_perfdata{plugin=\"check_test\",label=\"time\",uom=\"s\"} 0.5\n"
+	   "# TYPE nagios_perfdata_warning gauge\n"
+	   "# HELP nagios_perfdata_warning Warning threshold\n"
+	   "nagios_perfdata_warning{plugin=\"check_test\",label=\"time\",uom=\"s\"} 0.3\n"
+	   "# TYPE nagios_perfdata_min gauge\n"
+	   "# HELP nagios_perfdata_min Minimum value\n"
+	   "nagios_perfdata_min{plugin=\"check_test\",label=\"time\",uom=\"s\"} 0\n"
+	   "# EOF\n"),
+	   "openmetrics with perfdata, ranges and U left out");
+
+	ok(!strcmp(render(NP_OUTPUT_JSON, 0, "OK | noequals a=1\n"),
+	   "{\"plugin\":\"check_test\",\"state\":0,\"status\":\"OK\",\"output\":\"OK\",\"long_output\":null,"
+	   "\"perfdata\":[{\"label\":\"a\",\"value\":1,\"uom\":\"\",\"warn\":null,\"crit\":null,\"min\":null,\"max\":null}]}\n"),
+	   "words that are not perfdata are skipped");
+
+	ok(!strcmp(render(NP_OUTPUT_JSON, 0, "OK | a=1;~:5;10:;; b=2;x;;;\n"),
+	   "{\"plugin\":\"check_test\",\"state\":0,\"status\":\"OK\",\"output\":\"OK\",\"long_output\":null,\"perfdata\":["
+	   "{\"label\":\"a\",\"value\":1,\"uom\":\"\",\"warn\":{\"range\":\"~:5\",\"start\":null,\"end\":5,\"inside\":false},"
+	   "\"crit\":{\"range\":\"10:\",\"start\":10,\"end\":null,\"inside\":false},\"min\":null,\"max\":null},"
+	   "{\"label\":\"b\",\"value\":2,\"uom\":\"\",\"warn\":{\"range\":\"x\",\"start\":null,\"end\":null,\"inside\":false},"
+	   "\"crit\":null,\"min\":null,\"max\":null}]}\n"),
+	   "json thresholds with infinite ends and unparsable ranges");
+
+	ok(!strcmp(render(NP_OUTPUT_JSON, 0, "OK caf\xc3\xa9 \xe9t\xe9 \xc0\xaf \xed\xa0\x80 \xf0\x9f\x98\x80 \x01\n"),
+	   "{\"plugin\":\"check_test\",\"state\":0,\"status\":\"OK\",\"output\":"
+	   "\"OK caf\xc3\xa9 \\ufffdt\\ufffd \\ufffd\\ufffd \\ufffd\\ufffd\\ufffd \xf0\x9f\x98\x80 \\u0001\","
+	   "\"long_output\":null,\"perfdata\":[]}\n"),
+	   "json keeps UTF-8 and replaces other bytes");
+
+	return exit_status();
+}
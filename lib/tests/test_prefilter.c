@@ -0,0 +1,167 @@
+/*****************************************************************************
+* 
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+* 
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+* 
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+* 
+* 
+*****************************************************************************/
+
+#include "common.h"
+#include "utils_prefilter.h"
+#include "regex.h"
+#include "tap.h"
+
+#include <ctype.h>
+
+/* the ids of the literals in text, and the first position of one */
+static uint64_t
+naive(char **literals, int count, const char *text, size_t len, const char **first)
+{
+	uint64_t ids = 0;
+	const char *p;
+	int i;
+
+	*first = NULL;
+	for (i = 0; i < count; i++) {
+		if ((p = memmem(text, len, literals[i], strlen(literals[i]))) == NULL)
+			continue;
+		ids |= (uint64_t)1 << i;
+		if (*first == NULL || p < *first)
+			*first = p;
+	}
+	return ids;
+}
+
+int
+main(void)
+{
+	np_prefilter *pf;
+	char *literals[12], text[400];
+	char *needs_none[] = { ".*", "a|b*", "(foo)", "[abc]+", "x?y*", "\\w+", "ab|" };
+	char *regexes[] = { "ab+c", "a(b|c)d", "x[yz]*y", "ab*c", "(ab)?cd", "a.c|b{2}",
+	                    "a{0,2}bc", "ab{1,3}c{0}d", "^ab$", "a\\.b", "[[:alpha:]]ab", "c|ab",
+	                    "ab+?c", "ab{1}?c", "ab{,3}" };
+	char *stacked[] = { "ab+?c", "ac", "ab{1}?c", "ac", "ab{,3}", "a" };
+	const char *first, *found;
+	uint64_t ids;
+	regex_t re;
+	size_t len;
+	int i, j, n, bad, missed;
+
+	plan_tests(20);
+
+	pf = np_prefilter_new(FALSE);
+	ok(pf != NULL, "prefilter created");
+	ok(np_prefilter_scan(pf, "anything", 8) == 0, "nothing found without literals");
+	ok(np_prefilter_add(pf, 0, "ERROR", 5) && np_prefilter_add(pf, 1, "Timeout", 7) &&
+	   np_prefilter_add(pf, 2, "#", 1), "literals added");
+	ok(!np_prefilter_add(pf, 3, "", 0), "empty literal refused");
+	ok(np_prefilter_scan(pf, "all is fine here, nothing to see at all", 39) == 0, "no literal");
+	ok(np_prefilter_scan(pf, "a long line with an ERROR and a # in it", 39) == 5, "two literals");
+	ok(np_prefilter_scan(pf, "an error, not an ERRO", 21) == 0, "partial literals");
+	found = np_prefilter_find(pf, "connect: Timeout after 10s, ERROR", 33, &ids);
+	ok(found && !strncmp(found, "Timeout", 7) && ids == 2, "first literal found");
+	np_prefilter_free(pf);
+
+	pf = np_prefilter_new(TRUE);
+	np_prefilter_add(pf, 0, "error", 5);
+	ok(np_prefilter_scan(pf, "an ERROR and an Error", 21) == 1, "case ignored");
+	ok(!np_prefilter_add(pf, 1, "\xc3\xa9t\xc3\xa9", 6), "no case folding outside ASCII");
+	np_prefilter_free(pf);
+
+	/* the same as a search for each literal, across blocks and buckets */
+	srand(1);
+	for (n = 0, bad = 0; n < 2000; n++) {
+		pf = np_prefilter_new(n % 2);
+		for (i = 0; i < 12; i++) {
+			len = 1 + rand() % 5;
+			literals[i] = malloc(len + 1);
+			for (j = 0; j < (int)len; j++)
+				literals[i][j] = "abcd"[rand() % 4];
+			literals[i][len] = '\0';
+			np_prefilter_add(pf, i, literals[i], len);
+		}
+		len = rand() % sizeof(text);
+		for (j = 0; j < (int)len; j++)
+			text[j] = "abcdefghijklmnopqrstuvwxyz\n"[rand() % (n % 3 ? 27 : 5)];
+		if (n % 2) {
+			for (j = 0; j < (int)len; j++)
+				text[j] = (rand() % 2) ? toupper(text[j]) : text[j];
+			for (j = 0; j < (int)len; j++)
+				text[j] = tolower(text[j]);
+		}
+		ids = naive(literals, 12, text, len, &first);
+		if (np_prefilter_scan(pf, text, len) != ids)
+			bad++;
+		found = np_prefilter_find(pf, text, len, &ids);
+		if (found != first)
+			bad++;
+		for (i = 0; i < 12; i++)
+			free(literals[i]);
+		np_prefilter_free(pf);
+	}
+	ok(bad == 0, "random literals found as by memmem");
+
+	/* regular expressions */
+	pf = np_prefilter_new(FALSE);
+	ok(np_prefilter_add_regex(pf, 0, "ERROR [0-9]+ in (foo|bar)"), "literal of a regex");
+	ok(np_prefilter_add_regex(pf, 1, "time ?out|refused"), "literals of alternatives");
+	ok(np_prefilter_scan(pf, "ERROR 12 in foo", 15) == 1, "regex literal found");
+	ok(np_prefilter_scan(pf, "connection refused", 18) == 2 &&
+	   np_prefilter_scan(pf, "timed out: timeout", 18) == 2, "alternative literals found");
+	ok(np_prefilter_scan(pf, "connection reset by peer", 24) == 0, "regex literals not found");
+	np_prefilter_free(pf);
+
+	for (i = 0, bad = 0; i < (int)(sizeof(needs_none) / sizeof(*needs_none)); i++) {
+		pf = np_prefilter_new(FALSE);
+		if (np_prefilter_add_regex(pf, 0, needs_none[i]) || np_prefilter_scan(pf, "abcxyz", 6) != 0)
+			bad++;
+		np_prefilter_free(pf);
+	}
+	ok(bad == 0, "regexes without a literal they need");
+
+	/* quantifiers that let the byte before them be left out, stacked or not */
+	for (i = 0, bad = 0; i < (int)(sizeof(stacked) / sizeof(*stacked)); i += 2) {
+		pf = np_prefilter_new(FALSE);
+		np_prefilter_add_regex(pf, 0, stacked[i]);
+		if (np_prefilter_scan(pf, stacked[i + 1], strlen(stacked[i + 1])) != 1)
+			bad++;
+		np_prefilter_free(pf);
+	}
+	ok(bad == 0, "stacked and open-ended quantifiers");
+
+	/* every line a regex matches has its literal */
+	for (i = 0, bad = 0, missed = 0; i < (int)(sizeof(regexes) / sizeof(*regexes)); i++) {
+		pf = np_prefilter_new(FALSE);
+		if (!np_prefilter_add_regex(pf, 0, regexes[i]) ||
+		    regcomp(&re, regexes[i], REG_EXTENDED | REG_NOSUB) != 0) {
+			bad++;
+			np_prefilter_free(pf);
+			continue;
+		}
+		for (n = 0; n < 3000; n++) {
+			len = rand() % 8;
+			for (j = 0; j < (int)len; j++)
+				text[j] = "abcdxyz."[rand() % 8];
+			text[len] = '\0';
+			if (regexec(&re, text, 0, NULL, 0) == 0 && np_prefilter_scan(pf, text, len) != 1)
+				missed++;
+		}
+		regfree(&re);
+		np_prefilter_free(pf);
+	}
+	ok(bad == 0, "literals of all regexes");
+	ok(missed == 0, "no line a regex matches skipped");
+
+	return exit_status();
+}
@@ -0,0 +1,274 @@
+/*****************************************************************************
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*
+*****************************************************************************/
+
+#include "common.h"
+#include "utils_base.h"
+#include "utils_state.h"
+#include "tap.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+extern nagios_plugin *this_nagios_plugin;
+
+#define WRITERS 4
+#define WRITES  500
+#define SLOTS   8192
+
+/* flips a byte of the data of the record holding marker */
+static int
+damage(const char *path, const char *marker)
+{
+	static char buf[1 << 20];
+	size_t len = strlen(marker);
+	ssize_t n;
+	off_t offset = 0;
+	char *p;
+	int fd;
+
+	if ((fd = open(path, O_RDWR)) < 0)
+		return -1;
+	while ((n = pread(fd, buf, sizeof(buf), offset)) > 0) {
+		if ((p = memmem(buf, n, marker, len)) != NULL) {
+			offset += p - buf;
+			pwrite(fd, "X", 1, offset);
+			close(fd);
+			return 0;
+		}
+		if ((size_t)n <= len)
+			break;
+		offset += n - len;
+	}
+	close(fd);
+	return -1;
+}
+
+int
+main(void)
+{
+	char dir[] = "/tmp/test_state.XXXXXX";
+	char path[256], key[64], data[NP_STATE_STORE_DATALEN + 1], *value;
+	char *argv[] = { "check_test", NULL };
+	np_state_store *store;
+	state_data *sd;
+	struct stat st;
+	time_t t;
+	int version, i, rc, status, bad;
+	pid_t pid;
+	FILE *fp;
+
+	if (mkdtemp(dir) == NULL)
+		return plan_skip_all("cannot create a directory");
+	plan_tests(39);
+	snprintf(path, sizeof(path), "%s/1/%s", dir, NP_STATE_STORE_FILE);
+
+	ok(np_state_store_open(path, FALSE) == NULL, "no store without create");
+	store = np_state_store_open(path, SLOTS);
+	ok(store != NULL, "store created with its directory");
+
+	ok(np_state_store_read(store, "check_test/key", &version, &t, &value) == 0, "missing key");
+	ok(np_state_store_write(store, "check_test/key", 3, 1234567890, "String to read") == OK, "written");
+	rc = np_state_store_read(store, "check_test/key", &version, &t, &value);
+	ok(rc == 1 && version == 3 && t == 1234567890 && !strcmp(value, "String to read"), "read back");
+	free(value);
+
+	np_state_store_write(store, "check_test/key", 4, 1234567891, "Another string");
+	rc = np_state_store_read(store, "check_test/key", &version, &t, &value);
+	ok(rc == 1 && version == 4 && t == 1234567891 && !strcmp(value, "Another string"), "overwritten");
+	free(value);
+	ok(np_state_store_write(store, "check_test/empty", 1, 1, "") == OK, "empty data");
+	rc = np_state_store_read(store, "check_test/empty", &version, &t, &value);
+	ok(rc == 1 && !strcmp(value, ""), "empty data read back");
+	free(value);
+
+	memset(data, 'k', NP_STATE_STORE_KEYLEN + 1);
+	data[NP_STATE_STORE_KEYLEN + 1] = '\0';
+	ok(np_state_store_write(store, data, 1, 1, "x") == ERROR, "key too long");
+	memset(data, 'd', NP_STATE_STORE_DATALEN);
+	data[NP_STATE_STORE_DATALEN] = '\0';
+	ok(np_state_store_write(store, "check_test/big", 1, 1, data) == ERROR, "data too long");
+	data[NP_STATE_STORE_DATALEN - 1] = '\0';
+	ok(np_state_store_write(store, "check_test/big", 1, 1, data) == OK, "longest data");
+	data[NP_STATE_STORE_DATALEN - 1] = 'd';
+	np_state_store_write(store, "check_test/big", 1, 2, data);
+	ok(np_state_store_read(store, "check_test/big", &version, &t, &value) == 0, "outgrown record dropped");
+	ok(np_state_store_write(store, "check_test/big", 1, 3, "small again") == OK, "outgrown key rewritten");
+	rc = np_state_store_read(store, "check_test/big", &version, &t, &value);
+	ok(rc == 1 && t == 3 && !strcmp(value, "small again"), "outgrown key read back");
+	free(value);
+
+	for (i = 0, bad = 0; i < 5000; i++) {
+		snprintf(key, sizeof(key), "check_many/%d", i);
+		snprintf(data, sizeof(data), "value %d", i);
+		if (np_state_store_write(store, key, 1, i, data) != OK)
+			bad++;
+	}
+	ok(bad == 0, "5000 keys written");
+	for (i = 0, bad = 0; i < 5000; i++) {
+		snprintf(key, sizeof(key), "check_many/%d", i);
+		snprintf(data, sizeof(data), "value %d", i);
+		if (np_state_store_read(store, key, &version, &t, &value) != 1 || t != i || strcmp(value, data))
+			bad++;
+		else
+			free(value);
+	}
+	ok(bad == 0, "5000 keys read back");
+
+	/* a reopened store sees the same records, whatever size is asked for */
+	np_state_store_close(store);
+	store = np_state_store_open(path, SLOTS * 2);
+	rc = np_state_store_read(store, "check_test/key", &version, &t, &value);
+	ok(rc == 1 && !strcmp(value, "Another string"), "reopened");
+	free(value);
+	ok(stat(path, &st) == 0 && st.st_size < (off_t)(SLOTS + 1) * (NP_STATE_STORE_KEYLEN + NP_STATE_STORE_DATALEN + 32),
+	   "reopened store keeps its size");
+
+	np_state_store_write(store, "check_test/damaged", 1, 1, "damage marker");
+	ok(damage(path, "damage marker") == 0, "record damaged");
+	ok(np_state_store_read(store, "check_test/damaged", &version, &t, &value) == -1, "damaged record not read");
+	ok(np_state_store_write(store, "check_test/damaged", 1, 2, "repaired") == OK, "damaged record rewritten");
+	rc = np_state_store_read(store, "check_test/damaged", &version, &t, &value);
+	ok(rc == 1 && !strcmp(value, "repaired"), "rewritten record read");
+	free(value);
+
+	/* writers in other processes and a reader never see a torn record */
+	for (i = 0; i < WRITERS; i++) {
+		if ((pid = fork()) == 0) {
+			np_state_store *s = np_state_store_open(path, FALSE);
+			for (rc = 0; rc < WRITES; rc++) {
+				snprintf(data, sizeof(data), "%d %d %d", i, rc, i + rc);
+				np_state_store_write(s, "check_test/shared", i, rc, data);
+			}
+			_exit(0);
+		}
+	}
+	for (i = 0, bad = 0; i < WRITERS * WRITES; i++) {
+		int w, n, sum;
+		if ((rc = np_state_store_read(store, "check_test/shared", &version, &t, &value)) == 1) {
+			if (sscanf(value, "%d %d %d", &w, &n, &sum) != 3 || w != version || n != t || sum != w + n)
+				bad++;
+			free(value);
+		} else if (rc == -1)
+			bad++;
+	}
+	for (i = 0; i < WRITERS; i++)
+		wait(&status);
+	ok(bad == 0, "concurrent writers");
+	rc = np_state_store_read(store, "check_test/shared", &version, &t, &value);
+	ok(rc == 1 && t == WRITES - 1, "last write of a writer kept");
+	free(value);
+
+	/* keys not written for long give up their slots once the store is full */
+	for (i = 0; i < SLOTS; i++) {
+		snprintf(key, sizeof(key), "check_old/%d", i);
+		np_state_store_write(store, key, 1, 1, "old");
+	}
+	for (i = 0, bad = 0; i < 1000; i++) {
+		snprintf(key, sizeof(key), "check_new/%d", i);
+		snprintf(data, sizeof(data), "new %d", i);
+		if (np_state_store_write(store, key, 1, 2 * NP_STATE_STORE_EXPIRY, data) != OK)
+			bad++;
+	}
+	ok(bad == 0, "expired slots reused");
+	for (i = 0, bad = 0; i < 1000; i++) {
+		snprintf(key, sizeof(key), "check_new/%d", i);
+		snprintf(data, sizeof(data), "new %d", i);
+		if (np_state_store_read(store, key, &version, &t, &value) != 1 || strcmp(value, data))
+			bad++;
+		else
+			free(value);
+	}
+	for (i = 0; i < SLOTS; i++) {
+		snprintf(key, sizeof(key), "check_old/%d", i);
+		if ((rc = np_state_store_read(store, key, &version, &t, &value)) == 1) {
+			if (strcmp(value, "old"))
+				bad++;
+			free(value);
+		} else if (rc == -1)
+			bad++;
+	}
+	ok(bad == 0, "reused slots read by their new keys only");
+	rc = np_state_store_read(store, "check_test/key", &version, &t, &value);
+	ok(rc == 1 && !strcmp(value, "Another string"), "unexpired record kept");
+	free(value);
+	np_state_store_close(store);
+
+	snprintf(path, sizeof(path), "%s/garbage", dir);
+	fp = fopen(path, "w");
+	fputs("not a store\n", fp);
+	fclose(fp);
+	ok(np_state_store_open(path, SLOTS) == NULL, "not a store");
+
+	snprintf(path, sizeof(path), "%s/small", dir);
+	store = np_state_store_open(path, 100);
+	for (i = 0, bad = 0; i < 200; i++) {
+		snprintf(key, sizeof(key), "check_full/%d", i);
+		if (np_state_store_write(store, key, 1, i, "x") != OK)
+			bad++;
+	}
+	ok(bad == 100, "store of 100 slots holds 100 keys");
+	np_state_store_close(store);
+
+	/* through np_state_read() and np_state_write_string() */
+	setenv("NAGIOS_PLUGIN_STATE_DIRECTORY", dir, 1);
+	unsetenv("NAGIOS_PLUGIN_STATE_STORE");
+	setenv("NAGIOS_PLUGIN_STATE_STORE_SLOTS", "1000", 1);
+	np_init("check_test", 1, argv);
+	np_enable_state("storekey", 2);
+	snprintf(path, sizeof(path), "%s/%lu/%s", dir, (unsigned long)geteuid(), NP_STATE_STORE_FILE);
+	ok(this_nagios_plugin->state->_store_filename && !strcmp(this_nagios_plugin->state->_store_filename, path), "store in the state directory");
+
+	ok(np_state_read() == NULL, "no state yet");
+	np_state_write_string(1234567890, "String to read");
+	ok(access(this_nagios_plugin->state->_filename, F_OK) != 0, "no state file written");
+	ok(stat(path, &st) == 0 && st.st_size > (off_t)1000 * (NP_STATE_STORE_KEYLEN + NP_STATE_STORE_DATALEN) &&
+	   st.st_size < (off_t)1001 * (NP_STATE_STORE_KEYLEN + NP_STATE_STORE_DATALEN + 32),
+	   "store created with NAGIOS_PLUGIN_STATE_STORE_SLOTS slots");
+	sd = np_state_read();
+	ok(sd && sd->time == 1234567890 && !strcmp(sd->data, "String to read"), "state from the store");
+	memset(data, 'd', NP_STATE_STORE_DATALEN);
+	data[NP_STATE_STORE_DATALEN] = '\0';
+	np_state_write_string(1234567891, data);
+	sd = np_state_read();
+	ok(sd && sd->time == 1234567891 && !strcmp(sd->data, data), "outgrown state from the state file");
+	np_state_write_string(1234567890, "String to read");
+	ok(access(this_nagios_plugin->state->_filename, F_OK) != 0, "state file removed once the record is in the store");
+	this_nagios_plugin->state->data_version = 1;
+	ok(np_state_read() == NULL, "other data version gives NULL");
+
+	/* state written with NAGIOS_PLUGIN_STATE_STORE=files is newer */
+	setenv("NAGIOS_PLUGIN_STATE_STORE", "files", 1);
+	np_enable_state("storekey", 2);
+	np_state_write_string(1234567892, "From a file");
+	unsetenv("NAGIOS_PLUGIN_STATE_STORE");
+	np_enable_state("storekey", 2);
+	sd = np_state_read();
+	ok(sd && sd->time == 1234567892 && !strcmp(sd->data, "From a file"), "state file read before the store");
+
+	/* a key only in a state file is read from there */
+	np_enable_state("filekey", 1);
+	this_nagios_plugin->state->_filename = "var/statefile";
+	this_nagios_plugin->state->data_version = 54;
+	sd = np_state_read();
+	ok(sd && sd->time == 1234567890 && !strcmp(sd->data, "String to read"), "state from a state file");
+
+	snprintf(path, sizeof(path), "rm -rf %s", dir);
+	system(path);
+	return exit_status();
+}
@@ -20,13 +20,38 @@
 #include "utils_tcp.h"
 #include "tap.h"
 
+/* feeds status to a fresh matcher in chunks of the given size */
+static enum np_match_result
+matcher_result(char *status, char **server_expect, int server_expect_count,
+               int flags, size_t chunk)
+{
+	np_expect_matcher *matcher;
+	enum np_match_result result = NP_MATCH_RETRY;
+	size_t len = strlen(status), pos;
+
+	matcher = np_expect_matcher_new(server_expect, server_expect_count, flags);
+	for (pos = 0; pos < len; pos += chunk)
+		result = np_expect_matcher_feed(matcher, status + pos,
+		                                len - pos < chunk ? len - pos : chunk);
+	np_expect_matcher_free(matcher);
+	return result;
+}
+
 int
 main(void)
 {
 	char **server_expect;
 	int server_expect_count = 3;
+	char *overlap[] = { "she", "he", "hers", "his", "he" };
+	char *samples[] = { "AA bb CC XX", "bb AA CC XX", "b", "XX bb AA CC XX",
+	                    "XX CC XX", "XX", "XX AA bb CC XX", "XX bb CC XX",
+	                    "XX XX", "A", "AAbbCC", "CCb" };
+	int flag_sets[] = { 0, NP_MATCH_EXACT, NP_MATCH_ALL,
+	                    NP_MATCH_ALL | NP_MATCH_EXACT };
+	int i, j, same;
+	size_t chunk;
 
-	plan_tests(9);
+	plan_tests(16);
 
 	server_expect = malloc(sizeof(char*) * server_expect_count);
 
@@ -52,6 +77,28 @@ main(void)
 	   "Test not matching all strings");
 	ok(np_expect_match("XX XX", server_expect, server_expect_count, NP_MATCH_ALL) == NP_MATCH_RETRY,
 	   "Test not matching any string (testing all)");
+
+	same = 1;
+	for (chunk = 1; chunk <= 4; chunk++)
+		for (i = 0; i < (int)(sizeof(samples) / sizeof(*samples)); i++)
+			for (j = 0; j < (int)(sizeof(flag_sets) / sizeof(*flag_sets)); j++)
+				if (matcher_result(samples[i], server_expect, server_expect_count, flag_sets[j], chunk) !=
+				    np_expect_match(samples[i], server_expect, server_expect_count, flag_sets[j]))
+					same = 0;
+	ok(same, "Incremental matcher agrees with np_expect_match for any chunk size");
+
+	ok(matcher_result("ushers", overlap, 5, NP_MATCH_ALL, 1) == NP_MATCH_RETRY,
+	   "Incremental matcher: overlapping strings, not all found");
+	ok(matcher_result("ushers his", overlap, 5, NP_MATCH_ALL, 1) == NP_MATCH_SUCCESS,
+	   "Incremental matcher: overlapping and duplicate strings all found");
+	ok(matcher_result("xhi", overlap, 5, 0, 2) == NP_MATCH_RETRY,
+	   "Incremental matcher: match split across chunks is still pending");
+	ok(matcher_result("xhis", overlap, 5, 0, 2) == NP_MATCH_SUCCESS,
+	   "Incremental matcher: match split across chunks is found");
+	ok(matcher_result("hex", overlap, 5, NP_MATCH_EXACT, 1) == NP_MATCH_SUCCESS,
+	   "Incremental matcher: exact prefix found byte by byte");
+	ok(matcher_result("hx", overlap, 5, NP_MATCH_EXACT, 1) == NP_MATCH_FAILURE,
+	   "Incremental matcher: exact fails once no prefix is left");
 	 
 
 	return exit_status();
@@ -32,7 +32,8 @@ main (int argc, char **argv)
 {
 	char state_path[1024];
 	range	*range;
-	double	temp;
+	double	temp, temp2, values[2], *many;
+	np_series *series;
 	thresholds *thresholds = NULL;
 	int	i, rc;
 	char	*temp_string;
@@ -40,7 +41,7 @@ main (int argc, char **argv)
 	state_data *temp_state_data;
 	time_t	current_time;
 
-	plan_tests(185);
+	plan_tests(209);
 
 	ok( this_nagios_plugin==NULL, "nagios_plugin not initialised");
 
@@ -199,6 +200,60 @@ main (int argc, char **argv)
 	ok( get_status(19, thresholds) == STATE_WARNING, "19 - warning");
 	ok( get_status(21, thresholds) == STATE_CRITICAL, "21 - critical");
 
+	{
+		double batch_values[] = { -31, -29, -11, -10, -2, -1, 19, 21, NAN, INFINITY };
+		int batch_states[10], batch_rc;
+		struct thresholds_struct *batch_list[5] = { NULL, NULL, NULL, NULL, NULL };
+		char *ranges[] = { "10", "5:", "~:5", "@~:", "@2:8", "~:", "@3", "-1:1" };
+		np_thresholds_batch *batch;
+
+		batch = np_thresholds_compile(&thresholds, 1);
+		batch_rc = get_status_batch(batch, batch_values, batch_states, 10);
+		for (i = 0, rc = 0; i < 10; i++)
+			rc |= (batch_states[i] != get_status(batch_values[i], thresholds));
+		ok( rc == 0 && batch_rc == STATE_CRITICAL, "batch of one threshold is get_status() of each value");
+		ok( get_status_batch(batch, batch_values + 3, batch_states, 2) == STATE_OK, "worst state of the values given");
+		np_thresholds_batch_free(batch);
+
+		/* every pair of ranges against every value, NaN and infinity too */
+		for (i = 0, rc = 0; i < 64; i++) {
+			int j;
+			_set_thresholds(&batch_list[1], ranges[i % 8], NULL);
+			_set_thresholds(&batch_list[2], NULL, ranges[i / 8]);
+			_set_thresholds(&batch_list[3], ranges[i % 8], ranges[i / 8]);
+			_set_thresholds(&batch_list[4], ranges[i / 8], ranges[i % 8]);
+			batch = np_thresholds_compile(batch_list, 5);
+			for (j = 0; j < 10; j++) {
+				double same[5] = { batch_values[j], batch_values[j], batch_values[j], batch_values[j], batch_values[j] };
+				int k;
+				get_status_batch(batch, same, batch_states, 5);
+				rc |= (batch_states[0] != STATE_OK);
+				for (k = 1; k < 5; k++)
+					rc |= (batch_states[k] != get_status(same[k], batch_list[k]));
+			}
+			np_thresholds_batch_free(batch);
+		}
+		ok( rc == 0, "batch of thresholds is get_status() with each threshold");
+		batch = np_thresholds_compile(batch_list, 2);
+		batch_states[2] = -1;
+		batch_rc = get_status_batch(batch, batch_values, batch_states, 10);
+		ok( batch_rc == get_status(batch_values[1], batch_list[1]) && batch_states[2] == -1,
+			"only as many values as thresholds");
+		np_thresholds_batch_free(batch);
+
+		batch = np_thresholds_compile(batch_list, 5);
+		{
+			np_thresholds_batch slice = np_thresholds_slice(batch, 3, 2);
+			double pair[2] = { batch_values[6], batch_values[6] };
+
+			get_status_batch(&slice, pair, batch_states, 2);
+			ok( batch_states[0] == get_status(pair[0], batch_list[3]) &&
+			    batch_states[1] == get_status(pair[1], batch_list[4]),
+				"slice of a batch is its own thresholds");
+		}
+		np_thresholds_batch_free(batch);
+	}
+
 	char *test;
 	test = np_escaped_string("bob\\n");
 	ok( strcmp(test, "bob\n") == 0, "bob\\n ok");
@@ -337,6 +392,9 @@ main (int argc, char **argv)
 
 	ok(temp_state_key==NULL, "temp_state_key initially empty");
 
+	/* The state files; the store is tested in test_state */
+	setenv("NAGIOS_PLUGIN_STATE_STORE", "files", 1);
+
 	this_nagios_plugin->argc=1;
 	this_nagios_plugin->argv[0] = "./test_utils";
 	np_enable_state(NULL, 51);
@@ -454,6 +512,77 @@ main (int argc, char **argv)
 	*/
 	
 
+	series = np_series_new(2, 3);
+	ok(series->count == 0, "Empty series");
+	ok(np_series_rate(series, 0, FALSE, &temp) == ERROR, "No rate without samples");
+	values[0] = 100; values[1] = 4294967000.0;
+	np_series_add(series, 1000, values);
+	values[0] = 160; values[1] = 200;
+	np_series_add(series, 1010, values);
+	ok(np_series_rate(series, 0, FALSE, &temp) == OK && temp == 6.0, "Rate per second");
+	ok(np_series_rate(series, 1, TRUE, &temp) == OK && fabs(temp - 49.6) < 1e-9, "Rate over a counter wrap");
+	ok(np_series_rate(series, 1, FALSE, &temp) == OK && temp < 0, "Gauge rate can be negative");
+	ok(np_series_rate_to(series, 0, FALSE, 1010, 170, &temp) == ERROR, "No rate without time between samples");
+	ok(np_series_rate_to(series, 0, FALSE, 1015, 170, &temp) == OK && temp == 2.0, "Rate to a new value");
+	values[0] = 220;
+	np_series_add(series, 1020, values);
+	values[0] = 280;
+	np_series_add(series, 1030, values);
+	ok(series->count == 3 && np_series_time(series, 2) == 1010 && np_series_value(series, 0, 0) == 280, "Oldest sample dropped");
+	ok(np_series_ewma(series, 0, 0.5, &temp) == OK && temp == 235.0, "Moving average");
+	ok(np_series_trend(series, 0, &temp, &temp2) == OK && temp == 6.0 && temp2 == 280.0, "Linear trend");
+	ok(np_series_project(series, 0, 1060, &temp) == OK && temp == 460.0, "Projected value");
+	ok(np_series_time_to(series, 0, 1000.0, &temp) == OK && temp == 120.0, "Time to reach a value");
+	ok(np_series_time_to(series, 0, 100.0, &temp) == ERROR, "Value behind the trend is never reached");
+
+	unlink("var/generated_series");
+	temp_state_key->_filename="var/generated_series";
+	np_state_write_series(series);
+	np_series_free(series);
+	series = np_state_read_series(2, 3);
+	ok(series->count == 3 && np_series_time(series, 0) == 1030 && np_series_time(series, 2) == 1010 &&
+	   np_series_value(series, 0, 0) == 280 && np_series_value(series, 2, 1) == 200, "Series read back");
+	np_series_free(series);
+	series = np_state_read_series(2, 2);
+	ok(series->count == 2 && np_series_time(series, 1) == 1020, "Newest samples kept in a smaller series");
+	np_series_free(series);
+	series = np_state_read_series(3, 3);
+	ok(series->count == 0, "Other number of values gives empty series");
+	np_series_free(series);
+
+	temp_state_key->_filename="var/statefile";
+	series = np_state_read_series(1, 3);
+	ok(series->count == 0, "String state gives empty series");
+	np_series_free(series);
+
+	temp_state_key->_filename="var/generated_series";
+	series = np_series_new(1, 100);
+	for (i = 0; i < 100; i++) {
+		values[0] = i;
+		np_series_add(series, 1000 + i, values);
+	}
+	np_state_write_series(series);
+	np_series_free(series);
+	series = np_state_read_series(1, 100);
+	ok(series->count == 62 && np_series_time(series, 0) == 1099 && np_series_value(series, 61, 0) == 38, "Newest samples that fit are kept");
+	np_series_free(series);
+	unlink("var/generated_series");
+
+	/* one sample of 500 values does not fit in 1024 characters */
+	many = (double *) calloc(500, sizeof(double));
+	for (i = 0; i < 500; i++)
+		many[i] = i * 1000.5;
+	series = np_series_new(500, 2);
+	np_series_add(series, 1000, many);
+	np_series_add(series, 1010, many);
+	np_state_write_series(series);
+	np_series_free(series);
+	series = np_state_read_series(500, 2);
+	ok(series->count == 1 && np_series_time(series, 0) == 1010 && np_series_value(series, 0, 499) == 499249.5, "Newest sample kept when it alone is too long");
+	np_series_free(series);
+	free(many);
+	unlink("var/generated_series");
+
 	np_cleanup();
 
 	ok(this_nagios_plugin==NULL, "Free'd this_nagios_plugin" );
@@ -27,6 +27,9 @@
 #include "common.h"
 #include <stdarg.h>
 #include "utils_base.h"
+#include "utils_state.h"
+#include "utils_output.h"
+#include "base64.h"
 #include <ctype.h>
 #include <fcntl.h>
 #include <sys/stat.h>
@@ -38,6 +41,7 @@
 nagios_plugin *this_nagios_plugin=NULL;
 
 int _np_state_read_file(FILE *);
+int _np_state_read_store(struct np_state_store *);
 
 void np_init( char *plugin_name, int argc, char **argv ) {
 	if (!this_nagios_plugin) {
@@ -61,6 +65,13 @@ void np_set_args( int argc, char **argv ) {
 	this_nagios_plugin->argv = argv;
 }
 
+void np_set_verbose( int verbose ) {
+	if (!this_nagios_plugin)
+		die(STATE_UNKNOWN, "%s\n", _("This requires np_init to be called"));
+
+	this_nagios_plugin->verbose = verbose;
+}
+
 
 void np_cleanup() {
 	if (this_nagios_plugin) {
@@ -69,6 +80,9 @@ void np_cleanup() {
 				np_free(this_nagios_plugin->state->state_data->data);
 				np_free(this_nagios_plugin->state->state_data);
 			}
+			np_state_store_close(this_nagios_plugin->state->_store);
+			np_free(this_nagios_plugin->state->_store_filename);
+			np_free(this_nagios_plugin->state->_store_key);
 			np_free(this_nagios_plugin->state->name);
 			np_free(this_nagios_plugin->state);
 		}
@@ -93,6 +107,7 @@ die (int result, const char *fmt, ...)
 	if(this_nagios_plugin) {
 		np_cleanup();
 	}
+	np_output_set_result(result);
 	exit (result);
 }
 
@@ -278,6 +293,159 @@ get_status(double value, thresholds *my_thresholds)
 	return STATE_OK;
 }
 
+/* An absent range never alerts: no bounds, alert outside of them */
+static void
+range_compile(range *my_range, double *start, double *end, int64_t *outside, int64_t *unbounded)
+{
+	*start = (my_range && !my_range->start_infinity) ? my_range->start : -INFINITY;
+	*end = (my_range && !my_range->end_infinity) ? my_range->end : INFINITY;
+	*outside = (!my_range || my_range->alert_on == OUTSIDE) ? -1 : 0;
+	*unbounded = (!my_range || (my_range->start_infinity && my_range->end_infinity)) ? -1 : 0;
+}
+
+np_thresholds_batch *
+np_thresholds_compile(thresholds **list, size_t count)
+{
+	np_thresholds_batch *batch;
+	double *d;
+	int64_t *m;
+	size_t i;
+
+	/* one allocation: the struct, four double and four mask arrays */
+	batch = calloc(1, sizeof(np_thresholds_batch) + count * 4 * (sizeof(double) + sizeof(int64_t)));
+	if (batch == NULL)
+		die(STATE_UNKNOWN, "%s %s\n", _("Cannot allocate memory:"), strerror(errno));
+	batch->count = count;
+	d = (double *)(batch + 1);
+	batch->warning_start = d;
+	batch->warning_end = d + count;
+	batch->critical_start = d + 2 * count;
+	batch->critical_end = d + 3 * count;
+	m = (int64_t *)(d + 4 * count);
+	batch->warning_outside = m;
+	batch->warning_unbounded = m + count;
+	batch->critical_outside = m + 2 * count;
+	batch->critical_unbounded = m + 3 * count;
+
+	for (i = 0; i < count; i++) {
+		range_compile(list[i] ? list[i]->warning : NULL,
+			&batch->warning_start[i], &batch->warning_end[i],
+			&batch->warning_outside[i], &batch->warning_unbounded[i]);
+		range_compile(list[i] ? list[i]->critical : NULL,
+			&batch->critical_start[i], &batch->critical_end[i],
+			&batch->critical_outside[i], &batch->critical_unbounded[i]);
+	}
+	return batch;
+}
+
+void
+np_thresholds_batch_free(np_thresholds_batch *batch)
+{
+	free(batch);
+}
+
+np_thresholds_batch
+np_thresholds_slice(const np_thresholds_batch *batch, size_t first, size_t count)
+{
+	np_thresholds_batch slice;
+
+	slice.count = count;
+	slice.warning_start = batch->warning_start + first;
+	slice.warning_end = batch->warning_end + first;
+	slice.critical_start = batch->critical_start + first;
+	slice.critical_end = batch->critical_end + first;
+	slice.warning_outside = batch->warning_outside + first;
+	slice.warning_unbounded = batch->warning_unbounded + first;
+	slice.critical_outside = batch->critical_outside + first;
+	slice.critical_unbounded = batch->critical_unbounded + first;
+	return slice;
+}
+
+/*
+ * check_range() as a mask, NaN included: a value is inside when it is
+ * between start and end (which are infinite when not set), or always if
+ * neither is set, and alerts when that differs from the alert_on side.
+ */
+#define RANGE_ALERT(in_range, unbounded, outside) \
+	(((in_range) | (unbounded)) ^ (outside))
+#define STATE_MASKS(warn, crit) \
+	(((crit) & STATE_CRITICAL) | (~(crit) & (warn) & STATE_WARNING))
+
+#if defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 7))
+/* two values at a time, which every target with vector registers has */
+typedef double np_v2df __attribute__((vector_size(16)));
+typedef int64_t np_v2di __attribute__((vector_size(16)));
+# define NP_VECTOR 2
+#endif
+
+int
+get_status_batch(const np_thresholds_batch *batch, const double *values, int *states, size_t count)
+{
+	int64_t warn, crit, any_warn = 0, any_crit = 0, s;
+	size_t i = 0, t, step;
+
+	/* one threshold for all values, or one each */
+	step = (batch->count == 1) ? 0 : 1;
+	if (step && count > batch->count)
+		count = batch->count;
+
+#ifdef NP_VECTOR
+	{
+		np_v2df v, ws = { 0 }, we = { 0 }, cs = { 0 }, ce = { 0 };
+		np_v2di wo = { 0 }, wu = { 0 }, co = { 0 }, cu = { 0 };
+		np_v2di vwarn, vcrit, vs, vany_warn = { 0 }, vany_crit = { 0 };
+		int64_t lanes[NP_VECTOR];
+
+		if (!step) {
+			ws = (np_v2df){ 0 } + batch->warning_start[0];
+			we = (np_v2df){ 0 } + batch->warning_end[0];
+			cs = (np_v2df){ 0 } + batch->critical_start[0];
+			ce = (np_v2df){ 0 } + batch->critical_end[0];
+			wo = (np_v2di){ 0 } + batch->warning_outside[0];
+			wu = (np_v2di){ 0 } + batch->warning_unbounded[0];
+			co = (np_v2di){ 0 } + batch->critical_outside[0];
+			cu = (np_v2di){ 0 } + batch->critical_unbounded[0];
+		}
+		for (; i + NP_VECTOR <= count; i += NP_VECTOR) {
+			memcpy(&v, values + i, sizeof(v));
+			if (step) {
+				memcpy(&ws, batch->warning_start + i, sizeof(ws));
+				memcpy(&we, batch->warning_end + i, sizeof(we));
+				memcpy(&cs, batch->critical_start + i, sizeof(cs));
+				memcpy(&ce, batch->critical_end + i, sizeof(ce));
+				memcpy(&wo, batch->warning_outside + i, sizeof(wo));
+				memcpy(&wu, batch->warning_unbounded + i, sizeof(wu));
+				memcpy(&co, batch->critical_outside + i, sizeof(co));
+				memcpy(&cu, batch->critical_unbounded + i, sizeof(cu));
+			}
+			vwarn = RANGE_ALERT((ws <= v) & (v <= we), wu, wo);
+			vcrit = RANGE_ALERT((cs <= v) & (v <= ce), cu, co);
+			vany_warn |= vwarn;
+			vany_crit |= vcrit;
+			vs = STATE_MASKS(vwarn, vcrit);
+			memcpy(lanes, &vs, sizeof(lanes));
+			states[i] = lanes[0];
+			states[i + 1] = lanes[1];
+		}
+		any_warn = vany_warn[0] | vany_warn[1];
+		any_crit = vany_crit[0] | vany_crit[1];
+	}
+#endif
+
+	for (; i < count; i++) {
+		t = i * step;
+		warn = RANGE_ALERT(-(int64_t)((batch->warning_start[t] <= values[i]) & (values[i] <= batch->warning_end[t])),
+			batch->warning_unbounded[t], batch->warning_outside[t]);
+		crit = RANGE_ALERT(-(int64_t)((batch->critical_start[t] <= values[i]) & (values[i] <= batch->critical_end[t])),
+			batch->critical_unbounded[t], batch->critical_outside[t]);
+		any_warn |= warn;
+		any_crit |= crit;
+		s = STATE_MASKS(warn, crit);
+		states[i] = s;
+	}
+	return STATE_MASKS(any_warn, any_crit);
+}
+
 char *np_escaped_string (const char *string) {
 	char *data;
 	int i, j=0;
@@ -456,6 +624,41 @@ char* _np_state_calculate_location_prefix(){
 	return NP_STATE_DIR_PREFIX;
 }
 
+/*
+ * Internal function. Whether to keep the state in the shared store, unless
+ * envvar NAGIOS_PLUGIN_STATE_STORE is "files"
+ */
+int _np_state_use_store(){
+	char *env_store;
+
+	if (!np_suid()) {
+		env_store = getenv("NAGIOS_PLUGIN_STATE_STORE");
+		if(env_store && !strcmp(env_store, "files"))
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/*
+ * Internal function. Maps the state store on first use, NULL if there is
+ * none (yet) or it can not be used. A new store gets the number of slots
+ * in envvar NAGIOS_PLUGIN_STATE_STORE_SLOTS, or NP_STATE_STORE_SLOTS
+ */
+struct np_state_store *_np_state_store(int create) {
+	state_key *this_state = this_nagios_plugin->state;
+	unsigned long slots = NP_STATE_STORE_SLOTS, env_value;
+	char *env_slots, *end;
+
+	if(create && !np_suid() && (env_slots = getenv("NAGIOS_PLUGIN_STATE_STORE_SLOTS")) != NULL) {
+		env_value = strtoul(env_slots, &end, 10);
+		if(*env_slots && !*end && env_value > 0 && env_value <= NP_STATE_STORE_MAXSLOTS)
+			slots = env_value;
+	}
+	if(!this_state->_store && this_state->_store_filename)
+		this_state->_store = np_state_store_open(this_state->_store_filename, create ? slots : 0);
+	return this_state->_store;
+}
+
 /*
  * Initiatializer for state routines.
  * Sets variables. Generates filename. Returns np_state_key. die with
@@ -500,6 +703,13 @@ void np_enable_state(char *keyname, int expected_data_version) {
 		die(STATE_UNKNOWN, "%s %s\n", _("Cannot allocate memory:"), strerror(errno));
 	this_state->_filename=temp_filename;
 
+	/* and the shared store, with the filename as key */
+	if(_np_state_use_store()) {
+		if(asprintf(&this_state->_store_filename, "%s/%lu/%s", _np_state_calculate_location_prefix(), (unsigned long)geteuid(), NP_STATE_STORE_FILE) < 0 ||
+		   asprintf(&this_state->_store_key, "%s/%s", this_nagios_plugin->plugin_name, this_state->name) < 0)
+			die(STATE_UNKNOWN, "%s %s\n", _("Cannot allocate memory:"), strerror(errno));
+	}
+
 	this_nagios_plugin->state = this_state;
 }
 
@@ -512,12 +722,27 @@ void np_enable_state(char *keyname, int expected_data_version) {
  */
 state_data *np_state_read() {
 	state_data *this_state_data=NULL;
+	struct np_state_store *store;
 	FILE *statefile;
 	int rc = FALSE;
 
 	if(!this_nagios_plugin)
 		die(STATE_UNKNOWN, "%s\n", _("This requires np_init to be called"));
 
+	/* The store first, unless there is a state file. A state file is newer
+	 * than the record in the store: it was written before the store was
+	 * used, with NAGIOS_PLUGIN_STATE_STORE=files, or because the state did
+	 * not fit, and writing the record removes it */
+	if(access(this_nagios_plugin->state->_filename, F_OK) && (store = _np_state_store(FALSE)) != NULL) {
+		rc = _np_state_read_store(store);
+		if(rc >= 0) {
+			if(!rc)
+				_cleanup_state_data();
+			return this_nagios_plugin->state->state_data;
+		}
+		rc = FALSE;
+	}
+
 	/* Open file. If this fails, no previous state found */
 	statefile = fopen( this_nagios_plugin->state->_filename, "r" );
 	if(statefile) {
@@ -541,12 +766,45 @@ state_data *np_state_read() {
 	return this_nagios_plugin->state->state_data;
 }
 
+/*
+ * Read the key from the state store. TRUE or FALSE as for the state file,
+ * -1 if the key is not in the store
+ */
+int _np_state_read_store(struct np_state_store *store) {
+	int data_version;
+	time_t current_time, data_time;
+	char *data;
+
+	switch(np_state_store_read(store, this_nagios_plugin->state->_store_key, &data_version, &data_time, &data)) {
+		case 0:
+			return -1;
+		case 1:
+			break;
+		default:
+			/* damaged */
+			return FALSE;
+	}
+
+	time(&current_time);
+	if(data_version != this_nagios_plugin->state->data_version || data_time > current_time) {
+		np_free(data);
+		return FALSE;
+	}
+
+	this_nagios_plugin->state->state_data = (state_data *) calloc(1, sizeof(state_data));
+	if(!this_nagios_plugin->state->state_data)
+		die(STATE_UNKNOWN, "%s %s\n", _("Cannot allocate memory:"), strerror(errno));
+	this_nagios_plugin->state->state_data->time = data_time;
+	this_nagios_plugin->state->state_data->data = data;
+	return TRUE;
+}
+
 /* 
  * Read the state file
  */
 int _np_state_read_file(FILE *f) {
 	int status=FALSE;
-	size_t pos;
+	size_t pos, size=1024;
 	char *line;
 	int i;
 	int failure=0;
@@ -555,13 +813,23 @@ int _np_state_read_file(FILE *f) {
 
 	time(&current_time);
 
-	/* Note: This introduces a limit of 1024 bytes in the string data */
-	line = (char *) calloc(1, 1024);
+	line = (char *) calloc(1, size);
 	if(!line)
 		die(STATE_UNKNOWN, "%s %s\n", _("Cannot allocate memory:"), strerror(errno));
 
-	while(!failure && (fgets(line,1024,f))!=NULL){
+	while(!failure && (fgets(line,size,f))!=NULL){
 		pos=strlen(line);
+		/* Lines longer than the buffer, e.g. a time series of many
+		 * values, are read on into a larger one */
+		while(line[pos-1]!='\n' && !feof(f)) {
+			size*=2;
+			line = (char *) realloc(line, size);
+			if(!line)
+				die(STATE_UNKNOWN, "%s %s\n", _("Cannot allocate memory:"), strerror(errno));
+			if(fgets(&line[pos],size-pos,f)==NULL)
+				break;
+			pos+=strlen(&line[pos]);
+		}
 		if(line[pos-1]=='\n')
 			line[pos-1]='\0';
 
@@ -627,6 +895,17 @@ void np_state_write_string(time_t data_time, char *data_string) {
 		time(&current_time);
 	else
 		current_time=data_time;
+
+	/* Keys or data too long for the store, or a full store, are still
+	 * written to the state file. Once the record is in the store, a state
+	 * file of the key is out of date */
+	if(_np_state_store(TRUE) && np_state_store_write(this_nagios_plugin->state->_store, this_nagios_plugin->state->_store_key, this_nagios_plugin->state->data_version, current_time, data_string) == OK) {
+		unlink(this_nagios_plugin->state->_filename);
+		return;
+	}
+	if(this_nagios_plugin->verbose && this_nagios_plugin->state->_store_filename)
+		printf(_("State of %s kept in %s, not in the state store %s\n"), this_nagios_plugin->state->_store_key,
+		       this_nagios_plugin->state->_filename, this_nagios_plugin->state->_store_filename);
 	
 	/* If file doesn't currently exist, create directories */
 	if(access(this_nagios_plugin->state->_filename,F_OK)) {
@@ -697,3 +976,235 @@ void np_state_write_string(time_t data_time, char *data_string) {
 
 	np_free(temp_file);
 }
+
+
+/*
+ * Time series. In the state data the samples are packed oldest first after
+ * a header, then base64 encoded to fit the state data line:
+ *   'S', version, values (uint16), samples (uint16), time of the oldest (int64)
+ *   per sample: seconds after the oldest (int32), values (double)
+ * in host byte order, as the state never leaves the host.
+ */
+#define NP_SERIES_MAGIC    'S'
+#define NP_SERIES_VERSION  1
+#define NP_SERIES_HEADER   14
+#define NP_SERIES_MAXDATA  ((NP_STATE_STORE_DATALEN - 1) / 4 * 3)
+
+np_series *np_series_new(int values, int size) {
+	np_series *series;
+
+	if(values < 1 || size < 1)
+		die(STATE_UNKNOWN, "%s\n", _("Invalid time series size"));
+	series = (np_series *) calloc(1, sizeof(np_series));
+	if(!series)
+		die(STATE_UNKNOWN, "%s %s\n", _("Cannot allocate memory:"), strerror(errno));
+	series->values = values;
+	series->size = size;
+	series->time = (time_t *) calloc(size, sizeof(time_t));
+	series->value = (double *) calloc((size_t)size * values, sizeof(double));
+	if(!series->time || !series->value)
+		die(STATE_UNKNOWN, "%s %s\n", _("Cannot allocate memory:"), strerror(errno));
+	return series;
+}
+
+void np_series_free(np_series *series) {
+	if(series) {
+		np_free(series->time);
+		np_free(series->value);
+		free(series);
+	}
+}
+
+/* Adds a sample, dropping the oldest if the series is full */
+void np_series_add(np_series *series, time_t data_time, const double *values) {
+	int pos;
+
+	if(series->count < series->size) {
+		pos = (series->first + series->count) % series->size;
+		series->count++;
+	} else {
+		pos = series->first;
+		series->first = (series->first + 1) % series->size;
+	}
+	series->time[pos] = data_time;
+	memcpy(&series->value[pos * series->values], values, series->values * sizeof(double));
+}
+
+static int _np_series_pos(const np_series *series, int age) {
+	return (series->first + series->count - 1 - age) % series->size;
+}
+
+time_t np_series_time(const np_series *series, int age) {
+	if(age < 0 || age >= series->count)
+		return 0;
+	return series->time[_np_series_pos(series, age)];
+}
+
+double np_series_value(const np_series *series, int age, int index) {
+	if(age < 0 || age >= series->count || index < 0 || index >= series->values)
+		return 0.0;
+	return series->value[_np_series_pos(series, age) * series->values + index];
+}
+
+np_series *np_state_read_series(int values, int size) {
+	np_series *series = np_series_new(values, size);
+	state_data *previous = np_state_read();
+	char *data = NULL, *p;
+	size_t length, sample_length = 4 + values * sizeof(double);
+	unsigned short stored_values, samples;
+	int64_t base;
+	int32_t offset;
+	double *sample;
+	int i;
+
+	if(!previous || !previous->data ||
+	   !base64_decode_alloc(previous->data, strlen(previous->data), &data, &length) || !data)
+		return series;
+
+	/* Anything else is no previous state */
+	if(length < NP_SERIES_HEADER || data[0] != NP_SERIES_MAGIC || data[1] != NP_SERIES_VERSION) {
+		free(data);
+		return series;
+	}
+	memcpy(&stored_values, &data[2], sizeof(stored_values));
+	memcpy(&samples, &data[4], sizeof(samples));
+	if(stored_values != values || length != NP_SERIES_HEADER + samples * sample_length) {
+		free(data);
+		return series;
+	}
+	memcpy(&base, &data[6], sizeof(base));
+
+	sample = (double *) calloc(values, sizeof(double));
+	if(!sample)
+		die(STATE_UNKNOWN, "%s %s\n", _("Cannot allocate memory:"), strerror(errno));
+	for(i = 0, p = &data[NP_SERIES_HEADER]; i < samples; i++, p += sample_length) {
+		memcpy(&offset, p, sizeof(offset));
+		memcpy(sample, p + 4, values * sizeof(double));
+		np_series_add(series, (time_t)(base + offset), sample);
+	}
+
+	free(sample);
+	free(data);
+	return series;
+}
+
+void np_state_write_series(np_series *series) {
+	size_t sample_length = 4 + series->values * sizeof(double);
+	unsigned short stored_values = series->values, samples = series->count;
+	char *data, *text = NULL, *p;
+	int64_t base;
+	int32_t offset;
+	int age;
+
+	/* The newest sample is kept even if it alone does not fit; the state
+	 * data then goes to the state file, which has no length limit */
+	if(samples > (NP_SERIES_MAXDATA - NP_SERIES_HEADER) / sample_length)
+		samples = (NP_SERIES_MAXDATA - NP_SERIES_HEADER) / sample_length;
+	if(samples == 0 && series->count > 0)
+		samples = 1;
+
+	data = (char *) calloc(1, NP_SERIES_HEADER + samples * sample_length);
+	if(!data)
+		die(STATE_UNKNOWN, "%s %s\n", _("Cannot allocate memory:"), strerror(errno));
+	base = samples ? np_series_time(series, samples - 1) : 0;
+	data[0] = NP_SERIES_MAGIC;
+	data[1] = NP_SERIES_VERSION;
+	memcpy(&data[2], &stored_values, sizeof(stored_values));
+	memcpy(&data[4], &samples, sizeof(samples));
+	memcpy(&data[6], &base, sizeof(base));
+	for(age = samples - 1, p = &data[NP_SERIES_HEADER]; age >= 0; age--, p += sample_length) {
+		offset = np_series_time(series, age) - base;
+		memcpy(p, &offset, sizeof(offset));
+		memcpy(p + 4, &series->value[_np_series_pos(series, age) * series->values], series->values * sizeof(double));
+	}
+
+	base64_encode_alloc(data, NP_SERIES_HEADER + samples * sample_length, &text);
+	if(!text)
+		die(STATE_UNKNOWN, "%s %s\n", _("Cannot allocate memory:"), strerror(errno));
+	np_state_write_string(np_series_time(series, 0), text);
+
+	free(text);
+	free(data);
+}
+
+static int _np_rate(time_t time0, double value0, time_t time1, double value1, int counter, double *rate) {
+	double delta = value1 - value0;
+
+	if(time1 <= time0)
+		return ERROR;
+	/* Simple overflow catcher (same as in rrdtool, rrd_update.c) */
+	if(counter) {
+		if(delta < 0.0)
+			delta += 4294967296.0; /* 2^32 */
+		if(delta < 0.0)
+			delta += 18446744069414584320.0; /* 2^64-2^32 */
+	}
+	*rate = delta / (time1 - time0);
+	return OK;
+}
+
+int np_series_rate(const np_series *series, int index, int counter, double *rate) {
+	if(series->count < 2 || index < 0 || index >= series->values)
+		return ERROR;
+	return _np_rate(np_series_time(series, 1), np_series_value(series, 1, index),
+	                np_series_time(series, 0), np_series_value(series, 0, index), counter, rate);
+}
+
+int np_series_rate_to(const np_series *series, int index, int counter, time_t data_time, double value, double *rate) {
+	if(series->count < 1 || index < 0 || index >= series->values)
+		return ERROR;
+	return _np_rate(np_series_time(series, 0), np_series_value(series, 0, index),
+	                data_time, value, counter, rate);
+}
+
+int np_series_ewma(const np_series *series, int index, double alpha, double *average) {
+	int age;
+
+	if(series->count < 1 || index < 0 || index >= series->values)
+		return ERROR;
+	*average = np_series_value(series, series->count - 1, index);
+	for(age = series->count - 2; age >= 0; age--)
+		*average = alpha * np_series_value(series, age, index) + (1.0 - alpha) * *average;
+	return OK;
+}
+
+int np_series_trend(const np_series *series, int index, double *slope, double *value) {
+	double x, y, sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0, n = series->count, d;
+	int age;
+
+	if(series->count < 2 || index < 0 || index >= series->values)
+		return ERROR;
+	/* Times relative to the newest sample keep the sums small */
+	for(age = 0; age < series->count; age++) {
+		x = (double)(np_series_time(series, age) - np_series_time(series, 0));
+		y = np_series_value(series, age, index);
+		sx += x;
+		sy += y;
+		sxx += x * x;
+		sxy += x * y;
+	}
+	d = n * sxx - sx * sx;
+	if(d == 0.0)
+		return ERROR;
+	*slope = (n * sxy - sx * sy) / d;
+	*value = (sy - *slope * sx) / n;
+	return OK;
+}
+
+int np_series_project(const np_series *series, int index, time_t data_time, double *value) {
+	double slope;
+
+	if(np_series_trend(series, index, &slope, value) != OK)
+		return ERROR;
+	*value += slope * (double)(data_time - np_series_time(series, 0));
+	return OK;
+}
+
+int np_series_time_to(const np_series *series, int index, double value, double *seconds) {
+	double slope, now;
+
+	if(np_series_trend(series, index, &slope, &now) != OK || slope == 0.0)
+		return ERROR;
+	*seconds = (value - now) / slope;
+	return *seconds < 0.0 ? ERROR : OK;
+}
@@ -32,6 +32,20 @@ typedef struct thresholds_struct {
 	char    *critical_string;
 	} thresholds;
 
+/* Thresholds flattened for get_status_batch(), one entry per threshold.
+ * Unset ends are infinite; the masks are 0 or -1. */
+typedef struct np_thresholds_batch_struct {
+	size_t  count;
+	double  *warning_start;
+	double  *warning_end;
+	double  *critical_start;
+	double  *critical_end;
+	int64_t *warning_outside;     /* alert_on == OUTSIDE */
+	int64_t *warning_unbounded;   /* neither start nor end */
+	int64_t *critical_outside;
+	int64_t *critical_unbounded;
+	} np_thresholds_batch;
+
 #define NP_STATE_FORMAT_VERSION 1
 
 typedef struct state_data_struct {
@@ -41,19 +55,35 @@ typedef struct state_data_struct {
 	} state_data;
 
 
+struct np_state_store;
+
 typedef struct state_key_struct {
 	char       *name;
 	char       *plugin_name;
 	int        data_version;
 	char       *_filename;
 	state_data *state_data;
+	char       *_store_filename;        /* NULL to only use _filename */
+	char       *_store_key;
+	struct np_state_store *_store;
 	} state_key;
 
+/* The newest samples of one or more values, kept in the state as a ring */
+typedef struct np_series_struct {
+	int     values;   /* per sample */
+	int     size;     /* samples kept */
+	int     count;    /* samples held */
+	int     first;    /* ring position of the oldest */
+	time_t  *time;
+	double  *value;   /* values per sample, in ring order */
+	} np_series;
+
 typedef struct np_struct {
 	char      *plugin_name;
 	state_key *state;
 	int       argc;
 	char      **argv;
+	int       verbose;  /* report state kept in files instead of the store */
 	} nagios_plugin;
 
 range *parse_range_string (char *);
@@ -63,6 +93,16 @@ void print_thresholds(const char *, thresholds *);
 int check_range(double, range *);
 int get_status(double, thresholds *);
 
+/* Compile count thresholds (NULL entries never alert) for get_status_batch */
+np_thresholds_batch *np_thresholds_compile(thresholds **, size_t count);
+void np_thresholds_batch_free(np_thresholds_batch *);
+/* Thresholds first to first+count-1 of a batch, sharing its storage */
+np_thresholds_batch np_thresholds_slice(const np_thresholds_batch *, size_t first, size_t count);
+/* get_status() of count values into states, with threshold i for value i,
+ * or the one threshold for all of them.  Returns the worst state. With more
+ * than one threshold, only as many values as thresholds are evaluated. */
+int get_status_batch(const np_thresholds_batch *, const double *values, int *states, size_t count);
+
 /* All possible characters in a threshold range */
 #define NP_THRESHOLDS_CHARS "-0123456789.:@~"
 
@@ -105,9 +145,46 @@ char *np_extract_value(const char*, const char*, char);
 void np_enable_state(char *, int);
 state_data *np_state_read(void);
 void np_state_write_string(time_t, char *);
+/* NAGIOS_PLUGIN_STATE_DIRECTORY, or the compiled in state directory */
+char *_np_state_calculate_location_prefix(void);
+
+/*
+ * Time series in the state. Samples are numbered by age, 0 is the newest.
+ * np_state_read_series() returns an empty series if there is no previous
+ * state or it held another number of values; np_state_write_series()
+ * keeps as many of the newest samples as fit in the state data, and at
+ * least the newest one.
+ */
+np_series *np_series_new(int values, int size);
+void np_series_free(np_series *);
+void np_series_add(np_series *, time_t, const double *);
+time_t np_series_time(const np_series *, int age);
+double np_series_value(const np_series *, int age, int index);
+np_series *np_state_read_series(int values, int size);
+void np_state_write_series(np_series *);
+
+/*
+ * Per second rate of value index between the two newest samples, or from
+ * the newest sample to a new value. With counter, a decrease is taken as
+ * a 32 or 64 bit counter wrap. ERROR if there are not enough samples or no
+ * time between them.
+ */
+int np_series_rate(const np_series *, int index, int counter, double *rate);
+int np_series_rate_to(const np_series *, int index, int counter, time_t, double value, double *rate);
+/* Exponentially weighted moving average of value index, oldest first */
+int np_series_ewma(const np_series *, int index, double alpha, double *average);
+/* Least squares line of value index: change per second and the value it
+ * gives at the time of the newest sample. ERROR with fewer than two
+ * samples or all at the same time */
+int np_series_trend(const np_series *, int index, double *slope, double *value);
+/* The value the trend gives at a time, and the seconds from the newest
+ * sample until it reaches a value (ERROR if it never does) */
+int np_series_project(const np_series *, int index, time_t, double *value);
+int np_series_time_to(const np_series *, int index, double value, double *seconds);
 
 void np_init(char *, int argc, char **argv);
 void np_set_args(int argc, char **argv);
+void np_set_verbose(int verbose);
 void np_cleanup(void);
 
 /* np_suid() returns true if the real and effective uids differs, such as when
@@ -0,0 +1,762 @@
+/*****************************************************************************
+*
+* Library for DNS queries
+*
+* License: GPL
+* Copyright (c) 2018 Nagios Plugins Development Team
+*
+* Description:
+*
+* This file contains a small stub resolver for check_dns and check_dig: it
+* builds queries, parses responses and talks to the server over UDP with
+* a TCP fallback.  The packet handling is tested by libtap.
+*
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*
+*****************************************************************************/
+
+#include "common.h"
+#include "utils_dns.h"
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <fcntl.h>
+
+#define DNS_HEADER_LEN	12
+#define DNS_RETRY_MS	1000
+#define DNS_MAX_JUMPS	64
+
+static const struct {
+	const char *name;
+	int type;
+} dns_types[] = {
+	{ "A", NP_DNS_A },
+	{ "NS", NP_DNS_NS },
+	{ "CNAME", NP_DNS_CNAME },
+	{ "SOA", NP_DNS_SOA },
+	{ "WKS", NP_DNS_WKS },
+	{ "PTR", NP_DNS_PTR },
+	{ "MX", NP_DNS_MX },
+	{ "TXT", NP_DNS_TXT },
+	{ "AAAA", NP_DNS_AAAA },
+	{ "SRV", NP_DNS_SRV },
+	{ "DNAME", NP_DNS_DNAME },
+	{ "ANY", NP_DNS_ANY },
+	{ NULL, 0 }
+};
+
+int
+np_dns_type(const char *name)
+{
+	int i;
+
+	for (i = 0; dns_types[i].name != NULL; i++)
+		if (strcasecmp(name, dns_types[i].name) == 0)
+			return dns_types[i].type;
+	return -1;
+}
+
+const char *
+np_dns_type_name(int type)
+{
+	int i;
+
+	for (i = 0; dns_types[i].name != NULL; i++)
+		if (dns_types[i].type == type)
+			return dns_types[i].name;
+	return "UNKNOWN";
+}
+
+const char *
+np_dns_rcode_name(int rcode)
+{
+	static const char *names[] = {
+		"NOERROR", "FORMERR", "SERVFAIL", "NXDOMAIN", "NOTIMP", "REFUSED"
+	};
+
+	if (rcode >= 0 && rcode < (int)(sizeof(names) / sizeof(names[0])))
+		return names[rcode];
+	return "UNKNOWN";
+}
+
+const char *
+np_dns_strerror(int status)
+{
+	switch (status) {
+	case NP_DNS_OK:
+		return "ok";
+	case NP_DNS_PENDING:
+		return "no answer";
+	case NP_DNS_ERESOLVE:
+		return "could not resolve server";
+	case NP_DNS_ENAME:
+		return "invalid name";
+	case NP_DNS_ESOCKET:
+		return "socket error";
+	case NP_DNS_EREFUSED:
+		return "connection refused";
+	case NP_DNS_ETIMEOUT:
+		return "timed out";
+	case NP_DNS_EPARSE:
+		return "malformed response";
+	}
+	return "unknown error";
+}
+
+int
+np_dns_build_query(unsigned char *buf, size_t size, unsigned int id,
+                   const char *name, int type)
+{
+	size_t pos = DNS_HEADER_LEN, label;
+	const char *p = name, *dot;
+
+	if (size < DNS_HEADER_LEN + 1 + 4)
+		return -1;
+	memset(buf, 0, DNS_HEADER_LEN);
+	buf[0] = (id >> 8) & 0xff;
+	buf[1] = id & 0xff;
+	buf[2] = 0x01;          /* RD */
+	buf[5] = 1;             /* QDCOUNT */
+
+	/* "." and "" are the root, anything else is a dot separated list of
+	 * labels with an optional trailing dot */
+	if (strcmp(p, ".") == 0)
+		p++;
+	while (*p) {
+		dot = strchr(p, '.');
+		label = dot ? (size_t)(dot - p) : strlen(p);
+		if (label == 0 || label > 63)
+			return -1;
+		if (pos + 1 + label + 1 + 4 > size || pos + 1 + label > DNS_HEADER_LEN + 254)
+			return -1;
+		buf[pos++] = label;
+		memcpy(buf + pos, p, label);
+		pos += label;
+		p += label;
+		if (*p == '.')
+			p++;
+	}
+	buf[pos++] = 0;
+	buf[pos++] = (type >> 8) & 0xff;
+	buf[pos++] = type & 0xff;
+	buf[pos++] = 0;
+	buf[pos++] = NP_DNS_CLASS_IN;
+	return pos;
+}
+
+/* reads a possibly compressed name at *pos into out in presentation form
+ * and moves *pos past it.  returns -1 on malformed names. */
+static int
+dns_read_name(const unsigned char *buf, size_t len, size_t *pos, char *out)
+{
+	size_t p = *pos, o = 0, end = 0, wire = 0;
+	int jumps = 0, i;
+	unsigned char c;
+
+	for (;;) {
+		if (p >= len)
+			return -1;
+		c = buf[p];
+		if ((c & 0xc0) == 0xc0) {
+			if (p + 1 >= len || ++jumps > DNS_MAX_JUMPS)
+				return -1;
+			if (!end)
+				end = p + 2;
+			p = ((c & 0x3f) << 8) | buf[p + 1];
+			continue;
+		}
+		if (c & 0xc0)
+			return -1;
+		p++;
+		if (c == 0)
+			break;
+		if (p + c > len || (wire += c + 1) > 255)
+			return -1;
+		for (i = 0; i < c; i++, p++) {
+			if (o + 5 >= NP_DNS_MAXNAME)
+				return -1;
+			if (buf[p] == '.' || buf[p] == '\\' || buf[p] == '"') {
+				out[o++] = '\\';
+				out[o++] = buf[p];
+			} else if (buf[p] <= ' ' || buf[p] >= 0x7f) {
+				o += sprintf(out + o, "\\%03u", buf[p]);
+			} else {
+				out[o++] = buf[p];
+			}
+		}
+		out[o++] = '.';
+	}
+	if (o == 0)
+		out[o++] = '.';
+	out[o] = '\0';
+	*pos = end ? end : p;
+	return 0;
+}
+
+static unsigned int
+dns_u16(const unsigned char *p)
+{
+	return (p[0] << 8) | p[1];
+}
+
+static unsigned long
+dns_u32(const unsigned char *p)
+{
+	return ((unsigned long)p[0] << 24) | ((unsigned long)p[1] << 16) |
+	    ((unsigned long)p[2] << 8) | p[3];
+}
+
+/* formats the rdata at buf[pos..pos+rdlen) of a record of the given type */
+static char *
+dns_format_rdata(const unsigned char *buf, size_t len, size_t pos,
+                 size_t rdlen, int type)
+{
+	char name[NP_DNS_MAXNAME], name2[NP_DNS_MAXNAME];
+	char addr[INET6_ADDRSTRLEN];
+	size_t end = pos + rdlen, p = pos, o = 0, i, n;
+	char *data = NULL;
+
+	switch (type) {
+	case NP_DNS_A:
+		if (rdlen != 4 || inet_ntop(AF_INET, buf + pos, addr, sizeof(addr)) == NULL)
+			return NULL;
+		return strdup(addr);
+	case NP_DNS_AAAA:
+		if (rdlen != 16 || inet_ntop(AF_INET6, buf + pos, addr, sizeof(addr)) == NULL)
+			return NULL;
+		return strdup(addr);
+	case NP_DNS_NS:
+	case NP_DNS_CNAME:
+	case NP_DNS_PTR:
+	case NP_DNS_DNAME:
+		if (dns_read_name(buf, len, &p, name) < 0 || p != end)
+			return NULL;
+		return strdup(name);
+	case NP_DNS_MX:
+		if (rdlen < 3)
+			return NULL;
+		p += 2;
+		if (dns_read_name(buf, len, &p, name) < 0 || p != end)
+			return NULL;
+		if (asprintf(&data, "%u %s", dns_u16(buf + pos), name) < 0)
+			return NULL;
+		return data;
+	case NP_DNS_SRV:
+		if (rdlen < 7)
+			return NULL;
+		p += 6;
+		if (dns_read_name(buf, len, &p, name) < 0 || p != end)
+			return NULL;
+		if (asprintf(&data, "%u %u %u %s", dns_u16(buf + pos),
+		    dns_u16(buf + pos + 2), dns_u16(buf + pos + 4), name) < 0)
+			return NULL;
+		return data;
+	case NP_DNS_SOA:
+		if (dns_read_name(buf, len, &p, name) < 0 ||
+		    dns_read_name(buf, len, &p, name2) < 0 || p + 20 != end)
+			return NULL;
+		if (asprintf(&data, "%s %s %lu %lu %lu %lu %lu", name, name2,
+		    dns_u32(buf + p), dns_u32(buf + p + 4), dns_u32(buf + p + 8),
+		    dns_u32(buf + p + 12), dns_u32(buf + p + 16)) < 0)
+			return NULL;
+		return data;
+	case NP_DNS_WKS:
+		/* address, protocol number and the ports set in the bitmap */
+		if (rdlen < 5 || inet_ntop(AF_INET, buf + pos, addr, sizeof(addr)) == NULL)
+			return NULL;
+		if ((data = malloc(INET6_ADDRSTRLEN + 4 + (rdlen - 5) * 8 * 6)) == NULL)
+			return NULL;
+		o = sprintf(data, "%s %u", addr, buf[pos + 4]);
+		for (i = 0; i < (rdlen - 5) * 8; i++)
+			if (buf[pos + 5 + i / 8] & (0x80 >> (i % 8)))
+				o += sprintf(data + o, " %lu", (unsigned long)i);
+		return data;
+	case NP_DNS_TXT:
+		/* each character-string quoted, escaping like dig does */
+		if ((data = malloc(rdlen * 4 + 3 * rdlen + 1)) == NULL)
+			return NULL;
+		while (p < end) {
+			n = buf[p++];
+			if (p + n > end) {
+				free(data);
+				return NULL;
+			}
+			if (o)
+				data[o++] = ' ';
+			data[o++] = '"';
+			for (i = 0; i < n; i++, p++) {
+				if (buf[p] == '"' || buf[p] == '\\') {
+					data[o++] = '\\';
+					data[o++] = buf[p];
+				} else if (buf[p] < ' ' || buf[p] >= 0x7f) {
+					o += sprintf(data + o, "\\%03u", buf[p]);
+				} else {
+					data[o++] = buf[p];
+				}
+			}
+			data[o++] = '"';
+		}
+		data[o] = '\0';
+		return data;
+	}
+
+	/* anything else in the generic form of rfc3597 */
+	if ((data = malloc(16 + rdlen * 2)) == NULL)
+		return NULL;
+	o = sprintf(data, "\\# %lu", (unsigned long)rdlen);
+	if (rdlen)
+		data[o++] = ' ';
+	for (i = 0; i < rdlen; i++)
+		o += sprintf(data + o, "%02x", buf[pos + i]);
+	return data;
+}
+
+static int
+dns_read_section(const unsigned char *buf, size_t len, size_t *pos,
+                 int count, np_dns_rr **rrs, int *nrrs)
+{
+	char name[NP_DNS_MAXNAME];
+	size_t rdlen;
+	np_dns_rr *rr;
+	int i;
+
+	*nrrs = 0;
+	if (count == 0)
+		return 0;
+	if ((*rrs = calloc(count, sizeof(np_dns_rr))) == NULL)
+		return -1;
+	for (i = 0; i < count; i++) {
+		if (dns_read_name(buf, len, pos, name) < 0 || *pos + 10 > len)
+			return -1;
+		rr = &(*rrs)[i];
+		rr->type = dns_u16(buf + *pos);
+		rr->class = dns_u16(buf + *pos + 2);
+		rr->ttl = dns_u32(buf + *pos + 4);
+		rdlen = dns_u16(buf + *pos + 8);
+		*pos += 10;
+		if (*pos + rdlen > len)
+			return -1;
+		rr->name = strdup(name);
+		rr->data = dns_format_rdata(buf, len, *pos, rdlen, rr->type);
+		(*nrrs)++;
+		if (rr->name == NULL || rr->data == NULL)
+			return -1;
+		*pos += rdlen;
+	}
+	return 0;
+}
+
+int
+np_dns_parse_response(const unsigned char *buf, size_t len,
+                      np_dns_response *response)
+{
+	char name[NP_DNS_MAXNAME];
+	size_t pos = DNS_HEADER_LEN;
+	int i, qdcount;
+
+	memset(response, 0, sizeof(np_dns_response));
+	if (len < DNS_HEADER_LEN || !(buf[2] & 0x80))
+		return -1;
+	response->id = dns_u16(buf);
+	response->aa = (buf[2] & 0x04) != 0;
+	response->tc = (buf[2] & 0x02) != 0;
+	response->ra = (buf[3] & 0x80) != 0;
+	response->rcode = buf[3] & 0x0f;
+
+	qdcount = dns_u16(buf + 4);
+	for (i = 0; i < qdcount; i++) {
+		if (dns_read_name(buf, len, &pos, name) < 0 || pos + 4 > len)
+			return -1;
+		pos += 4;
+	}
+	if (dns_read_section(buf, len, &pos, dns_u16(buf + 6),
+	        &response->answer, &response->nanswer) < 0 ||
+	    dns_read_section(buf, len, &pos, dns_u16(buf + 8),
+	        &response->authority, &response->nauthority) < 0 ||
+	    dns_read_section(buf, len, &pos, dns_u16(buf + 10),
+	        &response->additional, &response->nadditional) < 0) {
+		/* a truncated answer may end anywhere; keep what we got */
+		if (response->tc)
+			return 0;
+		np_dns_response_free(response);
+		return -1;
+	}
+	return 0;
+}
+
+static void
+dns_free_section(np_dns_rr *rrs, int nrrs)
+{
+	int i;
+
+	for (i = 0; i < nrrs; i++) {
+		free(rrs[i].name);
+		free(rrs[i].data);
+	}
+	free(rrs);
+}
+
+void
+np_dns_response_free(np_dns_response *response)
+{
+	dns_free_section(response->answer, response->nanswer);
+	dns_free_section(response->authority, response->nauthority);
+	dns_free_section(response->additional, response->nadditional);
+	response->answer = response->authority = response->additional = NULL;
+	response->nanswer = response->nauthority = response->nadditional = 0;
+}
+
+char *
+np_dns_reverse_name(const char *address)
+{
+	unsigned char addr[16];
+	char *name, *p;
+	int i;
+
+	if (inet_pton(AF_INET, address, addr) == 1) {
+		if (asprintf(&name, "%u.%u.%u.%u.in-addr.arpa.",
+		    addr[3], addr[2], addr[1], addr[0]) < 0)
+			return NULL;
+		return name;
+	}
+	if (inet_pton(AF_INET6, address, addr) == 1) {
+		if ((p = name = malloc(16 * 4 + sizeof("ip6.arpa."))) == NULL)
+			return NULL;
+		for (i = 15; i >= 0; i--)
+			p += sprintf(p, "%x.%x.", addr[i] & 0x0f, addr[i] >> 4);
+		strcpy(p, "ip6.arpa.");
+		return name;
+	}
+	return NULL;
+}
+
+char *
+np_dns_default_server(void)
+{
+	char line[1024], server[1024];
+	FILE *fp;
+
+	if ((fp = fopen("/etc/resolv.conf", "r")) != NULL) {
+		while (fgets(line, sizeof(line), fp) != NULL) {
+			if (sscanf(line, " nameserver %1023s", server) == 1) {
+				fclose(fp);
+				return strdup(server);
+			}
+		}
+		fclose(fp);
+	}
+	return strdup("127.0.0.1");
+}
+
+static long
+dns_elapsed_ms(const struct timeval *from)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - from->tv_sec) * 1000 +
+	    (now.tv_usec - from->tv_usec) / 1000;
+}
+
+/* the round trip time, in seconds */
+static double
+dns_elapsed(const struct timeval *from)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (double)(now.tv_sec - from->tv_sec) +
+	    (double)(now.tv_usec - from->tv_usec) / 1.0e6;
+}
+
+/* phases of the retry of a truncated answer over TCP */
+enum {
+	DNS_TCP_NONE = 0,
+	DNS_TCP_CONNECT,
+	DNS_TCP_SEND,
+	DNS_TCP_LENGTH,
+	DNS_TCP_BODY
+};
+
+/* per query transport state for np_dns_send_queries() */
+typedef struct {
+	int sd;
+	unsigned char packet[DNS_HEADER_LEN + 260];
+	int plen;
+	struct timeval first;    /* the first send, the rtt is measured from it */
+	struct timeval sent;     /* the last send, for the resends */
+	struct sockaddr_storage addr;
+	socklen_t addrlen;
+	int tcp;                 /* DNS_TCP_* */
+	int tcp_sd;
+	unsigned char *tcp_buf;
+	size_t tcp_len, tcp_off;
+	struct timeval tcp_sent;
+} dns_transport;
+
+static void
+dns_tcp_close(dns_transport *t)
+{
+	if (t->tcp_sd >= 0)
+		close(t->tcp_sd);
+	free(t->tcp_buf);
+	t->tcp_buf = NULL;
+	t->tcp_sd = -1;
+	t->tcp = DNS_TCP_NONE;
+}
+
+/* starts asking the query again over TCP, as rfc1035 4.2.2 wants after a
+ * truncated UDP answer.  the exchange is driven by dns_tcp_step() from the
+ * poll loop, so it holds up none of the other queries.  returns -1 if the
+ * connection can not even be started. */
+static int
+dns_tcp_start(dns_transport *t, struct pollfd *pfd)
+{
+	int flags;
+
+	if ((t->tcp_sd = socket(t->addr.ss_family, SOCK_STREAM, IPPROTO_TCP)) < 0)
+		return -1;
+	flags = fcntl(t->tcp_sd, F_GETFL, 0);
+	fcntl(t->tcp_sd, F_SETFL, flags | O_NONBLOCK);
+
+	/* messages are prefixed with their length in two bytes */
+	if ((t->tcp_buf = malloc(t->plen + 2)) == NULL) {
+		dns_tcp_close(t);
+		return -1;
+	}
+	t->tcp_buf[0] = (t->plen >> 8) & 0xff;
+	t->tcp_buf[1] = t->plen & 0xff;
+	memcpy(t->tcp_buf + 2, t->packet, t->plen);
+	t->tcp_len = t->plen + 2;
+	t->tcp_off = 0;
+
+	gettimeofday(&t->tcp_sent, NULL);
+	if (connect(t->tcp_sd, (struct sockaddr *)&t->addr, t->addrlen) < 0 &&
+	    errno != EINPROGRESS) {
+		dns_tcp_close(t);
+		return -1;
+	}
+	t->tcp = DNS_TCP_CONNECT;
+	pfd->fd = t->tcp_sd;
+	pfd->events = POLLOUT;
+	return 0;
+}
+
+/* moves the TCP exchange on after poll() reported its socket ready.
+ * returns 0 while there is more to do, 1 once it is over.  the response of
+ * the query is only replaced on success, otherwise the truncated answer is
+ * kept. */
+static int
+dns_tcp_step(np_dns_query *query, dns_transport *t, struct pollfd *pfd)
+{
+	np_dns_response response;
+	unsigned char *buf;
+	socklen_t errlen = sizeof(int);
+	ssize_t n;
+	int err = 0;
+
+	switch (t->tcp) {
+	case DNS_TCP_CONNECT:
+		if (getsockopt(t->tcp_sd, SOL_SOCKET, SO_ERROR, &err, &errlen) < 0 || err)
+			return 1;
+		t->tcp = DNS_TCP_SEND;
+		/* FALLTHROUGH */
+	case DNS_TCP_SEND:
+		n = send(t->tcp_sd, t->tcp_buf + t->tcp_off, t->tcp_len - t->tcp_off, 0);
+		if (n < 0)
+			return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : 1;
+		if ((t->tcp_off += n) < t->tcp_len)
+			return 0;
+		t->tcp = DNS_TCP_LENGTH;
+		t->tcp_len = 2;
+		t->tcp_off = 0;
+		pfd->events = POLLIN;
+		return 0;
+	case DNS_TCP_LENGTH:
+	case DNS_TCP_BODY:
+		n = recv(t->tcp_sd, t->tcp_buf + t->tcp_off, t->tcp_len - t->tcp_off, 0);
+		if (n < 0)
+			return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? 0 : 1;
+		if (n == 0)
+			return 1;
+		if ((t->tcp_off += n) < t->tcp_len)
+			return 0;
+		if (t->tcp == DNS_TCP_LENGTH) {
+			t->tcp_len = dns_u16(t->tcp_buf);
+			if (t->tcp_len < DNS_HEADER_LEN ||
+			    (buf = realloc(t->tcp_buf, t->tcp_len)) == NULL)
+				return 1;
+			t->tcp_buf = buf;
+			t->tcp_off = 0;
+			t->tcp = DNS_TCP_BODY;
+			return 0;
+		}
+		if (np_dns_parse_response(t->tcp_buf, t->tcp_len, &response) < 0)
+			return 1;
+		if ((unsigned int)response.id != dns_u16(t->packet)) {
+			np_dns_response_free(&response);
+			return 1;
+		}
+		np_dns_response_free(&query->response);
+		query->response = response;
+		query->response.rtt = dns_elapsed(&t->tcp_sent);
+		query->response.tcp = 1;
+		return 1;
+	}
+	return 1;
+}
+
+int
+np_dns_send_queries(np_dns_query *queries, int nqueries, int timeout_ms)
+{
+	unsigned char buf[65536];
+	char port[8];
+	struct addrinfo hints, *ai;
+	struct pollfd *pfds;
+	struct timeval start;
+	dns_transport *t;
+	long elapsed, wait;
+	ssize_t len;
+	int i, pending = 0, answered = 0;
+
+	t = calloc(nqueries, sizeof(dns_transport));
+	pfds = calloc(nqueries, sizeof(struct pollfd));
+	if (t == NULL || pfds == NULL) {
+		free(t);
+		free(pfds);
+		for (i = 0; i < nqueries; i++)
+			queries[i].status = NP_DNS_ESOCKET;
+		return 0;
+	}
+	srandom(time(NULL) ^ getpid());
+	gettimeofday(&start, NULL);
+
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_socktype = SOCK_DGRAM;
+	hints.ai_protocol = IPPROTO_UDP;
+	for (i = 0; i < nqueries; i++) {
+		memset(&queries[i].response, 0, sizeof(np_dns_response));
+		pfds[i].fd = t[i].sd = t[i].tcp_sd = -1;
+		pfds[i].events = POLLIN;
+
+		snprintf(port, sizeof(port), "%d", queries[i].port ? queries[i].port : NP_DNS_PORT);
+		if (getaddrinfo(queries[i].server, port, &hints, &ai) != 0) {
+			queries[i].status = NP_DNS_ERESOLVE;
+			continue;
+		}
+		memcpy(&t[i].addr, ai->ai_addr, ai->ai_addrlen);
+		t[i].addrlen = ai->ai_addrlen;
+		freeaddrinfo(ai);
+
+		t[i].plen = np_dns_build_query(t[i].packet, sizeof(t[i].packet),
+		    random() & 0xffff, queries[i].name, queries[i].type);
+		if (t[i].plen < 0) {
+			queries[i].status = NP_DNS_ENAME;
+			continue;
+		}
+		/* connected, so that ICMP port unreachable shows up as an error
+		 * and only the server's answers are received */
+		t[i].sd = socket(t[i].addr.ss_family, SOCK_DGRAM, IPPROTO_UDP);
+		if (t[i].sd < 0 ||
+		    connect(t[i].sd, (struct sockaddr *)&t[i].addr, t[i].addrlen) < 0 ||
+		    send(t[i].sd, t[i].packet, t[i].plen, 0) != t[i].plen) {
+			queries[i].status = NP_DNS_ESOCKET;
+			continue;
+		}
+		gettimeofday(&t[i].first, NULL);
+		t[i].sent = t[i].first;
+		pfds[i].fd = t[i].sd;
+		queries[i].status = NP_DNS_PENDING;
+		pending++;
+	}
+
+	while (pending > 0) {
+		elapsed = dns_elapsed_ms(&start);
+		if (elapsed >= timeout_ms)
+			break;
+		/* resend what is still unanswered once a second */
+		wait = timeout_ms - elapsed;
+		for (i = 0; i < nqueries; i++) {
+			if (queries[i].status != NP_DNS_PENDING)
+				continue;
+			if (dns_elapsed_ms(&t[i].sent) >= DNS_RETRY_MS) {
+				send(t[i].sd, t[i].packet, t[i].plen, 0);
+				gettimeofday(&t[i].sent, NULL);
+			}
+			if (DNS_RETRY_MS - dns_elapsed_ms(&t[i].sent) < wait)
+				wait = DNS_RETRY_MS - dns_elapsed_ms(&t[i].sent);
+		}
+		if (poll(pfds, nqueries, wait > 0 ? wait : 0) <= 0)
+			continue;
+
+		for (i = 0; i < nqueries; i++) {
+			if (pfds[i].fd < 0 || !pfds[i].revents)
+				continue;
+			if (t[i].tcp) {
+				if (dns_tcp_step(&queries[i], &t[i], &pfds[i])) {
+					dns_tcp_close(&t[i]);
+					pfds[i].fd = -1;
+					pending--;
+				}
+				continue;
+			}
+			if (!(pfds[i].revents & (POLLIN | POLLERR)))
+				continue;
+			len = recv(t[i].sd, buf, sizeof(buf), 0);
+			if (len < 0) {
+				if (errno == ECONNREFUSED) {
+					queries[i].status = NP_DNS_EREFUSED;
+					pfds[i].fd = -1;
+					pending--;
+				}
+				continue;
+			}
+			/* ignore anything that is not the answer to our query.  the
+			 * resends keep the id, so this may be the answer to any of
+			 * them, and the rtt is taken from the first send */
+			if (len < DNS_HEADER_LEN || dns_u16(buf) != dns_u16(t[i].packet) ||
+			    !(buf[2] & 0x80))
+				continue;
+			if (np_dns_parse_response(buf, len, &queries[i].response) < 0) {
+				queries[i].status = NP_DNS_EPARSE;
+			} else {
+				queries[i].response.rtt = dns_elapsed(&t[i].first);
+				queries[i].status = NP_DNS_OK;
+				/* the query stays pending while it is asked again over
+				 * TCP.  if that fails or runs out of time the truncated
+				 * answer is kept, it is better than nothing */
+				if (queries[i].response.tc &&
+				    dns_tcp_start(&t[i], &pfds[i]) == 0)
+					continue;
+			}
+			pfds[i].fd = -1;
+			pending--;
+		}
+	}
+
+	for (i = 0; i < nqueries; i++) {
+		if (queries[i].status == NP_DNS_PENDING)
+			queries[i].status = NP_DNS_ETIMEOUT;
+		if (queries[i].status == NP_DNS_OK)
+			answered++;
+		if (t[i].sd >= 0)
+			close(t[i].sd);
+		dns_tcp_close(&t[i]);
+	}
+	free(t);
+	free(pfds);
+	return answered;
+}
@@ -0,0 +1,112 @@
+/* Header file for utils_dns */
+
+#ifndef _UTILS_DNS_
+#define _UTILS_DNS_
+
+#include <stddef.h>
+
+/* resource record types */
+#define NP_DNS_A         1
+#define NP_DNS_NS        2
+#define NP_DNS_CNAME     5
+#define NP_DNS_SOA       6
+#define NP_DNS_WKS       11
+#define NP_DNS_PTR       12
+#define NP_DNS_MX        15
+#define NP_DNS_TXT       16
+#define NP_DNS_AAAA      28
+#define NP_DNS_SRV       33
+#define NP_DNS_DNAME     39
+#define NP_DNS_ANY       255
+
+#define NP_DNS_CLASS_IN  1
+
+/* response codes */
+#define NP_DNS_NOERROR   0
+#define NP_DNS_FORMERR   1
+#define NP_DNS_SERVFAIL  2
+#define NP_DNS_NXDOMAIN  3
+#define NP_DNS_NOTIMP    4
+#define NP_DNS_REFUSED   5
+
+/* errors of np_dns_send_queries(), besides NP_DNS_OK */
+enum np_dns_status {
+	NP_DNS_OK = 0,
+	NP_DNS_PENDING,          /* not answered (yet) */
+	NP_DNS_ERESOLVE,         /* could not resolve the server */
+	NP_DNS_ENAME,            /* the name can not be put in a query */
+	NP_DNS_ESOCKET,          /* could not create or use a socket */
+	NP_DNS_EREFUSED,         /* the server port is closed */
+	NP_DNS_ETIMEOUT,         /* no answer within the timeout */
+	NP_DNS_EPARSE            /* the answer could not be parsed */
+};
+
+#define NP_DNS_MAXNAME   1025    /* presentation form, with escapes */
+#define NP_DNS_PORT      53
+
+/* a resource record, with the rdata in presentation form as dig prints it,
+ * e.g. "10 mx.example.com." for MX or "\"some\" \"text\"" for TXT */
+typedef struct np_dns_rr {
+	char *name;
+	int type;
+	int class;
+	unsigned long ttl;
+	char *data;
+} np_dns_rr;
+
+typedef struct np_dns_response {
+	int id;
+	int rcode;
+	int aa;                  /* authoritative answer */
+	int tc;                  /* truncated */
+	int ra;                  /* recursion available */
+	np_dns_rr *answer;
+	int nanswer;
+	np_dns_rr *authority;
+	int nauthority;
+	np_dns_rr *additional;
+	int nadditional;
+	double rtt;              /* seconds from query to answer */
+	int tcp;                 /* answered over TCP after a truncated reply */
+} np_dns_response;
+
+/* one question to one server, for np_dns_send_queries() */
+typedef struct np_dns_query {
+	const char *server;      /* address or host name of the server */
+	int port;
+	const char *name;
+	int type;
+	int status;              /* enum np_dns_status */
+	np_dns_response response;
+} np_dns_query;
+
+int np_dns_type(const char *name);
+const char *np_dns_type_name(int type);
+const char *np_dns_rcode_name(int rcode);
+const char *np_dns_strerror(int status);
+
+/* builds a recursive query into buf, returns its length or -1 */
+int np_dns_build_query(unsigned char *buf, size_t size, unsigned int id,
+                       const char *name, int type);
+/* parses a response, returns 0 or -1 if it is malformed */
+int np_dns_parse_response(const unsigned char *buf, size_t len,
+                          np_dns_response *response);
+void np_dns_response_free(np_dns_response *response);
+
+/* the in-addr.arpa or ip6.arpa name of an address, or NULL if the string is
+ * not an address.  the result is malloc()ed. */
+char *np_dns_reverse_name(const char *address);
+
+/* the first nameserver in /etc/resolv.conf, or the loopback address */
+char *np_dns_default_server(void);
+
+/*
+ * Sends all queries at once over UDP and waits up to timeout_ms for the
+ * answers, resending every second.  Truncated answers are asked again over
+ * TCP, alongside the other queries.  Each query ends up with a status, and
+ * with NP_DNS_OK a response with its round trip time, counted from the
+ * first send.  Returns the number of queries answered.
+ */
+int np_dns_send_queries(np_dns_query *queries, int nqueries, int timeout_ms);
+
+#endif /* _UTILS_DNS_ */
@@ -0,0 +1,304 @@
+/*****************************************************************************
+*
+* Library for reading MRTG logs
+*
+* License: GPL
+* Copyright (c) 2026 Nagios Plugins Development Team
+*
+* Description:
+*
+* This file contains the reading of a time window of an MRTG log and its
+* aggregation, shared by check_mrtg and check_mrtgtraf.  These are tested
+* by libtap.
+*
+* MRTG rewrites its log on every run and keeps it sorted newest first, so
+* the samples of the last minutes are the lines at the top of the file.
+* Where they stop is found by probing the time of the line at doubling
+* offsets until one is too old and then bisecting between the last two
+* probes, a few short reads even when the log holds years of samples.
+*
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*
+*****************************************************************************/
+
+#include "common.h"
+#include "utils_mrtg.h"
+
+#include <sys/stat.h>
+
+/* more than an MRTG log line, which is a time and four numbers */
+#define LINE_READ 256
+
+/* The sample on the null terminated line, FALSE if it has no time */
+static int
+parse_sample(const char *line, np_mrtg_sample *s)
+{
+	char *p;
+	int i;
+
+	s->time = strtol(line, &p, 10);
+	if (p == line || s->time <= 0)
+		return FALSE;
+	for (i = 0; i < 2; i++)
+		s->avg[i] = strtoul(p, &p, 10);
+	for (i = 0; i < 2; i++)
+		s->max[i] = strtoul(p, &p, 10);
+	s->span = 0;
+	return TRUE;
+}
+
+/* Read len bytes at off, fewer only at the end of the file */
+static ssize_t
+read_at(int fd, char *buf, size_t len, off_t off)
+{
+	ssize_t n;
+	size_t got;
+
+	for (got = 0; got < len; got += n) {
+		if ((n = pread(fd, buf + got, len - got, off + got)) < 0)
+			return -1;
+		if (n == 0)
+			break;
+	}
+	return got;
+}
+
+/*
+ * The first line starting after off, in *start, and its time in *t.  FALSE
+ * if there is none before size.
+ */
+static int
+line_after(int fd, off_t off, off_t size, off_t *start, time_t *t)
+{
+	char buf[LINE_READ + 1], *nl;
+	ssize_t n;
+
+	for (;;) {
+		if (off >= size)
+			return FALSE;
+		if ((n = read_at(fd, buf, (size - off < LINE_READ) ? size - off : LINE_READ, off)) <= 0)
+			return FALSE;
+		if ((nl = memchr(buf, '\n', n)) != NULL)
+			break;
+		off += n;
+	}
+	*start = off + (nl - buf) + 1;
+	if (*start >= size)
+		return FALSE;
+
+	if ((n = read_at(fd, buf, (size - *start < LINE_READ) ? size - *start : LINE_READ, *start)) <= 0)
+		return FALSE;
+	buf[n] = '\0';
+	*t = strtol(buf, NULL, 10);
+	return TRUE;
+}
+
+
+int
+np_mrtg_aggregation(const char *name, double *pct)
+{
+	char *end;
+	double p;
+
+	if (!strcmp(name, "MAX"))
+		return NP_MRTG_MAX;
+	if (name[0] == 'P' && name[1] != '\0') {
+		p = strtod(name + 1, &end);
+		if (*end == '\0' && p >= 0 && p <= 100) {
+			*pct = p;
+			return NP_MRTG_PCT;
+		}
+	}
+	return NP_MRTG_AVG;
+}
+
+
+int
+np_mrtg_window(int fd, time_t window, np_mrtg_sample **samples)
+{
+	struct stat st;
+	char head[2 * LINE_READ + 1], *buf, *p, *nl, *end;
+	np_mrtg_sample newest, *s;
+	off_t data, lo, hi, mid, step, stop, start;
+	time_t cutoff, t, before, lower;
+	ssize_t n;
+	int count, i;
+
+	*samples = NULL;
+	if (fstat(fd, &st) < 0)
+		return -1;
+
+	/* the counter readings, then the newest sample */
+	if ((n = read_at(fd, head, (st.st_size < (off_t)sizeof(head)) ? st.st_size : sizeof(head) - 1, 0)) <= 0)
+		return -1;
+	head[n] = '\0';
+	if ((nl = memchr(head, '\n', n)) == NULL)
+		return -1;
+	data = nl + 1 - head;
+	p = nl + 1;
+	if ((nl = strchr(p, '\n')) != NULL)
+		*nl = '\0';
+	if (!parse_sample(p, &newest))
+		return -1;
+
+	if (window <= 0) {
+		*samples = malloc(sizeof(np_mrtg_sample));
+		if (*samples == NULL)
+			return -1;
+		**samples = newest;
+		return 1;
+	}
+	cutoff = newest.time - window;
+
+	/*
+	 * Where the samples newer than cutoff end: the first line after lo is
+	 * known to be one of them, and the first line after hi, in stop, not.
+	 */
+	lo = data - 1;
+	hi = stop = st.st_size;
+	before = 0;
+	for (step = LINE_READ; data + step < st.st_size; step *= 2) {
+		mid = data + step - 1;
+		if (line_after(fd, mid, st.st_size, &start, &t) && t > cutoff) {
+			lo = mid;
+			continue;
+		}
+		hi = mid;
+		break;
+	}
+	while (hi - lo > 1) {
+		mid = lo + (hi - lo) / 2;
+		if (line_after(fd, mid, st.st_size, &start, &t) && t > cutoff)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	if (hi < st.st_size && line_after(fd, hi, st.st_size, &stop, &before) == FALSE) {
+		stop = st.st_size;
+		before = 0;
+	}
+
+	/* then the window with one read */
+	if ((buf = malloc(stop - data + 1)) == NULL)
+		return -1;
+	if ((n = read_at(fd, buf, stop - data, data)) < 0) {
+		free(buf);
+		return -1;
+	}
+	buf[n] = '\0';
+	end = buf + n;
+
+	for (count = 1, p = buf; (p = memchr(p, '\n', end - p)) != NULL; p++)
+		count++;
+	if ((s = malloc(count * sizeof(np_mrtg_sample))) == NULL) {
+		free(buf);
+		return -1;
+	}
+	for (count = 0, p = buf; p < end; p = nl + 1) {
+		if ((nl = memchr(p, '\n', end - p)) == NULL)
+			nl = end;
+		*nl = '\0';
+		if (parse_sample(p, &s[count]) && s[count].time > cutoff)
+			count++;
+	}
+	free(buf);
+
+	/* each sample stands for the time back to the one before it; the
+	 * oldest in the log for as long as the one after it */
+	for (i = 0; i < count; i++) {
+		if (i + 1 < count)
+			lower = s[i + 1].time;
+		else if (before > 0)
+			lower = before;
+		else if (i > 0)
+			lower = s[i].time - (s[i - 1].time - s[i].time);
+		else
+			lower = cutoff;
+		if (lower < cutoff)
+			lower = cutoff;
+		s[i].span = (s[i].time > lower) ? s[i].time - lower : 0;
+	}
+
+	if (count == 0) {
+		free(s);
+		return -1;
+	}
+	*samples = s;
+	return count;
+}
+
+
+typedef struct {
+	double value;
+	double weight;
+} weighted;
+
+static int
+weighted_cmp(const void *a, const void *b)
+{
+	double x = ((const weighted *)a)->value, y = ((const weighted *)b)->value;
+
+	return (x > y) - (x < y);
+}
+
+double
+np_mrtg_aggregate(const np_mrtg_sample *samples, int count, int variable,
+                  int how, double pct)
+{
+	weighted *w;
+	double sum = 0, total = 0, value;
+	int i;
+
+	if (count <= 0)
+		return 0;
+
+	if (how == NP_MRTG_MAX) {
+		value = samples[0].max[variable];
+		for (i = 1; i < count; i++) {
+			if (samples[i].max[variable] > value)
+				value = samples[i].max[variable];
+		}
+		return value;
+	}
+
+	for (i = 0; i < count; i++)
+		total += samples[i].span;
+
+	if (how == NP_MRTG_AVG) {
+		for (i = 0; i < count; i++)
+			sum += (double)samples[i].avg[variable] * (total > 0 ? samples[i].span : 1);
+		return sum / (total > 0 ? total : count);
+	}
+
+	/* the smallest average that, with those below it, covers pct of the time */
+	if ((w = malloc(count * sizeof(weighted))) == NULL)
+		return 0;
+	for (i = 0; i < count; i++) {
+		w[i].value = samples[i].avg[variable];
+		w[i].weight = total > 0 ? samples[i].span : 1;
+	}
+	qsort(w, count, sizeof(weighted), weighted_cmp);
+	if (total <= 0)
+		total = count;
+	for (i = 0; i < count - 1; i++) {
+		sum += w[i].weight;
+		if (sum >= total * pct / 100)
+			break;
+	}
+	value = w[i].value;
+	free(w);
+	return value;
+}
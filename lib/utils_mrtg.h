@@ -0,0 +1,47 @@
+/* Header file for utils_mrtg */
+
+#ifndef _UTILS_MRTG_
+#define _UTILS_MRTG_
+
+#include <sys/types.h>
+#include <time.h>
+
+/*
+ * The samples of an MRTG log.  The first line of the log holds the last
+ * counter readings, and every line after it a sample of both variables,
+ * newest first: its time, the two averages and the two maximums.  The
+ * samples of a time window are therefore a run at the top of the file,
+ * whose end is found by a binary search over the file offsets, and read
+ * with one read however much older data the log has.
+ */
+
+typedef struct np_mrtg_sample {
+	time_t time;
+	unsigned long avg[2];
+	unsigned long max[2];
+	/* seconds of the window the sample covers, back to the one before it */
+	time_t span;
+} np_mrtg_sample;
+
+enum {
+	NP_MRTG_AVG,
+	NP_MRTG_MAX,
+	NP_MRTG_PCT
+};
+
+/* The aggregation named by name: MAX, P followed by a percentile, which is
+ * put in *pct, or AVG, which anything else has always meant */
+int np_mrtg_aggregation(const char *name, double *pct);
+
+/* The samples of the MRTG log open on fd less than window seconds older
+ * than the newest, in *samples to be freed, or only the newest one when
+ * window is 0.  The number of samples, or -1 if the log has none. */
+int np_mrtg_window(int fd, time_t window, np_mrtg_sample **samples);
+
+/* Aggregate variable (0 or 1) of the samples: the average of the averages
+ * weighted by span, the maximum of the maximums, or the pct percentile of
+ * the averages weighted by span */
+double np_mrtg_aggregate(const np_mrtg_sample *samples, int count, int variable,
+                         int how, double pct);
+
+#endif /* _UTILS_MRTG_ */
@@ -0,0 +1,589 @@
+/*****************************************************************************
+*
+* Library for machine-readable plugin output
+*
+* License: GPL
+* Copyright (c) 2018 Nagios Plugins Development Team
+*
+* Description:
+*
+* This file converts the classic output of a plugin into JSON or
+* OpenMetrics.  stdout is sent to a temporary file from the moment the
+* option is seen; at exit the collected text is split into the status line,
+* long output and performance data as described in the plugin guidelines
+* and printed in the requested format.
+*
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*
+*****************************************************************************/
+
+#include "common.h"
+#include "utils_base.h"
+#include "utils_output.h"
+#include <ctype.h>
+#include <stddef.h>
+
+typedef struct np_metric {
+	char *label;
+	char *value;      /* NULL for "U" */
+	char *uom;
+	char *warn;
+	char *crit;
+	char *min;
+	char *max;
+	struct np_metric *next;
+} np_metric;
+
+static const char *state_names[] = { "OK", "WARNING", "CRITICAL", "UNKNOWN" };
+
+static int output_format = NP_OUTPUT_CLASSIC;
+static int output_result = -1;
+static const char *output_plugin;
+static FILE *output_capture;
+static int output_stdout = -1;
+static pid_t output_pid;
+
+
+int
+np_output_format_value(const char *name)
+{
+	if (!strcmp(name, "classic"))
+		return NP_OUTPUT_CLASSIC;
+	if (!strcmp(name, "json"))
+		return NP_OUTPUT_JSON;
+	if (!strcmp(name, "openmetrics"))
+		return NP_OUTPUT_OPENMETRICS;
+	return -1;
+}
+
+void
+np_output_set_result(int result)
+{
+	output_result = result;
+}
+
+/* strndup, and NULL for an empty string */
+static char *
+field(const char *start, size_t len)
+{
+	char *s;
+
+	if (len == 0)
+		return NULL;
+	if ((s = malloc(len + 1)) == NULL)
+		die(STATE_UNKNOWN, _("malloc() failed!\n"));
+	memcpy(s, start, len);
+	s[len] = '\0';
+	return s;
+}
+
+/* label=value[uom];[warn];[crit];[min];[max] ... with labels in single
+ * quotes if they have spaces, and '' for a quote inside them */
+static np_metric *
+parse_perfdata(const char *p, np_metric **tail)
+{
+	np_metric *head = NULL, *m;
+	const char *end, *f[5];
+	size_t len[5];
+	char *label;
+	int n, i;
+
+	while (*p) {
+		p += strspn(p, " \t\r\n");
+		if (!*p)
+			break;
+
+		if (*p == '\'') {
+			label = malloc(strlen(p));
+			if (label == NULL)
+				die(STATE_UNKNOWN, _("malloc() failed!\n"));
+			for (i = 0, p++; *p; p++) {
+				if (*p == '\'') {
+					if (p[1] != '\'')
+						break;
+					p++;
+				}
+				label[i++] = *p;
+			}
+			label[i] = '\0';
+			if (*p)
+				p++;
+		} else {
+			end = p + strcspn(p, "= \t\r\n");
+			label = field(p, end - p);
+			p = end;
+		}
+		if (*p != '=' || label == NULL) {
+			/* not performance data, skip the word */
+			free(label);
+			p += strcspn(p, " \t\r\n");
+			continue;
+		}
+		p++;
+
+		end = p + strcspn(p, " \t\r\n");
+		for (n = 0; n < 5; n++) {
+			f[n] = p;
+			len[n] = strcspn(p, "; \t\r\n");
+			p += len[n];
+			if (p >= end || *p != ';')
+				break;
+			p++;
+		}
+		p = end;
+
+		if ((m = calloc(1, sizeof(np_metric))) == NULL)
+			die(STATE_UNKNOWN, _("malloc() failed!\n"));
+		m->label = label;
+		/* the unit is what follows the number */
+		i = strspn(f[0], "0123456789.-+eE");
+		if (i > 0)
+			m->value = field(f[0], i);
+		m->uom = field(f[0] + i, len[0] - i);
+		if (m->uom && !m->value && !strcmp(m->uom, "U")) {
+			free(m->uom);
+			m->uom = NULL;
+		}
+		m->warn = n >= 1 ? field(f[1], len[1]) : NULL;
+		m->crit = n >= 2 ? field(f[2], len[2]) : NULL;
+		m->min = n >= 3 ? field(f[3], len[3]) : NULL;
+		m->max = n >= 4 ? field(f[4], len[4]) : NULL;
+
+		if (*tail)
+			(*tail)->next = m;
+		else
+			head = m;
+		*tail = m;
+	}
+	return head;
+}
+
+static void
+free_metrics(np_metric *m)
+{
+	np_metric *next;
+
+	for (; m; m = next) {
+		next = m->next;
+		free(m->label);
+		free(m->value);
+		free(m->uom);
+		free(m->warn);
+		free(m->crit);
+		free(m->min);
+		free(m->max);
+		free(m);
+	}
+}
+
+/* The state from the first of OK, WARNING, CRITICAL or UNKNOWN in the status
+ * line, for when the exit status is not known */
+static int
+result_from_text(const char *line)
+{
+	const char *p;
+	size_t len;
+	int i, best = STATE_UNKNOWN;
+	const char *first = NULL;
+
+	for (i = 0; i < 4; i++) {
+		len = strlen(state_names[i]);
+		for (p = strstr(line, state_names[i]); p; p = strstr(p + 1, state_names[i])) {
+			if ((p == line || !isalpha((unsigned char)p[-1])) && !isalpha((unsigned char)p[len])) {
+				if (first == NULL || p < first) {
+					first = p;
+					best = i;
+				}
+				break;
+			}
+		}
+	}
+	return best;
+}
+
+/* the length of the UTF-8 sequence at s, or 0 if it is not a valid one:
+ * no overlong forms, surrogates or code points past U+10FFFF */
+static size_t
+utf8_length(const unsigned char *s)
+{
+	size_t len, i;
+	unsigned long c;
+
+	if (s[0] < 0x80)
+		return 1;
+	else if (s[0] >= 0xc2 && s[0] <= 0xdf)
+		len = 2, c = s[0] & 0x1f;
+	else if (s[0] >= 0xe0 && s[0] <= 0xef)
+		len = 3, c = s[0] & 0x0f;
+	else if (s[0] >= 0xf0 && s[0] <= 0xf4)
+		len = 4, c = s[0] & 0x07;
+	else
+		return 0;
+	for (i = 1; i < len; i++) {
+		if ((s[i] & 0xc0) != 0x80)
+			return 0;
+		c = (c << 6) | (s[i] & 0x3f);
+	}
+	if ((len == 3 && (c < 0x800 || (c >= 0xd800 && c <= 0xdfff))) ||
+	    (len == 4 && (c < 0x10000 || c > 0x10ffff)))
+		return 0;
+	return len;
+}
+
+/* plugin output is not always UTF-8, bytes that are not are replaced */
+static void
+json_string(FILE *out, const char *str)
+{
+	const unsigned char *s = (const unsigned char *)str;
+	size_t len;
+
+	if (s == NULL) {
+		fputs("null", out);
+		return;
+	}
+	fputc('"', out);
+	for (; *s; s += len) {
+		len = 1;
+		switch (*s) {
+		case '"':  fputs("\\\"", out); break;
+		case '\\': fputs("\\\\", out); break;
+		case '\n': fputs("\\n", out); break;
+		case '\r': fputs("\\r", out); break;
+		case '\t': fputs("\\t", out); break;
+		default:
+			if (*s < 0x20)
+				fprintf(out, "\\u%04x", *s);
+			else if ((len = utf8_length(s)) == 0) {
+				fputs("\\ufffd", out);
+				len = 1;
+			} else
+				fwrite(s, 1, len, out);
+		}
+	}
+	fputc('"', out);
+}
+
+/* a threshold as {"range":"@5:10","start":5,"end":10,"inside":true}.  an
+ * infinite end is null, and so are both ends of a range that does not
+ * parse */
+static void
+json_range(FILE *out, const char *s)
+{
+	range *r = NULL;
+	char *copy;
+
+	if (s == NULL) {
+		fputs("null", out);
+		return;
+	}
+	if (*s && strspn(s, NP_THRESHOLDS_CHARS) == strlen(s) && (copy = strdup(s)) != NULL) {
+		r = parse_range_string(copy);
+		free(copy);
+	}
+	fputs("{\"range\":", out);
+	json_string(out, s);
+	fputs(",\"start\":", out);
+	if (r && !r->start_infinity)
+		fprintf(out, "%.15g", r->start);
+	else
+		fputs("null", out);
+	fputs(",\"end\":", out);
+	if (r && !r->end_infinity)
+		fprintf(out, "%.15g", r->end);
+	else
+		fputs("null", out);
+	fprintf(out, ",\"inside\":%s}", (r && r->alert_on == INSIDE) ? "true" : "false");
+	free(r);
+}
+
+/* a number as JSON, or null if it is not one */
+static void
+json_number(FILE *out, const char *s)
+{
+	char *end;
+	double d;
+
+	if (s != NULL) {
+		d = strtod(s, &end);
+		if (end != s && *end == '\0' && isfinite(d)) {
+			fprintf(out, "%.15g", d);
+			return;
+		}
+	}
+	fputs("null", out);
+}
+
+/* label values escape \, " and newlines */
+static void
+om_string(FILE *out, const char *s)
+{
+	fputc('"', out);
+	for (; s && *s; s++) {
+		if (*s == '\n')
+			fputs("\\n", out);
+		else {
+			if (*s == '"' || *s == '\\')
+				fputc('\\', out);
+			fputc(*s, out);
+		}
+	}
+	fputc('"', out);
+}
+
+/* one gauge family: the value, or a threshold that is a single number */
+static void
+om_family(FILE *out, const char *name, const char *help, const char *plugin,
+          np_metric *metrics, size_t offset)
+{
+	np_metric *m;
+	const char *s;
+	char *end;
+	double d;
+	int header = FALSE;
+
+	for (m = metrics; m; m = m->next) {
+		s = *(char **)((char *)m + offset);
+		if (s == NULL)
+			continue;
+		d = strtod(s, &end);
+		if (end == s || *end != '\0')
+			continue;
+		if (!header) {
+			fprintf(out, "# TYPE %s gauge\n# HELP %s %s\n", name, name, help);
+			header = TRUE;
+		}
+		fprintf(out, "%s{plugin=", name);
+		om_string(out, plugin);
+		fputs(",label=", out);
+		om_string(out, m->label);
+		fputs(",uom=", out);
+		om_string(out, m->uom ? m->uom : "");
+		fprintf(out, "} %.15g\n", d);
+	}
+}
+
+void
+np_output_render(FILE *out, int format, const char *plugin_name, int result,
+                 const char *text)
+{
+	np_metric *metrics = NULL, *tail = NULL, *m;
+	char *copy, *line, *next, *bar, *status = NULL, *long_output = NULL;
+	int in_quotes = 0, in_perfdata = FALSE;
+	size_t len;
+
+	if ((copy = strdup(text)) == NULL)
+		die(STATE_UNKNOWN, _("malloc() failed!\n"));
+
+	for (line = copy; line && *line; line = next) {
+		if ((next = strchr(line, '\n')) != NULL)
+			*next++ = '\0';
+		if (in_perfdata) {
+			m = parse_perfdata(line, &tail);
+			metrics = metrics ? metrics : m;
+			continue;
+		}
+
+		/* the first | outside double quotes, as remove_perfdata has it */
+		for (bar = line; *bar; bar++) {
+			if (*bar == '"')
+				in_quotes = !in_quotes;
+			else if (*bar == '|' && !in_quotes)
+				break;
+		}
+		if (*bar) {
+			*bar++ = '\0';
+			m = parse_perfdata(bar, &tail);
+			metrics = metrics ? metrics : m;
+			/* after the first line, the rest is all performance data */
+			in_perfdata = (line != copy);
+		}
+
+		if (status == NULL) {
+			status = line;
+			len = strlen(status);
+			while (len > 0 && isspace((unsigned char)status[len - 1]))
+				status[--len] = '\0';
+		} else if (*line || long_output) {
+			len = long_output ? strlen(long_output) : 0;
+			long_output = realloc(long_output, len + strlen(line) + 2);
+			if (long_output == NULL)
+				die(STATE_UNKNOWN, _("malloc() failed!\n"));
+			sprintf(long_output + len, "%s%s", len ? "\n" : "", line);
+		}
+	}
+	if (result < STATE_OK || result > STATE_UNKNOWN)
+		result = STATE_UNKNOWN;
+
+	if (format == NP_OUTPUT_JSON) {
+		fputs("{\"plugin\":", out);
+		json_string(out, plugin_name);
+		fprintf(out, ",\"state\":%d,\"status\":\"%s\",\"output\":", result, state_names[result]);
+		json_string(out, status ? status : "");
+		fputs(",\"long_output\":", out);
+		json_string(out, long_output);
+		fputs(",\"perfdata\":[", out);
+		for (m = metrics; m; m = m->next) {
+			fputs("{\"label\":", out);
+			json_string(out, m->label);
+			fputs(",\"value\":", out);
+			json_number(out, m->value);
+			fputs(",\"uom\":", out);
+			json_string(out, m->uom ? m->uom : "");
+			fputs(",\"warn\":", out);
+			json_range(out, m->warn);
+			fputs(",\"crit\":", out);
+			json_range(out, m->crit);
+			fputs(",\"min\":", out);
+			json_number(out, m->min);
+			fputs(",\"max\":", out);
+			json_number(out, m->max);
+			fputs(m->next ? "}," : "}", out);
+		}
+		fputs("]}\n", out);
+	} else if (format == NP_OUTPUT_OPENMETRICS) {
+		fputs("# TYPE nagios_plugin_state gauge\n"
+		      "# HELP nagios_plugin_state 0 OK, 1 WARNING, 2 CRITICAL, 3 UNKNOWN\n"
+		      "nagios_plugin_state{plugin=", out);
+		om_string(out, plugin_name);
+		fprintf(out, "} %d\n", result);
+		fputs("# TYPE nagios_plugin_output info\n"
+		      "nagios_plugin_output_info{plugin=", out);
+		om_string(out, plugin_name);
+		fputs(",output=", out);
+		om_string(out, status ? status : "");
+		fputs("} 1\n", out);
+		om_family(out, "nagios_perfdata", "Performance data value", plugin_name,
+		          metrics, offsetof(np_metric, value));
+		om_family(out, "nagios_perfdata_warning", "Warning threshold", plugin_name,
+		          metrics, offsetof(np_metric, warn));
+		om_family(out, "nagios_perfdata_critical", "Critical threshold", plugin_name,
+		          metrics, offsetof(np_metric, crit));
+		om_family(out, "nagios_perfdata_min", "Minimum value", plugin_name,
+		          metrics, offsetof(np_metric, min));
+		om_family(out, "nagios_perfdata_max", "Maximum value", plugin_name,
+		          metrics, offsetof(np_metric, max));
+		fputs("# EOF\n", out);
+	} else {
+		fputs(text, out);
+	}
+
+	free_metrics(metrics);
+	free(long_output);
+	free(copy);
+}
+
+/* Prints what was collected in the requested format */
+static void
+output_finish(int status)
+{
+	char *text = NULL;
+	size_t len = 0;
+	ssize_t n;
+	int fd;
+
+	/* not in a child that exit()s */
+	if (output_capture == NULL || getpid() != output_pid)
+		return;
+
+	fflush(stdout);
+	fd = fileno(output_capture);
+	dup2(output_stdout, STDOUT_FILENO);
+	close(output_stdout);
+
+	lseek(fd, 0, SEEK_SET);
+	do {
+		if ((text = realloc(text, len + 4097)) == NULL)
+			return;
+		n = read(fd, text + len, 4096);
+		if (n > 0)
+			len += n;
+	} while (n > 0);
+	text[len] = '\0';
+	fclose(output_capture);
+	output_capture = NULL;
+
+	if (status < STATE_OK || status > STATE_UNKNOWN)
+		status = output_result >= 0 ? output_result : result_from_text(text);
+	np_output_render(stdout, output_format, output_plugin, status, text);
+	fflush(stdout);
+	free(text);
+}
+
+#ifdef HAVE_ON_EXIT
+static void
+output_on_exit(int status, void *arg)
+{
+	output_finish(status);
+}
+#else
+static void
+output_at_exit(void)
+{
+	output_finish(output_result);
+}
+#endif
+
+static void
+output_start(const char *plugin_name)
+{
+	fflush(stdout);
+	output_plugin = plugin_name;
+	output_pid = getpid();
+	if ((output_capture = tmpfile()) == NULL)
+		return;
+	if ((output_stdout = dup(STDOUT_FILENO)) < 0 ||
+	    dup2(fileno(output_capture), STDOUT_FILENO) < 0) {
+		/* then classic output it is */
+		fclose(output_capture);
+		output_capture = NULL;
+		return;
+	}
+#ifdef HAVE_ON_EXIT
+	on_exit(output_on_exit, NULL);
+#else
+	atexit(output_at_exit);
+#endif
+}
+
+char **
+np_output_opts(int *argc, char **argv, const char *plugin_name)
+{
+	char *value;
+	int i, j, n;
+
+	for (i = 1; i < *argc; i++) {
+		if (!strncmp(argv[i], "--output-format=", 16)) {
+			value = argv[i] + 16;
+			n = 1;
+		} else if (!strcmp(argv[i], "--output-format") && i + 1 < *argc) {
+			value = argv[i + 1];
+			n = 2;
+		} else
+			continue;
+
+		if ((output_format = np_output_format_value(value)) < 0)
+			die(STATE_UNKNOWN, "%s: %s\n", _("Unknown output format"), value);
+		/* including the NULL at the end */
+		for (j = i; j + n <= *argc; j++)
+			argv[j] = argv[j + n];
+		*argc -= n;
+		i--;
+	}
+
+	if (output_format != NP_OUTPUT_CLASSIC && output_capture == NULL)
+		output_start(plugin_name);
+	return argv;
+}
@@ -0,0 +1,43 @@
+#ifndef NAGIOS_UTILS_OUTPUT_H_INCLUDED
+#define NAGIOS_UTILS_OUTPUT_H_INCLUDED
+
+/*
+ * utils_output.h: machine-readable plugin output.
+ *
+ * With --output-format=json or --output-format=openmetrics, the classic
+ * output of a plugin (status line, long output and performance data) is
+ * collected instead of printed, and printed in that format when the plugin
+ * exits. The exit status is not changed.
+ *
+ * In JSON, bytes of the output that are not UTF-8 become U+FFFD. The warn
+ * and crit thresholds of the performance data are objects holding the
+ * range as given and its parsed start, end (null for infinity) and
+ * whether it alerts inside, e.g. {"range":"@5:10","start":5,"end":10,
+ * "inside":true}.
+ */
+
+#include <stdio.h>
+
+enum {
+	NP_OUTPUT_CLASSIC,
+	NP_OUTPUT_JSON,
+	NP_OUTPUT_OPENMETRICS
+};
+
+/* np_output_opts: Remove --output-format arguments from **argv and start
+ * collecting the output if a machine-readable format is asked for. Called
+ * from np_extra_opts(), so plugins need not call it themselves. */
+char **np_output_opts(int *argc, char **argv, const char *plugin_name);
+
+/* The format by name, or -1 */
+int np_output_format_value(const char *);
+
+/* The result passed to die(), for systems where the exit status can not be
+ * seen at exit */
+void np_output_set_result(int);
+
+/* Print classic plugin output in another format */
+void np_output_render(FILE *, int format, const char *plugin_name, int result,
+                      const char *text);
+
+#endif /* NAGIOS_UTILS_OUTPUT_H_INCLUDED */
@@ -0,0 +1,528 @@
+/*****************************************************************************
+*
+* Library for the literal prefilter of check_log
+*
+* License: GPL
+* Copyright (c) 2026 Nagios Plugins Development Team
+*
+* Description:
+*
+* This file contains a search for many literals at once, used to skip the
+* lines none of the regular expressions of check_log can match.  These are
+* tested by libtap.
+*
+* The search is a Teddy matcher: every literal is in one of eight buckets,
+* and for each of the first three bytes of the literals there is a table of
+* the buckets a byte fits, split into one table for the low and one for the
+* high nibble of the byte.  Sixteen positions are looked up at once by
+* shuffling the tables with the text; a position is only compared with the
+* literals when all three of its bytes fit the same bucket.  Without vector
+* shuffles the same lookup is done a byte at a time on full byte tables.
+*
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*
+*****************************************************************************/
+
+#include "common.h"
+#include "utils_prefilter.h"
+#include "c-ctype.h"
+
+#define BUCKETS      8
+#define FINGERPRINT  3    /* bytes of a literal looked up */
+#define BLOCK        16   /* positions looked up at once */
+
+/* __builtin_shuffle() with a variable mask becomes pshufb on x86, which
+ * needs SSSE3 and is only used when the processor has it, and tbl on
+ * aarch64 */
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 5
+# if defined(__x86_64__) || defined(__i386__)
+#  define NP_TEDDY
+#  define TEDDY_TARGET __attribute__((target("ssse3")))
+#  define teddy_usable() __builtin_cpu_supports("ssse3")
+# elif defined(__aarch64__)
+#  define NP_TEDDY
+#  define TEDDY_TARGET
+#  define teddy_usable() 1
+# endif
+#endif
+
+typedef struct pf_literal {
+	char   *text;
+	size_t len;
+	int    id;
+} pf_literal;
+
+struct np_prefilter {
+	int           ignore_case;
+	int           vector;
+	uint64_t      all_ids;
+	pf_literal    *literals;     /* literal i is in bucket i % BUCKETS */
+	size_t        count;
+	unsigned char table[FINGERPRINT][256];
+	unsigned char lo[FINGERPRINT][BLOCK];
+	unsigned char hi[FINGERPRINT][BLOCK];
+};
+
+
+np_prefilter *
+np_prefilter_new(int ignore_case)
+{
+	np_prefilter *pf;
+
+	if ((pf = calloc(1, sizeof(np_prefilter))) == NULL)
+		return NULL;
+	pf->ignore_case = ignore_case;
+#ifdef NP_TEDDY
+	pf->vector = teddy_usable();
+#endif
+	return pf;
+}
+
+void
+np_prefilter_free(np_prefilter *pf)
+{
+	size_t i;
+
+	if (pf == NULL)
+		return;
+	for (i = 0; i < pf->count; i++)
+		free(pf->literals[i].text);
+	free(pf->literals);
+	free(pf);
+}
+
+/* byte c fits the bucket at offset k */
+static void
+table_set(np_prefilter *pf, int k, unsigned char c, unsigned char bit)
+{
+	pf->table[k][c] |= bit;
+	pf->lo[k][c & 15] |= bit;
+	pf->hi[k][c >> 4] |= bit;
+}
+
+/* the checks of np_prefilter_add() that do not depend on memory */
+static int
+literal_usable(const np_prefilter *pf, int id, const char *literal, size_t len)
+{
+	size_t i;
+
+	if (len == 0 || id < 0 || id >= NP_PREFILTER_IDS)
+		return FALSE;
+	for (i = 0; pf->ignore_case && i < len; i++) {
+		if ((unsigned char)literal[i] & 0x80)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+int
+np_prefilter_add(np_prefilter *pf, int id, const char *literal, size_t len)
+{
+	pf_literal *lit;
+	unsigned char bit = 1 << (pf->count % BUCKETS);
+	int k, c;
+
+	if (!literal_usable(pf, id, literal, len))
+		return FALSE;
+
+	lit = realloc(pf->literals, (pf->count + 1) * sizeof(pf_literal));
+	if (lit == NULL)
+		return FALSE;
+	pf->literals = lit;
+	lit = &pf->literals[pf->count];
+	if ((lit->text = malloc(len)) == NULL)
+		return FALSE;
+	memcpy(lit->text, literal, len);
+	lit->len = len;
+	lit->id = id;
+	pf->count++;
+	pf->all_ids |= (uint64_t)1 << id;
+
+	for (k = 0; k < FINGERPRINT; k++) {
+		if ((size_t)k >= len) {
+			/* shorter literals fit any byte there */
+			for (c = 0; c < 256; c++)
+				table_set(pf, k, c, bit);
+			continue;
+		}
+		c = (unsigned char)literal[k];
+		table_set(pf, k, c, bit);
+		if (pf->ignore_case) {
+			table_set(pf, k, c_tolower(c), bit);
+			table_set(pf, k, c_toupper(c), bit);
+		}
+	}
+	return TRUE;
+}
+
+/* the patterns of the literals in buckets that start at p */
+static uint64_t
+verify(const np_prefilter *pf, const unsigned char *p, size_t left, unsigned buckets)
+{
+	const pf_literal *lit;
+	uint64_t ids = 0;
+	size_t i, j;
+	int b;
+
+	for (b = 0; b < BUCKETS; b++) {
+		if (!(buckets & (1 << b)))
+			continue;
+		for (i = b; i < pf->count; i += BUCKETS) {
+			lit = &pf->literals[i];
+			if (lit->len > left)
+				continue;
+			if (!pf->ignore_case) {
+				if (memcmp(p, lit->text, lit->len) == 0)
+					ids |= (uint64_t)1 << lit->id;
+				continue;
+			}
+			for (j = 0; j < lit->len; j++) {
+				if (c_tolower(p[j]) != c_tolower((unsigned char)lit->text[j]))
+					break;
+			}
+			if (j == lit->len)
+				ids |= (uint64_t)1 << lit->id;
+		}
+	}
+	return ids;
+}
+
+#ifdef NP_TEDDY
+typedef unsigned char np_v16qi __attribute__((vector_size(BLOCK)));
+
+/*
+ * Moves *i on to the first block of BLOCK positions with a candidate, and
+ * returns TRUE with the buckets of each position in lanes.  FALSE once the
+ * last byte looked up would be past end.
+ */
+TEDDY_TARGET static int
+teddy_block(const np_prefilter *pf, const unsigned char *s, size_t *i, size_t end,
+            unsigned char lanes[BLOCK])
+{
+	np_v16qi lo0, hi0, lo1, hi1, lo2, hi2, v0, v1, v2, m;
+	uint64_t any[2];
+
+	memcpy(&lo0, pf->lo[0], BLOCK);
+	memcpy(&hi0, pf->hi[0], BLOCK);
+	memcpy(&lo1, pf->lo[1], BLOCK);
+	memcpy(&hi1, pf->hi[1], BLOCK);
+	memcpy(&lo2, pf->lo[2], BLOCK);
+	memcpy(&hi2, pf->hi[2], BLOCK);
+
+	for (; *i + BLOCK + FINGERPRINT - 1 <= end; *i += BLOCK) {
+		memcpy(&v0, s + *i, BLOCK);
+		memcpy(&v1, s + *i + 1, BLOCK);
+		memcpy(&v2, s + *i + 2, BLOCK);
+		m = __builtin_shuffle(lo0, v0 & 15) & __builtin_shuffle(hi0, v0 >> 4) &
+		    __builtin_shuffle(lo1, v1 & 15) & __builtin_shuffle(hi1, v1 >> 4) &
+		    __builtin_shuffle(lo2, v2 & 15) & __builtin_shuffle(hi2, v2 >> 4);
+		memcpy(any, &m, BLOCK);
+		if (any[0] | any[1]) {
+			memcpy(lanes, &m, BLOCK);
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+#endif
+
+/* np_prefilter_find() with first, np_prefilter_scan() without */
+static const char *
+search(const np_prefilter *pf, const char *text, size_t len, uint64_t *ids, int first)
+{
+	const unsigned char *s = (const unsigned char *)text;
+	unsigned char m;
+	uint64_t found;
+	size_t i = 0;
+#ifdef NP_TEDDY
+	unsigned char lanes[BLOCK];
+	int j;
+#endif
+
+	*ids = 0;
+	if (pf->count == 0)
+		return NULL;
+
+	while (i < len) {
+#ifdef NP_TEDDY
+		if (pf->vector && teddy_block(pf, s, &i, len, lanes)) {
+			for (j = 0; j < BLOCK; j++) {
+				if (lanes[j] == 0)
+					continue;
+				found = verify(pf, s + i + j, len - i - j, lanes[j]);
+				if (found && first) {
+					*ids = found;
+					return text + i + j;
+				}
+				*ids |= found;
+			}
+			if (*ids == pf->all_ids)
+				return NULL;
+			i += BLOCK;
+			continue;
+		}
+#endif
+		/* a byte at a time, and the last bytes of the text */
+		for (; i < len; i++) {
+			m = pf->table[0][s[i]];
+			if (i + 1 < len)
+				m &= pf->table[1][s[i + 1]];
+			if (i + 2 < len)
+				m &= pf->table[2][s[i + 2]];
+			if (m == 0)
+				continue;
+			found = verify(pf, s + i, len - i, m);
+			if (found && first) {
+				*ids = found;
+				return text + i;
+			}
+			*ids |= found;
+			if (*ids == pf->all_ids)
+				return NULL;
+		}
+	}
+	return NULL;
+}
+
+uint64_t
+np_prefilter_scan(const np_prefilter *pf, const char *text, size_t len)
+{
+	uint64_t ids;
+
+	search(pf, text, len, &ids, FALSE);
+	return ids;
+}
+
+const char *
+np_prefilter_find(const np_prefilter *pf, const char *text, size_t len, uint64_t *ids)
+{
+	return search(pf, text, len, ids, TRUE);
+}
+
+
+/* past the bracket expression at p */
+static const char *
+skip_bracket(const char *p, const char *end)
+{
+	char close;
+
+	p++;
+	if (p < end && *p == '^')
+		p++;
+	if (p < end && *p == ']')
+		p++;
+	for (; p < end && *p != ']'; p++) {
+		/* [:class:], [.coll.] and [=equiv=] */
+		if (*p == '[' && p + 1 < end && (p[1] == ':' || p[1] == '.' || p[1] == '=')) {
+			close = p[1];
+			for (p += 2; p + 1 < end && !(p[0] == close && p[1] == ']'); p++)
+				;
+			p++;
+		}
+	}
+	return (p < end) ? p + 1 : end;
+}
+
+/* past the group at p */
+static const char *
+skip_group(const char *p, const char *end)
+{
+	int depth = 0;
+
+	while (p < end) {
+		if (*p == '\\')
+			p += 2;
+		else if (*p == '[')
+			p = skip_bracket(p, end);
+		else {
+			if (*p == '(')
+				depth++;
+			else if (*p == ')' && --depth == 0)
+				return p + 1;
+			p++;
+		}
+	}
+	return end;
+}
+
+/*
+ * Past the duplication symbols at p, with *zero set if any of them lets
+ * what they follow be left out: *, ?, {0...} or {,max}.  They may be
+ * stacked, as in b+? or b{1}?, which glibc takes as (b+)? and (b{1})?.
+ */
+static const char *
+skip_quantifiers(const char *p, const char *end, int *zero)
+{
+	const char *q;
+
+	*zero = FALSE;
+	while (p < end) {
+		if (*p == '*' || *p == '?') {
+			*zero = TRUE;
+			p++;
+		} else if (*p == '+') {
+			p++;
+		} else if (*p == '{' && p + 1 < end && (c_isdigit(p[1]) || p[1] == ',')) {
+			/* {min}, {min,}, {min,max} or {,max} */
+			if (p[1] == ',' || strtol(p + 1, NULL, 10) == 0)
+				*zero = TRUE;
+			for (q = p + 1; q < end && *q != '}'; q++)
+				;
+			p = (q < end) ? q + 1 : end;
+		} else {
+			break;
+		}
+	}
+	return p;
+}
+
+/*
+ * The longest run of literal bytes a branch of an extended regular
+ * expression can not match without, copied to best.  Groups, bracket
+ * expressions and anything but plain ASCII end a run; a byte whose
+ * quantifiers let it be left out is dropped from it.
+ */
+static size_t
+branch_literal(const char *p, const char *end, char *best, char *run)
+{
+	size_t run_len = 0, best_len = 0;
+	unsigned char c;
+	const char *q;
+	int zero;
+
+#define END_RUN() do { \
+		if (run_len > best_len) { \
+			memcpy(best, run, run_len); \
+			best_len = run_len; \
+		} \
+		run_len = 0; \
+	} while (0)
+
+	while (p < end) {
+		c = *p;
+		if (c == '\\' && p + 1 < end) {
+			c = p[1];
+			p += 2;
+			/* \w, \b, \1, \< and the like are not literal */
+			if (c_isalnum(c) || c == '<' || c == '>' || c == '`' || c == '\'' || (c & 0x80))
+				END_RUN();
+			else
+				run[run_len++] = c;
+			continue;
+		}
+		switch (c) {
+		case '*':
+		case '?':
+		case '+':
+		case '{':
+			/* the byte before is only known to be needed once all
+			 * the quantifiers following it are */
+			q = skip_quantifiers(p, end, &zero);
+			if (zero && run_len)
+				run_len--;
+			END_RUN();
+			p = (q > p) ? q : p + 1;
+			break;
+		case '[':
+			END_RUN();
+			p = skip_bracket(p, end);
+			break;
+		case '(':
+			END_RUN();
+			p = skip_group(p, end);
+			break;
+		case '.':
+		case '^':
+		case '$':
+		case ')':
+		case '}':
+			END_RUN();
+			p++;
+			break;
+		default:
+			if (c & 0x80)
+				END_RUN();
+			else
+				run[run_len++] = c;
+			p++;
+		}
+	}
+	END_RUN();
+#undef END_RUN
+	return best_len;
+}
+
+int
+np_prefilter_add_regex(np_prefilter *pf, int id, const char *regex)
+{
+	const char *p, *start, *end = regex + strlen(regex);
+	char *literals, *lit, *run;
+	size_t *lens, n = 0, i, count = pf->count;
+	uint64_t all_ids = pf->all_ids;
+	int ok = TRUE;
+
+	if (id < 0 || id >= NP_PREFILTER_IDS)
+		return FALSE;
+	/* the literal of each alternative, one after the other */
+	literals = malloc(end - regex + 1);
+	run = malloc(end - regex + 1);
+	lens = malloc((end - regex + 1) * sizeof(size_t));
+	if (literals == NULL || run == NULL || lens == NULL) {
+		free(literals);
+		free(run);
+		free(lens);
+		return FALSE;
+	}
+
+	/* the top level alternatives, each with a literal of its own */
+	for (p = start = regex, lit = literals; ok; ) {
+		if (p < end && *p == '\\')
+			p += 2;
+		else if (p < end && *p == '[')
+			p = skip_bracket(p, end);
+		else if (p < end && *p == '(')
+			p = skip_group(p, end);
+		else if (p < end && *p != '|')
+			p++;
+		else {
+			if (p > end)
+				p = end;
+			lens[n] = branch_literal(start, p, lit, run);
+			ok = lens[n] > 0;
+			lit += lens[n++];
+			if (p >= end)
+				break;
+			start = ++p;
+		}
+	}
+
+	/* all or none: every literal is checked before the first is added,
+	 * and the ones added are taken back if memory runs out half way.  the
+	 * table bits they set stay, which only costs a few more candidates */
+	for (i = 0, lit = literals; ok && i < n; lit += lens[i++])
+		ok = literal_usable(pf, id, lit, lens[i]);
+	for (i = 0, lit = literals; ok && i < n; lit += lens[i++])
+		ok = np_prefilter_add(pf, id, lit, lens[i]);
+	if (!ok) {
+		while (pf->count > count)
+			free(pf->literals[--pf->count].text);
+		pf->all_ids = all_ids;
+	}
+	free(literals);
+	free(run);
+	free(lens);
+	return ok;
+}
@@ -0,0 +1,44 @@
+/* Header file for utils_prefilter */
+
+#ifndef _UTILS_PREFILTER_
+#define _UTILS_PREFILTER_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A multi-literal search to pick out the lines worth running regexec() on.
+ * Every pattern (numbered 0 to NP_PREFILTER_IDS-1) is added with the
+ * literals it can not match without; a scan returns the patterns with one
+ * of their literals in the text, and the others need not be tried.
+ *
+ * The literals are put in eight buckets, and the first three bytes at each
+ * position are looked up in per-bucket nibble tables sixteen positions at a
+ * time, in the manner of the Teddy matcher.  Only the positions where all
+ * three bytes fit a bucket are compared with its literals.
+ */
+
+#define NP_PREFILTER_IDS 64
+
+typedef struct np_prefilter np_prefilter;
+
+np_prefilter *np_prefilter_new(int ignore_case);
+void np_prefilter_free(np_prefilter *);
+
+/* A literal of pattern id.  FALSE if it can not be used: an empty literal,
+ * or one that is not ASCII when case is ignored. */
+int np_prefilter_add(np_prefilter *, int id, const char *literal, size_t len);
+
+/* The literals extended regular expression regex needs, one from each
+ * alternative, for pattern id.  FALSE, and nothing added, if it needs
+ * none; regex must then always be tried. */
+int np_prefilter_add_regex(np_prefilter *, int id, const char *regex);
+
+/* The patterns with a literal in text, one bit per id */
+uint64_t np_prefilter_scan(const np_prefilter *, const char *text, size_t len);
+
+/* The first position in text where a literal starts, with the patterns of
+ * the literals found there in *ids, or NULL */
+const char *np_prefilter_find(const np_prefilter *, const char *text, size_t len, uint64_t *ids);
+
+#endif /* _UTILS_PREFILTER_ */
@@ -0,0 +1,378 @@
+/*****************************************************************************
+*
+* Library for the plugin state store
+*
+* License: GPL
+* Copyright (c) 2018 Nagios Plugins Development Team
+*
+* Description:
+*
+* This file contains the memory-mapped store behind np_state_read() and
+* np_state_write_string().  The store is a fixed table of slots addressed by
+* a hash of "plugin/keyname" with linear probing.  Slots are never freed,
+* which would cut the probe sequences of the keys after them, but a slot not
+* written for NP_STATE_STORE_EXPIRY seconds is given to a new key on its
+* probe sequence, so checks that were removed do not fill the store.  The
+* number of slots is chosen when the store is created and kept in its
+* header; a store that fills up has to be removed to be made larger.
+*
+* Readers take no locks: every slot has a sequence number that is odd while
+* the slot is written, and a reader copies the slot until it sees the same
+* even number before and after.  Writers serialise on an fcntl() lock of
+* the slot, which the kernel drops if the writer dies.  A reader that keeps
+* finding the slot busy, because its writer was scheduled out half way,
+* waits for that lock instead of giving up.  A checksum over the
+* record catches a slot left half written by a crash, which then reads as
+* no previous state.
+*
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*
+*****************************************************************************/
+
+#include "common.h"
+#include "utils_state.h"
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+
+#define STORE_MAGIC       "NPSTATE"
+#define STORE_VERSION     1
+#define STORE_PROBES      64
+#define STORE_READ_TRIES  1000
+/* datalen of a key whose data outgrew its slot and is in the state file */
+#define STORE_OUTGROWN    0xffff
+
+#define store_barrier()   __sync_synchronize()
+
+typedef struct store_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t slots;
+	uint32_t slot_size;
+	uint32_t reserved[13];
+} store_header;
+
+typedef struct store_slot {
+	volatile uint32_t seq;   /* odd while the slot is written */
+	uint32_t checksum;       /* of the record below */
+	int64_t time;
+	int32_t data_version;
+	uint16_t keylen;         /* 0 for a free slot */
+	uint16_t datalen;
+	char key[NP_STATE_STORE_KEYLEN];
+	char data[NP_STATE_STORE_DATALEN];
+} store_slot;
+
+struct np_state_store {
+	int fd;
+	size_t size;
+	uint32_t nslots;
+	store_header *header;
+	store_slot *slots;
+};
+
+#define STORE_SIZE(nslots) (sizeof(store_header) + (size_t)(nslots) * sizeof(store_slot))
+
+
+static uint32_t
+fnv1a(uint32_t hash, const void *buf, size_t len)
+{
+	const unsigned char *p = buf;
+
+	while (len--)
+		hash = (hash ^ *p++) * 16777619U;
+	return hash;
+}
+
+static uint32_t
+slot_checksum(const store_slot *slot)
+{
+	uint32_t hash = 2166136261U;
+
+	hash = fnv1a(hash, &slot->time, sizeof(slot->time));
+	hash = fnv1a(hash, &slot->data_version, sizeof(slot->data_version));
+	hash = fnv1a(hash, &slot->datalen, sizeof(slot->datalen));
+	return fnv1a(hash, slot->data, (slot->datalen < NP_STATE_STORE_DATALEN) ? slot->datalen : 0);
+}
+
+/* the record of a slot, without its sequence number */
+static void
+slot_copy(const store_slot *slot, store_slot *copy)
+{
+	copy->keylen = slot->keylen;
+	if (copy->keylen > NP_STATE_STORE_KEYLEN)
+		copy->keylen = 0;
+	memcpy(copy->key, slot->key, copy->keylen);
+	copy->time = slot->time;
+	copy->data_version = slot->data_version;
+	copy->datalen = slot->datalen;
+	copy->checksum = slot->checksum;
+	memcpy(copy->data, slot->data, (copy->datalen < NP_STATE_STORE_DATALEN) ? copy->datalen : 0);
+}
+
+/* blocking lock or unlock of a byte range of the store file */
+static int
+store_lock(np_state_store *store, off_t start, off_t len, short type)
+{
+	struct flock fl;
+
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = type;
+	fl.l_whence = SEEK_SET;
+	fl.l_start = start;
+	fl.l_len = len;
+	while (fcntl(store->fd, F_SETLKW, &fl) < 0) {
+		if (errno != EINTR)
+			return ERROR;
+	}
+	return OK;
+}
+
+/* creates the missing directories of path, like np_state_write_string() */
+static void
+store_mkdirs(const char *path)
+{
+	char *dirs = strdup(path), *p;
+
+	if (dirs == NULL)
+		return;
+	for (p = dirs + 1; *p; p++) {
+		if (*p == '/') {
+			*p = '\0';
+			if (access(dirs, F_OK))
+				mkdir(dirs, S_IRWXU);
+			*p = '/';
+		}
+	}
+	free(dirs);
+}
+
+np_state_store *
+np_state_store_open(const char *path, unsigned long create)
+{
+#ifdef HAVE_SYS_MMAN_H
+	np_state_store *store;
+	store_header header;
+	struct stat st;
+	void *map;
+
+	if ((store = calloc(1, sizeof(np_state_store))) == NULL)
+		return NULL;
+
+	store->fd = open(path, create ? O_RDWR | O_CREAT : O_RDWR, S_IRUSR | S_IWUSR | S_IRGRP);
+	if (store->fd < 0 && create && errno == ENOENT) {
+		store_mkdirs(path);
+		store->fd = open(path, O_RDWR | O_CREAT, S_IRUSR | S_IWUSR | S_IRGRP);
+	}
+	if (store->fd < 0) {
+		free(store);
+		return NULL;
+	}
+	fcntl(store->fd, F_SETFD, FD_CLOEXEC);
+
+	/* whoever gets the header lock first on a new file sets it up */
+	if (store_lock(store, 0, sizeof(store_header), F_WRLCK) != OK ||
+	    fstat(store->fd, &st) < 0)
+		goto fail;
+	if (st.st_size == 0) {
+		if (!create || create > NP_STATE_STORE_MAXSLOTS)
+			goto fail;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, STORE_MAGIC, sizeof(header.magic));
+		header.version = STORE_VERSION;
+		header.slots = create;
+		header.slot_size = sizeof(store_slot);
+		/* sparse, only the slots in use take up space */
+		if (ftruncate(store->fd, STORE_SIZE(create)) < 0 ||
+		    pwrite(store->fd, &header, sizeof(header), 0) != sizeof(header))
+			goto fail;
+		st.st_size = STORE_SIZE(create);
+	} else if (pread(store->fd, &header, sizeof(header), 0) != sizeof(header)) {
+		goto fail;
+	}
+	store_lock(store, 0, sizeof(store_header), F_UNLCK);
+
+	if (memcmp(header.magic, STORE_MAGIC, sizeof(header.magic)) ||
+	    header.version != STORE_VERSION ||
+	    header.slots == 0 || header.slots > NP_STATE_STORE_MAXSLOTS ||
+	    header.slot_size != sizeof(store_slot) ||
+	    (size_t)st.st_size != STORE_SIZE(header.slots))
+		goto fail;
+	map = mmap(NULL, STORE_SIZE(header.slots), PROT_READ | PROT_WRITE, MAP_SHARED, store->fd, 0);
+	if (map == MAP_FAILED)
+		goto fail;
+	store->size = STORE_SIZE(header.slots);
+	store->nslots = header.slots;
+	store->header = map;
+	store->slots = (store_slot *)(store->header + 1);
+	return store;
+
+fail:
+	close(store->fd);
+	free(store);
+#endif /* HAVE_SYS_MMAN_H */
+	return NULL;
+}
+
+void
+np_state_store_close(np_state_store *store)
+{
+	if (store == NULL)
+		return;
+#ifdef HAVE_SYS_MMAN_H
+	if (store->header)
+		munmap(store->header, store->size);
+#endif
+	close(store->fd);
+	free(store);
+}
+
+/*
+ * The slot of key, or -1.  With claim, if key is not there yet, the first
+ * slot on the probe sequence last written before expired is returned, or
+ * else the first free one.  Keys are compared without the seqlock, so the
+ * caller checks the key again under the seqlock or the slot lock.
+ */
+static int
+store_find(np_state_store *store, const char *key, size_t keylen, int claim,
+           time_t expired)
+{
+	uint32_t start = fnv1a(2166136261U, key, keylen) % store->nslots;
+	store_slot *slot;
+	int i, n, reuse = -1;
+
+	for (n = 0; n < STORE_PROBES; n++) {
+		i = (start + n) % store->nslots;
+		slot = &store->slots[i];
+		if (slot->keylen == 0)
+			return !claim ? -1 : (reuse >= 0) ? reuse : i;
+		store_barrier();
+		if (slot->keylen == keylen && memcmp(slot->key, key, keylen) == 0)
+			return i;
+		if (claim && reuse < 0 && slot->time < expired)
+			reuse = i;
+	}
+	return reuse;
+}
+
+int
+np_state_store_read(np_state_store *store, const char *key,
+                    int *data_version, time_t *data_time, char **data)
+{
+	store_slot *slot, copy;
+	size_t keylen = strlen(key);
+	uint32_t seq;
+	off_t offset;
+	int i, tries;
+
+	if ((i = store_find(store, key, keylen, FALSE, 0)) < 0)
+		return 0;
+	slot = &store->slots[i];
+
+	for (tries = 0; tries < STORE_READ_TRIES; tries++) {
+		seq = slot->seq;
+		if (seq & 1)
+			continue;
+		store_barrier();
+		slot_copy(slot, &copy);
+		store_barrier();
+		if (slot->seq == seq)
+			break;
+	}
+	if (tries == STORE_READ_TRIES) {
+		/* a crashed writer leaves the sequence odd, the checksum tells */
+		offset = (char *)slot - (char *)store->header;
+		if (store_lock(store, offset, sizeof(store_slot), F_RDLCK) != OK)
+			return -1;
+		slot_copy(slot, &copy);
+		store_lock(store, offset, sizeof(store_slot), F_UNLCK);
+	}
+	/* the slot went to another key after it expired */
+	if (copy.keylen != keylen || memcmp(copy.key, key, keylen))
+		return 0;
+	if (copy.checksum != slot_checksum(&copy))
+		return -1;
+	if (copy.datalen == STORE_OUTGROWN)
+		return 0;
+
+	if ((*data = malloc(copy.datalen + 1)) == NULL)
+		return -1;
+	memcpy(*data, copy.data, copy.datalen);
+	(*data)[copy.datalen] = '\0';
+	*data_version = copy.data_version;
+	*data_time = copy.time;
+	return 1;
+}
+
+int
+np_state_store_write(np_state_store *store, const char *key,
+                     int data_version, time_t data_time, const char *data)
+{
+	size_t keylen = strlen(key), datalen = strlen(data);
+	time_t expired = data_time - NP_STATE_STORE_EXPIRY;
+	store_slot *slot;
+	off_t offset;
+	int i, n, same, outgrown;
+
+	if (keylen == 0 || keylen > NP_STATE_STORE_KEYLEN)
+		return ERROR;
+	/* data too long for a slot goes to the state file, and the record the
+	 * key may already have must not be read instead of it */
+	outgrown = datalen >= NP_STATE_STORE_DATALEN;
+
+	/* another writer can claim the slot we found first */
+	for (n = 0; n < STORE_PROBES; n++) {
+		if ((i = store_find(store, key, keylen, !outgrown, expired)) < 0)
+			return ERROR;
+		slot = &store->slots[i];
+		offset = (char *)slot - (char *)store->header;
+		if (store_lock(store, offset, sizeof(store_slot), F_WRLCK) != OK)
+			return ERROR;
+		same = slot->keylen == keylen && memcmp(slot->key, key, keylen) == 0;
+		if (same || (!outgrown && (slot->keylen == 0 || slot->time < expired)))
+			break;
+		store_lock(store, offset, sizeof(store_slot), F_UNLCK);
+	}
+	if (n == STORE_PROBES)
+		return ERROR;
+
+	/* a crashed writer may have left the sequence odd */
+	if (!(slot->seq & 1))
+		slot->seq++;
+	store_barrier();
+	if (!same) {
+		memcpy(slot->key, key, keylen);
+		store_barrier();
+		slot->keylen = keylen;
+	}
+	if (outgrown) {
+		slot->datalen = STORE_OUTGROWN;
+	} else {
+		slot->time = data_time;
+		slot->data_version = data_version;
+		slot->datalen = datalen;
+		memcpy(slot->data, data, datalen);
+	}
+	slot->checksum = slot_checksum(slot);
+	store_barrier();
+	slot->seq++;
+
+	store_lock(store, offset, sizeof(store_slot), F_UNLCK);
+	return outgrown ? ERROR : OK;
+}
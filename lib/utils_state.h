@@ -0,0 +1,43 @@
+/* Header file for utils_state */
+
+#ifndef _UTILS_STATE_
+#define _UTILS_STATE_
+
+#include <time.h>
+
+/*
+ * A memory-mapped key/value store for the plugin state, one file per user
+ * in the state directory instead of one file per key.  np_state_read() and
+ * np_state_write_string() use it when it can be opened and fall back to
+ * the state files otherwise.
+ */
+
+#define NP_STATE_STORE_FILE     "np_state.db"
+/* slots of a new store, NAGIOS_PLUGIN_STATE_STORE_SLOTS can set another
+ * number.  an existing store keeps the number it was created with. */
+#define NP_STATE_STORE_SLOTS    65536
+#define NP_STATE_STORE_MAXSLOTS (1 << 24)
+#define NP_STATE_STORE_KEYLEN   128     /* "plugin/keyname" */
+#define NP_STATE_STORE_DATALEN  1024    /* the same limit as the state files */
+/* a key not written for this long gives up its slot to a new key */
+#define NP_STATE_STORE_EXPIRY   (60 * 60 * 24 * 30)
+
+typedef struct np_state_store np_state_store;
+
+/* maps the store at path.  If create is set, a missing store (and its
+ * directory) is created with that many slots.  NULL if it can not be
+ * opened or is not a store of this version. */
+np_state_store *np_state_store_open(const char *path, unsigned long create);
+void np_state_store_close(np_state_store *store);
+
+/* 1 and the record if key is in the store, with data malloc()ed, 0 if it is
+ * not, -1 if the record is damaged */
+int np_state_store_read(np_state_store *store, const char *key,
+                        int *data_version, time_t *data_time, char **data);
+/* OK, or ERROR if the key or data are too long or the probe sequence of
+ * the key has no free or expired slot.  Data too long for the store drops
+ * the record key had, so that it is read from the state file instead. */
+int np_state_store_write(np_state_store *store, const char *key,
+                         int data_version, time_t data_time, const char *data);
+
+#endif /* _UTILS_STATE_ */
@@ -73,3 +73,216 @@ np_expect_match(char *status, char **server_expect, int expect_count, int flags)
 	else
 		return NP_MATCH_FAILURE;
 }
+
+
+struct np_expect_matcher {
+	char **expect;
+	int count;
+	int flags;
+	char *found;		/* per expect string: matched */
+	char *dead;		/* per expect string: can no longer match (exact) */
+	int nfound;
+	int ndead;
+	size_t pos;		/* bytes consumed so far */
+	int stopped;		/* a NUL byte was seen */
+	/* Aho-Corasick automaton, substring matching only */
+	int *delta;		/* nstates * 256 transitions */
+	int *out;		/* first expect string ending in each state */
+	int *dict;		/* next state on the suffix chain with output */
+	int *same;		/* next expect string identical to this one */
+	int state;
+};
+
+static void
+np_expect_mark(np_expect_matcher *m, int i)
+{
+	for (; i >= 0; i = m->same[i]) {
+		if (m->found[i])
+			continue;
+		m->found[i] = 1;
+		m->nfound++;
+		if (m->flags & NP_MATCH_VERBOSE)
+			printf("found [%s]\n", m->expect[i]);
+	}
+}
+
+static int
+np_expect_build_automaton(np_expect_matcher *m)
+{
+	int nstates = 1, total = 1, i, c, s, t, f, head = 0, tail = 0;
+	int *fail, *queue;
+	const unsigned char *p;
+
+	for (i = 0; i < m->count; i++)
+		total += strlen(m->expect[i]);
+
+	m->delta = malloc(sizeof(int) * 256 * total);
+	m->out = malloc(sizeof(int) * total);
+	m->dict = malloc(sizeof(int) * total);
+	fail = malloc(sizeof(int) * total);
+	queue = malloc(sizeof(int) * total);
+	if (!m->delta || !m->out || !m->dict || !fail || !queue) {
+		free(fail);
+		free(queue);
+		return -1;
+	}
+	for (i = 0; i < 256 * total; i++)
+		m->delta[i] = -1;
+	for (i = 0; i < total; i++)
+		m->out[i] = m->dict[i] = -1;
+
+	/* trie of all expect strings */
+	for (i = 0; i < m->count; i++) {
+		s = 0;
+		for (p = (const unsigned char *)m->expect[i]; *p; p++) {
+			if (m->delta[s * 256 + *p] < 0)
+				m->delta[s * 256 + *p] = nstates++;
+			s = m->delta[s * 256 + *p];
+		}
+		if (m->out[s] >= 0) {
+			/* duplicate expect string, chain it to the first one */
+			for (t = m->out[s]; m->same[t] >= 0; t = m->same[t])
+				;
+			m->same[t] = i;
+		} else {
+			m->out[s] = i;
+		}
+	}
+
+	/* breadth first: failure links, complete the transition function */
+	fail[0] = 0;
+	for (c = 0; c < 256; c++) {
+		t = m->delta[c];
+		if (t < 0) {
+			m->delta[c] = 0;
+		} else {
+			fail[t] = 0;
+			queue[tail++] = t;
+		}
+	}
+	while (head < tail) {
+		s = queue[head++];
+		f = fail[s];
+		m->dict[s] = m->out[f] >= 0 ? f : m->dict[f];
+		for (c = 0; c < 256; c++) {
+			t = m->delta[s * 256 + c];
+			if (t < 0) {
+				m->delta[s * 256 + c] = m->delta[f * 256 + c];
+			} else {
+				fail[t] = m->delta[f * 256 + c];
+				queue[tail++] = t;
+			}
+		}
+	}
+
+	free(fail);
+	free(queue);
+	return 0;
+}
+
+np_expect_matcher *
+np_expect_matcher_new(char **server_expect, int expect_count, int flags)
+{
+	np_expect_matcher *m;
+	int i;
+
+	if ((m = calloc(1, sizeof(*m))) == NULL)
+		return NULL;
+	m->expect = server_expect;
+	m->count = expect_count;
+	m->flags = flags;
+	m->found = calloc(expect_count + 1, 1);
+	m->dead = calloc(expect_count + 1, 1);
+	m->same = malloc(sizeof(int) * (expect_count + 1));
+	if (!m->found || !m->dead || !m->same) {
+		np_expect_matcher_free(m);
+		return NULL;
+	}
+	for (i = 0; i < expect_count; i++) {
+		m->same[i] = -1;
+		if (flags & NP_MATCH_VERBOSE)
+			printf("looking for [%s] %s the response\n", server_expect[i],
+			    (flags & NP_MATCH_EXACT) ? "in beginning of" : "anywhere in");
+	}
+
+	if (!(flags & NP_MATCH_EXACT) && np_expect_build_automaton(m) < 0) {
+		np_expect_matcher_free(m);
+		return NULL;
+	}
+
+	/* an empty expect string matches any response */
+	for (i = 0; i < expect_count; i++)
+		if (server_expect[i][0] == '\0' && !m->found[i]) {
+			m->found[i] = 1;
+			m->nfound++;
+		}
+
+	return m;
+}
+
+enum np_match_result
+np_expect_matcher_feed(np_expect_matcher *m, const char *data, size_t len)
+{
+	const unsigned char *p = (const unsigned char *)data;
+	size_t n;
+	int i, s;
+
+	/* np_expect_match() works on C strings, so nothing after a NUL counts */
+	for (n = 0; n < len && !m->stopped; n++) {
+		if (p[n] == '\0') {
+			m->stopped = 1;
+			break;
+		}
+	}
+	len = n;
+
+	if (m->flags & NP_MATCH_EXACT) {
+		for (i = 0; i < m->count; i++) {
+			size_t elen, cmp;
+
+			if (m->found[i] || m->dead[i])
+				continue;
+			elen = strlen(m->expect[i]);
+			cmp = (m->pos + len < elen ? m->pos + len : elen) - m->pos;
+			if (memcmp(data, m->expect[i] + m->pos, cmp) != 0) {
+				m->dead[i] = 1;
+				m->ndead++;
+			} else if (m->pos + cmp == elen) {
+				np_expect_mark(m, i);
+			}
+		}
+	} else {
+		s = m->state;
+		for (n = 0; n < len; n++) {
+			s = m->delta[s * 256 + p[n]];
+			if (m->out[s] >= 0)
+				np_expect_mark(m, m->out[s]);
+			for (i = m->dict[s]; i >= 0; i = m->dict[i])
+				np_expect_mark(m, m->out[i]);
+		}
+		m->state = s;
+	}
+	m->pos += len;
+
+	if ((m->flags & NP_MATCH_ALL && m->nfound == m->count) ||
+	    (!(m->flags & NP_MATCH_ALL) && m->nfound >= 1))
+		return NP_MATCH_SUCCESS;
+	else if (!(m->flags & NP_MATCH_EXACT) || m->nfound + m->ndead < m->count)
+		return NP_MATCH_RETRY;
+	else
+		return NP_MATCH_FAILURE;
+}
+
+void
+np_expect_matcher_free(np_expect_matcher *m)
+{
+	if (m == NULL)
+		return;
+	free(m->found);
+	free(m->dead);
+	free(m->same);
+	free(m->delta);
+	free(m->out);
+	free(m->dict);
+	free(m);
+}
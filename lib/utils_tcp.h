@@ -20,3 +20,21 @@ enum np_match_result np_expect_match(char *status,
                                      char **server_expect,
                                      int server_expect_count,
                                      int flags);
+
+/*
+ * Incremental version of np_expect_match(): the matcher is fed the response
+ * chunk by chunk as it is received and keeps its state between calls, so
+ * each byte is only looked at once.  Substring matching runs an Aho-Corasick
+ * automaton over all expect strings, NP_MATCH_EXACT only follows the strings
+ * that are still a possible prefix.  The results are the same as calling
+ * np_expect_match() on everything fed so far.
+ */
+typedef struct np_expect_matcher np_expect_matcher;
+
+np_expect_matcher *np_expect_matcher_new(char **server_expect,
+                                         int server_expect_count,
+                                         int flags);
+enum np_match_result np_expect_matcher_feed(np_expect_matcher *matcher,
+                                            const char *data,
+                                            size_t len);
+void np_expect_matcher_free(np_expect_matcher *matcher);
@@ -155,9 +155,22 @@ typedef struct dhcp_offer_struct {
   u_int32_t lease_time;           /* lease time in seconds */
   u_int32_t renewal_time;         /* renewal time in seconds */
   u_int32_t rebinding_time;       /* rebinding time in seconds */
+  double latency;                 /* seconds from DHCPDISCOVER to this offer */
   struct dhcp_offer_struct *next;
 } dhcp_offer;
 
+/* one DHCPDISCOVER in flight: sent out of an interface, or in unicast mode
+ * relayed to one server.  offers are matched back to it by xid. */
+typedef struct dhcp_probe_struct {
+  char interface_name[IFNAMSIZ];
+  int sock; /* shared by all probes on the same interface */
+  unsigned char hardware_address[MAX_DHCP_CHADDR_LENGTH];
+  struct in_addr my_ip;     /* relay address (unicast mode) */
+  struct in_addr server_ip; /* server to query (unicast mode) */
+  u_int32_t xid;
+  struct timeval sent;
+} dhcp_probe;
+
 typedef struct requested_server_struct {
   struct in_addr server_address;
   int answered;
@@ -203,8 +216,11 @@ unsigned char client_hardware_address[MAX_DHCP_CHADDR_LENGTH] = "";
 unsigned char *user_specified_mac = NULL;
 
 char network_interface_name[IFNAMSIZ] = "eth0";
+char **interface_names = NULL; /* all interfaces given with -i */
+int num_interfaces = 0;
 
-u_int32_t packet_xid = 0;
+dhcp_probe *probes = NULL;
+int num_probes = 0;
 
 u_int32_t dhcp_lease_time = 0;
 u_int32_t dhcp_renewal_time = 0;
@@ -236,22 +252,24 @@ void print_hardware_address(const unsigned char *);
 int get_hardware_address(int, char *);
 int get_ip_address(int, char *);
 
-int send_dhcp_discover(int);
-int get_dhcp_offer(int);
+int setup_dhcp_probes(void);
+int send_dhcp_discover(dhcp_probe *);
+int get_dhcp_offer(void);
 
 int get_results(void);
 
-int add_dhcp_offer(struct in_addr, dhcp_packet *);
+int add_dhcp_offer(struct in_addr, dhcp_packet *, double);
+int requested_servers_answered(void);
 int free_dhcp_offer_list(void);
 int free_requested_server_list(void);
 
-int create_dhcp_socket(void);
+int create_dhcp_socket(const char *);
 int close_dhcp_socket(int);
 int send_dhcp_packet(void *, int, int, struct sockaddr_in *);
 int receive_dhcp_packet(void *, int, int, int, struct sockaddr_in *);
 
 int main(int argc, char **argv) {
-  int dhcp_socket;
+  int i;
   int result = STATE_UNKNOWN;
 
   setlocale(LC_ALL, "");
@@ -272,28 +290,23 @@ int main(int argc, char **argv) {
   /* this plugin almost certainly needs root permissions. */
   np_warn_if_not_root();
 
-  /* create socket for DHCP communications */
-  dhcp_socket = create_dhcp_socket();
+  /* create sockets for DHCP communications, one per interface */
+  setup_dhcp_probes();
 
-  /* get hardware address of client machine */
-  if (user_specified_mac != NULL) {
-    memcpy(client_hardware_address, user_specified_mac, 6);
-  } else {
-    get_hardware_address(dhcp_socket, network_interface_name);
+  /* send all DHCPDISCOVER packets at once */
+  for (i = 0; i < num_probes; i++) {
+    send_dhcp_discover(&probes[i]);
   }
 
-  if (unicast) { /* get IP address of client machine */
-    get_ip_address(dhcp_socket, network_interface_name);
-  }
+  /* wait for DHCPOFFER packets */
+  get_dhcp_offer();
 
-  /* send DHCPDISCOVER packet */
-  send_dhcp_discover(dhcp_socket);
-
-  /* wait for a DHCPOFFER packet */
-  get_dhcp_offer(dhcp_socket);
-
-  /* close socket we created */
-  close_dhcp_socket(dhcp_socket);
+  /* close sockets we created */
+  for (i = 0; i < num_probes; i++) {
+    if (i == 0 || probes[i].sock != probes[i - 1].sock) {
+      close_dhcp_socket(probes[i].sock);
+    }
+  }
 
   /* determine state/plugin output to return */
   result = get_results();
@@ -301,10 +314,72 @@ int main(int argc, char **argv) {
   /* free allocated memory */
   free_dhcp_offer_list();
   free_requested_server_list();
+  free(probes);
 
   return result;
 }
 
+/* opens a socket on each interface and sets up the DHCPDISCOVERs to send
+ * through it: one broadcast, or in unicast mode one per requested server */
+int setup_dhcp_probes(void) {
+  requested_server *server;
+  dhcp_probe probe;
+  int i;
+
+  if (num_interfaces == 0) {
+    interface_names = malloc(sizeof(char *));
+    if (interface_names == NULL) {
+      die(STATE_UNKNOWN, _("Could not allocate memory for interface list\n"));
+    }
+    interface_names[num_interfaces++] = network_interface_name;
+  }
+
+  for (i = 0; i < num_interfaces; i++) {
+    bzero(&probe, sizeof(probe));
+    strncpy(probe.interface_name, interface_names[i], IFNAMSIZ - 1);
+
+    /* in unicast mode the socket is bound to the address of its interface,
+     * so that has to be known first */
+    if (unicast) {
+      probe.sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+      if (probe.sock < 0) {
+        printf(_("Error: Could not create socket!\n"));
+        exit(STATE_UNKNOWN);
+      }
+      get_ip_address(probe.sock, probe.interface_name);
+      close(probe.sock);
+      probe.my_ip = my_ip;
+    }
+    probe.sock = create_dhcp_socket(probe.interface_name);
+
+    /* get hardware address of client machine */
+    if (user_specified_mac != NULL) {
+      memcpy(client_hardware_address, user_specified_mac, 6);
+    } else {
+      get_hardware_address(probe.sock, probe.interface_name);
+    }
+    memcpy(probe.hardware_address, client_hardware_address,
+           sizeof(probe.hardware_address));
+
+    server = unicast ? requested_server_list : NULL;
+    do {
+      if (server != NULL) {
+        probe.server_ip = server->server_address;
+        server = server->next;
+      } else {
+        probe.server_ip = dhcp_ip;
+      }
+      probes = realloc(probes, sizeof(dhcp_probe) * (num_probes + 1));
+      if (probes == NULL) {
+        die(STATE_UNKNOWN, _("Could not allocate memory for DHCP probes\n"));
+      }
+      probes[num_probes++] = probe;
+    } while (server != NULL);
+  }
+
+  return OK;
+}
+
 /* determines hardware address on client machine */
 int get_hardware_address(int sock, char *interface_name) {
 
@@ -455,7 +530,7 @@ int get_ip_address(int sock, char *interface_name) {
 }
 
 /* sends a DHCPDISCOVER broadcast message in an attempt to find DHCP servers */
-int send_dhcp_discover(int sock) {
+int send_dhcp_discover(dhcp_probe *probe) {
   dhcp_packet discover_packet;
   struct sockaddr_in sockaddr_broadcast;
   unsigned short opts;
@@ -478,17 +553,17 @@ int send_dhcp_discover(int sock) {
    * to srand & random if not.
    */
   int randfd = open("/dev/urandom", O_RDONLY);
-  if (randfd > 2 && read(randfd, (char *)&packet_xid, sizeof(uint32_t)) >= 0) {
-    /* no-op as we have successfully filled packet_xid */
+  if (randfd > 2 && read(randfd, (char *)&probe->xid, sizeof(uint32_t)) >= 0) {
+    /* no-op as we have successfully filled probe->xid */
   } else {
     /* fallback bad rand */
-    srand(time(NULL));
-    packet_xid = random();
+    srand(time(NULL) + (probe - probes));
+    probe->xid = random();
   }
   if (randfd > 2) {
     close(randfd);
   }
-  discover_packet.xid = htonl(packet_xid);
+  discover_packet.xid = htonl(probe->xid);
 
   /* WHAT THE HECK IS UP WITH THIS?!?  IF I DON'T MAKE THIS CALL, ONLY ONE
    * SERVER RESPONSE IS PROCESSED!!!! */
@@ -505,7 +580,7 @@ int send_dhcp_discover(int sock) {
   discover_packet.flags = unicast ? 0 : htons(DHCP_BROADCAST_FLAG);
 
   /* our hardware address */
-  memcpy(discover_packet.chaddr, client_hardware_address,
+  memcpy(discover_packet.chaddr, probe->hardware_address,
          ETHERNET_HARDWARE_ADDRESS_LENGTH);
 
   /* first four bytes of options field is magic cookie (as per RFC 2132) */
@@ -534,7 +609,7 @@ int send_dhcp_discover(int sock) {
 
   /* unicast fields */
   if (unicast) {
-    discover_packet.giaddr.s_addr = my_ip.s_addr;
+    discover_packet.giaddr.s_addr = probe->my_ip.s_addr;
   }
 
   /* see RFC 1542, 4.1.1 */
@@ -544,13 +619,13 @@ int send_dhcp_discover(int sock) {
   sockaddr_broadcast.sin_family = address_family;
   sockaddr_broadcast.sin_port = htons(DHCP_SERVER_PORT);
   sockaddr_broadcast.sin_addr.s_addr =
-      unicast ? dhcp_ip.s_addr : INADDR_BROADCAST;
+      unicast ? probe->server_ip.s_addr : INADDR_BROADCAST;
   bzero(&sockaddr_broadcast.sin_zero, sizeof(sockaddr_broadcast.sin_zero));
 
   if (verbose) {
-    printf(_("DHCPDISCOVER to %s port %d\n"),
+    printf(_("DHCPDISCOVER to %s port %d on %s\n"),
            inet_ntoa(sockaddr_broadcast.sin_addr),
-           ntohs(sockaddr_broadcast.sin_port));
+           ntohs(sockaddr_broadcast.sin_port), probe->interface_name);
     printf("DHCPDISCOVER XID: %u (0x%X)\n", ntohl(discover_packet.xid),
            ntohl(discover_packet.xid));
     printf("DHCDISCOVER ciaddr:  %s\n", inet_ntoa(discover_packet.ciaddr));
@@ -560,7 +635,8 @@ int send_dhcp_discover(int sock) {
   }
 
   /* send the DHCPDISCOVER packet out */
-  send_dhcp_packet(&discover_packet, sizeof(discover_packet), sock,
+  gettimeofday(&probe->sent, NULL);
+  send_dhcp_packet(&discover_packet, sizeof(discover_packet), probe->sock,
                    &sockaddr_broadcast);
 
   if (verbose) {
@@ -570,111 +646,159 @@ int send_dhcp_discover(int sock) {
   return OK;
 }
 
-/* waits for a DHCPOFFER message from one or more DHCP servers */
-int get_dhcp_offer(int sock) {
+/* waits for DHCPOFFER messages from one or more DHCP servers, on all
+ * interfaces at once.  returns early once every requested server has
+ * made an offer. */
+int get_dhcp_offer(void) {
   dhcp_packet offer_packet;
   struct sockaddr_in source;
   struct sockaddr_in via;
+  struct pollfd *pfds;
+  struct timeval now;
+  dhcp_probe *probe;
   int result = OK;
   int responses = 0;
-  int x;
-  time_t start_time;
-  time_t current_time;
-
-  time(&start_time);
+  int nsocks = 0;
+  int wait_ms;
+  int i, x;
+  long elapsed_ms;
+
+  /* one pollfd per socket; probes on the same interface are adjacent */
+  pfds = malloc(sizeof(struct pollfd) * num_probes);
+  if (pfds == NULL) {
+    die(STATE_UNKNOWN, _("Could not allocate memory for poll list\n"));
+  }
+  for (i = 0; i < num_probes; i++) {
+    if (i == 0 || probes[i].sock != probes[i - 1].sock) {
+      pfds[nsocks].fd = probes[i].sock;
+      pfds[nsocks].events = POLLIN;
+      nsocks++;
+    }
+  }
 
   /* receive as many responses as we can */
   for (responses = 0, valid_responses = 0;;) {
-    time(&current_time);
-    if ((current_time - start_time) >= dhcpoffer_timeout) {
+    if (requested_servers > 0 && requested_servers_answered()) {
+      if (verbose) {
+        printf(_("All requested servers have made an offer\n"));
+      }
       break;
     }
 
-    if (verbose) {
-      printf("\n\n");
+    gettimeofday(&now, NULL);
+    elapsed_ms = (now.tv_sec - probes[0].sent.tv_sec) * 1000 +
+                 (now.tv_usec - probes[0].sent.tv_usec) / 1000;
+    wait_ms = dhcpoffer_timeout * 1000 - elapsed_ms;
+    if (wait_ms <= 0) {
+      break;
     }
 
-    bzero(&source, sizeof(source));
-    bzero(&via, sizeof(via));
-    bzero(&offer_packet, sizeof(offer_packet));
-
-    result = receive_dhcp_packet(&offer_packet, sizeof(offer_packet), sock,
-                                 dhcpoffer_timeout, &source);
+    if (poll(pfds, nsocks, wait_ms) <= 0) {
+      continue;
+    }
 
-    if (result != OK) {
-      if (verbose) {
-        printf(_("Result=ERROR\n"));
+    for (i = 0; i < nsocks; i++) {
+      if (!(pfds[i].revents & POLLIN)) {
+        continue;
       }
-      continue;
-    } else {
+
       if (verbose) {
-        printf(_("Result=OK\n"));
+        printf("\n\n");
       }
-      responses++;
-    }
 
-    /* The "source" is either a server or a relay. */
-    /* Save a copy of "source" into "via" even if it's via itself */
-    memcpy(&via, &source, sizeof(source));
+      bzero(&source, sizeof(source));
+      bzero(&via, sizeof(via));
+      bzero(&offer_packet, sizeof(offer_packet));
 
-    if (verbose) {
-      printf(_("DHCPOFFER from IP address %s"), inet_ntoa(source.sin_addr));
-      printf(_(" via %s\n"), inet_ntoa(via.sin_addr));
-      printf("DHCPOFFER XID: %u (0x%X)\n", ntohl(offer_packet.xid),
-             ntohl(offer_packet.xid));
-    }
+      result = receive_dhcp_packet(&offer_packet, sizeof(offer_packet),
+                                   pfds[i].fd, 0, &source);
+      gettimeofday(&now, NULL);
 
-    /* check packet xid to see if its the same as the one we used in the
-     * discover packet */
-    if (ntohl(offer_packet.xid) != packet_xid) {
-      if (verbose) {
-        printf(_("DHCPOFFER XID (%u) did not match DHCPDISCOVER XID (%u) - "
-                 "ignoring packet\n"),
-               ntohl(offer_packet.xid), packet_xid);
+      if (result != OK) {
+        if (verbose) {
+          printf(_("Result=ERROR\n"));
+        }
+        continue;
+      } else {
+        if (verbose) {
+          printf(_("Result=OK\n"));
+        }
+        responses++;
       }
-      continue;
-    }
 
-    /* check hardware address */
-    result = OK;
-    if (verbose) {
-      printf("DHCPOFFER chaddr: ");
-    }
+      /* The "source" is either a server or a relay. */
+      /* Save a copy of "source" into "via" even if it's via itself */
+      memcpy(&via, &source, sizeof(source));
 
-    for (x = 0; x < ETHERNET_HARDWARE_ADDRESS_LENGTH; x++) {
       if (verbose) {
-        printf("%02X", (unsigned char)offer_packet.chaddr[x]);
+        printf(_("DHCPOFFER from IP address %s"), inet_ntoa(source.sin_addr));
+        printf(_(" via %s\n"), inet_ntoa(via.sin_addr));
+        printf("DHCPOFFER XID: %u (0x%X)\n", ntohl(offer_packet.xid),
+               ntohl(offer_packet.xid));
       }
 
-      if (offer_packet.chaddr[x] != client_hardware_address[x]) {
-        result = ERROR;
+      /* find the DHCPDISCOVER this is an answer to by its xid */
+      for (probe = NULL, x = 0; x < num_probes; x++) {
+        if (probes[x].sock == pfds[i].fd &&
+            probes[x].xid == ntohl(offer_packet.xid)) {
+          probe = &probes[x];
+          break;
+        }
+      }
+      if (probe == NULL) {
+        if (verbose) {
+          printf(_("DHCPOFFER XID (%u) did not match any DHCPDISCOVER XID - "
+                   "ignoring packet\n"),
+                 ntohl(offer_packet.xid));
+        }
+        continue;
       }
-    }
 
-    if (verbose) {
-      printf("\n");
-    }
+      /* check hardware address */
+      result = OK;
+      if (verbose) {
+        printf("DHCPOFFER chaddr: ");
+      }
+
+      for (x = 0; x < ETHERNET_HARDWARE_ADDRESS_LENGTH; x++) {
+        if (verbose) {
+          printf("%02X", (unsigned char)offer_packet.chaddr[x]);
+        }
+
+        if (offer_packet.chaddr[x] != probe->hardware_address[x]) {
+          result = ERROR;
+        }
+      }
 
-    if (result == ERROR) {
       if (verbose) {
-        printf(_("DHCPOFFER hardware address did not match our own - ignoring "
-                 "packet\n"));
+        printf("\n");
       }
-      continue;
-    }
 
-    if (verbose) {
-      printf("DHCPOFFER ciaddr: %s\n", inet_ntoa(offer_packet.ciaddr));
-      printf("DHCPOFFER yiaddr: %s\n", inet_ntoa(offer_packet.yiaddr));
-      printf("DHCPOFFER siaddr: %s\n", inet_ntoa(offer_packet.siaddr));
-      printf("DHCPOFFER giaddr: %s\n", inet_ntoa(offer_packet.giaddr));
-    }
+      if (result == ERROR) {
+        if (verbose) {
+          printf(_("DHCPOFFER hardware address did not match our own - "
+                   "ignoring packet\n"));
+        }
+        continue;
+      }
+
+      if (verbose) {
+        printf("DHCPOFFER ciaddr: %s\n", inet_ntoa(offer_packet.ciaddr));
+        printf("DHCPOFFER yiaddr: %s\n", inet_ntoa(offer_packet.yiaddr));
+        printf("DHCPOFFER siaddr: %s\n", inet_ntoa(offer_packet.siaddr));
+        printf("DHCPOFFER giaddr: %s\n", inet_ntoa(offer_packet.giaddr));
+      }
 
-    add_dhcp_offer(source.sin_addr, &offer_packet);
+      add_dhcp_offer(source.sin_addr, &offer_packet,
+                     (now.tv_sec - probe->sent.tv_sec) +
+                         (now.tv_usec - probe->sent.tv_usec) / 1000000.0);
 
-    valid_responses++;
+      valid_responses++;
+    }
   }
 
+  free(pfds);
+
   if (verbose) {
     printf(_("Total responses seen on the wire: %d\n"), responses);
     printf(_("Valid responses for this machine: %d\n"), valid_responses);
@@ -763,7 +887,7 @@ int receive_dhcp_packet(void *buffer, int buffer_size, int sock, int timeout,
 }
 
 /* creates a socket for DHCP communication */
-int create_dhcp_socket(void) {
+int create_dhcp_socket(const char *interface_name) {
   struct sockaddr_in myname;
   struct ifreq interface;
   int sock;
@@ -805,18 +929,18 @@ int create_dhcp_socket(void) {
 
     /* bind socket to interface */
 #if defined(__linux__)
-  strncpy(interface.ifr_ifrn.ifrn_name, network_interface_name, IFNAMSIZ - 1);
+  strncpy(interface.ifr_ifrn.ifrn_name, interface_name, IFNAMSIZ - 1);
   interface.ifr_ifrn.ifrn_name[IFNAMSIZ - 1] = '\0';
   if (setsockopt(sock, SOL_SOCKET, SO_BINDTODEVICE, (char *)&interface,
                  sizeof(interface)) < 0) {
     printf(_("Error: Could not bind socket to interface %s.  Check your "
              "privileges...\n"),
-           network_interface_name);
+           interface_name);
     exit(STATE_UNKNOWN);
   }
 
 #else
-  strncpy(interface.ifr_name, network_interface_name, IFNAMSIZ - 1);
+  strncpy(interface.ifr_name, interface_name, IFNAMSIZ - 1);
   interface.ifr_name[IFNAMSIZ - 1] = '\0';
 #endif
 
@@ -863,7 +987,8 @@ int add_requested_server(struct in_addr server_address) {
 }
 
 /* adds a DHCP OFFER to list in memory */
-int add_dhcp_offer(struct in_addr source, dhcp_packet *offer_packet) {
+int add_dhcp_offer(struct in_addr source, dhcp_packet *offer_packet,
+                   double latency) {
   dhcp_offer *new_offer;
   int x;
   unsigned option_type;
@@ -970,11 +1095,13 @@ int add_dhcp_offer(struct in_addr source, dhcp_packet *offer_packet) {
   new_offer->lease_time = dhcp_lease_time;
   new_offer->renewal_time = dhcp_renewal_time;
   new_offer->rebinding_time = dhcp_rebinding_time;
+  new_offer->latency = latency;
 
   if (verbose) {
     printf(_("Added offer from server @ %s"),
            inet_ntoa(new_offer->server_address));
-    printf(_(" of IP address %s\n"), inet_ntoa(new_offer->offered_address));
+    printf(_(" of IP address %s"), inet_ntoa(new_offer->offered_address));
+    printf(_(" after %.3f seconds\n"), latency);
   }
 
   /* add new offer to head of list */
@@ -984,6 +1111,28 @@ int add_dhcp_offer(struct in_addr source, dhcp_packet *offer_packet) {
   return OK;
 }
 
+/* returns TRUE once every requested server has made an offer */
+int requested_servers_answered(void) {
+  requested_server *temp_server;
+  dhcp_offer *temp_offer;
+
+  for (temp_server = requested_server_list; temp_server != NULL;
+       temp_server = temp_server->next) {
+    for (temp_offer = dhcp_offer_list; temp_offer != NULL;
+         temp_offer = temp_offer->next) {
+      if (temp_offer->server_address.s_addr ==
+          temp_server->server_address.s_addr) {
+        break;
+      }
+    }
+    if (temp_offer == NULL) {
+      return FALSE;
+    }
+  }
+
+  return TRUE;
+}
+
 /* frees memory allocated to DHCP OFFER list */
 int free_dhcp_offer_list(void) {
   dhcp_offer *this_offer;
@@ -1012,12 +1161,54 @@ int free_requested_server_list(void) {
   return OK;
 }
 
+/* the time each server took to make its first offer */
+char *perfd_offer_latency(void) {
+  dhcp_offer *temp_offer;
+  dhcp_offer *other_offer;
+  double latency;
+  char *label;
+  char *perfdata = "";
+
+  for (temp_offer = dhcp_offer_list; temp_offer != NULL;
+       temp_offer = temp_offer->next) {
+    /* report each server once, at its fastest offer; the list is newest
+     * first, so skip the server if it shows up again further down */
+    latency = temp_offer->latency;
+    for (other_offer = temp_offer->next; other_offer != NULL;
+         other_offer = other_offer->next) {
+      if (other_offer->server_address.s_addr ==
+          temp_offer->server_address.s_addr) {
+        break;
+      }
+    }
+    if (other_offer != NULL) {
+      continue;
+    }
+    for (other_offer = dhcp_offer_list; other_offer != temp_offer;
+         other_offer = other_offer->next) {
+      if (other_offer->server_address.s_addr ==
+              temp_offer->server_address.s_addr &&
+          other_offer->latency < latency) {
+        latency = other_offer->latency;
+      }
+    }
+    xasprintf(&label, "offer_%s", inet_ntoa(temp_offer->server_address));
+    xasprintf(&perfdata, "%s%s%s", perfdata, *perfdata ? " " : "",
+              fperfdata(label, latency, "s", FALSE, 0, FALSE, 0, TRUE, 0,
+                        FALSE, 0));
+    free(label);
+  }
+
+  return perfdata;
+}
+
 /* gets state and plugin output to return */
 int get_results(void) {
   dhcp_offer *temp_offer;
   requested_server *temp_server;
   int result;
   u_int32_t max_lease_time = 0;
+  char *perfdata;
 
   received_requested_address = FALSE;
   responses_none = strdup("");
@@ -1139,7 +1330,8 @@ int get_results(void) {
     printf("%lu sec", (unsigned long)max_lease_time);
   }
 
-  printf(".\n");
+  perfdata = perfd_offer_latency();
+  printf(".%s%s\n", *perfdata ? "|" : "", perfdata);
 
   if (requested_servers > 0 && requested_servers != requested_responses) {
     printf("No response from:%s\n", responses_none);
@@ -1222,10 +1414,13 @@ int process_arguments(int argc, char **argv) {
       }
       break;
 
-    case 'i': /* interface name */
-      strncpy(network_interface_name, optarg,
-              sizeof(network_interface_name) - 1);
-      network_interface_name[sizeof(network_interface_name) - 1] = '\x0';
+    case 'i': /* interface name, may be given more than once */
+      interface_names =
+          realloc(interface_names, sizeof(char *) * (num_interfaces + 1));
+      if (interface_names == NULL) {
+        die(STATE_UNKNOWN, _("Could not allocate memory for interface list\n"));
+      }
+      interface_names[num_interfaces++] = optarg;
       break;
 
     case 'u': /* unicast testing */
@@ -1461,10 +1656,16 @@ void print_help(void) {
   printf("    %s\n", _("Seconds to wait for DHCPOFFER before timeout occurs"));
   printf(" %s\n", "-i, --interface=STRING");
   printf("    %s\n", _("Interface to to use for listening (i.e. eth0)"));
+  printf("    %s\n", _("May be given more than once to probe several interfaces at once"));
   printf(" %s\n", "-m, --mac=STRING");
   printf("    %s\n", _("MAC address to use in the DHCP request"));
   printf(" %s\n", "-u, --unicast");
   printf("    %s\n", _("Unicast testing: mimic a DHCP relay, requires -s"));
+  printf("    %s\n", _("Each -s server is queried at the same time"));
+  printf("\n");
+  printf("%s\n", _("Notes:"));
+  printf(" %s\n", _("The plugin stops waiting as soon as every -s server has made an offer."));
+  printf(" %s\n", _("The time to the first offer of each server is reported as perfdata."));
   printf(UT_SUPPORT);
   return;
 }
@@ -1473,6 +1674,6 @@ void print_usage(void) {
   printf("%s\n", _("Usage:"));
   printf(" %s [-v] [-u] [-s serverip] [-r requestedip] [-t timeout]\n",
          progname);
-  printf("                  [-i interface] [-m mac]\n");
+  printf("                  [-i interface [-i interface ...]] [-m mac]\n");
   return;
 }
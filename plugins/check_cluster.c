@@ -29,12 +29,25 @@ const char *email = "devel@nagios-plugins.org";
 #include "common.h"
 #include "utils.h"
 #include "utils_base.h"
+#include "regex.h"
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #define CHECK_SERVICES	1
 #define CHECK_HOSTS	2
 
+/* longest name kept of a host or service, and longest line parsed */
+#define MAX_NAME	1024
+#define MAX_LINE	8192
+
 void print_help (void);
 void print_usage (void);
+void count_state (int);
+int is_member (const char *, const char *);
+FILE *open_source (const char *);
+void read_status_file (FILE *);
+void read_state_lines (FILE *);
+FILE *query_livestatus (const char *);
 
 int total_services_ok=0;
 int total_services_warning=0;
@@ -52,6 +65,12 @@ int check_type=CHECK_SERVICES;
 
 char *data_vals=NULL;
 char *label=NULL;
+char *status_file=NULL;
+char *state_file=NULL;
+char *livestatus_socket=NULL;
+regex_t host_regex, service_regex;
+int host_match=FALSE, service_match=FALSE;
+int members=0;
 
 int verbose=0;
 
@@ -61,9 +80,9 @@ int process_arguments(int,char **);
 
 int main(int argc, char **argv){
 	char *ptr;
-	int data_val;
 	int return_code=STATE_OK;
 	thresholds *thresholds = NULL;
+	FILE *fp;
 
 	setlocale (LC_ALL, "");
 	bindtextdomain (PACKAGE, LOCALEDIR);
@@ -80,45 +99,43 @@ int main(int argc, char **argv){
 	if(verbose)
 		print_thresholds("check_cluster", thresholds);
 
+	signal (SIGALRM, timeout_alarm_handler);
+	alarm (timeout_interval);
+
 	/* check the data values */
-	for(ptr=strtok(data_vals,",");ptr!=NULL;ptr=strtok(NULL,",")){
-
-		data_val=atoi(ptr);
-
-		if(check_type==CHECK_SERVICES){
-			switch(data_val){
-			case 0:
-				total_services_ok++;
-				break;
-			case 1:
-				total_services_warning++;
-				break;
-			case 2:
-				total_services_critical++;
-				break;
-			case 3:
-				total_services_unknown++;
-				break;
-			default:
-				break;
-		        }
-	        }
-		else{
-			switch(data_val){
-			case 0:
-				total_hosts_up++;
-				break;
-			case 1:
-				total_hosts_down++;
-				break;
-			case 2:
-				total_hosts_unreachable++;
-				break;
-			default:
-				break;
-		        }
-	        }
-        }
+	if(data_vals!=NULL){
+		for(ptr=strtok(data_vals,",");ptr!=NULL;ptr=strtok(NULL,","))
+			count_state(atoi(ptr));
+	}
+
+	/* and the states of the members in each source */
+	if(status_file!=NULL){
+		fp=open_source(status_file);
+		read_status_file(fp);
+		if(fp!=stdin)
+			fclose(fp);
+	}
+	if(state_file!=NULL){
+		fp=open_source(state_file);
+		read_state_lines(fp);
+		if(fp!=stdin)
+			fclose(fp);
+	}
+	if(livestatus_socket!=NULL){
+		fp=query_livestatus(livestatus_socket);
+		read_state_lines(fp);
+		fclose(fp);
+	}
+
+	alarm (0);
+
+	if(verbose && data_vals==NULL)
+		printf(_("%d members\n"), members);
+
+	/* a cluster of no members is a typo in -m or -M, not a healthy one */
+	if(data_vals==NULL && members==0)
+		die(STATE_UNKNOWN, _("CLUSTER UNKNOWN: %s: no members matched\n"),
+		    (label!=NULL)?label:(check_type==CHECK_SERVICES)?"Service cluster":"Host cluster");
 
 
 	/* return the status of the cluster */
@@ -140,12 +157,225 @@ int main(int argc, char **argv){
 }
 
 
+void count_state(int data_val){
+
+	if(check_type==CHECK_SERVICES){
+		switch(data_val){
+		case 0:
+			total_services_ok++;
+			break;
+		case 1:
+			total_services_warning++;
+			break;
+		case 2:
+			total_services_critical++;
+			break;
+		case 3:
+			total_services_unknown++;
+			break;
+		default:
+			break;
+	        }
+        }
+	else{
+		switch(data_val){
+		case 0:
+			total_hosts_up++;
+			break;
+		case 1:
+			total_hosts_down++;
+			break;
+		case 2:
+			total_hosts_unreachable++;
+			break;
+		default:
+			break;
+	        }
+        }
+}
+
+
+/* whether a host or service is in the cluster, by --host-match and
+ * --service-match; names that are not known are "" */
+int is_member(const char *host, const char *service){
+
+	if(host_match && regexec(&host_regex, host, 0, NULL, 0)!=0)
+		return FALSE;
+	if(check_type==CHECK_SERVICES && service_match &&
+	   regexec(&service_regex, service, 0, NULL, 0)!=0)
+		return FALSE;
+	return TRUE;
+}
+
+
+/* counts the state of a member, or nothing if state is not a number */
+static void
+count_member(const char *host, const char *service, const char *state){
+	char *end;
+	long data_val;
+
+	data_val=strtol(state, &end, 10);
+	if(end==state || *end!='\0' || !is_member(host, service))
+		return;
+	if(verbose>1)
+		printf("%s%s%s: %ld\n", host, (check_type==CHECK_SERVICES)?";":"",
+		       (check_type==CHECK_SERVICES)?service:"", data_val);
+	members++;
+	count_state((int)data_val);
+}
+
+
+/*
+ * reads one line of at most size-1 characters into buf, without the
+ * newline.  The rest of a longer line is skipped and *truncated set, so
+ * that any source is read in bounded memory.
+ */
+static char *
+read_line(FILE *fp, char *buf, size_t size, int *truncated){
+	size_t len;
+	int c;
+
+	if(fgets(buf, size, fp)==NULL)
+		return NULL;
+	len=strlen(buf);
+	*truncated=FALSE;
+	if(len>0 && buf[len-1]=='\n')
+		buf[--len]='\0';
+	else if(!feof(fp)){
+		*truncated=TRUE;
+		while((c=fgetc(fp))!=EOF && c!='\n');
+	}
+	if(len>0 && buf[len-1]=='\r')
+		buf[--len]='\0';
+	return buf;
+}
+
+
+FILE *open_source(const char *file){
+	FILE *fp;
+
+	if(!strcmp(file, "-"))
+		return stdin;
+	if((fp=fopen(file, "r"))==NULL)
+		die(STATE_UNKNOWN, _("CLUSTER UNKNOWN: Cannot read %s: %s\n"), file, strerror(errno));
+	return fp;
+}
+
+
+/*
+ * counts the hosts or services of a Nagios status.dat, a block at a time:
+ *
+ * servicestatus {
+ *	host_name=web1
+ *	service_description=HTTP
+ *	current_state=0
+ *	...
+ *	}
+ *
+ * Nagios 2 calls the blocks host and service.
+ */
+void read_status_file(FILE *fp){
+	char line[MAX_LINE], host[MAX_NAME], service[MAX_NAME], state[16];
+	char *p;
+	int in_block=FALSE, truncated;
+
+	while((p=read_line(fp, line, sizeof(line), &truncated))!=NULL){
+		/* plugin output is the only thing that gets this long */
+		if(truncated)
+			continue;
+		p+=strspn(p, " \t");
+
+		if(!in_block){
+			if(check_type==CHECK_SERVICES)
+				in_block=!strcmp(p, "servicestatus {") || !strcmp(p, "service {");
+			else
+				in_block=!strcmp(p, "hoststatus {") || !strcmp(p, "host {");
+			host[0]=service[0]=state[0]='\0';
+		}
+		else if(!strcmp(p, "}")){
+			count_member(host, service, state);
+			in_block=FALSE;
+		}
+		else if(!strncmp(p, "host_name=", 10))
+			strncpy(host, p+10, sizeof(host)-1)[sizeof(host)-1]='\0';
+		else if(!strncmp(p, "service_description=", 20))
+			strncpy(service, p+20, sizeof(service)-1)[sizeof(service)-1]='\0';
+		else if(!strncmp(p, "current_state=", 14))
+			strncpy(state, p+14, sizeof(state)-1)[sizeof(state)-1]='\0';
+	}
+	if(ferror(fp))
+		die(STATE_UNKNOWN, _("CLUSTER UNKNOWN: Error reading %s\n"), status_file);
+}
+
+
+/*
+ * counts lines of [host;]state for host clusters and [host;service;]state
+ * for service clusters, which is what livestatus returns for the queries
+ * in query_livestatus()
+ */
+void read_state_lines(FILE *fp){
+	char line[MAX_LINE], *field[3], *p;
+	int n, truncated;
+
+	while((p=read_line(fp, line, sizeof(line), &truncated))!=NULL){
+		if(truncated || *p=='\0')
+			continue;
+		for(n=0, field[0]=p; n<2 && (p=strchr(p, ';'))!=NULL; ){
+			*p++='\0';
+			field[++n]=p;
+		}
+		if(n==0)
+			count_member("", "", field[0]);
+		else if(check_type==CHECK_HOSTS && n==1)
+			count_member(field[0], "", field[1]);
+		else if(check_type==CHECK_SERVICES && n==2 && strchr(field[2], ';')==NULL)
+			count_member(field[0], field[1], field[2]);
+	}
+}
+
+
+/* the states of all hosts or services from a livestatus socket */
+FILE *query_livestatus(const char *path){
+	struct sockaddr_un su;
+	const char *query;
+	FILE *fp;
+	int sd;
+
+	if(check_type==CHECK_SERVICES)
+		query="GET services\nColumns: host_name description state\n\n";
+	else
+		query="GET hosts\nColumns: name state\n\n";
+
+	if(strlen(path)>=sizeof(su.sun_path))
+		die(STATE_UNKNOWN, _("CLUSTER UNKNOWN: Socket path too long: %s\n"), path);
+	memset(&su, 0, sizeof(su));
+	su.sun_family=AF_UNIX;
+	strcpy(su.sun_path, path);
+	if((sd=socket(PF_UNIX, SOCK_STREAM, 0))<0 ||
+	   connect(sd, (struct sockaddr *)&su, sizeof(su))<0 ||
+	   write(sd, query, strlen(query))!=(ssize_t)strlen(query))
+		die(STATE_UNKNOWN, _("CLUSTER UNKNOWN: Cannot query %s: %s\n"), path, strerror(errno));
+	shutdown(sd, SHUT_WR);
+	if((fp=fdopen(sd, "r"))==NULL)
+		die(STATE_UNKNOWN, _("CLUSTER UNKNOWN: Cannot query %s: %s\n"), path, strerror(errno));
+	return fp;
+}
+
 
 int process_arguments(int argc, char **argv){
 	int c;
 	int option=0;
+	int cflags=REG_NOSUB|REG_EXTENDED;
+	int errcode;
+	char errbuf[MAX_INPUT_BUFFER];
 	static struct option longopts[]={
 		{"data",     required_argument,0,'d'},
+		{"status-file", required_argument,0,'f'},
+		{"state-file", required_argument,0,'F'},
+		{"livestatus", required_argument,0,'S'},
+		{"host-match", required_argument,0,'m'},
+		{"service-match", required_argument,0,'M'},
+		{"timeout",  required_argument,0,'t'},
 		{"warning",  required_argument,0,'w'},
 		{"critical", required_argument,0,'c'},
 		{"label",    required_argument,0,'l'},
@@ -163,7 +393,7 @@ int process_arguments(int argc, char **argv){
 
 	while(1){
 
-		c=getopt_long(argc,argv,"hHsvVw:c:d:l:",longopts,&option);
+		c=getopt_long(argc,argv,"hHsvVw:c:d:l:f:F:S:m:M:t:",longopts,&option);
 
 		if(c==-1 || c==EOF || c==1)
 			break;
@@ -194,6 +424,40 @@ int process_arguments(int argc, char **argv){
 			label=(char *)strdup(optarg);
 			break;
 
+		case 'f': /* Nagios status.dat */
+			status_file=optarg;
+			break;
+
+		case 'F': /* file of states */
+			state_file=optarg;
+			break;
+
+		case 'S': /* livestatus socket */
+			livestatus_socket=optarg;
+			break;
+
+		case 'm': /* host members */
+			if((errcode=regcomp(&host_regex, optarg, cflags))!=0){
+				regerror(errcode, &host_regex, errbuf, MAX_INPUT_BUFFER);
+				usage2(_("Could not compile regular expression"), errbuf);
+			}
+			host_match=TRUE;
+			break;
+
+		case 'M': /* service members */
+			if((errcode=regcomp(&service_regex, optarg, cflags))!=0){
+				regerror(errcode, &service_regex, errbuf, MAX_INPUT_BUFFER);
+				usage2(_("Could not compile regular expression"), errbuf);
+			}
+			service_match=TRUE;
+			break;
+
+		case 't': /* timeout */
+			if(!is_intpos(optarg))
+				usage2(_("Timeout interval must be a positive integer"), optarg);
+			timeout_interval=atoi(optarg);
+			break;
+
 		case 'v': /* verbose */
 			verbose++;
 			break;
@@ -214,7 +478,7 @@ int process_arguments(int argc, char **argv){
 	        }
 	}
 
-	if(data_vals==NULL)
+	if(data_vals==NULL && status_file==NULL && state_file==NULL && livestatus_socket==NULL)
 		return ERROR;
 
 	return OK;
@@ -250,6 +514,20 @@ print_help(void)
 	printf (" %s\n", "-d, --data=LIST");
 	printf ("    %s\n", _("The status codes of the hosts or services in the cluster, separated by"));
 	printf ("    %s\n", _("commas"));
+	printf (" %s\n", "-f, --status-file=FILE");
+	printf ("    %s\n", _("Read the states of the hosts or services from a Nagios status.dat"));
+	printf (" %s\n", "-F, --state-file=FILE");
+	printf ("    %s\n", _("Read the states from a file (\"-\" for stdin) with one host;state or"));
+	printf ("    %s\n", _("host;service;state per line"));
+	printf (" %s\n", "-S, --livestatus=SOCKET");
+	printf ("    %s\n", _("Query the states from a livestatus Unix socket"));
+	printf (" %s\n", "-m, --host-match=REGEX");
+	printf ("    %s\n", _("Only count hosts or services of hosts whose name matches REGEX"));
+	printf (" %s\n", "-M, --service-match=REGEX");
+	printf ("    %s\n", _("Only count services whose description matches REGEX"));
+	printf ("    %s\n", _("A status file, state file or livestatus query without any matching host"));
+	printf ("    %s\n", _("or service is UNKNOWN"));
+	printf (UT_PLUG_TIMEOUT, DEFAULT_SOCKET_TIMEOUT);
 
 	printf(UT_VERBOSE);
 
@@ -262,6 +540,9 @@ print_help(void)
 	printf (" %s\n", "check_cluster -s -d 2,0,2,0 -c @3:");
 	printf ("    %s\n", _("Will alert critical if there are 3 or more service data points in a non-OK") );
 	printf ("    %s\n", _("state.") );
+	printf (" %s\n", "check_cluster -s -f /usr/local/nagios/var/status.dat -m '^web' -M '^HTTP$' -c @2:");
+	printf ("    %s\n", _("Will alert critical if the HTTP service is not OK on 2 or more of the web"));
+	printf ("    %s\n", _("hosts."));
 
 	printf(UT_SUPPORT);
 }
@@ -274,6 +555,8 @@ print_usage(void)
 	printf("%s\n", _("Usage:"));
 	printf(" %s (-s | -h) -d val1[,val2,...,valn] [-l label]\n", progname);
 	printf("[-w threshold] [-c threshold] [-v] [--help]\n");
+	printf(" %s (-s | -h) (-f status.dat | -F file | -S socket) [-m regex]\n", progname);
+	printf("[-M regex] [-l label] [-w threshold] [-c threshold] [-t timeout] [-v]\n");
 
 }
 
@@ -218,9 +218,9 @@ main (int argc, char **argv)
 {
   int result = STATE_UNKNOWN;
   int disk_result = STATE_UNKNOWN;
-  char *output = NULL;
+  np_buf output = NP_BUF_INIT;
   char *details;
-  char *perf;
+  np_buf perf = NP_BUF_INIT;
   char *preamble;
   char *flag_header = NULL;
   char *label_name;
@@ -230,7 +230,11 @@ main (int argc, char **argv)
   double warning_high_tide;
   double critical_high_tide;
   int temp_result;
-  int temp_result2;
+  int states[6], pair;
+  double values[6];
+  thresholds **path_thresholds;
+  np_thresholds_batch *batch, path_batch;
+  size_t num_paths, path_index;
 
   struct mount_entry *me;
   struct mount_entry *last_me = NULL;
@@ -245,9 +249,7 @@ main (int argc, char **argv)
 #endif
 
   preamble = strdup (" - free space:");
-  output = strdup ("");
   details = strdup ("");
-  perf = strdup ("");
   stat_buf = malloc(sizeof *stat_buf);
 
   setlocale (LC_ALL, "");
@@ -329,8 +331,25 @@ main (int argc, char **argv)
       }
   }
 
+  /* the three pairs of thresholds of every path, compiled once */
+  for (num_paths = 0, path = path_select_list; path; path = path->name_next)
+    num_paths++;
+  path_thresholds = malloc (6 * num_paths * sizeof (thresholds *) + 1);
+  if (path_thresholds == NULL)
+    die (STATE_UNKNOWN, _("Could not allocate memory for the thresholds\n"));
+  for (path_index = 0, path = path_select_list; path; path = path->name_next, path_index += 6) {
+    path_thresholds[path_index] = path->freespace_units;
+    path_thresholds[path_index + 1] = path->freespace_percent;
+    path_thresholds[path_index + 2] = path->usedspace_units;
+    path_thresholds[path_index + 3] = path->usedspace_percent;
+    path_thresholds[path_index + 4] = path->usedinodes_percent;
+    path_thresholds[path_index + 5] = path->freeinodes_percent;
+  }
+  batch = np_thresholds_compile (path_thresholds, 6 * num_paths);
+  free (path_thresholds);
+
   /* Process for every path in list */
-  for (path = path_select_list; path; path=path->name_next) {
+  for (path = path_select_list, path_index = 0; path; path=path->name_next, path_index += 6) {
     if (verbose_machine_output && path->freespace_percent->warning != NULL && path->freespace_percent->critical != NULL)
       printf("Thresholds(pct) for %s warn: %f crit %f\n",path->name, path->freespace_percent->warning->end,
                                                          path->freespace_percent->critical->end);
@@ -404,44 +423,34 @@ main (int argc, char **argv)
        */
 
 
-      temp_result = get_status(path->dfree_units, path->freespace_units);
-      if (verbose_machine_output) printf("Freespace_units result=%d\n", temp_result);
-      temp_result2 = get_status(path->dfree_pct, path->freespace_percent);
-      if (verbose_machine_output) printf("Freespace%% result=%d\n", temp_result2);
-
-      if (combined_thresholds) {
-        temp_result = min_state(temp_result, temp_result2);
-      }
-      else {
-        temp_result = max_state(temp_result, temp_result2);
-      }
-      disk_result = max_state(disk_result, temp_result);
-
-      temp_result = get_status(path->dused_units, path->usedspace_units);
-      if (verbose_machine_output) printf("Usedspace_units result=%d\n", temp_result);
-      temp_result2 = get_status(path->dused_pct, path->usedspace_percent);
-      if (verbose_machine_output) printf("Usedspace_percent result=%d\n", temp_result2);
+      /* the three pairs of thresholds of this path in one pass */
+      path_batch = np_thresholds_slice(batch, path_index, 6);
+      values[0] = path->dfree_units;
+      values[1] = path->dfree_pct;
+      values[2] = path->dused_units;
+      values[3] = path->dused_pct;
+      values[4] = path->dused_inodes_percent;
+      values[5] = path->dfree_inodes_percent;
+      get_status_batch(&path_batch, values, states, 6);
 
-      if (combined_thresholds) {
-        temp_result = min_state(temp_result, temp_result2);
-      }
-      else {
-        temp_result = max_state(temp_result, temp_result2);
+      if (verbose_machine_output) {
+        printf("Freespace_units result=%d\n", states[0]);
+        printf("Freespace%% result=%d\n", states[1]);
+        printf("Usedspace_units result=%d\n", states[2]);
+        printf("Usedspace_percent result=%d\n", states[3]);
+        printf("Usedinodes_percent result=%d\n", states[4]);
+        printf("Freeinodes_percent result=%d\n", states[5]);
       }
-      disk_result = max_state(disk_result, temp_result);
-
-      temp_result = get_status(path->dused_inodes_percent, path->usedinodes_percent);
-      if (verbose_machine_output) printf("Usedinodes_percent result=%d\n", temp_result);
-      temp_result2 = get_status(path->dfree_inodes_percent, path->freeinodes_percent);
-      if (verbose_machine_output) printf("Freeinodes_percent result=%d\n", temp_result2);
 
-      if (combined_thresholds) {
-        temp_result = min_state(temp_result, temp_result2);
-      }
-      else {
-        temp_result = max_state(temp_result, temp_result2);
+      for (pair = 0; pair < 6; pair += 2) {
+        if (combined_thresholds) {
+          temp_result = min_state(states[pair], states[pair + 1]);
+        }
+        else {
+          temp_result = max_state(states[pair], states[pair + 1]);
+        }
+        disk_result = max_state(disk_result, temp_result);
       }
-      disk_result = max_state(disk_result, temp_result);
 
       result = max_state(result, disk_result);
 
@@ -502,13 +511,12 @@ main (int argc, char **argv)
       } else {
           label_name = (!strcmp(me->me_mountdir, "none") || display_mntp) ? me->me_devname : me->me_mountdir;
           /* Nb: *_high_tide are unset when == ULONG_MAX */
-          xasprintf (&perf, "%s %s", perf,
-                     perfdata (label_name,
-                               path->dused_units, units,
-                               (warning_high_tide != ULONG_MAX ? TRUE : FALSE), warning_high_tide,
-                               (critical_high_tide != ULONG_MAX ? TRUE : FALSE), critical_high_tide,
-                               TRUE, 0,
-                               TRUE, path->dtotal_units));
+          perfdata_append (&perf, label_name,
+                           path->dused_units, units,
+                           (warning_high_tide != ULONG_MAX ? TRUE : FALSE), warning_high_tide,
+                           (critical_high_tide != ULONG_MAX ? TRUE : FALSE), critical_high_tide,
+                           TRUE, 0,
+                           TRUE, path->dtotal_units);
 
           if (inode_perfdata_enabled) {
 
@@ -526,23 +534,22 @@ main (int argc, char **argv)
               print_inode_perfdata_critical = TRUE;
             }
 
-            xasprintf (&perf, "%s %s", perf,
-                       perfdata (inode_label_name,
-                                  path->dused_inodes_percent, "%",
-                                  print_inode_perfdata_warning, (print_inode_perfdata_warning ? path->freeinodes_percent->warning->end : 0),
-                                  print_inode_perfdata_critical, (print_inode_perfdata_critical ? path->freeinodes_percent->critical->end : 0),
-                                  TRUE, 0,
-                                  TRUE, 100));
+            perfdata_append (&perf, inode_label_name,
+                             path->dused_inodes_percent, "%",
+                             print_inode_perfdata_warning, (print_inode_perfdata_warning ? path->freeinodes_percent->warning->end : 0),
+                             print_inode_perfdata_critical, (print_inode_perfdata_critical ? path->freeinodes_percent->critical->end : 0),
+                             TRUE, 0,
+                             TRUE, 100);
 
             raw_used_inodes_name = calloc(strlen(label_name) + 1 + 11, 1);
             raw_used_inodes_name = strcat(raw_used_inodes_name, label_name);
             raw_used_inodes_name = strcat(raw_used_inodes_name, "_inode_used");
-            xasprintf(&perf, "%s %s", perf, perfdata(raw_used_inodes_name, path->inodes_total - path->inodes_free, "", FALSE, 0, FALSE, 0, TRUE, 0, TRUE, path->inodes_total));
+            perfdata_append(&perf, raw_used_inodes_name, path->inodes_total - path->inodes_free, "", FALSE, 0, FALSE, 0, TRUE, 0, TRUE, path->inodes_total);
 
             raw_free_inodes_name = calloc(strlen(label_name) + 1 + 11, 1);
             raw_free_inodes_name = strcat(raw_free_inodes_name, label_name);
             raw_free_inodes_name = strcat(raw_free_inodes_name, "_inode_free");
-            xasprintf(&perf, "%s %s", perf, perfdata(raw_free_inodes_name, path->inodes_free, "", FALSE, 0, FALSE, 0, TRUE, 0, TRUE, path->inodes_total));
+            perfdata_append(&perf, raw_free_inodes_name, path->inodes_free, "", FALSE, 0, FALSE, 0, TRUE, 0, TRUE, path->inodes_total);
           }
 
       }
@@ -557,24 +564,23 @@ main (int argc, char **argv)
           else {
               xasprintf(&flag_header, "");
           }
-          xasprintf (&output, "%s %s %.0f %s (%.2f%%",
-                     output,
-                     (!strcmp(me->me_mountdir, "none") || display_mntp) ? me->me_devname : me->me_mountdir,
-                     (double)path->dfree_units,
-                     units,
-                     path->dfree_pct);
+          np_buf_printf (&output, " %s %.0f %s (%.2f%%",
+                         (!strcmp(me->me_mountdir, "none") || display_mntp) ? me->me_devname : me->me_mountdir,
+                         (double)path->dfree_units,
+                         units,
+                         path->dfree_pct);
           /* Whether or not to put all disks on new line */
           if (newlines) {
               if (path->dused_inodes_percent < 0) {
-                  xasprintf(&output, "%s inode=-)%s;\n", output, (disk_result ? "]" : ""));
+                  np_buf_printf(&output, " inode=-)%s;\n", (disk_result ? "]" : ""));
               } else {
-                  xasprintf(&output, "%s inode=%.0f%%)%s;\n", output, path->dfree_inodes_percent, ((disk_result && verbose) ? "]" : ""));
+                  np_buf_printf(&output, " inode=%.0f%%)%s;\n", path->dfree_inodes_percent, ((disk_result && verbose) ? "]" : ""));
               }
           } else {
               if (path->dused_inodes_percent < 0) {
-                  xasprintf(&output, "%s inode=-)%s;", output, (disk_result ? "]" : ""));
+                  np_buf_printf(&output, " inode=-)%s;", (disk_result ? "]" : ""));
               } else {
-                  xasprintf(&output, "%s inode=%.0f%%)%s;", output, path->dfree_inodes_percent, ((disk_result && verbose) ? "]" : ""));
+                  np_buf_printf(&output, " inode=%.0f%%)%s;", path->dfree_inodes_percent, ((disk_result && verbose) ? "]" : ""));
               }
           }
 
@@ -593,17 +599,18 @@ main (int argc, char **argv)
     }
 
   }
+  np_thresholds_batch_free (batch);
 
     if (human_output) {
         print_human_disk_entries(&human_disk_entries[0], num_human_disk_entries);
     } else {
         if (verbose >= 2)
-            xasprintf (&output, "%s%s", output, details);
+            np_buf_puts (&output, details);
 
         if (newlines) {
-            printf ("DISK %s%s\n%s|%s\n", state_text (result), (erronly && result==STATE_OK) ? "" : preamble, output, perf);
+            printf ("DISK %s%s\n%s|%s%s\n", state_text (result), (erronly && result==STATE_OK) ? "" : preamble, np_buf_str (&output), perf.len ? " " : "", np_buf_str (&perf));
         } else {
-            printf ("DISK %s%s%s|%s\n", state_text (result), (erronly && result==STATE_OK) ? "" : preamble, output, perf);
+            printf ("DISK %s%s%s|%s%s\n", state_text (result), (erronly && result==STATE_OK) ? "" : preamble, np_buf_str (&output), perf.len ? " " : "", np_buf_str (&perf));
         }
 
     }
@@ -9,10 +9,6 @@
 * 
 * This file contains the check_dns plugin
 * 
-* LIMITATION: nslookup on Solaris 7 can return output over 2 lines, which
-* will not be picked up by this plugin
-* 
-* 
 * This program is free software: you can redistribute it and/or modify
 * it under the terms of the GNU General Public License as published by
 * the Free Software Foundation, either version 3 of the License, or
@@ -28,15 +24,6 @@
 * 
 * 
 *****************************************************************************/
-#define IF_RECORD(label, querytype, verb_str, comp_str) if (strstr (chld_out.line[i], label) && (strncmp(query_type, querytype, query_size) == 0 || strncmp(query_type, "-querytype=ANY", query_size) == 0)) { \
-      if (verbose) { \
-          printf(verb_str); \
-      } \
-      temp_buffer = rindex (chld_out.line[i], comp_str); \
-      addresses[n_addresses++] = check_new_address(temp_buffer); \
-      memset(query_found, '\0', sizeof(query_found)); \
-      strncpy(query_found, querytype, sizeof(query_found)); 
-
 const char *progname = "check_dns";
 const char *copyright = "2000-2018";
 const char *email = "devel@nagios-plugins.org";
@@ -45,22 +32,23 @@ const char *email = "devel@nagios-plugins.org";
 #include "utils.h"
 #include "utils_base.h"
 #include "netutils.h"
-#include "runcmd.h"
+#include "utils_dns.h"
 
 int process_arguments (int, char **);
 int validate_arguments (void);
-int error_scan (char *);
 void print_help (void);
 void print_usage (void);
 
 /* Allow up to 4096 input length, this is helpful
    when the TXT records returned have multiple 255 legth values returned */
 #define ADDRESS_LENGTH 4096
+/* record types that can be asked for in one run */
+#define MAX_QUERY_TYPES 16
 char query_address[ADDRESS_LENGTH] = "";
 char dns_server[ADDRESS_LENGTH] = "";
-char tmp_dns_server[ADDRESS_LENGTH] = "";
 char ptr_server[ADDRESS_LENGTH] = "";
-char query_type[32] = "";
+int query_types[MAX_QUERY_TYPES];
+int query_type_cnt = 0;
 int query_set = FALSE;
 int verbose = FALSE;
 char **expected_address = NULL;
@@ -68,6 +56,7 @@ int expected_address_cnt = 0;
 
 int expect_authority = FALSE;
 int accept_cname = FALSE;
+int zone_mode = FALSE;
 thresholds *time_thresholds = NULL;
 
 
@@ -81,51 +70,336 @@ qstrcmp(const void *p1, const void *p2)
 }
 
 
-char *
-check_new_address(char *temp_buffer)
+/* does the record answer a query of the given type? */
+static int
+record_matches(const np_dns_rr *rr, int type)
 {
-    temp_buffer++;
-    /* Strip leading spaces */
-    for (; *temp_buffer != '\0' && *temp_buffer == ' '; temp_buffer++) {
-        /* NOOP */;
+    /* cnames only count when we accept them, as they are part of most
+     * answers to other types */
+    if (rr->type == NP_DNS_CNAME) {
+        return accept_cname && (type == NP_DNS_CNAME || type == NP_DNS_ANY);
+    }
+    return rr->type == type || type == NP_DNS_ANY;
+}
+
+
+/* the record data as the address string -a compares against.  these are
+ * the values nslookup used to print, so existing -a values keep working:
+ * just the target of SRV records, the primary server of SOA records and
+ * the protocol of WKS records */
+static char *
+record_address(const np_dns_rr *rr)
+{
+    char *address, *p;
+
+    switch (rr->type) {
+    case NP_DNS_SRV:
+        p = strrchr(rr->data, ' ');
+        return strdup(p ? p + 1 : rr->data);
+    case NP_DNS_WKS:
+        address = strdup((p = strchr(rr->data, ' ')) ? p + 1 : rr->data);
+        address[strcspn(address, " ")] = '\0';
+        return address;
+    case NP_DNS_SOA:
+        address = strdup(rr->data);
+        if ((p = strchr(address, ' ')) != NULL) {
+            *p = '\0';
+        }
+        if (strlen(address) > 1 && address[strlen(address) - 1] == '.') {
+            address[strlen(address) - 1] = '\0';
+        }
+        return address;
+    }
+    return strdup(rr->data);
+}
+
+
+/* dies with the message for a query that did not get an answer */
+static void
+query_error(const np_dns_query *query)
+{
+    switch (query->status) {
+    case NP_DNS_ETIMEOUT:
+        die (STATE_CRITICAL, "%s %s %s\n", _("Connection to DNS"), query->server, _("timed out"));
+    case NP_DNS_EREFUSED:
+        die (STATE_CRITICAL, "%s %s %s\n", _("Connection to DNS"), query->server, _("was refused"));
+    case NP_DNS_ERESOLVE:
+        die (STATE_UNKNOWN, "%s %s\n", _("Could not resolve DNS server"), query->server);
+    case NP_DNS_ENAME:
+        die (STATE_UNKNOWN, "%s '%s'\n", _("Invalid name to query:"), query->name);
+    default:
+        die (STATE_CRITICAL, "%s %s: %s\n", _("No response from DNS"), query->server, np_dns_strerror(query->status));
+    }
+}
+
+
+/* the value compared between the servers of a zone: the serial for SOA,
+ * otherwise the sorted records as -a would see them.  NULL if the server
+ * did not answer. */
+static char *
+zone_value(const np_dns_query *query)
+{
+    const np_dns_response *response = &query->response;
+    char **records = NULL;
+    char *value = NULL, *p;
+    int n = 0, i;
+
+    if (query->status != NP_DNS_OK) {
+        return NULL;
+    }
+    if (response->rcode != NP_DNS_NOERROR) {
+        return strdup(np_dns_rcode_name(response->rcode));
     }
 
-    strip(temp_buffer);
-    if (temp_buffer==NULL || strlen(temp_buffer)==0) {
-        die (STATE_CRITICAL, "%s%s%s\n", _("DNS CRITICAL - '"), NSLOOKUP_COMMAND, _("' returned empty host name string"));
+    for (i = 0; i < response->nanswer; i++) {
+        if (!record_matches(&response->answer[i], query->type)) {
+            continue;
+        }
+        if (query->type == NP_DNS_SOA) {
+            /* mname rname serial ... */
+            p = strchr(response->answer[i].data, ' ');
+            p = p ? strchr(p + 1, ' ') : NULL;
+            value = strndup(p ? p + 1 : "?", p ? strcspn(p + 1, " ") : 1);
+            break;
+        }
+        records = realloc(records, sizeof(*records) * (n + 1));
+        if (records == NULL) {
+            die (STATE_UNKNOWN, "%s\n", _("Could not allocate memory for addresses"));
+        }
+        records[n++] = record_address(&response->answer[i]);
     }
 
-    return temp_buffer;
+    if (query->type != NP_DNS_SOA && n > 0) {
+        qsort(records, n, sizeof(*records), qstrcmp);
+        value = "";
+        for (i = 0; i < n; i++) {
+            xasprintf(&value, "%s%s%s", value, i ? "," : "", records[i]);
+            free(records[i]);
+        }
+    }
+    free(records);
+    return value ? value : strdup(_("no records"));
+}
+
+
+/*
+ * Zone consistency: looks up the NS set of the zone at the server, then asks
+ * every one of the nameservers for the SOA and the requested record types at
+ * once, and reports any server whose serial or answers differ from the others.
+ */
+static int
+check_zone(const char *server)
+{
+    np_dns_query ns_query, *queries;
+    np_dns_response *response;
+    char **ns_names, **ns_addresses, **values;
+    char *msg = NULL;
+    np_buf perfdata = NP_BUF_INIT;
+    char *label;
+    int types[MAX_QUERY_TYPES + 1];
+    int n_types = 0, n_ns = 0, remaining;
+    int result = STATE_OK;
+    int differs;
+    double elapsed_time, slowest = 0;
+    struct timeval tv;
+    int i, j, k;
+
+    types[n_types++] = NP_DNS_SOA;
+    for (i = 0; query_set && i < query_type_cnt; i++) {
+        if (query_types[i] != NP_DNS_SOA) {
+            types[n_types++] = query_types[i];
+        }
+    }
+
+    alarm (timeout_interval + 1);
+    gettimeofday (&tv, NULL);
+
+    memset(&ns_query, 0, sizeof(ns_query));
+    ns_query.server = server;
+    ns_query.name = query_address;
+    ns_query.type = NP_DNS_NS;
+    np_dns_send_queries(&ns_query, 1, timeout_interval * 1000);
+    if (ns_query.status != NP_DNS_OK) {
+        query_error(&ns_query);
+    }
+    response = &ns_query.response;
+    if (response->rcode == NP_DNS_NXDOMAIN) {
+        die (STATE_CRITICAL, "%s %s %s\n", _("Domain"), query_address, _("was not found by the server"));
+    }
+    else if (response->rcode != NP_DNS_NOERROR) {
+        die (STATE_CRITICAL, "%s %s %s %s\n", server, _("returned"), np_dns_rcode_name(response->rcode), "NS");
+    }
+
+    /* use the glue records from the answer where there are any, so the
+     * nameservers do not have to be resolved one by one */
+    ns_names = calloc(response->nanswer, sizeof(char *));
+    ns_addresses = calloc(response->nanswer, sizeof(char *));
+    if (ns_names == NULL || ns_addresses == NULL) {
+        die (STATE_UNKNOWN, "%s\n", _("Could not allocate memory for queries"));
+    }
+    for (i = 0; i < response->nanswer; i++) {
+        if (response->answer[i].type != NP_DNS_NS) {
+            continue;
+        }
+        ns_names[n_ns] = ns_addresses[n_ns] = response->answer[i].data;
+        for (j = 0; j < response->nadditional; j++) {
+            if ((response->additional[j].type == NP_DNS_A || response->additional[j].type == NP_DNS_AAAA) &&
+                strcasecmp(response->additional[j].name, ns_names[n_ns]) == 0) {
+                ns_addresses[n_ns] = response->additional[j].data;
+                break;
+            }
+        }
+        if (verbose) {
+            printf ("%s %s (%s)\n", _("Nameserver"), ns_names[n_ns], ns_addresses[n_ns]);
+        }
+        n_ns++;
+    }
+    if (n_ns == 0) {
+        die (STATE_CRITICAL, "%s %s %s %s\n", _("DNS"), server, _("has no NS records for"), query_address);
+    }
+
+    queries = calloc(n_ns * n_types, sizeof(np_dns_query));
+    values = calloc(n_ns * n_types, sizeof(char *));
+    if (queries == NULL || values == NULL) {
+        die (STATE_UNKNOWN, "%s\n", _("Could not allocate memory for queries"));
+    }
+    for (i = 0; i < n_ns; i++) {
+        for (k = 0; k < n_types; k++) {
+            queries[i * n_types + k].server = ns_addresses[i];
+            queries[i * n_types + k].name = query_address;
+            queries[i * n_types + k].type = types[k];
+        }
+    }
+
+    remaining = timeout_interval * 1000 - deltime (tv) / 1000;
+    np_dns_send_queries(queries, n_ns * n_types, remaining > 0 ? remaining : 0);
+
+    elapsed_time = (double)deltime (tv) / 1.0e6;
+
+    /* servers that did not answer, or not authoritatively */
+    for (i = 0; i < n_ns * n_types; i++) {
+        values[i] = zone_value(&queries[i]);
+        if (verbose) {
+            printf ("%s %s: %s%s\n", ns_names[i / n_types], np_dns_type_name(types[i % n_types]),
+                    values[i] ? values[i] : np_dns_strerror(queries[i].status),
+                    queries[i].status == NP_DNS_OK && !queries[i].response.aa ? _(" (not authoritative)") : "");
+        }
+        if (i % n_types != 0) {
+            continue;
+        }
+        if (values[i] == NULL) {
+            result = STATE_CRITICAL;
+            xasprintf(&msg, "%s%s%s %s", msg ? msg : "", msg ? "; " : "", ns_names[i / n_types],
+                      np_dns_strerror(queries[i].status));
+        }
+        else if (!queries[i].response.aa) {
+            result = max_state(result, STATE_WARNING);
+            xasprintf(&msg, "%s%s%s %s %s", msg ? msg : "", msg ? "; " : "", ns_names[i / n_types],
+                      _("is not authoritative for"), query_address);
+        }
+    }
+
+    /* list every server's value where they do not all agree */
+    for (k = 0; k < n_types; k++) {
+        char *first = NULL;
+
+        differs = FALSE;
+        for (i = 0; i < n_ns; i++) {
+            if (values[i * n_types + k] == NULL) {
+                continue;
+            }
+            if (first == NULL) {
+                first = values[i * n_types + k];
+            }
+            else if (strcasecmp(first, values[i * n_types + k]) != 0) {
+                differs = TRUE;
+            }
+        }
+        if (!differs) {
+            continue;
+        }
+        result = STATE_CRITICAL;
+        xasprintf(&msg, "%s%s%s %s:", msg ? msg : "", msg ? "; " : "",
+                  k == 0 ? _("serial") : np_dns_type_name(types[k]), _("differs"));
+        for (i = 0, j = 0; i < n_ns; i++) {
+            if (values[i * n_types + k] != NULL) {
+                xasprintf(&msg, "%s%s %s=%s", msg, j++ ? "," : "", ns_names[i], values[i * n_types + k]);
+            }
+        }
+    }
+
+    /* latency of every server, as the slowest of its queries */
+    for (i = 0; i < n_ns; i++) {
+        double rtt = 0;
+        int answered = FALSE;
+
+        for (k = 0; k < n_types; k++) {
+            if (queries[i * n_types + k].status == NP_DNS_OK) {
+                rtt = max(rtt, queries[i * n_types + k].response.rtt);
+                answered = TRUE;
+            }
+        }
+        if (!answered) {
+            continue;
+        }
+        slowest = max(slowest, rtt);
+        xasprintf (&label, "rtt_%s", ns_names[i]);
+        if (label[strlen(label) - 1] == '.') {
+            label[strlen(label) - 1] = '\0';
+        }
+        fperfdata_append (&perfdata, label, rtt, "s", FALSE, 0, FALSE, 0, TRUE, 0, FALSE, 0);
+    }
+
+    if (result == STATE_OK) {
+        result = get_status(slowest, time_thresholds);
+        printf ("%s %s: ", _("DNS"), state_text(result));
+        printf (ngettext("%d server", "%d servers", n_ns), n_ns);
+        printf (" %s %s %s %s", _("for"), query_address, _("agree on serial"), values[0]);
+        printf (" (%.3f %s)", elapsed_time, _("seconds"));
+    }
+    else {
+        printf ("%s %s - %s", _("DNS"), state_text(result), msg);
+    }
+    printf ("|%s%s%s\n", fperfdata ("time", elapsed_time, "s", FALSE, 0, FALSE, 0, TRUE, 0, FALSE, 0),
+            perfdata.len ? " " : "", np_buf_str (&perfdata));
+
+    for (i = 0; i < n_ns * n_types; i++) {
+        np_dns_response_free(&queries[i].response);
+    }
+    np_dns_response_free(&ns_query.response);
+    return result;
 }
 
 
 int
 main (int argc, char **argv)
 {
-    char *command_line = NULL;
-    char input_buffer[MAX_INPUT_BUFFER];
     char *address = NULL; /* comma separated str with addrs/ptrs (sorted) */
     char **addresses = NULL;
     int n_addresses = 0;
     char *msg = NULL;
-    char query_found[24] = "";
-    int query_size = 24;
+    char *missing = NULL;
+    char *server = NULL;
+    char *lookup_name = query_address;
     char *temp_buffer = NULL;
+    np_buf perfdata_rtt = NP_BUF_INIT;
+    char *label = NULL;
     int non_authoritative = FALSE;
-    int result = STATE_UNKNOWN;
+    int result = STATE_OK;
+    int found;
     double elapsed_time;
     long microsec;
     struct timeval tv;
-    int parse_address = FALSE; /* This flag scans for Address: but only after Name: */
-    output chld_out, chld_err;
-    size_t i;
+    np_dns_query *queries;
+    np_dns_response *response;
+    int i, j;
 
     setlocale (LC_ALL, "");
     bindtextdomain (PACKAGE, LOCALEDIR);
     textdomain (PACKAGE);
 
     /* Set signal handling and alarm */
-    if (signal (SIGALRM, runcmd_timeout_alarm_handler) == SIG_ERR) {
+    if (signal (SIGALRM, socket_timeout_alarm_handler) == SIG_ERR) {
         usage_va(_("Cannot catch SIGALRM"));
     }
 
@@ -136,181 +410,116 @@ main (int argc, char **argv)
         usage_va(_("Could not parse arguments"));
     }
 
-    /* get the command to run */
-    xasprintf (&command_line, "%s %s %s %s", NSLOOKUP_COMMAND, query_type, query_address, dns_server);
+    server = strlen(dns_server) > 0 ? dns_server : np_dns_default_server();
 
-    alarm (timeout_interval);
-    gettimeofday (&tv, NULL);
-
-    if (verbose) {
-        printf ("%s\n", command_line);
+    if (zone_mode) {
+        return check_zone(server);
     }
 
-    /* run the command */
-    if((np_runcmd(command_line, &chld_out, &chld_err, 0)) != 0) {
-        msg = strdup(_("nslookup returned an error status"));
-        result = STATE_WARNING;
+    /* without -q, an address is looked up in reverse */
+    if (!query_set && (temp_buffer = np_dns_reverse_name(query_address)) != NULL) {
+        lookup_name = temp_buffer;
+        query_types[0] = NP_DNS_PTR;
     }
 
-    /* scan stdout */
-    for(i = 0; i < chld_out.lines; i++) {
-        if (addresses == NULL) {
-            addresses = malloc(sizeof(*addresses)*10);
-        }
-        else if (!(n_addresses % 10)) {
-            addresses = realloc(addresses,sizeof(*addresses) * (n_addresses + 10));
-        }
-
+    /* ask for all record types at once */
+    queries = calloc(query_type_cnt, sizeof(np_dns_query));
+    if (queries == NULL) {
+        die (STATE_UNKNOWN, "%s\n", _("Could not allocate memory for queries"));
+    }
+    for (i = 0; i < query_type_cnt; i++) {
+        queries[i].server = server;
+        queries[i].name = lookup_name;
+        queries[i].type = query_types[i];
         if (verbose) {
-            puts(chld_out.line[i]);
+            printf ("%s %s %s %s\n", _("Querying"), server, _("for"), lookup_name);
+            printf ("%s %s\n", _("Query type:"), np_dns_type_name(query_types[i]));
         }
+    }
 
-        /* bug ID: 2946553 - Older versions of bind will use all available dns
-        + servers, we have to match the one specified */
-        if (strlen(dns_server) > 0 && strstr(chld_out.line[i], "Server:")) {
-            temp_buffer = strchr(chld_out.line[i], ':');
-            temp_buffer++;
+    /* the queries time out by themselves, the alarm is only a backstop */
+    alarm (timeout_interval + 1);
+    gettimeofday (&tv, NULL);
 
-            if (temp_buffer > (char *)1) {
-                /* Strip leading tabs */
-                for (; *temp_buffer != '\0' && *temp_buffer == '\t'; temp_buffer++) {
-                    /* NOOP */;
-                }
+    np_dns_send_queries(queries, query_type_cnt, timeout_interval * 1000);
 
-                strip(temp_buffer);
-                if (temp_buffer==NULL || strlen(temp_buffer)==0) {
-                    die (STATE_CRITICAL, "%s%s%s\n", _("DNS CRITICAL - '"), NSLOOKUP_COMMAND, _("' returned empty server string"));
-                }
+    microsec = deltime (tv);
+    elapsed_time = (double)microsec / 1.0e6;
 
-                if (strcmp(temp_buffer, dns_server) != 0) {
-                    die (STATE_CRITICAL, "%s %s\n", _("DNS CRITICAL - No response from DNS server:"), dns_server);
-                }
-            }
+    for (i = 0; i < query_type_cnt; i++) {
+        if (queries[i].status != NP_DNS_OK) {
+            query_error(&queries[i]);
         }
-        /* Provide the server name\ip to error_scan when not using -s */
-        else if (strlen(tmp_dns_server) == 0) {
-            temp_buffer = strchr(chld_out.line[i], ':');
-            temp_buffer++;
-            if (temp_buffer > (char *)1) {
-                /* Strip leading tabs */
-                for (; *temp_buffer != '\0' && *temp_buffer == '\t'; temp_buffer++) {
-                    /* NOOP */;
-                }
-                strip(temp_buffer);
-                strncpy(tmp_dns_server, temp_buffer, ADDRESS_LENGTH);
+        response = &queries[i].response;
+
+        if (verbose) {
+            printf ("%s %s: %s, %d %s, %.3f %s%s%s\n", _("Answer to"),
+                    np_dns_type_name(queries[i].type), np_dns_rcode_name(response->rcode),
+                    response->nanswer, _("records"), response->rtt, _("seconds"),
+                    response->aa ? _(", authoritative") : "",
+                    response->tcp ? _(", over TCP") : "");
+            for (j = 0; j < response->nanswer; j++) {
+                printf ("%s\t%lu\tIN\t%s\t%s\n", response->answer[j].name, response->answer[j].ttl,
+                        np_dns_type_name(response->answer[j].type), response->answer[j].data);
             }
         }
 
-        if (strstr (chld_out.line[i], "Authoritative answers can be found from:")) {
+        switch (response->rcode) {
+        case NP_DNS_NOERROR:
             break;
+        /* Host or domain name does not exist */
+        case NP_DNS_NXDOMAIN:
+            die (STATE_CRITICAL, "%s %s %s\n", _("Domain"), query_address, _("was not found by the server"));
+        /* Query refused (usually by an ACL in the namserver) */
+        case NP_DNS_REFUSED:
+            die (STATE_CRITICAL, "%s %s\n", _("Query was refused by DNS server at"), server);
+        /* Internal server failure */
+        case NP_DNS_SERVFAIL:
+            die (STATE_CRITICAL, "%s %s\n", _("DNS failure for"), server);
+        /* Request error, or a type the server does not implement */
+        default:
+            result = STATE_WARNING;
+            xasprintf (&msg, "%s %s %s %s", server, _("returned"), np_dns_rcode_name(response->rcode),
+                       np_dns_type_name(queries[i].type));
+            continue;
         }
-        /* the server is responding, we just got the host name...*/
-        if (strstr (chld_out.line[i], "Name:")) {
-            parse_address = TRUE;
-        }
-        /* begin handling types of records */
-        IF_RECORD("AAAA address", "-querytype=AAAA", "Found AAAA record\n", ' ') }
-        else IF_RECORD("exchanger =", "-querytype=MX", "Found MX record\n", '=') }
-        else IF_RECORD("service =", "-querytype=SRV", "Found SRV record\n", ' ') }
-        else IF_RECORD("nameserver =", "-querytype=NS", "Found NS record\n", ' ') }
-        else IF_RECORD("dname =", "-querytype=DNAME", "Found DNAME record\n", ' ') }
-        else IF_RECORD("protocol =", "-querytype=WKS", "Found WKS record\n", ' ') }
-        else if (strstr (chld_out.line[i], "text =") && (strncmp(query_type, "-querytype=TXT", query_size) == 0 || strncmp(query_type, "-querytype=ANY", query_size) == 0)) {
-            if (verbose) {
-                printf("Found TXT record\n");
-            }
-            temp_buffer = index(chld_out.line[i], '"');
-            --temp_buffer;
-            addresses[n_addresses++] = check_new_address(temp_buffer);
-            memset(query_found, '\0', sizeof(query_found));
-            strncpy(query_found, "-querytype=TXT", sizeof(query_found)); 
+
+        if (!response->aa) {
+            non_authoritative = TRUE;
         }
 
-        /* only matching for origin records, if requested other fields could be included at a later date */
-        else IF_RECORD("origin =", "-querytype=SOA", "Found SOA record\n", ' ') }
-        /* cnames cannot use macro as we must check for accepting them separately */
-        else if (accept_cname && strstr (chld_out.line[i], "canonical name =") && (strncmp(query_type, "-querytype=CNAME", query_size) == 0 || strncmp(query_type, "-querytype=ANY", query_size) == 0)) {
-            if (verbose) {
-                printf("Found CNAME record\n");
+        found = FALSE;
+        for (j = 0; j < response->nanswer; j++) {
+            if (!record_matches(&response->answer[j], queries[i].type)) {
+                continue;
             }
-            temp_buffer = index (chld_out.line[i], '=');
-            addresses[n_addresses++] = check_new_address(temp_buffer);
-            strncpy(query_found, "-querytype=CNAME", sizeof(query_found));
-        }
-        /* does not need strncmp as we want A at all times unless another record match */
-        else if (parse_address == TRUE && (strstr (chld_out.line[i], "Address:") || strstr (chld_out.line[i], "Addresses:"))) {
-            temp_buffer = index (chld_out.line[i], ':');
-            char *temp_address = check_new_address(temp_buffer);
-            addresses[n_addresses++] = temp_address;
-            /* Bind 9.11.x onwards reports AAAA records the same as A records */
-            /* It is assumed that nslookup returns a valid IPv4 or IPv6 address */
-            /* Hence we'll look for a colon : in the address to detect an IPv6 address */
-            if (strstr(temp_address, ":")) {
-                if (verbose) {
-                    printf("Found AAAA record\n");
-                }
-                strncpy(query_found, "-querytype=AAAA", sizeof(query_found));
-            }
-            else {
-                if (verbose) {
-                    printf("Found A record\n");
-                }
-                strncpy(query_found, "-querytype=A", sizeof(query_found));
-            }
-        }
-        /* must be after other records with "name" as an identifier, as ptr does not spefify */
-        else IF_RECORD("name =", "-querytype=PTR", "Found PTR record\n", ' ') }
-        /* needed for non-query ptr\reverse lookup checks */
-        else if (strstr(chld_out.line[i], ".in-addr.arpa") && !query_set) {
-            if ((temp_buffer = strstr(chld_out.line[i], "name = "))) {
-                addresses[n_addresses++] = strdup(rindex(temp_buffer, ' ') + 1);
+            if (verbose) {
+                printf ("Found %s record\n", np_dns_type_name(response->answer[j].type));
             }
-            else {
-                xasprintf(&msg, "%s %s %s %s", _("Warning plugin error"));
-                result = STATE_WARNING;
+            addresses = realloc(addresses, sizeof(*addresses) * (n_addresses + 1));
+            if (addresses == NULL) {
+                die (STATE_UNKNOWN, "%s\n", _("Could not allocate memory for addresses"));
             }
+            addresses[n_addresses++] = record_address(&response->answer[j]);
+            found = TRUE;
         }
-
-        if (strstr (chld_out.line[i], _("Non-authoritative answer:"))) {
-            non_authoritative = TRUE;
+        if (!found && query_set && queries[i].type != NP_DNS_ANY) {
+            xasprintf (&missing, "%s%s%s", missing ? missing : "", missing ? ", " : "",
+                       np_dns_type_name(queries[i].type));
         }
 
-        int tmp = error_scan(chld_out.line[i]);
-        if (result == STATE_UNKNOWN || result < tmp) {
-            result = tmp;
-            if (result != STATE_OK) {
-                msg = strchr (chld_out.line[i], ':');
-                if (msg) {
-                    msg++;
-                }
-                else {
-                    msg = chld_out.line[i];
-                }
-                break;
-            }
-        }
-    }  /*This is the end of the scan stdout loop */
-
-    /* scan stderr */
-    for(i = 0; i < chld_err.lines; i++) {
-        if (verbose) {
-            puts(chld_err.line[i]);
-        }
+        xasprintf (&label, "rtt_%s", np_dns_type_name(queries[i].type));
+        fperfdata_append (&perfdata_rtt, label, response->rtt, "s",
+                          FALSE, 0, FALSE, 0, TRUE, 0, FALSE, 0);
+    }
 
-        if (error_scan (chld_err.line[i]) != STATE_OK) {
-            result = max_state (result, error_scan (chld_err.line[i]));
-            msg = strchr(chld_err.line[i], ':');
-            if(msg) {
-                msg++;
-            }
-            else {
-                msg = chld_err.line[i];
-            }
-        }
+    /* Host name is valid, but server doesn't have records... */
+    if (n_addresses == 0 && result == STATE_OK) {
+        die (STATE_CRITICAL, "%s %s %s\n", _("DNS"), server, _("has no records"));
     }
 
     if (addresses) {
-        int i,slen;
+        int slen;
         char *adrp;
         qsort(addresses, n_addresses, sizeof(*addresses), qstrcmp);
         for(i=0, slen=1; i < n_addresses; i++) {
@@ -324,9 +533,6 @@ main (int argc, char **argv)
             adrp += strlen(addresses[i]);
         }
         *adrp = 0;
-      }
-    else {
-        die (STATE_CRITICAL, "%s%s%s\n", _("DNS CRITICAL - '"), NSLOOKUP_COMMAND, _("' msg parsing exited with no address"));
     }
 
     /* compare to expected address */
@@ -357,20 +563,15 @@ main (int argc, char **argv)
         }
     }
 
-    /* compare query type to query found, if query type is ANY we can skip as any record is accepted*/
-    if (result == STATE_OK && query_set && (strncmp(query_type, "-querytype=ANY", 15) != 0)) {
-        if (strncmp(query_type, query_found, 16) != 0) {
-          if (verbose) {
-              printf( "%s %s %s %s %s\n", _("Failed query for"), query_type, _("only found"), query_found, _(", or nothing"));
-          }
-          result = STATE_CRITICAL;
-          xasprintf(&msg, "%s %s %s %s", _("query type of"), query_type, _("was not found for"), query_address);
+    /* every record type asked for must have been found, except for ANY */
+    if (result == STATE_OK && missing != NULL) {
+        if (verbose) {
+            printf( "%s %s\n", _("Failed query for"), missing);
         }
+        result = STATE_CRITICAL;
+        xasprintf(&msg, "%s %s %s %s", _("query type of"), missing, _("was not found for"), query_address);
     }
 
-    microsec = deltime (tv);
-    elapsed_time = (double)microsec / 1.0e6;
-
     if (result == STATE_OK) {
         result = get_status(elapsed_time, time_thresholds);
         if (result == STATE_OK) {
@@ -385,102 +586,43 @@ main (int argc, char **argv)
         printf (ngettext("%.3f second response time", "%.3f seconds response time", elapsed_time), elapsed_time);
         printf (". %s %s %s", query_address, _("returns"), address);
         if ((time_thresholds->warning != NULL) && (time_thresholds->critical != NULL)) {
-            printf ("|%s\n", fperfdata ("time", elapsed_time, "s",
+            printf ("|%s", fperfdata ("time", elapsed_time, "s",
                     TRUE, time_thresholds->warning->end,
                     TRUE, time_thresholds->critical->end,
                     TRUE, 0, FALSE, 0));
         }
         else if ((time_thresholds->warning == NULL) && (time_thresholds->critical != NULL)) {
-            printf ("|%s\n", fperfdata ("time", elapsed_time, "s",
+            printf ("|%s", fperfdata ("time", elapsed_time, "s",
                     FALSE, 0,
                     TRUE, time_thresholds->critical->end,
                     TRUE, 0, FALSE, 0));
         }
         else if ((time_thresholds->warning != NULL) && (time_thresholds->critical == NULL)) {
-            printf ("|%s\n", fperfdata ("time", elapsed_time, "s",
+            printf ("|%s", fperfdata ("time", elapsed_time, "s",
                     TRUE, time_thresholds->warning->end,
                     FALSE, 0,
                     TRUE, 0, FALSE, 0));
         }
         else {
-          printf ("|%s\n", fperfdata ("time", elapsed_time, "s", FALSE, 0, FALSE, 0, TRUE, 0, FALSE, 0));
+          printf ("|%s", fperfdata ("time", elapsed_time, "s", FALSE, 0, FALSE, 0, TRUE, 0, FALSE, 0));
         }
+        printf ("%s%s\n", perfdata_rtt.len ? " " : "", np_buf_str (&perfdata_rtt));
     }
     else if (result == STATE_WARNING) {
-        printf ("%s %s\n", _("DNS WARNING -"), !strcmp (msg, "") ? _("Probably a non-existent host/domain") : msg);
+        printf ("%s %s\n", _("DNS WARNING -"), msg == NULL ? _("Probably a non-existent host/domain") : msg);
     }
     else if (result == STATE_CRITICAL) {
-        printf ("%s %s\n", _("DNS CRITICAL -"), !strcmp (msg, "") ? _("Probably a non-existent host/domain") : msg);
+        printf ("%s %s\n", _("DNS CRITICAL -"), msg == NULL ? _("Probably a non-existent host/domain") : msg);
     }
     else {
-        printf ("%s %s\n", _("DNS UNKNOWN -"), !strcmp (msg, "") ? _("Probably a non-existent host/domain") : msg);
+        printf ("%s %s\n", _("DNS UNKNOWN -"), msg == NULL ? _("Probably a non-existent host/domain") : msg);
     }
 
-    return result;
-}
-
-
-int
-error_scan (char *input_buffer)
-{
-    if (strstr (input_buffer, _("Note: nslookup is deprecated and may be removed from future releases.")) ||
-        strstr (input_buffer, _("Consider using the `dig' or `host' programs instead.  Run nslookup with")) ||
-        strstr (input_buffer, _("the `-sil[ent]' option to prevent this message from appearing.")))
-    {
-        return STATE_OK;
-    }
-    /* the DNS lookup timed out */
-    else if (strcasestr (input_buffer, "connection timed out")) {
-        die (STATE_CRITICAL, "%s %s %s\n", _("Connection to DNS"), (strlen(dns_server)==0)?tmp_dns_server:dns_server, _("timed out"));
-    }
-    /* DNS server is not running... */
-    else if (strstr (input_buffer, "No response from server")) {
-        die (STATE_CRITICAL, "%s %s\n", _("No response from DNS"), (strlen(dns_server)==0)?tmp_dns_server:dns_server);
-    }
-    /* Host name is valid, but server doesn't have records... */
-    else if (strstr (input_buffer, "No records") || strstr (input_buffer, "No answer")) {
-        die (STATE_CRITICAL, "%s %s %s\n", _("DNS"), (strlen(dns_server)==0)?tmp_dns_server:dns_server, _("has no records"));
-    }
-    /* Connection was refused */
-    else if (strcasestr (input_buffer, "Connection refused") ||
-             strstr (input_buffer, "Couldn't find server") ||
-             strstr (input_buffer, "Refused") ||
-             (strstr (input_buffer, "** server can't find") &&
-              strstr (input_buffer, ": REFUSED")))
-    {
-        die (STATE_CRITICAL, "%s %s %s\n", _("Connection to DNS"), (strlen(dns_server)==0)?tmp_dns_server:dns_server, _("was refused"));
-    }
-    /* Query refused (usually by an ACL in the namserver) */
-    else if (strstr (input_buffer, "Query refused")) {
-        die (STATE_CRITICAL, "%s %s\n", _("Query was refused by DNS server at"), (strlen(dns_server)==0)?tmp_dns_server:dns_server);
-    }
-    /* No information (e.g. nameserver IP has two PTR records) */
-    else if (strstr (input_buffer, "No information")) {
-        die (STATE_CRITICAL, "%s %s\n", _("No information returned by DNS server at"), (strlen(dns_server)==0)?tmp_dns_server:dns_server);
-    }
-    /* Host or domain name does not exist */
-    else if (strstr (input_buffer, "Non-existent") ||
-             strstr (input_buffer, "** server can't find") ||
-             strstr (input_buffer,"NXDOMAIN"))
-    {
-        die (STATE_CRITICAL, "%s %s %s\n", _("Domain"), query_address, _("was not found by the server"));
-    }
-
-    /* Network is unreachable */
-    else if (strstr (input_buffer, "Network is unreachable")) {
-        die (STATE_CRITICAL, "%s\n", _("Network is unreachable"));
-    }
-    /* Internal server failure */
-    else if (strstr (input_buffer, "Server failure")) {
-        die (STATE_CRITICAL, "%s %s\n", _("DNS failure for"), (strlen(dns_server)==0)?tmp_dns_server:dns_server);
-    }
-    /* Request error or the DNS lookup timed out */
-    else if (strstr (input_buffer, "Format error") ||
-             strstr (input_buffer, "Timed out"))
-    {
-        return STATE_WARNING;
+    for (i = 0; i < query_type_cnt; i++) {
+        np_dns_response_free(&queries[i].response);
     }
-    return STATE_OK;
+    free(queries);
+    return result;
 }
 
 
@@ -491,6 +633,7 @@ process_arguments (int argc, char **argv)
     int c;
     char *warning = NULL;
     char *critical = NULL;
+    char *type;
 
     int opt_index = 0;
     static struct option long_opts[] = {
@@ -505,6 +648,7 @@ process_arguments (int argc, char **argv)
         {"expected-address", required_argument, 0, 'a'},
         {"expect-authority", no_argument, 0, 'A'},
         {"accept-cname", no_argument, 0, 'n'},
+        {"zone", no_argument, 0, 'z'},
         {"warning", required_argument, 0, 'w'},
         {"critical", required_argument, 0, 'c'},
         {0, 0, 0, 0}
@@ -521,7 +665,7 @@ process_arguments (int argc, char **argv)
     }
 
     while (1) {
-        c = getopt_long (argc, argv, "hVvAnt:H:s:r:a:q:w:c:", long_opts, &opt_index);
+        c = getopt_long (argc, argv, "hVvAnzt:H:s:r:a:q:w:c:", long_opts, &opt_index);
 
         if (c == -1 || c == EOF) {
             break;
@@ -553,8 +697,6 @@ process_arguments (int argc, char **argv)
             break;
         /* server name */
         case 's':
-            /* TODO: this host_or_die check is probably unnecessary.
-            * Better to confirm nslookup response matches */
             host_or_die(optarg);
             if (strlen (optarg) >= ADDRESS_LENGTH) {
                 die (STATE_UNKNOWN, "%s\n", _("Input buffer overflow"));
@@ -579,19 +721,23 @@ process_arguments (int argc, char **argv)
             expected_address[expected_address_cnt] = strdup(optarg);
             expected_address_cnt++;
             break;
-        /* querytype -- A or AAAA or ANY or SRV or TXT, etc. */
+        /* querytype -- A or AAAA or ANY or SRV or TXT, etc., or a list of them */
         case 'q':
-            if (strlen (optarg) < 1 || strlen (optarg) > 5) {
-                die (STATE_UNKNOWN, "%s\n", _("Missing valid querytype parameter.  Try using 'A' or 'AAAA' or 'SRV' or 'ANY'"));
+            for (type = strtok(optarg, ","); type != NULL; type = strtok(NULL, ",")) {
+                if (np_dns_type(type) == -1) {
+                    die (STATE_UNKNOWN, "%s\n", _("Missing valid querytype parameter.  Try using 'A' or 'AAAA' or 'SRV' or 'ANY'"));
+                }
+                if (query_type_cnt >= MAX_QUERY_TYPES) {
+                    die (STATE_UNKNOWN, "%s\n", _("Too many query types"));
+                }
+                query_types[query_type_cnt++] = np_dns_type(type);
+                /* logic is set such that we must accept cnames if they are querying for them */
+                if (np_dns_type(type) == NP_DNS_CNAME) {
+                    accept_cname = TRUE;
+                }
             }
-            strntoupper(optarg, strlen(optarg));
-            strcpy(query_type, "-querytype=");
-            strcat(query_type, optarg);
             query_set = TRUE;
-            /* logic is set such that we must accept cnames if they are querying for them */
-            if (strcmp(query_type, "-querytype=CNAME") != 0) {
-                break;
-            }
+            break;
         /* accept cname responses as a result */
         case 'n':
             accept_cname = TRUE;
@@ -600,6 +746,10 @@ process_arguments (int argc, char **argv)
         case 'A':
             expect_authority = TRUE;
             break;
+        /* compare all nameservers of the zone */
+        case 'z':
+            zone_mode = TRUE;
+            break;
         case 'w':
             warning = optarg;
             break;
@@ -625,15 +775,16 @@ validate_arguments ()
         return ERROR;
     }
 
+    if (zone_mode && expected_address_cnt > 0) {
+        usage4 (_("-a can not be used with -z, the servers are compared with each other"));
+    }
+
     /* Bind 9.11.x onwards performs a query for both A and AAAA records */
     /* The previous default behavior of nslookup was just A records. */
     /* To ensure that exisitng users of this plugin do not get incorrect results */
     /* set the querytype to A if it has not already been specified. */
-    /* If an end user wants both A and AAAA then they need to use ANY. */
-    if (strcmp(query_type, "") == 0) {
-        /*query_type = "-querytype=A";*/
-        strcpy(query_type, "-querytype=");
-        strcat(query_type, "A");
+    if (query_type_cnt == 0) {
+        query_types[query_type_cnt++] = NP_DNS_A;
     }
 
     return OK;
@@ -648,9 +799,10 @@ print_help (void)
     printf ("%s\n", "Copyright (c) 1999 Ethan Galstad <nagios@nagios.org>");
     printf (COPYRIGHT, copyright, email);
 
-    printf ("%s\n", _("This plugin uses the nslookup program to obtain the IP address for the given host/domain query."));
+    printf ("%s\n", _("This plugin queries a DNS server to obtain the IP address for the given host/domain query."));
     printf ("%s\n", _("An optional DNS server to use may be specified."));
-    printf ("%s\n", _("If no DNS server is specified, the default server(s) specified in /etc/resolv.conf will be used."));
+    printf ("%s\n", _("If no DNS server is specified, the first nameserver in /etc/resolv.conf will be used."));
+    printf ("%s\n", _("The name is queried as given, search domains from /etc/resolv.conf are not applied."));
 
     printf ("\n\n");
 
@@ -663,10 +815,11 @@ print_help (void)
     printf ("    %s\n", _("The name or address you want to query"));
     printf ("%s\n", " -s, --server=HOST");
     printf ("    %s\n", _("Optional DNS server you want to use for the lookup"));
-    printf ("%s\n", " -q, --querytype=TYPE");
-    printf ("    %s\n", _("Optional DNS record query type where TYPE =(A, AAAA, SRV, TXT, MX, ANY)"));
-    printf ("    %s\n", _("The default query type is 'A' (IPv4 host entry)"));
-    printf ("    %s\n", _("BIND 9.11.x onwards supports both 'A' and 'AAAA', if you want both use 'ANY'"));
+    printf ("%s\n", " -q, --querytype=TYPE[,TYPE...]");
+    printf ("    %s\n", _("Optional DNS record query type where TYPE =(A, AAAA, SRV, TXT, MX, SOA, NS, CNAME, PTR, WKS, ANY)"));
+    printf ("    %s\n", _("The default query type is 'A' (IPv4 host entry), or 'PTR' if HOST is an address"));
+    printf ("    %s\n", _("Several types (e.g. A,AAAA) are queried at once and all of them must be found."));
+    printf ("    %s\n", _("The records of all types are compared against -a together."));
     printf ("%s\n", " -a, --expected-address=IP-ADDRESS|HOST");
     printf ("    %s\n", _("Optional IP-ADDRESS you expect the DNS server to return. HOST must end with"));
     printf ("    %s\n", _("a dot (.). This option can be repeated multiple times (Returns OK if any"));
@@ -678,6 +831,11 @@ print_help (void)
     printf ("%s\n", " -n, --accept-cname");
     printf ("    %s\n", _("Optionally accept cname responses as a valid result to a query"));
     printf ("    %s\n", _("The default is to ignore cname responses as part of the result"));
+    printf ("%s\n", " -z, --zone");
+    printf ("    %s\n", _("Treat HOST as a zone: look up its NS records at the server, then query"));
+    printf ("    %s\n", _("all of the nameservers at once and check that they are authoritative and"));
+    printf ("    %s\n", _("agree on the SOA serial and on the records of the types given with -q."));
+    printf ("    %s\n", _("The thresholds apply to the slowest nameserver."));
     printf ("%s\n", " -w, --warning=seconds");
     printf ("    %s\n", _("Return warning if elapsed time exceeds value. Default off"));
     printf ("%s\n", " -c, --critical=seconds");
@@ -693,5 +851,5 @@ void
 print_usage (void)
 {
     printf ("%s\n", _("Usage:"));
-    printf ("%s %s\n", progname, "-H host [-s server] [-q type ] [-a expected-address] [-A] [-n] [-t timeout] [-w warn] [-c crit]");
+    printf ("%s %s\n", progname, "-H host [-s server] [-q type[,type...]] [-a expected-address] [-A] [-n] [-z] [-t timeout] [-w warn] [-c crit]");
 }
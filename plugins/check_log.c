@@ -0,0 +1,559 @@
+/*****************************************************************************
+*
+* Nagios check_log plugin
+*
+* License: GPL
+* Copyright (c) 2000 Ethan Galstad (nagios@nagios.org)
+* Copyright (c) 2000-2026 Nagios Plugins Development Team
+*
+* Description:
+*
+* This file contains the check_log plugin
+*
+* This plugin scans a log file for lines matching one or more queries.
+* Successive runs only report *new* matches: the position in the log file
+* up to which it was read is kept in the plugin state, and only the bytes
+* appended since are read.  A log file rotated away since the previous run
+* is read to its end first, a truncated or rewritten one from its start.
+*
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*
+*****************************************************************************/
+
+const char *progname = "check_log";
+const char *copyright = "2000-2026";
+const char *email = "devel@nagios-plugins.org";
+
+#include "common.h"
+#include "utils.h"
+#include "utils_base.h"
+#include "utils_prefilter.h"
+#include "regex.h"
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#define LOG_STATE_VERSION 1
+
+/* bytes read at a time, and the longest line matched; the rest of longer
+ * lines is skipped */
+#define CHUNK_SIZE	65536
+#define MAX_LINE	65536
+
+/* how much of the log before the saved offset is hashed, to tell a log
+ * that was truncated and written again from one that only grew */
+#define TAIL_HASHED	256
+
+typedef struct log_query {
+	char *text;
+	int literal;
+	regex_t regex;
+	long count;
+} log_query;
+
+int process_arguments (int, char **);
+int validate_arguments (void);
+void print_help (void);
+void print_usage (void);
+
+char *log_file = NULL;
+char *rotated_file = NULL;
+log_query *queries = NULL;
+int nqueries = 0;
+int ignore_case = FALSE;
+int max_warning = -1;
+int verbose = 0;
+
+/* the literals the queries need, and which queries it has literals of */
+np_prefilter *prefilter = NULL;
+uint64_t prefiltered = 0;
+
+long total_matches = 0;
+char last_entry[MAX_INPUT_BUFFER];
+
+char buf[MAX_LINE + CHUNK_SIZE + 1];
+
+
+/* ids are the queries with a literal in the line, per the prefilter */
+static void
+match_line (const char *line, size_t len, uint64_t ids)
+{
+	uint64_t bit;
+	int i, matched = FALSE;
+
+	for (i = 0; i < nqueries; i++) {
+		bit = (i < NP_PREFILTER_IDS) ? (uint64_t) 1 << i : 0;
+		if (prefiltered & bit) {
+			/* a literal query is matched by the prefilter */
+			if (!(ids & bit) || (!queries[i].literal && regexec (&queries[i].regex, line, 0, NULL, 0) != 0))
+				continue;
+		}
+		else if (queries[i].literal) {
+			if ((ignore_case ? strcasestr (line, queries[i].text) : strstr (line, queries[i].text)) == NULL)
+				continue;
+		}
+		else if (regexec (&queries[i].regex, line, 0, NULL, 0) != 0)
+			continue;
+		queries[i].count++;
+		matched = TRUE;
+	}
+	if (matched) {
+		total_matches++;
+		if (len >= sizeof (last_entry))
+			len = sizeof (last_entry) - 1;
+		memcpy (last_entry, line, len);
+		last_entry[len] = '\0';
+	}
+}
+
+
+/* one line, with the queries the prefilter finds literals for */
+static void
+match_one (char *line, char *nl)
+{
+	*nl = '\0';
+	match_line (line, nl - line, prefilter ? np_prefilter_scan (prefilter, line, nl - line) : 0);
+}
+
+
+/*
+ * Matches the complete lines from start to end.  When every query has
+ * literals, the lines without any are skipped over without looking for
+ * their ends.
+ */
+static void
+match_lines (char *start, char *end)
+{
+	char *line, *nl, *next;
+	const char *hit;
+	uint64_t ids;
+
+	if (prefilter && nqueries <= NP_PREFILTER_IDS &&
+	    prefiltered == ((uint64_t) -1 >> (NP_PREFILTER_IDS - nqueries))) {
+		for (next = start; next < end; next = nl + 1) {
+			if ((hit = np_prefilter_find (prefilter, next, end - next, &ids)) == NULL)
+				return;
+			nl = memchr (hit, '\n', end - hit);
+			for (line = (char *) hit; line > next && line[-1] != '\n'; line--)
+				;
+			match_one (line, nl);
+		}
+		return;
+	}
+
+	for (line = start; (nl = memchr (line, '\n', end - line)) != NULL; line = nl + 1)
+		match_one (line, nl);
+}
+
+
+/*
+ * Matches the lines of fd from offset from to to, and returns the offset
+ * after the last line matched.  A line without its newline at the end is
+ * left for the next run, unless the log is not written to any more (final).
+ */
+static off_t
+scan_log (int fd, const char *name, off_t from, off_t to, int final)
+{
+	off_t pos = from, done = from;
+	size_t have = 0;
+	ssize_t n;
+	char *line, *end, *nl;
+	int skipping = FALSE;
+
+	while (pos < to) {
+		n = pread (fd, buf + have, min (CHUNK_SIZE, to - pos), pos);
+		if (n < 0)
+			die (STATE_UNKNOWN, _("Log check error: Cannot read %s: %s\n"), name, strerror (errno));
+		if (n == 0)
+			break;
+		pos += n;
+		end = buf + have + n;
+
+		line = buf;
+		if (skipping && (nl = memchr (line, '\n', end - line)) != NULL) {
+			line = nl + 1;
+			skipping = FALSE;
+		}
+		if (!skipping) {
+			for (nl = end; nl > line && nl[-1] != '\n'; nl--)
+				;
+			match_lines (line, nl);
+			line = nl;
+		}
+		done = pos - (end - line);
+
+		have = end - line;
+		if (have >= MAX_LINE) {
+			/* the start of an overlong line is all that gets matched */
+			if (!skipping)
+				match_one (line, line + MAX_LINE);
+			skipping = TRUE;
+			done = pos;
+			have = 0;
+		}
+		else if (skipping) {
+			done = pos;
+			have = 0;
+		}
+		else
+			memmove (buf, line, have);
+	}
+
+	if (final && have > 0) {
+		match_one (buf, buf + have);
+		done = pos;
+	}
+	return done;
+}
+
+
+/* FNV-1a of the TAIL_HASHED bytes before offset */
+static unsigned long
+tail_hash (int fd, off_t offset)
+{
+	unsigned char tail[TAIL_HASHED];
+	unsigned long hash = 2166136261UL;
+	off_t start = max (0, offset - TAIL_HASHED);
+	ssize_t i, n;
+
+	n = pread (fd, tail, offset - start, start);
+	for (i = 0; i < n; i++)
+		hash = ((hash ^ tail[i]) * 16777619UL) & 0xffffffffUL;
+	return hash;
+}
+
+
+/*
+ * The log the previous run read, if it was rotated away: --rotated, or
+ * the log file name with .1 or .0 appended.  -1 if it is not found.
+ */
+static int
+open_rotated (dev_t dev, ino_t ino, struct stat *st, char **name)
+{
+	char *names[3];
+	int i, fd;
+
+	names[0] = rotated_file;
+	xasprintf (&names[1], "%s.1", log_file);
+	xasprintf (&names[2], "%s.0", log_file);
+
+	for (i = 0; i < 3; i++) {
+		if (names[i] == NULL || (fd = open (names[i], O_RDONLY)) < 0)
+			continue;
+		if (fstat (fd, st) == 0 && st->st_dev == dev && st->st_ino == ino) {
+			*name = names[i];
+			return fd;
+		}
+		close (fd);
+	}
+	return -1;
+}
+
+
+int
+main (int argc, char **argv)
+{
+	int result = STATE_OK;
+	int fd, rfd, i;
+	char *rname, *state;
+	unsigned long dev, ino, hash;
+	long long offset;
+	off_t start = 0, end;
+	struct stat st, rst;
+	state_data *previous;
+	np_buf perf = NP_BUF_INIT;
+
+	setlocale (LC_ALL, "");
+	bindtextdomain (PACKAGE, LOCALEDIR);
+	textdomain (PACKAGE);
+
+	/* Parse extra opts if any */
+	argv = np_extra_opts (&argc, argv, progname);
+
+	np_init ((char *) progname, argc, argv);
+
+	if (process_arguments (argc, argv) == ERROR)
+		usage4 (_("Could not parse arguments"));
+	np_set_verbose (verbose);
+
+	/* one state per set of arguments, as there was one old log for each */
+	np_enable_state (NULL, LOG_STATE_VERSION);
+
+	signal (SIGALRM, timeout_alarm_handler);
+	alarm (timeout_interval);
+
+	if ((fd = open (log_file, O_RDONLY)) < 0) {
+		if (errno == ENOENT)
+			die (STATE_UNKNOWN, _("Log check error: Log file %s does not exist!\n"), log_file);
+		die (STATE_UNKNOWN, _("Log check error: Log file %s is not readable!\n"), log_file);
+	}
+	if (fstat (fd, &st) < 0)
+		die (STATE_UNKNOWN, _("Log check error: Cannot stat %s: %s\n"), log_file, strerror (errno));
+
+	previous = np_state_read ();
+	if (previous == NULL) {
+		/* like the first run of check_log.sh, only remember where the log ends */
+		end = st.st_size;
+		xasprintf (&state, "%lu %lu %lld %lx", (unsigned long) st.st_dev,
+		           (unsigned long) st.st_ino, (long long) end, tail_hash (fd, end));
+		np_state_write_string (0, state);
+		printf (_("Log check data initialized...\n"));
+		return STATE_OK;
+	}
+	if (sscanf ((char *) previous->data, "%lu %lu %lld %lx", &dev, &ino, &offset, &hash) != 4)
+		dev = ino = offset = hash = 0;
+
+	if (dev == (unsigned long) st.st_dev && ino == (unsigned long) st.st_ino) {
+		/* the same log, unless it was truncated and written again */
+		if (offset <= st.st_size && tail_hash (fd, offset) == hash)
+			start = offset;
+		else if (verbose)
+			printf (_("%s was truncated, reading it from the start\n"), log_file);
+	}
+	else if ((rfd = open_rotated (dev, ino, &rst, &rname)) >= 0) {
+		/* the rest of the log the previous run read */
+		if (offset <= rst.st_size && tail_hash (rfd, offset) == hash) {
+			if (verbose)
+				printf (_("%s was rotated to %s, reading %lld bytes of it\n"),
+				        log_file, rname, (long long) (rst.st_size - offset));
+			scan_log (rfd, rname, offset, rst.st_size, TRUE);
+		}
+		close (rfd);
+	}
+	else if (verbose)
+		printf (_("%s was rotated, the old log was not found\n"), log_file);
+
+	if (verbose)
+		printf (_("Reading %s from offset %lld to %lld\n"), log_file,
+		        (long long) start, (long long) st.st_size);
+	end = scan_log (fd, log_file, start, st.st_size, FALSE);
+
+	xasprintf (&state, "%lu %lu %lld %lx", (unsigned long) st.st_dev,
+	           (unsigned long) st.st_ino, (long long) end, tail_hash (fd, end));
+	np_state_write_string (0, state);
+	close (fd);
+
+	alarm (0);
+
+	perfdata_append (&perf, "match", total_matches, "", FALSE, 0, FALSE, 0, TRUE, 0, FALSE, 0);
+	for (i = 0; nqueries > 1 && i < nqueries; i++)
+		perfdata_append (&perf, queries[i].text, queries[i].count, "", FALSE, 0, FALSE, 0, TRUE, 0, FALSE, 0);
+
+	if (total_matches == 0) {
+		printf (_("Log check ok - 0 pattern matches found|%s\n"), np_buf_str (&perf));
+		return STATE_OK;
+	}
+
+	if (max_warning >= 0 && total_matches <= max_warning)
+		result = STATE_WARNING;
+	else
+		result = STATE_CRITICAL;
+	printf ("(%ld) %s|%s\n", total_matches, last_entry, np_buf_str (&perf));
+	return result;
+}
+
+
+static void
+add_query (const char *text, int literal)
+{
+	log_query *q;
+
+	queries = realloc (queries, (nqueries + 1) * sizeof (log_query));
+	if (queries == NULL)
+		die (STATE_UNKNOWN, _("Could not realloc() queries\n"));
+	q = &queries[nqueries++];
+	memset (q, 0, sizeof (log_query));
+	q->text = strdup (text);
+	q->literal = literal;
+}
+
+
+/* process command-line arguments */
+int
+process_arguments (int argc, char **argv)
+{
+	int c, i, errcode;
+	int cflags = REG_EXTENDED | REG_NOSUB;
+	char errbuf[MAX_INPUT_BUFFER], *env;
+
+	int option = 0;
+	static struct option longopts[] = {
+		{"filename", required_argument, 0, 'F'},
+		{"query", required_argument, 0, 'q'},
+		{"literal", required_argument, 0, 'l'},
+		{"ignore-case", no_argument, 0, 'i'},
+		{"max_warning", required_argument, 0, 'w'},
+		{"rotated", required_argument, 0, 'r'},
+		{"oldlog", required_argument, 0, 'O'},
+		{"exitstatus", required_argument, 0, 'x'},
+		{"timeout", required_argument, 0, 't'},
+		{"verbose", no_argument, 0, 'v'},
+		{"version", no_argument, 0, 'V'},
+		{"help", no_argument, 0, 'h'},
+		{0, 0, 0, 0}
+	};
+
+	if (argc < 2)
+		return ERROR;
+
+	while (1) {
+		c = getopt_long (argc, argv, "hVvF:q:l:iw:r:O:x:t:", longopts, &option);
+
+		if (c == -1 || c == EOF)
+			break;
+
+		switch (c) {
+		case 'h':									/* help */
+			print_help ();
+			exit (STATE_OK);
+		case 'V':									/* version */
+			print_revision (progname, NP_VERSION);
+			exit (STATE_OK);
+		case 'v':									/* verbose */
+			verbose++;
+			break;
+		case 'F':									/* log file */
+			log_file = optarg;
+			break;
+		case 'q':									/* regular expression */
+			add_query (optarg, FALSE);
+			break;
+		case 'l':									/* literal string */
+			add_query (optarg, TRUE);
+			break;
+		case 'i':
+			ignore_case = TRUE;
+			break;
+		case 'w':									/* most matches for a warning */
+			if (!is_integer (optarg) || (max_warning = atoi (optarg)) < 0)
+				usage2 (_("Max warning must be a non-negative integer"), optarg);
+			break;
+		case 'r':									/* rotated log */
+			rotated_file = optarg;
+			break;
+		case 'O':
+		case 'x':
+			/* options of check_log.sh with nothing left to do */
+			break;
+		case 't':									/* timeout */
+			/* the temporary directory of check_log.sh, unless a number */
+			if (is_intpos (optarg))
+				timeout_interval = atoi (optarg);
+			break;
+		default:
+			usage5 ();
+		}
+	}
+
+	if (ignore_case)
+		cflags |= REG_ICASE;
+	for (i = 0; i < nqueries; i++) {
+		if (queries[i].literal)
+			continue;
+		if ((errcode = regcomp (&queries[i].regex, queries[i].text, cflags)) != 0) {
+			regerror (errcode, &queries[i].regex, errbuf, MAX_INPUT_BUFFER);
+			usage2 (_("Could not compile regular expression"), errbuf);
+		}
+	}
+
+	/* only the lines with a literal a query needs are matched against it */
+	env = getenv ("NAGIOS_PLUGIN_LOG_PREFILTER");
+	if (env == NULL || strcmp (env, "no")) {
+		prefilter = np_prefilter_new (ignore_case);
+		for (i = 0; prefilter && i < nqueries && i < NP_PREFILTER_IDS; i++) {
+			if (queries[i].literal ? np_prefilter_add (prefilter, i, queries[i].text, strlen (queries[i].text))
+			                       : np_prefilter_add_regex (prefilter, i, queries[i].text))
+				prefiltered |= (uint64_t) 1 << i;
+			else if (verbose > 1)
+				printf (_("No literal to prefilter query %s\n"), queries[i].text);
+		}
+	}
+
+	return validate_arguments ();
+}
+
+
+int
+validate_arguments (void)
+{
+	if (log_file == NULL)
+		usage4 (_("You must supply a log file name using '-F'"));
+	if (nqueries == 0)
+		usage4 (_("You must supply a query using '-q' or '-l'"));
+	return OK;
+}
+
+
+void
+print_help (void)
+{
+	print_revision (progname, NP_VERSION);
+
+	printf ("Copyright (c) 2000 Ethan Galstad (nagios@nagios.org)\n");
+	printf (COPYRIGHT, copyright, email);
+
+	printf ("%s\n", _("This plugin scans a log file for lines matching one or more queries."));
+	printf ("%s\n", _("Only lines written since the previous run with the same arguments are read."));
+
+	printf ("\n\n");
+
+	print_usage ();
+
+	printf (UT_HELP_VRSN);
+	printf (UT_EXTRA_OPTS);
+
+	printf (" %s\n", "-F, --filename=FILE");
+	printf ("    %s\n", _("The log file to scan"));
+	printf (" %s\n", "-q, --query=REGEX");
+	printf ("    %s\n", _("Count the lines matching this extended regular expression. Can be given"));
+	printf ("    %s\n", _("more than once, and each query is counted in the performance data"));
+	printf (" %s\n", "-l, --literal=STRING");
+	printf ("    %s\n", _("Count the lines containing STRING. Can be given more than once"));
+	printf (" %s\n", "-i, --ignore-case");
+	printf ("    %s\n", _("Ignore case in all queries"));
+	printf (" %s\n", "-w, --max_warning=INTEGER");
+	printf ("    %s\n", _("Return WARNING for up to this many matching lines and CRITICAL for more"));
+	printf ("    %s\n", _("(default: CRITICAL for any matching line)"));
+	printf (" %s\n", "-r, --rotated=FILE");
+	printf ("    %s\n", _("Where the log is rotated to, to read the end of the previous log"));
+	printf ("    %s\n", _("(default: FILE.1 or FILE.0)"));
+	printf (UT_PLUG_TIMEOUT, DEFAULT_SOCKET_TIMEOUT);
+	printf (UT_VERBOSE);
+
+	printf ("\n");
+	printf ("%s\n", _("Notes:"));
+	printf (" %s\n", _("The offset read up to is kept in the plugin state, see NAGIOS_PLUGIN_STATE_DIRECTORY."));
+	printf (" %s\n", _("The first run only records the end of the log and returns OK. A line is"));
+	printf (" %s\n", _("counted once, however many queries it matches."));
+	printf (" %s\n", _("The -O and -x options of the old check_log script are accepted and ignored."));
+	printf (" %s\n", _("As the matches are only reported once, set max_attempts to 1 and do not"));
+	printf (" %s\n", _("notify on recovery for the service."));
+
+	printf ("\n");
+	printf ("%s\n", _("Examples:"));
+	printf (" %s\n", "check_log -F /var/log/messages -q 'LOGIN FAILURE'");
+	printf (" %s\n", "check_log -F /var/log/app.log -l ERROR -l FATAL -q 'took [0-9]{4,} ms' -w 5");
+
+	printf (UT_SUPPORT);
+}
+
+
+void
+print_usage (void)
+{
+	printf ("%s\n", _("Usage:"));
+	printf (" %s -F logfile (-q regex | -l string)... [-i] [-w max_warning]\n", progname);
+	printf ("[-r rotated_log] [-t timeout] [-v]\n");
+}
@@ -35,6 +35,8 @@ const char *email = "devel@nagios-plugins.org";
 
 #include "common.h"
 #include "utils.h"
+#include "utils_mrtg.h"
+#include <fcntl.h>
 
 int process_arguments (int, char **);
 int validate_arguments (void);
@@ -43,7 +45,9 @@ void print_usage (void);
 
 char *log_file = NULL;
 int expire_minutes = 0;
-int use_average = TRUE;
+int aggregation = NP_MRTG_AVG;
+double percentile = 0;
+int window_minutes = 0;
 int variable_number = -1;
 unsigned long value_warning_threshold = 0L;
 unsigned long value_critical_threshold = 0L;
@@ -54,14 +58,11 @@ int
 main (int argc, char **argv)
 {
 	int result = STATE_OK;
-	FILE *fp;
-	int line;
-	char input_buffer[MAX_INPUT_BUFFER];
-	char *temp_buffer;
+	int fd, count;
+	np_mrtg_sample *samples;
+	char *aggregate;
 	time_t current_time;
 	time_t timestamp = 0L;
-	unsigned long average_value_rate = 0L;
-	unsigned long maximum_value_rate = 0L;
 	unsigned long rate = 0L;
 
 	setlocale (LC_ALL, "");
@@ -75,58 +76,22 @@ main (int argc, char **argv)
 		usage4 (_("Could not parse arguments\n"));
 
 	/* open the MRTG log file for reading */
-	fp = fopen (log_file, "r");
-	if (fp == NULL) {
+	fd = open (log_file, O_RDONLY);
+	if (fd < 0) {
 		printf (_("Unable to open MRTG log file\n"));
 		return STATE_UNKNOWN;
 	}
 
-	line = 0;
-	while (fgets (input_buffer, MAX_INPUT_BUFFER - 1, fp)) {
-
-		line++;
-
-		/* skip the first line of the log file */
-		if (line == 1)
-			continue;
-
-		/* break out of read loop if we've passed the number of entries we want to read */
-		if (line > 2)
-			break;
-
-		/* grab the timestamp */
-		temp_buffer = strtok (input_buffer, " ");
-		timestamp = strtoul (temp_buffer, NULL, 10);
-
-		/* grab the average value 1 rate */
-		temp_buffer = strtok (NULL, " ");
-		if (variable_number == 1)
-			average_value_rate = strtoul (temp_buffer, NULL, 10);
-
-		/* grab the average value 2 rate */
-		temp_buffer = strtok (NULL, " ");
-		if (variable_number == 2)
-			average_value_rate = strtoul (temp_buffer, NULL, 10);
-
-		/* grab the maximum value 1 rate */
-		temp_buffer = strtok (NULL, " ");
-		if (variable_number == 1)
-			maximum_value_rate = strtoul (temp_buffer, NULL, 10);
-
-		/* grab the maximum value 2 rate */
-		temp_buffer = strtok (NULL, " ");
-		if (variable_number == 2)
-			maximum_value_rate = strtoul (temp_buffer, NULL, 10);
-	}
-
-	/* close the log file */
-	fclose (fp);
+	/* the newest sample, or all of those in the window */
+	count = np_mrtg_window (fd, window_minutes * 60, &samples);
+	close (fd);
 
 	/* if we couldn't read enough data, return an unknown error */
-	if (line <= 2) {
+	if (count <= 0) {
 		printf (_("Unable to process MRTG log file\n"));
 		return STATE_UNKNOWN;
 	}
+	timestamp = samples[0].time;
 
 	/* make sure the MRTG data isn't too old */
 	time (&current_time);
@@ -138,10 +103,18 @@ main (int argc, char **argv)
 	}
 
 	/* else check the incoming/outgoing rates */
-	if (use_average == TRUE)
-		rate = average_value_rate;
+	rate = (unsigned long) (np_mrtg_aggregate (samples, count, variable_number - 1,
+	                                           aggregation, percentile) + 0.5);
+	free (samples);
+
+	if (aggregation == NP_MRTG_MAX)
+		aggregate = _("Max");
+	else if (aggregation == NP_MRTG_PCT)
+		xasprintf (&aggregate, _("%gth percentile"), percentile);
 	else
-		rate = maximum_value_rate;
+		aggregate = _("Avg");
+	if (window_minutes > 0)
+		xasprintf (&aggregate, _("%s over %d minutes"), aggregate, window_minutes);
 
 	if (rate > value_critical_threshold)
 		result = STATE_CRITICAL;
@@ -149,8 +122,7 @@ main (int argc, char **argv)
 		result = STATE_WARNING;
 
 	printf("%s - %s. %s = %lu %s|%s\n", state_text(result),
-	       (use_average == TRUE) ? _("Avg") : _("Max"),
-	       label, rate, units,
+	       aggregate, label, rate, units,
 	       perfdata(label, (long) rate, units,
 		        (int) value_warning_threshold, (long) value_warning_threshold,
 		        (int) value_critical_threshold, (long) value_critical_threshold,
@@ -172,6 +144,7 @@ process_arguments (int argc, char **argv)
 		{"logfile", required_argument, 0, 'F'},
 		{"expires", required_argument, 0, 'e'},
 		{"aggregation", required_argument, 0, 'a'},
+		{"window", required_argument, 0, 'W'},
 		{"variable", required_argument, 0, 'v'},
 		{"critical", required_argument, 0, 'c'},
 		{"warning", required_argument, 0, 'w'},
@@ -196,7 +169,7 @@ process_arguments (int argc, char **argv)
 	}
 
 	while (1) {
-		c = getopt_long (argc, argv, "hVF:e:a:v:c:w:l:u:", longopts,
+		c = getopt_long (argc, argv, "hVF:e:a:W:v:c:w:l:u:", longopts,
 									 &option);
 
 		if (c == -1 || c == EOF)
@@ -209,11 +182,13 @@ process_arguments (int argc, char **argv)
 		case 'e':									/* ups name */
 			expire_minutes = atoi (optarg);
 			break;
-		case 'a':									/* port */
-			if (!strcmp (optarg, "MAX"))
-				use_average = FALSE;
-			else
-				use_average = TRUE;
+		case 'a':									/* aggregation */
+			aggregation = np_mrtg_aggregation (optarg, &percentile);
+			break;
+		case 'W':									/* window */
+			if (!is_intnonneg (optarg))
+				usage2 (_("Window must be a non-negative integer"), optarg);
+			window_minutes = atoi (optarg);
 			break;
 		case 'v':
 			variable_number = atoi (optarg);
@@ -258,11 +233,11 @@ process_arguments (int argc, char **argv)
 	}
 
 	if (argc > c && strcmp (argv[c], "MAX") == 0) {
-		use_average = FALSE;
+		aggregation = NP_MRTG_MAX;
 		c++;
 	}
 	else if (argc > c && strcmp (argv[c], "AVG") == 0) {
-		use_average = TRUE;
+		aggregation = NP_MRTG_AVG;
 		c++;
 	}
 
@@ -332,8 +307,10 @@ print_help (void)
   printf ("   %s\n", _("The MRTG log file containing the data you want to monitor"));
   printf (" %s\n", "-e, --expires=MINUTES");
   printf ("   %s\n", _("Minutes before MRTG data is considered to be too old"));
-  printf (" %s\n", "-a, --aggregation=AVG|MAX");
-  printf ("   %s\n", _("Should we check average or maximum values?"));
+  printf (" %s\n", "-a, --aggregation=AVG|MAX|P<percentile>");
+  printf ("   %s\n", _("Should we check average or maximum values, or a percentile of the averages?"));
+  printf (" %s\n", "-W, --window=MINUTES");
+  printf ("   %s\n", _("Aggregate the samples of the last MINUTES instead of checking the newest"));
   printf (" %s\n", "-v, --variable=INTEGER");
   printf ("   %s\n", _("Which variable set should we inspect? (1 or 2)"));
   printf (" %s\n", "-w, --warning=INTEGER");
@@ -352,6 +329,10 @@ print_help (void)
   printf (" %s\n", _("the data in the log file is older than <expire_minutes> old, a WARNING"));
   printf (" %s\n", _("status is returned and a warning message is printed."));
 
+  printf ("\n");
+  printf (" %s\n", _("With a window, the averages of the samples in it are averaged, or their"));
+  printf (" %s\n", _("percentile taken, by the time each sample stands for, so that the half hour"));
+  printf (" %s\n", _("and longer samples MRTG consolidates older data to count for their length."));
   printf ("\n");
 	printf (" %s\n", _("This plugin is useful for monitoring MRTG data that does not correspond to"));
   printf (" %s\n", _("bandwidth usage.  (Use the check_mrtgtraf plugin for monitoring bandwidth)."));
@@ -380,6 +361,6 @@ void
 print_usage (void)
 {
   printf ("%s\n", _("Usage:"));
-	printf ("%s -F log_file -a <AVG | MAX> -v variable -w warning -c critical\n",progname);
-  printf ("[-l label] [-u units] [-e expire_minutes] [-t timeout] [-v]\n");
+	printf ("%s -F log_file -a <AVG | MAX | P<percentile>> -v variable -w warning -c critical\n",progname);
+  printf ("[-W window_minutes] [-l label] [-u units] [-e expire_minutes] [-t timeout] [-v]\n");
 }
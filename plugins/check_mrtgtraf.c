@@ -31,6 +31,8 @@
 
 #include "common.h"
 #include "utils.h"
+#include "utils_mrtg.h"
+#include <fcntl.h>
 
 const char *progname = "check_mrtgtraf";
 const char *copyright = "1999-2014";
@@ -44,7 +46,9 @@ void print_usage(void);
 int verbose = false;
 char *log_file = NULL;
 int expire_minutes = -1;
-int use_average = TRUE;
+int aggregation = NP_MRTG_AVG;
+double percentile = 0;
+int window_minutes = 0;
 unsigned long incoming_warning_threshold = 0L;
 unsigned long incoming_critical_threshold = 0L;
 unsigned long outgoing_warning_threshold = 0L;
@@ -56,17 +60,12 @@ int
 main (int argc, char **argv)
 {
 	int result = STATE_OK;
-	FILE *fp;
-	int line;
-	char input_buffer[MAX_INPUT_BUFFER];
-	char *temp_buffer;
+	int fd, count;
+	np_mrtg_sample *samples;
 	time_t current_time;
 	char *error_message;
+	char *aggregate;
 	time_t timestamp = 0L;
-	unsigned long average_incoming_rate = 0L;
-	unsigned long average_outgoing_rate = 0L;
-	unsigned long maximum_incoming_rate = 0L;
-	unsigned long maximum_outgoing_rate = 0L;
 	unsigned long incoming_rate = 0L;
 	unsigned long outgoing_rate = 0L;
 	double adjusted_incoming_rate = 0.0;
@@ -87,63 +86,29 @@ main (int argc, char **argv)
 		usage4 (_("Could not parse arguments"));
 
 	/* open the MRTG log file for reading */
-	fp = fopen (log_file, "r");
-	if (fp == NULL)
+	fd = open (log_file, O_RDONLY);
+	if (fd < 0)
 		usage4 (_("Unable to open MRTG log file"));
 
-	line = 0;
-
-	while (fgets (input_buffer, MAX_INPUT_BUFFER - 1, fp)) {
-
-		line++;
-
-		/* skip the first line of the log file */
-		if (line == 1)
-			continue;
-
-		/* break out of read loop */
-		/* if we've passed the number of entries we want to read */
-		if (line > 2)
-			break;
-
-		/* grab the timestamp */
-		temp_buffer = strtok (input_buffer, " ");
-		timestamp = strtoul (temp_buffer, NULL, 10);
-		if (verbose)
-			printf("%s %lu\n", _("Found timestamp of:"), timestamp);
-
-		/* grab the average incoming transfer rate */
-		temp_buffer = strtok (NULL, " ");
-		average_incoming_rate = strtoul (temp_buffer, NULL, 10);
-		if (verbose)
-			printf("%s %lu\n", _("Found average incoming rate of:"), average_incoming_rate);
-
-		/* grab the average outgoing transfer rate */
-		temp_buffer = strtok (NULL, " ");
-		average_outgoing_rate = strtoul (temp_buffer, NULL, 10);
-		if (verbose)
-			printf("%s %lu\n", _("Found average outgoing rate of:"), average_outgoing_rate);
-
-		/* grab the maximum incoming transfer rate */
-		temp_buffer = strtok (NULL, " ");
-		maximum_incoming_rate = strtoul (temp_buffer, NULL, 10);
-		if (verbose)
-			printf("%s %lu\n", _("Found maximum incoming rate of:"), maximum_incoming_rate);
-
-		/* grab the maximum outgoing transfer rate */
-		temp_buffer = strtok (NULL, " ");
-		maximum_outgoing_rate = strtoul (temp_buffer, NULL, 10);
-		if (verbose)
-			printf("%s %lu\n", _("Found maximum outgoing rate of:"), maximum_outgoing_rate);
-	}
-
-	/* close the log file */
-	fclose (fp);
+	/* the newest sample, or all of those in the window */
+	count = np_mrtg_window (fd, window_minutes * 60, &samples);
+	close (fd);
 
 	/* if we couldn't read enough data, return an unknown error */
-	if (line <= 2)
+	if (count <= 0)
 		usage4 (_("Unable to process MRTG log file"));
 
+	timestamp = samples[0].time;
+	if (verbose) {
+		printf("%s %lu\n", _("Found timestamp of:"), (unsigned long) timestamp);
+		printf("%s %lu\n", _("Found average incoming rate of:"), samples[0].avg[0]);
+		printf("%s %lu\n", _("Found average outgoing rate of:"), samples[0].avg[1]);
+		printf("%s %lu\n", _("Found maximum incoming rate of:"), samples[0].max[0]);
+		printf("%s %lu\n", _("Found maximum outgoing rate of:"), samples[0].max[1]);
+		if (window_minutes > 0)
+			printf(_("Found %d samples in the last %d minutes\n"), count, window_minutes);
+	}
+
 	/* make sure the MRTG data isn't too old */
 	time (&current_time);
 	if ((expire_minutes > 0) &&
@@ -152,16 +117,23 @@ main (int argc, char **argv)
 		     (int) ((current_time - timestamp) / 60));
 
 	/* else check the incoming/outgoing rates */
-	if (use_average == TRUE) {
+	if (aggregation == NP_MRTG_AVG) {
 		if (verbose) printf("%s\n", _("Using average rates not maximum."));
-		incoming_rate = average_incoming_rate;
-		outgoing_rate = average_outgoing_rate;
+		aggregate = _("Avg");
+	}
+	else if (aggregation == NP_MRTG_PCT) {
+		if (verbose) printf("%s\n", _("Using a percentile of the average rates."));
+		xasprintf (&aggregate, _("%gth percentile"), percentile);
 	}
 	else {
 		if (verbose) printf("%s\n", _("Using default maximum rates."));
-		incoming_rate = maximum_incoming_rate;
-		outgoing_rate = maximum_outgoing_rate;
+		aggregate = _("Max");
 	}
+	if (window_minutes > 0)
+		xasprintf (&aggregate, _("%s over %d minutes"), aggregate, window_minutes);
+	incoming_rate = (unsigned long) (np_mrtg_aggregate (samples, count, 0, aggregation, percentile) + 0.5);
+	outgoing_rate = (unsigned long) (np_mrtg_aggregate (samples, count, 1, aggregation, percentile) + 0.5);
+	free (samples);
 
 	/* report incoming traffic in Bytes/sec */
 	if (incoming_rate < 1024) {
@@ -209,8 +181,8 @@ main (int argc, char **argv)
 	}
 
 	xasprintf (&error_message, _("%s. In = %0.1f %s/s, %s. Out = %0.1f %s/s|%s %s"),
-	          (use_average == TRUE) ? _("Avg") : _("Max"), adjusted_incoming_rate,
-	          incoming_speed_rating, (use_average == TRUE) ? _("Avg") : _("Max"),
+	          aggregate, adjusted_incoming_rate,
+	          incoming_speed_rating, aggregate,
 	          adjusted_outgoing_rate, outgoing_speed_rating,
 	          fperfdata("in", adjusted_incoming_rate, incoming_speed_rating,
 	                   (int)incoming_warning_threshold, incoming_warning_threshold,
@@ -250,6 +222,7 @@ process_arguments (int argc, char **argv)
 		{"filename", required_argument, 0, 'F'},
 		{"expires", required_argument, 0, 'e'},
 		{"aggregation", required_argument, 0, 'a'},
+		{"window", required_argument, 0, 'W'},
 		{"critical", required_argument, 0, 'c'},
 		{"warning", required_argument, 0, 'w'},
 		{"verbose", no_argument, 0, 'v'},
@@ -272,7 +245,7 @@ process_arguments (int argc, char **argv)
 	}
 
 	while (1) {
-		c = getopt_long (argc, argv, "hVvF:e:a:c:w:", longopts, &option);
+		c = getopt_long (argc, argv, "hVvF:e:a:W:c:w:", longopts, &option);
 
 		if (c == -1 || c == EOF)
 			break;
@@ -284,11 +257,13 @@ process_arguments (int argc, char **argv)
 		case 'e':									/* expiration time */
 			expire_minutes = atoi (optarg);
 			break;
-		case 'a':									/* aggregation (AVE or MAX) */
-			if (!strcmp (optarg, "MAX"))
-				use_average = FALSE;
-			else
-				use_average = TRUE;
+		case 'a':									/* aggregation (AVG, MAX or a percentile) */
+			aggregation = np_mrtg_aggregation (optarg, &percentile);
+			break;
+		case 'W':									/* window */
+			if (!is_intnonneg (optarg))
+				usage2 (_("Window must be a non-negative integer"), optarg);
+			window_minutes = atoi (optarg);
 			break;
 		case 'c':									/* warning threshold */
 			sscanf (optarg, "%lu,%lu", &incoming_critical_threshold,
@@ -325,11 +300,11 @@ process_arguments (int argc, char **argv)
 	}
 
 	if (argc > c && strcmp (argv[c], "MAX") == 0) {
-		use_average = FALSE;
+		aggregation = NP_MRTG_MAX;
 		c++;
 	}
 	else if (argc > c && strcmp (argv[c], "AVG") == 0) {
-		use_average = TRUE;
+		aggregation = NP_MRTG_AVG;
 		c++;
 	}
 
@@ -386,8 +361,11 @@ print_help (void)
   printf ("    %s\n", _("File to read log from"));
   printf (" %s\n", "-e, --expires=INTEGER");
   printf ("    %s\n", _("Minutes after which log expires"));
-  printf (" %s\n", "-a, --aggregation=(AVG|MAX)");
-  printf ("    %s\n", _("Test average or maximum"));
+  printf (" %s\n", "-a, --aggregation=(AVG|MAX|P<percentile>)");
+  printf ("    %s\n", _("Test average or maximum, or a percentile of the averages"));
+  printf (" %s\n", "-W, --window=MINUTES");
+  printf ("    %s\n", _("Aggregate the samples of the last MINUTES, weighted by the time"));
+  printf ("    %s\n", _("each stands for, instead of testing the newest"));
   printf (" %s\n", "-w, --warning");
   printf ("    %s\n", _("Warning threshold pair <incoming>,<outgoing>"));
   printf (" %s\n", "-c, --critical");
@@ -417,6 +395,6 @@ void
 print_usage (void)
 {
 	printf (_("Usage"));
-  printf (" %s -F <log_file> -a <AVG | MAX> -w <warning_pair>\n",progname);
-  printf ("-c <critical_pair> [-e expire_minutes]\n");
+  printf (" %s -F <log_file> -a <AVG | MAX | P<percentile>> -w <warning_pair>\n",progname);
+  printf ("-c <critical_pair> [-e expire_minutes] [-W window_minutes]\n");
 }
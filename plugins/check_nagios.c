@@ -39,10 +39,24 @@ const char *email = "devel@nagios-plugins.org";
 #include "common.h"
 #include "runcmd.h"
 #include "utils.h"
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef HAVE_SYS_MMAN_H
+# include <sys/mman.h>
+#endif
+
+/* how far into the status log created= is looked for first; Nagios 2 and
+ * later write it in the info block at the top of status.dat */
+#define HEADER_SCAN 65536
 
 int process_arguments (int, char **);
 void print_help (void);
 void print_usage (void);
+unsigned long status_log_time (const char *, size_t);
+int count_proc_processes (const char *);
+int count_ps_processes (const char *);
 
 char *status_log = NULL;
 char *process_string = NULL;
@@ -54,33 +68,14 @@ int
 main (int argc, char **argv)
 {
 	int result = STATE_UNKNOWN;
-	char input_buffer[MAX_INPUT_BUFFER];
 	unsigned long latest_entry_time = 0L;
-	unsigned long temp_entry_time = 0L;
 	int proc_entries = 0;
 	time_t current_time;
-	char *temp_ptr;
-	FILE *fp;
-	int procuid = 0;
-	int procpid = 0;
-	int procppid = 0;
-	int procjid = 0;
-	int procvsz = 0;
-	int procrss = 0;
-	char proc_cgroup_hierarchy[MAX_INPUT_BUFFER];
-	float procpcpu = 0;
-	char procstat[8];
-#ifdef PS_USES_PROCETIME
-	char procetime[MAX_INPUT_BUFFER];
-#endif /* PS_USES_PROCETIME */
-	char procprog[MAX_INPUT_BUFFER];
-	char *procargs;
-	int pos, cols;
-	int expected_cols = PS_COLS - 1;
-	const char *zombie = "Z";
-	char *temp_string;
-	output chld_out, chld_err;
-	size_t i;
+	struct stat st;
+	char *status;
+	ssize_t n;
+	size_t len;
+	int fd, mapped = FALSE;
 
 	setlocale (LC_ALL, "");
 	bindtextdomain (PACKAGE, LOCALEDIR);
@@ -100,32 +95,199 @@ main (int argc, char **argv)
 	/* handle timeouts gracefully... */
 	alarm (timeout_interval);
 
-	/* open the status log */
-	fp = fopen (status_log, "r");
-	if (fp == NULL) {
+	/* open the status log, mapped when it can be */
+	if ((fd = open (status_log, O_RDONLY)) < 0 || fstat (fd, &st) < 0) {
 		die (STATE_CRITICAL, "NAGIOS %s: %s\n", _("CRITICAL"), _("Cannot open status log for reading!"));
 	}
+	len = st.st_size;
+	status = NULL;
+#ifdef HAVE_SYS_MMAN_H
+	if (len > 0 && (status = mmap (NULL, len, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED)
+		status = NULL;
+	mapped = (status != NULL);
+#endif
+	if (status == NULL) {
+		status = malloc (len + 1);
+		if (status == NULL)
+			die (STATE_UNKNOWN, _("Could not malloc() the status log\n"));
+		for (len = 0; (n = read (fd, status + len, st.st_size - len)) > 0; len += n)
+			;
+	}
 
 	/* get the date/time of the last item updated in the log */
-	while (fgets (input_buffer, MAX_INPUT_BUFFER - 1, fp)) {
-		if ((temp_ptr = strstr (input_buffer, "created=")) != NULL) {
-			temp_entry_time = strtoul (temp_ptr + 8, NULL, 10);
-			latest_entry_time = temp_entry_time;
-			break;
-		} else if ((temp_ptr = strtok (input_buffer, "]")) != NULL) {
-			temp_entry_time = strtoul (temp_ptr + 1, NULL, 10);
-			if (temp_entry_time > latest_entry_time)
-				latest_entry_time = temp_entry_time;
+	latest_entry_time = status_log_time (status, len);
+#ifdef HAVE_SYS_MMAN_H
+	if (mapped)
+		munmap (status, st.st_size);
+	else
+#endif
+		free (status);
+	close (fd);
+
+	/* count the number of matching Nagios processes... */
+	if ((proc_entries = count_proc_processes (argv[0])) == ERROR)
+		proc_entries = count_ps_processes (argv[0]);
+
+	/* reset the alarm handler */
+	alarm (0);
+
+	if (proc_entries == 0) {
+		die (STATE_CRITICAL, "NAGIOS %s: %s\n", _("CRITICAL"), _("Could not locate a running Nagios process!"));
+	}
+
+	if (latest_entry_time == 0L) {
+		die (STATE_CRITICAL, "NAGIOS %s: %s\n", _("CRITICAL"), _("Cannot parse Nagios log file for valid time"));
+	}
+
+	time (&current_time);
+	if ((int)(current_time - latest_entry_time) > (expire_minutes * 60)) {
+		result = STATE_WARNING;
+	} else {
+		result = STATE_OK;
+	}
+
+	printf ("NAGIOS %s: ", (result == STATE_OK) ? _("OK") : _("WARNING"));
+	printf (ngettext ("%d process", "%d processes", proc_entries), proc_entries);
+	printf (", ");
+	printf (
+	  ngettext ("status log updated %d second ago",
+	    "status log updated %d seconds ago",
+	    (int) (current_time - latest_entry_time) ),
+	    (int) (current_time - latest_entry_time) );
+	printf ("\n");
+
+	return result;
+}
+
+
+/* strtoul() of the number at p, which need not be null terminated */
+static unsigned long
+number_at (const char *p, const char *end)
+{
+	char number[32];
+	size_t i;
+
+	for (i = 0; i < sizeof (number) - 1 && p + i < end && p[i] != '\n'; i++)
+		number[i] = p[i];
+	number[i] = '\0';
+	return strtoul (number, NULL, 10);
+}
+
+
+/*
+ * The time of the status log: created= of a Nagios 2 or later status.dat,
+ * looked for at the top of the file before the rest, or the newest
+ * [time] the lines of a Nagios 1 status.log start with.
+ */
+unsigned long
+status_log_time (const char *status, size_t len)
+{
+	const char *p, *nl, *end = status + len;
+	unsigned long entry_time, latest_entry_time = 0L;
+
+	if ((p = memmem (status, min (len, HEADER_SCAN), "created=", 8)) != NULL ||
+	    (len > HEADER_SCAN && (p = memmem (status, len, "created=", 8)) != NULL))
+		return number_at (p + 8, end);
+
+	for (p = status; p < end; p = nl + 1) {
+		if ((nl = memchr (p, '\n', end - p)) == NULL)
+			nl = end;
+		while (p < nl && *p == ']')
+			p++;
+		if (p == nl)
+			continue;
+		entry_time = number_at (p + 1, nl);
+		if (entry_time > latest_entry_time)
+			latest_entry_time = entry_time;
+	}
+	return latest_entry_time;
+}
+
+
+/*
+ * The processes with process_string in their arguments, read from
+ * /proc/PID/cmdline.  ERROR if there is no /proc to read.
+ */
+int
+count_proc_processes (const char *self)
+{
+	char path[64], args[MAX_INPUT_BUFFER], *end;
+	struct dirent *de;
+	DIR *dir;
+	ssize_t i, n;
+	long pid;
+	int fd, proc_entries = 0;
+
+	if (access ("/proc/self/cmdline", R_OK) != 0 || (dir = opendir ("/proc")) == NULL)
+		return ERROR;
+	if (verbose >= 2)
+		printf ("%s\n", _("reading /proc"));
+
+	while ((de = readdir (dir)) != NULL) {
+		if (!isdigit ((unsigned char) de->d_name[0]))
+			continue;
+		pid = strtol (de->d_name, &end, 10);
+		if (*end != '\0')
+			continue;
+		snprintf (path, sizeof (path), "/proc/%ld/cmdline", pid);
+		if ((fd = open (path, O_RDONLY)) < 0)
+			continue;
+		n = read (fd, args, sizeof (args) - 1);
+		close (fd);
+		/* kernel threads and zombies have no arguments */
+		if (n <= 0)
+			continue;
+
+		/* the arguments are null terminated, ps shows them with spaces */
+		for (i = 0; i < n; i++) {
+			if (args[i] == '\0')
+				args[i] = ' ';
+		}
+		args[n] = '\0';
+		strip (args);
+
+		if (!strstr (args, self) && strstr (args, process_string) && strcmp (args, "")) {
+			proc_entries++;
+			if (verbose >= 2)
+				printf (_("Found process: %ld %s\n"), pid, args);
 		}
 	}
-	fclose (fp);
+	closedir (dir);
+	return proc_entries;
+}
+
+
+/* The same from the output of ps */
+int
+count_ps_processes (const char *self)
+{
+	int proc_entries = 0;
+	int procuid = 0;
+	int procpid = 0;
+	int procppid = 0;
+	int procjid = 0;
+	int procvsz = 0;
+	int procrss = 0;
+	char proc_cgroup_hierarchy[MAX_INPUT_BUFFER];
+	float procpcpu = 0;
+	char procstat[8];
+#ifdef PS_USES_PROCETIME
+	char procetime[MAX_INPUT_BUFFER];
+#endif /* PS_USES_PROCETIME */
+	char procprog[MAX_INPUT_BUFFER];
+	char *procargs;
+	int pos, cols;
+	int expected_cols = PS_COLS - 1;
+	const char *zombie = "Z";
+	char *temp_string;
+	output chld_out, chld_err;
+	size_t i;
 
 	if (verbose >= 2)
 		printf("command: %s\n", PS_COMMAND);
 
 	/* run the command to check for the Nagios process.. */
-	if((result = np_runcmd(PS_COMMAND, &chld_out, &chld_err, 0)) != 0)
-		result = STATE_WARNING;
+	np_runcmd(PS_COMMAND, &chld_out, &chld_err, 0);
 
 	/* count the number of matching Nagios processes... */
 	for(i = 0; i < chld_out.lines; i++) {
@@ -150,7 +312,7 @@ main (int argc, char **argv)
 			}
 
 			/* May get empty procargs */
-			if (!strstr(procargs, argv[0]) && strstr(procargs, process_string) && strcmp(procargs,"")) {
+			if (!strstr(procargs, self) && strstr(procargs, process_string) && strcmp(procargs,"")) {
 				proc_entries++;
 				if (verbose >= 2) {
 					printf (_("Found process: %s %s\n"), procprog, procargs);
@@ -159,39 +321,7 @@ main (int argc, char **argv)
 		}
 	}
 
-	/* If we get anything on stderr, at least set warning */
-	if(chld_err.buflen)
-		(void)max_state (result, STATE_WARNING);
-
-	/* reset the alarm handler */
-	alarm (0);
-
-	if (proc_entries == 0) {
-		die (STATE_CRITICAL, "NAGIOS %s: %s\n", _("CRITICAL"), _("Could not locate a running Nagios process!"));
-	}
-
-	if (latest_entry_time == 0L) {
-		die (STATE_CRITICAL, "NAGIOS %s: %s\n", _("CRITICAL"), _("Cannot parse Nagios log file for valid time"));
-	}
-
-	time (&current_time);
-	if ((int)(current_time - latest_entry_time) > (expire_minutes * 60)) {
-		result = STATE_WARNING;
-	} else {
-		result = STATE_OK;
-	}
-
-	printf ("NAGIOS %s: ", (result == STATE_OK) ? _("OK") : _("WARNING"));
-	printf (ngettext ("%d process", "%d processes", proc_entries), proc_entries);
-	printf (", ");
-	printf (
-	  ngettext ("status log updated %d second ago",
-	    "status log updated %d seconds ago",
-	    (int) (current_time - latest_entry_time) ),
-	    (int) (current_time - latest_entry_time) );
-	printf ("\n");
-
-	return result;
+	return proc_entries;
 }
 
 
@@ -39,6 +39,8 @@ const char *email = "devel@nagios-plugins.org";
 #include "utils.h"
 
 static char *server_address=NULL;
+static char **server_addresses=NULL;
+static int num_server_addresses=0;
 static int verbose=0;
 static short do_offset=0;
 static char *owarn="60";
@@ -95,6 +97,21 @@ typedef struct {
 	};
 } ntp_message;
 
+/* outcome of the clock selection for one server */
+enum {
+	SEL_DISCARDED,          /* no answer, stratum 0 or alarm condition */
+	SEL_CANDIDATE,          /* passed the sanity checks */
+	SEL_FALSETICKER,        /* outside the intersection of the majority */
+	SEL_OUTLIER,            /* truechimer, dropped by the cluster algorithm */
+	SEL_SURVIVOR            /* used for the combined offset */
+};
+
+/* minimum number of survivors the cluster algorithm keeps (rfc5905) */
+#define NMIN 3
+/* lower bound for the root distance, so that servers which report no delay
+ * or dispersion at all still get a correctness interval (seconds) */
+#define MINDIST 0.001
+
 /* this structure holds data about results from querying offset from a peer */
 typedef struct {
 	time_t waiting;         /* ts set when we started waiting for a response */
@@ -104,9 +121,19 @@ typedef struct {
 	double rtdelay;         /* converted from the ntp_message */
 	double rtdisp;          /* converted from the ntp_message */
 	double offset[AVG_NUM]; /* offsets from each response */
+	double delay[AVG_NUM];  /* round trip delay of each response */
 	uint8_t flags;       /* byte with leapindicator,vers,mode. see macros */
+	char addr[INET6_ADDRSTRLEN]; /* numeric address of the server */
+	double avg_offset;      /* mean of offset[] */
+	double jitter;          /* rms deviation of offset[] from the mean */
+	double rootdist;        /* root distance, half the correctness interval */
+	int selection;          /* SEL_* */
 } ntp_server_results;
 
+/* every address queried by offset_request(), for the per server report */
+static ntp_server_results *servers=NULL;
+static int num_servers=0;
+
 /* this structure holds everything in an ntp control message as per rfc1305 */
 typedef struct {
 	uint8_t flags;       /* byte with leapindicator,vers,mode. see macros */
@@ -261,15 +288,76 @@ struct timeval ntp64_to_tv(uint64_t n) {
 	}while(0);
 
 /* calculate the offset of the local clock */
-static inline double calc_offset(const ntp_message *m, const struct timeval *t){
-	double client_tx, peer_rx, peer_tx, client_rx;
+static inline double calc_offset(const ntp_message *m, double client_rx){
+	double client_tx, peer_rx, peer_tx;
 	client_tx = ntp64_to_double(m->origts);
 	peer_rx = ntp64_to_double(m->rxts);
 	peer_tx = ntp64_to_double(m->txts);
-	client_rx=TVasDOUBLE((*t));
 	return (.5*((peer_tx-client_rx)+(peer_rx-client_tx)));
 }
 
+/* calculate the round trip delay, without the time spent on the server */
+static inline double calc_delay(const ntp_message *m, double client_rx){
+	double client_tx, peer_rx, peer_tx;
+	client_tx = ntp64_to_double(m->origts);
+	peer_rx = ntp64_to_double(m->rxts);
+	peer_tx = ntp64_to_double(m->txts);
+	return (client_rx-client_tx)-(peer_tx-peer_rx);
+}
+
+/* ask the kernel to timestamp incoming packets, so that time spent between
+ * the packet arriving and us reading it does not show up as offset */
+static void enable_rx_timestamps(int sd){
+	int on=1;
+#if defined(SO_TIMESTAMPNS)
+	setsockopt(sd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+#elif defined(SO_TIMESTAMP)
+	setsockopt(sd, SOL_SOCKET, SO_TIMESTAMP, &on, sizeof(on));
+#endif
+}
+
+/* read one response and return its receive time: the kernel timestamp if
+ * there is one, else the time the read returned */
+static double recv_ntp_message(int sd, ntp_message *m){
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	struct timeval now;
+	char control[256];
+	double client_rx;
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base=m;
+	iov.iov_len=sizeof(ntp_message);
+	msg.msg_iov=&iov;
+	msg.msg_iovlen=1;
+	msg.msg_control=control;
+	msg.msg_controllen=sizeof(control);
+
+	if(recvmsg(sd, &msg, 0) < 0) msg.msg_controllen=0;
+	gettimeofday(&now, NULL);
+	client_rx=TVasDOUBLE(now);
+
+	for(cmsg=CMSG_FIRSTHDR(&msg); cmsg!=NULL; cmsg=CMSG_NXTHDR(&msg, cmsg)){
+		if(cmsg->cmsg_level != SOL_SOCKET) continue;
+#ifdef SCM_TIMESTAMPNS
+		if(cmsg->cmsg_type == SCM_TIMESTAMPNS){
+			struct timespec ts;
+			memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+			client_rx=ts.tv_sec+(1e-9*ts.tv_nsec);
+		}
+#endif
+#ifdef SCM_TIMESTAMP
+		if(cmsg->cmsg_type == SCM_TIMESTAMP){
+			struct timeval tv;
+			memcpy(&tv, CMSG_DATA(cmsg), sizeof(tv));
+			client_rx=TVasDOUBLE(tv);
+		}
+#endif
+	}
+	return client_rx;
+}
+
 /* print out a ntp packet in human readable/debuggable format */
 void print_ntp_message(const ntp_message *p){
 	struct timeval ref, orig, rx, tx;
@@ -354,77 +442,183 @@ void setup_request(ntp_message *p){
 	}
 }
 
-/* select the "best" server from a list of servers, and return its index.
- * this is done by filtering servers based on stratum, dispersion, and
- * finally round-trip delay. */
-int best_offset_server(const ntp_server_results *slist, int nservers){
-	int i=0, cserver=0, best_server=-1;
-
-	/* for each server */
-	for(cserver=0; cserver<nservers; cserver++){
-		/* We don't want any servers that fails these tests */
-		/* Sort out servers that didn't respond or responede with a 0 stratum;
-		 * stratum 0 is for reference clocks so no NTP server should ever report
-		 * a stratum 0 */
-		if ( slist[cserver].stratum == 0 && !allow_zero_stratum){
-			if (verbose) printf("discarding peer %d: stratum=%d\n", cserver, slist[cserver].stratum);
-			continue;
+/* one edge of a correctness interval, for the intersection algorithm */
+typedef struct {
+	double edge;
+	int type;               /* +1 lower end, 0 midpoint, -1 upper end */
+} ntp_interval_edge;
+
+static int cmp_interval_edge(const void *a, const void *b){
+	const ntp_interval_edge *ea=a, *eb=b;
+	if(ea->edge < eb->edge) return -1;
+	if(ea->edge > eb->edge) return 1;
+	/* on ties, open intervals before closing them */
+	return eb->type - ea->type;
+}
+
+/* fill in the per server statistics and sort out servers that did not
+ * respond or that are not synchronized.  returns TRUE for candidates. */
+static int ntp_server_candidate(ntp_server_results *srv){
+	int i;
+	double min_delay=0., sum=0.;
+
+	if(srv->num_responses == 0){
+		if (verbose) printf("discarding peer %s: no response\n", srv->addr);
+		return FALSE;
+	}
+
+	for(i=0; i<srv->num_responses; i++){
+		sum+=srv->offset[i];
+		if(i == 0 || srv->delay[i] < min_delay) min_delay=srv->delay[i];
+	}
+	srv->avg_offset=sum/srv->num_responses;
+	sum=0.;
+	for(i=0; i<srv->num_responses; i++){
+		sum+=(srv->offset[i]-srv->avg_offset)*(srv->offset[i]-srv->avg_offset);
+	}
+	srv->jitter=sqrt(sum/srv->num_responses);
+	if(min_delay < 0) min_delay=0;
+	srv->rootdist=srv->rtdelay/2 + srv->rtdisp + min_delay/2 + srv->jitter;
+	if(srv->rootdist < MINDIST) srv->rootdist=MINDIST;
+	DBG(printf("peer %s: offset %g jitter %g root distance %g\n",
+	           srv->addr, srv->avg_offset, srv->jitter, srv->rootdist));
+
+	/* Sort out servers that responded with a 0 stratum; stratum 0 is for
+	 * reference clocks so no NTP server should ever report a stratum 0 */
+	if ( srv->stratum == 0 && !allow_zero_stratum){
+		if (verbose) printf("discarding peer %s: stratum=%d\n", srv->addr, srv->stratum);
+		return FALSE;
+	}
+	/* Sort out servers with error flags */
+	if ( LI(srv->flags) == LI_ALARM ){
+		if (verbose) printf("discarding peer %s: flags=%d\n", srv->addr, LI(srv->flags));
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/* run the clock selection of rfc5905 over the servers: the intersection
+ * algorithm finds the largest interval that a majority of the correctness
+ * intervals [offset-rootdist, offset+rootdist] agree on and marks the rest
+ * as falsetickers, the cluster algorithm then drops the outliers among the
+ * truechimers.  the survivors are combined into *offset, weighted by their
+ * root distance.  returns the number of survivors. */
+int select_offset_servers(ntp_server_results *slist, int nservers, double *offset){
+	int i, j, m=0, n=0, allow, found, chime, survivors=0, worst;
+	double low=0., high=0., weight=0., sel_jitter, max_jitter, min_jitter;
+	ntp_interval_edge *edges;
+
+	for(i=0; i<nservers; i++){
+		if(ntp_server_candidate(&slist[i])){
+			slist[i].selection=SEL_CANDIDATE;
+			m++;
+		} else {
+			slist[i].selection=SEL_DISCARDED;
 		}
-		/* Sort out servers with error flags */
-		if ( LI(slist[cserver].flags) == LI_ALARM ){
-			if (verbose) printf("discarding peer %d: flags=%d\n", cserver, LI(slist[cserver].flags));
-			continue;
+	}
+	if(m == 0){
+		DBG(printf("no peers meeting synchronization criteria :(\n"));
+		return 0;
+	}
+
+	edges=(ntp_interval_edge*)malloc(sizeof(ntp_interval_edge)*3*m);
+	if(edges==NULL) die(STATE_UNKNOWN, "can not allocate interval array");
+	for(i=0; i<nservers; i++){
+		if(slist[i].selection != SEL_CANDIDATE) continue;
+		edges[n].edge=slist[i].avg_offset-slist[i].rootdist;
+		edges[n++].type=1;
+		edges[n].edge=slist[i].avg_offset;
+		edges[n++].type=0;
+		edges[n].edge=slist[i].avg_offset+slist[i].rootdist;
+		edges[n++].type=-1;
+	}
+	qsort(edges, n, sizeof(ntp_interval_edge), cmp_interval_edge);
+
+	/* allow for an increasing number of falsetickers until a majority
+	 * of the intervals intersect */
+	for(allow=0; 2*allow < m; allow++){
+		found=0;
+		chime=0;
+		for(i=0; i<n; i++){
+			chime+=edges[i].type;
+			if(chime >= m-allow){
+				low=edges[i].edge;
+				break;
+			}
+			if(edges[i].type == 0) found++;
+		}
+		chime=0;
+		for(i=n-1; i>=0; i--){
+			chime-=edges[i].type;
+			if(chime >= m-allow){
+				high=edges[i].edge;
+				break;
+			}
+			if(edges[i].type == 0) found++;
 		}
+		if(found > allow) continue;
+		if(high > low) break;
+	}
+	free(edges);
+	if(2*allow >= m){
+		if (verbose) printf("no majority of peers agrees on the time\n");
+		return 0;
+	}
+	if (verbose) printf("intersection [%.10g, %.10g], %d falseticker(s) allowed\n", low, high, allow);
 
-		/* If we don't have a server yet, use the first one */
-		if (best_server == -1) {
-			best_server = cserver;
-			DBG(printf("using peer %d as our first candidate\n", best_server));
-			continue;
+	for(i=0; i<nservers; i++){
+		if(slist[i].selection != SEL_CANDIDATE) continue;
+		if(slist[i].avg_offset < low || slist[i].avg_offset > high){
+			if (verbose) printf("peer %s is a falseticker\n", slist[i].addr);
+			slist[i].selection=SEL_FALSETICKER;
+		} else {
+			slist[i].selection=SEL_SURVIVOR;
+			survivors++;
 		}
+	}
 
-		/* compare the server to the best one we've seen so far */
-		/* does it have an equal or better stratum? */
-		DBG(printf("comparing peer %d with peer %d\n", cserver, best_server));
-		if(slist[cserver].stratum <= slist[best_server].stratum){
-			DBG(printf("stratum for peer %d <= peer %d\n", cserver, best_server));
-			/* does it have an equal or better dispersion? */
-			if(slist[cserver].rtdisp <= slist[best_server].rtdisp){
-				DBG(printf("dispersion for peer %d <= peer %d\n", cserver, best_server));
-				/* does it have a better rtdelay? */
-				if(slist[cserver].rtdelay < slist[best_server].rtdelay){
-					DBG(printf("rtdelay for peer %d < peer %d\n", cserver, best_server));
-					best_server = cserver;
-					DBG(printf("peer %d is now our best candidate\n", best_server));
-				}
+	/* cluster algorithm: keep dropping the survivor that contributes the
+	 * most selection jitter, as long as that is more than the jitter of
+	 * the best peer and there are more than NMIN left */
+	while(survivors > NMIN){
+		worst=-1;
+		max_jitter=0.;
+		min_jitter=-1.;
+		for(i=0; i<nservers; i++){
+			if(slist[i].selection != SEL_SURVIVOR) continue;
+			sel_jitter=0.;
+			for(j=0; j<nservers; j++){
+				if(slist[j].selection != SEL_SURVIVOR) continue;
+				sel_jitter+=(slist[i].avg_offset-slist[j].avg_offset)*(slist[i].avg_offset-slist[j].avg_offset);
+			}
+			sel_jitter=sqrt(sel_jitter/(survivors-1));
+			if(worst < 0 || sel_jitter > max_jitter){
+				worst=i;
+				max_jitter=sel_jitter;
 			}
+			if(min_jitter < 0 || slist[i].jitter < min_jitter) min_jitter=slist[i].jitter;
 		}
+		if(max_jitter <= min_jitter) break;
+		if (verbose) printf("peer %s is an outlier: selection jitter %.10g\n", slist[worst].addr, max_jitter);
+		slist[worst].selection=SEL_OUTLIER;
+		survivors--;
 	}
 
-	if(best_server >= 0) {
-		DBG(printf("best server selected: peer %d\n", best_server));
-		return best_server;
-	} else {
-		DBG(printf("no peers meeting synchronization criteria :(\n"));
-		return -1;
+	*offset=0.;
+	for(i=0; i<nservers; i++){
+		if(slist[i].selection != SEL_SURVIVOR) continue;
+		*offset+=slist[i].avg_offset/slist[i].rootdist;
+		weight+=1/slist[i].rootdist;
 	}
+	*offset/=weight;
+	return survivors;
 }
 
-/* do everything we need to get the total average offset
- * - we use a certain amount of parallelization with poll() to ensure
- *   we don't waste time sitting around waiting for single packets.
- * - we also "manually" handle resolving host names and connecting, because
- *   we have to do it in a way that our lazy macros don't handle currently :( */
-double offset_request(const char *host, int *status){
-	int i=0, j=0, ga_result=0, num_hosts=0, *socklist=NULL, respnum=0;
-	int servers_completed=0, one_read=0, servers_readable=0, best_index=-1;
-	time_t now_time=0, start_ts=0;
-	ntp_message *req=NULL;
-	double avg_offset=0.;
-	struct timeval recv_time;
+/* resolve each host and open a socket to every address it resolves to,
+ * appending them to servers and socklist */
+static int setup_offset_servers(char **hosts, int nhosts, int **socklist){
+	int i, ga_result, num=0, sd;
 	struct addrinfo *ai=NULL, *ai_tmp=NULL, hints;
-	struct pollfd *ufds=NULL;
-	ntp_server_results *servers=NULL;
 
 	/* setup hints to only return results from getaddrinfo that we'd like */
 	memset(&hints, 0, sizeof(struct addrinfo));
@@ -432,46 +626,78 @@ double offset_request(const char *host, int *status){
 	hints.ai_protocol = IPPROTO_UDP;
 	hints.ai_socktype = SOCK_DGRAM;
 
-	/* fill in ai with the list of hosts resolved by the host name */
-	ga_result = getaddrinfo(host, "123", &hints, &ai);
-	if(ga_result!=0){
-		die(STATE_UNKNOWN, "error getting address for %s: %s\n",
-		    host, gai_strerror(ga_result));
+	for(i=0; i<nhosts; i++){
+		/* fill in ai with the list of hosts resolved by the host name */
+		ga_result = getaddrinfo(hosts[i], "123", &hints, &ai);
+		if(ga_result!=0){
+			die(STATE_UNKNOWN, "error getting address for %s: %s\n",
+			    hosts[i], gai_strerror(ga_result));
+		}
+		for(ai_tmp=ai; ai_tmp!=NULL; ai_tmp=ai_tmp->ai_next){
+			servers=(ntp_server_results*)realloc(servers, sizeof(ntp_server_results)*(num+1));
+			if(servers==NULL) die(STATE_UNKNOWN, "can not allocate server array");
+			*socklist=(int*)realloc(*socklist, sizeof(int)*(num+1));
+			if(*socklist==NULL) die(STATE_UNKNOWN, "can not allocate socket array");
+			memset(&servers[num], 0, sizeof(ntp_server_results));
+			if(getnameinfo(ai_tmp->ai_addr, ai_tmp->ai_addrlen, servers[num].addr,
+			               sizeof(servers[num].addr), NULL, 0, NI_NUMERICHOST) != 0)
+				strncpy(servers[num].addr, hosts[i], sizeof(servers[num].addr)-1);
+
+			sd=socket(ai_tmp->ai_family, SOCK_DGRAM, IPPROTO_UDP);
+			if(sd == -1) {
+				perror(NULL);
+				die(STATE_UNKNOWN, "can not create new socket");
+			}
+			if(connect(sd, ai_tmp->ai_addr, ai_tmp->ai_addrlen)){
+				/* don't die here, because it is enough if there is one server
+				   answering in time. This also would break for dual ipv4/6 stacked
+				   ntp servers when the client only supports on of them.
+				 */
+				DBG(printf("can't create socket connection on peer %s: %s\n", servers[num].addr, strerror(errno)));
+				close(sd);
+				sd=-1;
+			} else {
+				enable_rx_timestamps(sd);
+			}
+			(*socklist)[num++]=sd;
+		}
+		freeaddrinfo(ai);
 	}
+	DBG(printf("Found %d peers to check\n", num));
+	return num;
+}
+
+/* do everything we need to get the total average offset
+ * - all addresses of all hosts are queried at the same time, using poll()
+ *   to ensure we don't waste time sitting around waiting for single packets.
+ * - we also "manually" handle resolving host names and connecting, because
+ *   we have to do it in a way that our lazy macros don't handle currently :(
+ * - the per server results are left in servers[] for the caller */
+double offset_request(char **hosts, int nhosts, int *status){
+	int i=0, num_hosts=0, *socklist=NULL, respnum=0;
+	int servers_completed=0, one_read=0, servers_readable=0;
+	time_t now_time=0, start_ts=0;
+	ntp_message *req=NULL;
+	double avg_offset=0., client_rx;
+	struct pollfd *ufds=NULL;
 
-	/* count the number of returned hosts, and allocate stuff accordingly */
-	for(ai_tmp=ai; ai_tmp!=NULL; ai_tmp=ai_tmp->ai_next){ num_hosts++; }
+	num_hosts=setup_offset_servers(hosts, nhosts, &socklist);
+	num_servers=num_hosts;
 	req=(ntp_message*)malloc(sizeof(ntp_message)*num_hosts);
 	if(req==NULL) die(STATE_UNKNOWN, "can not allocate ntp message array");
-	socklist=(int*)malloc(sizeof(int)*num_hosts);
-	if(socklist==NULL) die(STATE_UNKNOWN, "can not allocate socket array");
 	ufds=(struct pollfd*)malloc(sizeof(struct pollfd)*num_hosts);
 	if(ufds==NULL) die(STATE_UNKNOWN, "can not allocate socket array");
-	servers=(ntp_server_results*)malloc(sizeof(ntp_server_results)*num_hosts);
-	if(servers==NULL) die(STATE_UNKNOWN, "can not allocate server array");
-	memset(servers, 0, sizeof(ntp_server_results)*num_hosts);
-	DBG(printf("Found %d peers to check\n", num_hosts));
-
-	/* setup each socket for writing, and the corresponding struct pollfd */
-	ai_tmp=ai;
-	for(i=0;ai_tmp;i++){
-		socklist[i]=socket(ai_tmp->ai_family, SOCK_DGRAM, IPPROTO_UDP);
-		if(socklist[i] == -1) {
-			perror(NULL);
-			die(STATE_UNKNOWN, "can not create new socket");
-		}
-		if(connect(socklist[i], ai_tmp->ai_addr, ai_tmp->ai_addrlen)){
-			/* don't die here, because it is enough if there is one server
-			   answering in time. This also would break for dual ipv4/6 stacked
-			   ntp servers when the client only supports on of them.
-			 */
-			DBG(printf("can't create socket connection on peer %i: %s\n", i, strerror(errno)));
-		} else {
-			ufds[i].fd=socklist[i];
-			ufds[i].events=POLLIN;
-			ufds[i].revents=0;
+
+	/* setup the struct pollfd for each socket; poll() skips the
+	 * negative descriptors of the addresses we could not connect to */
+	for(i=0; i<num_hosts; i++){
+		ufds[i].fd=socklist[i];
+		ufds[i].events=POLLIN;
+		ufds[i].revents=0;
+		if(socklist[i] == -1){
+			servers[i].num_requests=servers[i].num_responses=AVG_NUM;
+			servers_completed++;
 		}
-		ai_tmp = ai_tmp->ai_next;
 	}
 
 	/* now do AVG_NUM checks to each host.  we stop before timeout/2 seconds
@@ -487,14 +713,13 @@ double offset_request(const char *host, int *status){
 		for(i=0; i<num_hosts; i++){
 			if(servers[i].waiting<now_time && servers[i].num_responses<AVG_NUM){
 				if(verbose && servers[i].num_requests != servers[i].num_responses) printf("re-");
-				if(verbose) printf("sending request to peer %d\n", i);
+				if(verbose) printf("sending request to peer %s\n", servers[i].addr);
 				setup_request(&req[i]);
 				write(socklist[i], &req[i], sizeof(ntp_message));
 				servers[i].waiting=now_time+delay;
 				if(servers[i].num_requests == servers[i].num_responses) {
 					servers[i].num_requests++;
 				}
-				break;
 			}
 		}
 
@@ -509,16 +734,16 @@ double offset_request(const char *host, int *status){
 		for(i=0; servers_readable && i<num_hosts; i++){
 			if(ufds[i].revents&POLLIN && servers[i].num_responses < AVG_NUM){
 				if(verbose) {
-					printf("response from peer %d: ", i);
+					printf("response from peer %s: ", servers[i].addr);
 				}
 
-				read(ufds[i].fd, &req[i], sizeof(ntp_message));
-				gettimeofday(&recv_time, NULL);
+				client_rx=recv_ntp_message(ufds[i].fd, &req[i]);
 				DBG(print_ntp_message(&req[i]));
 				respnum=servers[i].num_responses++;
-				servers[i].offset[respnum]=calc_offset(&req[i], &recv_time);
+				servers[i].offset[respnum]=calc_offset(&req[i], client_rx);
+				servers[i].delay[respnum]=calc_delay(&req[i], client_rx);
 				if(verbose) {
-					printf("offset %.10g\n", servers[i].offset[respnum]);
+					printf("offset %.10g delay %.10g\n", servers[i].offset[respnum], servers[i].delay[respnum]);
 				}
 				servers[i].stratum=req[i].stratum;
 				servers[i].rtdisp=ntp32_to_double(req[i].rtdisp);
@@ -537,16 +762,14 @@ double offset_request(const char *host, int *status){
 		die(timeout_state, "%s: No response from NTP server\n", state_text(timeout_state));
 	}
 
-	/* now, pick the best server from the list */
-	best_index=best_offset_server(servers, num_hosts);
-	if(best_index < 0){
+	/* unreachable addresses only pretended to be complete */
+	for(i=0; i<num_hosts; i++){
+		if(socklist[i] == -1) servers[i].num_responses=0;
+	}
+
+	/* now, pick the truechimers from the list and combine their offsets */
+	if(select_offset_servers(servers, num_hosts, &avg_offset) == 0){
 		*status=STATE_UNKNOWN;
-	} else {
-		/* finally, calculate the average offset */
-		for(i=0; i<servers[best_index].num_responses;i++){
-			avg_offset+=servers[best_index].offset[i];
-		}
-		avg_offset/=servers[best_index].num_responses;
 	}
 
 	/* cleanup */
@@ -556,9 +779,7 @@ double offset_request(const char *host, int *status){
 	 * for(j=0; j<num_hosts; j++){ close(socklist[j]); } */
 	free(socklist);
 	free(ufds);
-	free(servers);
 	free(req);
-	freeaddrinfo(ai);
 
 	if(verbose) printf("overall average offset: %.10g\n", avg_offset);
 	return avg_offset;
@@ -786,7 +1007,13 @@ int process_arguments(int argc, char **argv){
 		case 'H':
 			if(is_host(optarg) == FALSE)
 				usage2(_("Invalid hostname/address"), optarg);
-			server_address = strdup(optarg);
+			server_addresses = realloc(server_addresses, sizeof(char*)*(num_server_addresses+1));
+			if(server_addresses == NULL)
+				die(STATE_UNKNOWN, _("Could not allocate memory for server list\n"));
+			server_addresses[num_server_addresses++] = strdup(optarg);
+			/* the jitter is only checked on the first server */
+			if(server_address == NULL)
+				server_address = server_addresses[0];
 			break;
 		case 't':
 			timeout_interval = parse_timeout_string(optarg);
@@ -834,8 +1061,58 @@ char *perfd_jitter (double jitter)
 		TRUE, 0, FALSE, 0);
 }
 
+/* how many servers were used, and which ones were falsetickers */
+char *servers_summary (void)
+{
+	int i, selected=0, falsetickers=0;
+	char *falseticker_list=NULL, *summary=NULL;
+
+	for(i=0; i<num_servers; i++){
+		if(servers[i].selection == SEL_SURVIVOR) selected++;
+		if(servers[i].selection != SEL_FALSETICKER) continue;
+		falsetickers++;
+		if(falseticker_list == NULL)
+			xasprintf(&falseticker_list, "%s", servers[i].addr);
+		else
+			xasprintf(&falseticker_list, "%s %s", falseticker_list, servers[i].addr);
+	}
+	xasprintf(&summary, _("%d of %d servers selected"), selected, num_servers);
+	if(falsetickers)
+		xasprintf(&summary, "%s, %s: %s", summary, _("falsetickers"), falseticker_list);
+	free(falseticker_list);
+	return summary;
+}
+
+/* offset and jitter of every server that answered, plus the falsetickers */
+char *perfd_servers (void)
+{
+	int i, falsetickers=0;
+	char *label, *line=NULL;
+
+	for(i=0; i<num_servers; i++){
+		if(servers[i].num_responses == 0) continue;
+		if(servers[i].selection == SEL_FALSETICKER) falsetickers++;
+		xasprintf(&label, "offset_%s", servers[i].addr);
+		xasprintf(&line, "%s%s%s", line ? line : "", line ? " " : "",
+		          sperfdata (label, servers[i].avg_offset, "s",
+		                     offset_thresholds->warning_string,
+		                     offset_thresholds->critical_string,
+		                     FALSE, 0, FALSE, 0));
+		free(label);
+		xasprintf(&label, "jitter_%s", servers[i].addr);
+		xasprintf(&line, "%s %s", line,
+		          fperfdata (label, servers[i].jitter, "s",
+		                     FALSE, 0, FALSE, 0, TRUE, 0, FALSE, 0));
+		free(label);
+	}
+	xasprintf(&line, "%s%s%s", line ? line : "", line ? " " : "",
+	          perfdata ("falsetickers", falsetickers, "",
+	                    FALSE, 0, FALSE, 0, TRUE, 0, FALSE, 0));
+	return line;
+}
+
 int main(int argc, char *argv[]){
-	int result, offset_result, jitter_result;
+	int i, result, offset_result, jitter_result;
 	double offset=0, jitter=0;
 	char *result_line, *perfdata_line;
 
@@ -860,7 +1137,7 @@ int main(int argc, char *argv[]){
 	/* set socket timeout */
 	alarm (timeout_interval);
 
-	offset = offset_request(server_address, &offset_result);
+	offset = offset_request(server_addresses, num_server_addresses, &offset_result);
 	/* check_ntp used to always return CRITICAL if offset_result == STATE_UNKNOWN.
 	 * Now we'll only do that is the offset thresholds were set */
 	if (do_offset && offset_result == STATE_UNKNOWN) {
@@ -909,9 +1186,15 @@ int main(int argc, char *argv[]){
 		xasprintf(&result_line, "%s, jitter=%f", result_line, jitter);
 		xasprintf(&perfdata_line, "%s %s", perfdata_line,  perfd_jitter(jitter));
 	}
+	if (num_servers > 1) {
+		xasprintf(&result_line, "%s, %s", result_line, servers_summary());
+		xasprintf(&perfdata_line, "%s %s", perfdata_line, perfd_servers());
+	}
 	printf("%s|%s\n", result_line, perfdata_line);
 
-	if(server_address!=NULL) free(server_address);
+	for(i=0; i<num_server_addresses; i++) free(server_addresses[i]);
+	free(server_addresses);
+	free(servers);
 	return result;
 }
 
@@ -951,6 +1234,10 @@ void print_help(void){
 	printf("%s\n", _("Notes:"));
 	printf(" %s\n", _("--delay is useful if you are triggering the anti-DOS for the"));
 	printf(" %s\n", _("NTP server and need to leave a bigger gap between queries"));
+	printf(" %s\n", _("-H may be given more than once. All servers are queried at the same"));
+	printf(" %s\n", _("time and the offset is combined from the ones the NTP clock selection"));
+	printf(" %s\n", _("considers truechimers; the falsetickers are listed in the output."));
+	printf(" %s\n", _("Jitter (-j, -k) is only checked on the first server."));
 	printf(UT_THRESHOLDS_NOTES);
 
 	printf("\n");
@@ -958,6 +1245,9 @@ void print_help(void){
 	printf(" %s\n", _("Normal offset check:"));
 	printf("  %s\n", ("./check_ntp -H ntpserv -w 0.5 -c 1"));
 	printf("\n");
+	printf(" %s\n", _("Compare the local clock against several servers at once:"));
+	printf("  %s\n", ("./check_ntp -H ntp1 -H ntp2 -H pool.ntp.org -w 0.5 -c 1"));
+	printf("\n");
 	printf(" %s\n", _("Check jitter too, avoiding critical notifications if jitter isn't available"));
 	printf(" %s\n", _("(See Notes above for more details on thresholds formats):"));
 	printf("  %s\n", ("./check_ntp -H ntpserv -w 0.5 -c 1 -j -1:100 -k -1:200"));
@@ -974,5 +1264,5 @@ print_usage(void)
 	printf ("%s\n", _("WARNING: check_ntp is deprecated. Please use check_ntp_peer or"));
 	printf ("%s\n\n", _("check_ntp_time instead."));
 	printf ("%s\n", _("Usage:"));
-	printf(" %s -H <host> [-w <warn>] [-c <crit>] [-j <warn>] [-k <crit>] [-4|-6] [-v verbose] [-d <delay>]\n", progname);
+	printf(" %s -H <host> [-H <host> ...] [-w <warn>] [-c <crit>] [-j <warn>] [-k <crit>] [-4|-6] [-v verbose] [-d <delay>]\n", progname);
 }
@@ -129,6 +129,44 @@ typedef struct {
 #define PEER_INCLUDED 0x04
 #define PEER_SYNCSOURCE 0x06
 
+/* READVAR requests kept in flight at the same time */
+#define MAX_PIPELINE 32
+/* resend a READVAR request that got no answer for this long (seconds) */
+#define REQUEST_RETRY 1
+/* and give up on its peer after this many resends */
+#define REQUEST_RETRIES 5
+
+/* a control message response being put together from its fragments */
+typedef struct {
+	char *data;          /* reassembled data, NUL terminated once complete */
+	int size;            /* allocated size of data */
+	int received;        /* data bytes received so far */
+	int total;           /* data length once the last fragment is in, else -1 */
+	int error;           /* the server answered with the error bit set */
+	uint16_t *frags;     /* offsets of the fragments received, to skip dups */
+	int nfrags;
+} ntp_cm_response;
+
+/* a READVAR request for one association and the state of its response */
+typedef struct {
+	int peer;            /* index into the READSTAT peer list */
+	int getvar;          /* index into getvars[] */
+	uint16_t seq;        /* sequence number of the outstanding request */
+	struct timeval last_rx; /* when it was sent or a fragment last came in */
+	int retries;
+	int done;
+	ntp_cm_response resp;
+} ntp_peer_query;
+
+/* variables asked for, falling back to the next one on errors: older
+ * servers don't know what jitter is, and some don't like dispersion either */
+static const char *getvars[] = {
+	"stratum,offset,jitter",
+	"stratum,offset,dispersion",
+	""
+};
+#define NUM_GETVARS (sizeof(getvars)/sizeof(getvars[0]))
+
 /* NTP control message header is 12 bytes, plus any data in the data
  * field, plus null padding to the nearest 32-bit boundary per rfc.
  */
@@ -188,6 +226,165 @@ setup_control_request(ntp_control_message *p, uint8_t opcode, uint16_t seq){
 	/* Remaining fields are zero for requests */
 }
 
+void
+cm_response_reset(ntp_cm_response *r){
+	free(r->data);
+	free(r->frags);
+	memset(r, 0, sizeof(ntp_cm_response));
+	r->total=-1;
+}
+
+/* add a response fragment at the position given by its offset field.
+ * fragments may arrive out of order or twice; returns TRUE once all of
+ * the data up to the last fragment (the one without REM_MORE) is in */
+int
+cm_response_add(ntp_cm_response *r, const ntp_control_message *m){
+	int i, offset=ntohs(m->offset), count=ntohs(m->count);
+	void *tmp;
+
+	if(m->op&REM_ERROR){
+		r->error=1;
+		return TRUE;
+	}
+	for(i=0; i<r->nfrags; i++){
+		if(r->frags[i] == offset) return FALSE;
+	}
+	if(offset+count+1 > r->size){
+		if((tmp=realloc(r->data, offset+count+1)) == NULL)
+			die(STATE_UNKNOWN, "can not (re)allocate response buffer\n");
+		r->data=tmp;
+		r->size=offset+count+1;
+	}
+	if((tmp=realloc(r->frags, sizeof(uint16_t)*(r->nfrags+1))) == NULL)
+		die(STATE_UNKNOWN, "can not (re)allocate response buffer\n");
+	r->frags=tmp;
+	r->frags[r->nfrags++]=offset;
+	memcpy(r->data+offset, m->data, count);
+	r->received+=count;
+	if(!(m->op&REM_MORE)) r->total=offset+count;
+
+	if(r->total >= 0 && r->received >= r->total){
+		r->data[r->total]='\0';
+		return TRUE;
+	}
+	return FALSE;
+}
+
+/* read one control message.  returns -1 if the read failed and 0 for
+ * obviously invalid packets */
+int
+read_control_message(int conn, ntp_control_message *m){
+	int len;
+
+	if((len=read(conn, m, sizeof(ntp_control_message))) == -1)
+		return -1;
+	if(len < 12 || !(m->op&REM_RESP) || ntohs(m->count) > MAX_CM_SIZE ||
+	   ntohs(m->count) > len-12)
+		return 0;
+	DBG(print_ntp_control_message(m));
+	return len;
+}
+
+void
+send_readvar_request(int conn, ntp_peer_query *q, uint16_t assoc, uint16_t seq){
+	ntp_control_message req;
+
+	setup_control_request(&req, OP_READVAR, seq);
+	req.assoc = assoc;
+	/* Putting the wanted variable names in the request
+	 * cause the server to provide _only_ the requested values.
+	 * thus reducing net traffic, guaranteeing us only a single
+	 * datagram in reply, and making interpretation much simpler
+	 */
+	strncpy(req.data, getvars[q->getvar], MAX_CM_SIZE-1);
+	req.count = htons(strlen(getvars[q->getvar]));
+	DBG(printf("sending READVAR request for peer %.2x, sequence %d\n", ntohs(assoc), seq));
+	write(conn, &req, SIZEOF_NTPCM(req));
+	DBG(print_ntp_control_message(&req));
+	cm_response_reset(&q->resp);
+	q->seq=seq;
+	gettimeofday(&q->last_rx, NULL);
+}
+
+/* the sequence number after seq; 0 is not used and 1 is the READSTAT's, so
+ * a late answer to it never matches a READVAR after the wrap */
+static uint16_t
+next_seq(uint16_t seq){
+	return (seq == UINT16_MAX) ? 2 : seq+1;
+}
+
+/* fetch the variables of all the queried peers at once: up to MAX_PIPELINE
+ * READVAR requests are in flight, each with its own sequence number, and
+ * responses are matched back to their request by that number */
+void
+readvar_requests(int conn, ntp_assoc_status_pair *peers, ntp_peer_query *queries, int nqueries){
+	int i, next=0, inflight=0, done=0;
+	uint16_t seq=2;
+	struct pollfd pfd;
+	ntp_control_message req;
+	ntp_peer_query *q;
+
+	pfd.fd=conn;
+	pfd.events=POLLIN;
+	while(done < nqueries){
+		while(inflight < MAX_PIPELINE && next < nqueries){
+			send_readvar_request(conn, &queries[next], peers[queries[next].peer].assoc, seq);
+			seq=next_seq(seq);
+			next++;
+			inflight++;
+		}
+		/* UDP: ask again if nothing came for a request for a while, as it
+		 * or a fragment of its response got lost.  A slow response that is
+		 * still coming in is left alone, since the new request starts the
+		 * response over and fragments for the old one no longer match. */
+		for(i=0; i<next; i++){
+			q=&queries[i];
+			if(q->done || deltime(q->last_rx) < REQUEST_RETRY*1000000L)
+				continue;
+			if(q->retries++ == REQUEST_RETRIES){
+				if(verbose) printf("no response to READVAR request for peer %.2x\n", ntohs(peers[q->peer].assoc));
+				cm_response_reset(&q->resp);
+				q->done=1;
+				inflight--;
+				done++;
+				continue;
+			}
+			if(verbose) printf("resending READVAR request for peer %.2x\n", ntohs(peers[q->peer].assoc));
+			send_readvar_request(conn, q, peers[q->peer].assoc, seq);
+			seq=next_seq(seq);
+		}
+		if(done == nqueries) break;
+
+		if(poll(&pfd, 1, 100) <= 0) continue;
+		if(read_control_message(conn, &req) <= 0) continue;
+		if(!(req.op&OP_READVAR)) continue;
+
+		for(i=0; i<next; i++){
+			if(!queries[i].done && queries[i].seq == ntohs(req.seq)) break;
+		}
+		if(i == next) continue;
+		q=&queries[i];
+		gettimeofday(&q->last_rx, NULL);
+		if(!cm_response_add(&q->resp, &req)) continue;
+
+		if(q->resp.error && q->getvar+1 < (int)NUM_GETVARS){
+			if(verbose) {
+				if(q->getvar == 0)
+					printf("The command failed. This is usually caused by servers refusing the 'jitter'\nvariable. Restarting with 'dispersion'...\n");
+				else
+					printf("Server didn't like dispersion either; will retrieve everything\n");
+			}
+			q->getvar++;
+			send_readvar_request(conn, q, peers[q->peer].assoc, seq);
+			seq=next_seq(seq);
+			continue;
+		}
+		q->done=1;
+		inflight--;
+		done++;
+	}
+}
+
 /* This function does all the actual work; roughly here's what it does
  * beside setting the offest, jitter and stratum passed as argument:
  *  - offset can be negative, so if it cannot get the offset, offset_result
@@ -200,16 +397,16 @@ setup_control_request(ntp_control_message *p, uint8_t opcode, uint16_t seq){
  *  used later in main to check is the server was synchronized. It works
  *  so I left it alone */
 int ntp_request(const char *host, double *offset, int *offset_result, double *jitter, int *stratum, int *num_truechimers){
-	int conn=-1, i, npeers=0, num_candidates=0;
+	int conn=-1, i, npeers=0, num_candidates=0, nqueries=0;
 	double tmp_offset = 0;
 	int min_peer_sel=PEER_INCLUDED;
-	int peers_size=0, peer_offset=0;
 	int status;
 	ntp_assoc_status_pair *peers=NULL;
 	ntp_control_message req;
-	const char *getvar = "stratum,offset,jitter";
+	ntp_cm_response peerlist;
+	ntp_peer_query *queries=NULL;
+	const char *getvar;
 	char *data, *value, *nptr;
-	void *tmp;
 
 	status = STATE_OK;
 	*offset_result = STATE_UNKNOWN;
@@ -228,44 +425,43 @@ int ntp_request(const char *host, double *offset, int *offset_result, double *ji
 	 *     we take anything better than 0x04 (see the rfc for details) but
 	 *     set a minimum of warning.
 	 * 3) Send a READVAR request for information on each peer identified
-	 *    in 2b greater than the minimum selection value.
+	 *    in 2b greater than the minimum selection value.  These are all
+	 *    sent at once, so that busy servers with hundreds of associations
+	 *    answer within about one round trip.
 	 * 4) Extract the offset, jitter and stratum value from the data[]
 	 *    (it's ASCII)
 	 */
 	my_udp_connect(server_address, port, &conn);
 
-	/* keep sending requests until the server stops setting the
-	 * REM_MORE bit, though usually this is only 1 packet. */
-	do{
-		setup_control_request(&req, OP_READSTAT, 1);
-		DBG(printf("sending READSTAT request"));
-		write(conn, &req, SIZEOF_NTPCM(req));
-		DBG(print_ntp_control_message(&req));
-
-		do {
-			/* Attempt to read the largest size packet possible */
-			req.count=htons(MAX_CM_SIZE);
-			DBG(printf("receiving READSTAT response"))
-			if(read(conn, &req, SIZEOF_NTPCM(req)) == -1)
-				die(STATE_CRITICAL, "NTP CRITICAL: No response from NTP server\n");
-			DBG(print_ntp_control_message(&req));
-			/* discard obviously invalid packets */
-			if (ntohs(req.count) > MAX_CM_SIZE)
-				die(STATE_CRITICAL, "NTP CRITICAL: Invalid packet received from NTP server\n");
-		} while (!(req.op&OP_READSTAT && ntohs(req.seq) == 1));
-
+	/* the peer list may not fit in one packet, in which case the
+	 * server sends fragments with the REM_MORE bit set on all but
+	 * the last one; put them back together by their offset. */
+	memset(&peerlist, 0, sizeof(peerlist));
+	cm_response_reset(&peerlist);
+	setup_control_request(&req, OP_READSTAT, 1);
+	DBG(printf("sending READSTAT request"));
+	write(conn, &req, SIZEOF_NTPCM(req));
+	DBG(print_ntp_control_message(&req));
+
+	do {
+		DBG(printf("receiving READSTAT response"))
+		switch(read_control_message(conn, &req)) {
+		case -1:
+			die(STATE_CRITICAL, "NTP CRITICAL: No response from NTP server\n");
+		case 0:
+			die(STATE_CRITICAL, "NTP CRITICAL: Invalid packet received from NTP server\n");
+		}
+		if(!(req.op&OP_READSTAT && ntohs(req.seq) == 1)) continue;
 		if (LI(req.flags) == LI_ALARM) li_alarm = 1;
-		/* Each peer identifier is 4 bytes in the data section, which
-	 	 * we represent as a ntp_assoc_status_pair datatype.
-	 	 */
-		peers_size+=ntohs(req.count);
-		if((tmp=realloc(peers, peers_size)) == NULL)
-			free(peers), die(STATE_UNKNOWN, "can not (re)allocate 'peers' buffer\n");
-		peers=tmp;
-		memcpy((void*)((ptrdiff_t)peers+peer_offset), (void*)req.data, ntohs(req.count));
-		npeers=peers_size/sizeof(ntp_assoc_status_pair);
-		peer_offset+=ntohs(req.count);
-	} while(req.op&REM_MORE);
+	} while (!cm_response_add(&peerlist, &req));
+
+	/* Each peer identifier is 4 bytes in the data section, which
+	 * we represent as a ntp_assoc_status_pair datatype.
+	 */
+	if(!peerlist.error){
+		peers=(ntp_assoc_status_pair*)peerlist.data;
+		npeers=peerlist.total/sizeof(ntp_assoc_status_pair);
+	}
 
 	/* first, let's find out if we have a sync source, or if there are
 	 * at least some candidates. In the latter case we'll issue
@@ -294,120 +490,90 @@ int ntp_request(const char *host, double *offset, int *offset_result, double *ji
 	}
 
 
+	/* Only query this server if it is the current sync source */
+	/* If there's no sync.peer, query all candidates and use the best one */
+	if(npeers && (queries=calloc(npeers, sizeof(ntp_peer_query))) == NULL)
+		die(STATE_UNKNOWN, "can not allocate peer query array\n");
 	for (i = 0; i < npeers; i++){
-		/* Only query this server if it is the current sync source */
-		/* If there's no sync.peer, query all candidates and use the best one */
 		if (PEER_SEL(peers[i].status) >= min_peer_sel){
 			if(verbose) printf("Getting offset, jitter and stratum for peer %.2x\n", ntohs(peers[i].assoc));
-			xasprintf(&data, "");
-			do{
-				setup_control_request(&req, OP_READVAR, 2);
-				req.assoc = peers[i].assoc;
-				/* Putting the wanted variable names in the request
-				 * cause the server to provide _only_ the requested values.
-				 * thus reducing net traffic, guaranteeing us only a single
-				 * datagram in reply, and making interpretation much simpler
-				 */
-				/* Older servers doesn't know what jitter is, so if we get an
-				 * error on the first pass we redo it with "dispersion" */
-				strncpy(req.data, getvar, MAX_CM_SIZE-1);
-				req.count = htons(strlen(getvar));
-				DBG(printf("sending READVAR request...\n"));
-				write(conn, &req, SIZEOF_NTPCM(req));
-				DBG(print_ntp_control_message(&req));
-
-				do {
-					req.count = htons(MAX_CM_SIZE);
-					DBG(printf("receiving READVAR response...\n"));
-					read(conn, &req, SIZEOF_NTPCM(req));
-					DBG(print_ntp_control_message(&req));
-				} while (!(req.op&OP_READVAR && ntohs(req.seq) == 2));
-
-				if(!(req.op&REM_ERROR))
-					xasprintf(&data, "%s%s", data, req.data);
-			} while(req.op&REM_MORE);
-
-			if(req.op&REM_ERROR) {
-				if(strstr(getvar, "jitter")) {
-					if(verbose) printf("The command failed. This is usually caused by servers refusing the 'jitter'\nvariable. Restarting with 'dispersion'...\n");
-					getvar = "stratum,offset,dispersion";
-					i--;
-					continue;
-				} else if(strlen(getvar)) {
-					if(verbose) printf("Server didn't like dispersion either; will retrieve everything\n");
-					getvar = "";
-					i--;
-					continue;
-				}
+			queries[nqueries++].peer=i;
+		}
+	}
+	readvar_requests(conn, peers, queries, nqueries);
+
+	for (i = 0; i < nqueries; i++){
+		data = queries[i].resp.data != NULL ? queries[i].resp.data : "";
+		getvar = getvars[queries[i].getvar];
+
+		if(verbose > 1)
+			printf("Server responded: >>>%s<<<\n", data);
+
+		/* get the offset */
+		if(verbose)
+			printf("parsing offset from peer %.2x: ", ntohs(peers[queries[i].peer].assoc));
+
+		value = np_extract_ntpvar(data, "offset");
+		nptr=NULL;
+		/* Convert the value if we have one */
+		if(value != NULL)
+			tmp_offset = strtod(value, &nptr) / 1000;
+		/* If value is null or no conversion was performed */
+		if(value == NULL || value==nptr) {
+			if(verbose) printf("error: unable to read server offset response.\n");
+		} else {
+			if(verbose) printf("%.10g\n", tmp_offset);
+			if(*offset_result == STATE_UNKNOWN || fabs(tmp_offset) < fabs(*offset)) {
+				*offset = tmp_offset;
+				*offset_result = STATE_OK;
+			} else {
+				/* Skip this one; move to the next */
+				continue;
 			}
+		}
 
-			if(verbose > 1)
-				printf("Server responded: >>>%s<<<\n", data);
-
-			/* get the offset */
-			if(verbose)
-				printf("parsing offset from peer %.2x: ", ntohs(peers[i].assoc));
-
-			value = np_extract_ntpvar(data, "offset");
+		if(do_jitter) {
+			/* get the jitter */
+			if(verbose) {
+				printf("parsing %s from peer %.2x: ", strstr(getvar, "dispersion") != NULL ? "dispersion" : "jitter", ntohs(peers[queries[i].peer].assoc));
+			}
+			value = np_extract_ntpvar(data, strstr(getvar, "dispersion") != NULL ? "dispersion" : "jitter");
 			nptr=NULL;
 			/* Convert the value if we have one */
 			if(value != NULL)
-				tmp_offset = strtod(value, &nptr) / 1000;
+				*jitter = strtod(value, &nptr);
 			/* If value is null or no conversion was performed */
 			if(value == NULL || value==nptr) {
-				if(verbose) printf("error: unable to read server offset response.\n");
-			} else {
-				if(verbose) printf("%.10g\n", tmp_offset);
-				if(*offset_result == STATE_UNKNOWN || fabs(tmp_offset) < fabs(*offset)) {
-					*offset = tmp_offset;
-					*offset_result = STATE_OK;
-				} else {
-					/* Skip this one; move to the next */
-					continue;
-				}
+				if(verbose) printf("error: unable to read server jitter/dispersion response.\n");
+				*jitter = -1;
+			} else if(verbose) {
+				printf("%.10g\n", *jitter);
 			}
+		}
 
-			if(do_jitter) {
-				/* get the jitter */
-				if(verbose) {
-					printf("parsing %s from peer %.2x: ", strstr(getvar, "dispersion") != NULL ? "dispersion" : "jitter", ntohs(peers[i].assoc));
-				}
-				value = np_extract_ntpvar(data, strstr(getvar, "dispersion") != NULL ? "dispersion" : "jitter");
-				nptr=NULL;
-				/* Convert the value if we have one */
-				if(value != NULL)
-					*jitter = strtod(value, &nptr);
-				/* If value is null or no conversion was performed */
-				if(value == NULL || value==nptr) {
-					if(verbose) printf("error: unable to read server jitter/dispersion response.\n");
-					*jitter = -1;
-				} else if(verbose) {
-					printf("%.10g\n", *jitter);
-				}
+		if(do_stratum) {
+			/* get the stratum */
+			if(verbose) {
+				printf("parsing stratum from peer %.2x: ", ntohs(peers[queries[i].peer].assoc));
 			}
-
-			if(do_stratum) {
-				/* get the stratum */
-				if(verbose) {
-					printf("parsing stratum from peer %.2x: ", ntohs(peers[i].assoc));
-				}
-				value = np_extract_ntpvar(data, "stratum");
-				nptr=NULL;
-				/* Convert the value if we have one */
-				if(value != NULL)
-					*stratum = strtol(value, &nptr, 10);
-				if(value == NULL || value==nptr) {
-					if(verbose) printf("error: unable to read server stratum response.\n");
-					*stratum = -1;
-				} else {
-					if(verbose) printf("%i\n", *stratum);
-				}
+			value = np_extract_ntpvar(data, "stratum");
+			nptr=NULL;
+			/* Convert the value if we have one */
+			if(value != NULL)
+				*stratum = strtol(value, &nptr, 10);
+			if(value == NULL || value==nptr) {
+				if(verbose) printf("error: unable to read server stratum response.\n");
+				*stratum = -1;
+			} else {
+				if(verbose) printf("%i\n", *stratum);
 			}
-		} /* if (PEER_SEL(peers[i].status) >= min_peer_sel) */
-	} /* for (i = 0; i < npeers; i++) */
+		}
+	} /* for (i = 0; i < nqueries; i++) */
 
 	close(conn);
-	if(peers!=NULL) free(peers);
+	for (i = 0; i < nqueries; i++) cm_response_reset(&queries[i].resp);
+	free(queries);
+	cm_response_reset(&peerlist);
 
 	return status;
 }
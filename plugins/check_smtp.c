@@ -106,6 +106,7 @@ int check_warning_time = FALSE;
 double critical_time = 0;
 int check_critical_time = FALSE;
 int verbose = 0;
+int extended_perfdata = FALSE;
 int use_ssl = FALSE;
 int use_starttls = FALSE;
 int use_sni = FALSE;
@@ -274,6 +275,7 @@ main (int argc, char **argv)
 		    smtp_quit();
 		    return STATE_UNKNOWN;
 		  }
+		  np_net_timing_mark(&np_timing.upgraded);
 		  result = np_net_ssl_init_with_hostname(sd, (use_sni ? server_address : NULL));
 		  if(result != STATE_OK) {
 		    printf (_("CRITICAL - Cannot create SSL context.\n"));
@@ -463,7 +465,7 @@ main (int argc, char **argv)
 			result = STATE_WARNING;
 	}
 
-	printf (_("SMTP %s - %s%.3f sec. response time%s%s|%s\n"),
+	printf (_("SMTP %s - %s%.3f sec. response time%s%s|%s%s%s\n"),
 			state_text (result),
 			error_msg,
 			elapsed_time,
@@ -471,7 +473,9 @@ main (int argc, char **argv)
 			fperfdata ("time", elapsed_time, "s",
 				(int)check_warning_time, warning_time,
 				(int)check_critical_time, critical_time,
-				TRUE, 0, FALSE, 0));
+				TRUE, 0, FALSE, 0),
+			extended_perfdata ? " " : "",
+			extended_perfdata ? np_net_timing_perfdata () : "");
 
 	return result;
 }
@@ -486,7 +490,8 @@ process_arguments (int argc, char **argv)
 	char* temp;
 
 	enum {
-	  SNI_OPTION
+	  SNI_OPTION,
+	  EXTENDED_PERFDATA_OPTION = CHAR_MAX + 1
 	};
 
 	int option = 0;
@@ -516,6 +521,7 @@ process_arguments (int argc, char **argv)
 		{"certificate",required_argument,0,'D'},
 		{"ignore-quit-failure",no_argument,0,'q'},
 		{"proxy",no_argument,0,'r'},
+		{"extended-perfdata",no_argument,0,EXTENDED_PERFDATA_OPTION},
 		{0, 0, 0, 0}
 	};
 
@@ -666,6 +672,9 @@ process_arguments (int argc, char **argv)
 			usage (_("SSL support not available - install OpenSSL and recompile"));
 #endif
       break;
+		case EXTENDED_PERFDATA_OPTION:
+			extended_perfdata = TRUE;
+			break;
 		case 'r':
 			use_proxy_prefix = TRUE;
 			break;
@@ -791,6 +800,7 @@ recvline(char *buf, size_t bufsize)
 			break;
 		if (buf[i] == '\n') {
 			buf[++i] = '\0';
+			np_net_timing_recv(i);
 			return i;
 		}
 	}
@@ -903,6 +913,8 @@ print_help (void)
 
 	printf (UT_CONN_TIMEOUT, DEFAULT_SOCKET_TIMEOUT);
 
+	printf (UT_EXTENDED_PERFDATA);
+
 	printf (UT_VERBOSE);
 
 	printf("\n");
@@ -923,5 +935,6 @@ print_usage (void)
   printf ("%s -H host [-p port] [-4|-6] [-e expect] [-C command] [-R response] [-f from addr]\n", progname);
   printf ("[-A authtype -U authuser -P authpass] [-w warn] [-c crit] [-t timeout] [-q]\n");
   printf ("[-F fqdn] [-S] [-L] [-D warn days cert expire[,crit days cert expire]] [--sni] [-v] \n");
+  printf ("[--extended-perfdata]\n");
 }
 
@@ -99,7 +99,7 @@ char regex_expect[MAX_INPUT_BUFFER] = "";
 regex_t preg;
 regmatch_t pmatch[10];
 char errbuf[MAX_INPUT_BUFFER] = "";
-char perfstr[MAX_INPUT_BUFFER] = "| ";
+np_buf perfstr = NP_BUF_INIT;
 int cflags = REG_EXTENDED | REG_NOSUB | REG_NEWLINE;
 int eflags = 0;
 int errcode, excode;
@@ -153,9 +153,7 @@ static int strict_mode = 0;
 double offset = 0.0;
 double multiplier = 1.0;
 int rate_multiplier = 1;
-state_data *previous_state;
-double *previous_value;
-size_t previous_size = OID_COUNT_STEP;
+np_series *previous;
 int perf_labels = 1;
 char* ip_version = "";
 
@@ -183,7 +181,7 @@ static char *fix_snmp_range(char *th)
 int
 main (int argc, char **argv)
 {
-	int i, j, len, line, total_oids;
+	int i, j, line, total_oids;
 	unsigned int bk_count = 0, dq_count = 0;
 	int iresult = STATE_UNKNOWN;
 	int result = STATE_UNKNOWN;
@@ -201,15 +199,11 @@ main (int argc, char **argv)
 	char *th_crit=NULL;
 	char type[8] = "";
 	output chld_out, chld_err;
-	char *previous_string=NULL;
-	char *ap=NULL;
-	char *state_string=NULL;
-	size_t response_length, current_length, string_length, show_length;
+	size_t show_length;
 	char *temp_string=NULL;
 	char *quote_string=NULL;
 	time_t current_time;
 	double temp_double;
-	time_t duration;
 	char *conv = "12345678";
 	int is_counter=0;
 	int command_interval;
@@ -223,7 +217,6 @@ main (int argc, char **argv)
 	unitv = malloc (unitv_size * sizeof(*unitv));
 	thlds = malloc (thlds_size * sizeof(*thlds));
 	response_value = malloc (response_size * sizeof(*response_value));
-	previous_value = malloc (previous_size * sizeof(*previous_value));
 	eval_method = calloc (eval_size, sizeof(*eval_method));
 	oids = calloc(oids_size, sizeof (char *));
 
@@ -246,6 +239,7 @@ main (int argc, char **argv)
 
 	if (process_arguments (argc, argv) == ERROR)
 		usage4 (_("Could not parse arguments"));
+	np_set_verbose(verbose);
 
 	command_interval = timeout_interval / retries + 1;
 	if (command_interval < 1) {
@@ -256,20 +250,11 @@ main (int argc, char **argv)
 	if(calculate_rate) {
 		if (!strcmp(label, "SNMP"))
 			label = strdup("SNMP RATE");
-		i=0;
-		previous_state = np_state_read();
-		if(previous_state!=NULL) {
-			/* Split colon separated values */
-			previous_string = strdup((char *) previous_state->data);
-			while((ap = strsep(&previous_string, ":")) != NULL) {
-				if(verbose>2)
-					printf("Previous State for %d=%s\n", i, ap);
-				while (i >= previous_size) {
-					previous_size += OID_COUNT_STEP;
-					previous_value = realloc(previous_value, previous_size * sizeof(*previous_value));
-				}
-				previous_value[i++]=strtod(ap,NULL);
-			}
+		/* The values of the last run */
+		previous = np_state_read_series(numoids, 1);
+		if(verbose>2) {
+			for (i=0; i<numoids && previous->count; i++)
+				printf("Previous State for %d=%.0f\n", i, np_series_value(previous, 0, i));
 		}
 	}
 
@@ -522,20 +507,11 @@ main (int argc, char **argv)
 			response_value[i] *= multiplier;
 
 			if(calculate_rate) {
-				if (previous_state!=NULL) {
-					duration = current_time-previous_state->time;
-					if(duration<=0)
+				if (previous->count && i < previous->values) {
+					if(np_series_rate_to(previous, i, is_counter, current_time, response_value[i], &temp_double) != OK)
 						die(STATE_UNKNOWN,_("Time duration between plugin calls is invalid"));
-					temp_double = response_value[i]-previous_value[i];
-					/* Simple overflow catcher (same as in rrdtool, rrd_update.c) */
-					if(is_counter) {
-						if(temp_double<(double)0.0)
-							temp_double+=(double)4294967296.0; /* 2^32 */
-						if(temp_double<(double)0.0)
-							temp_double+=(double)18446744069414584320.0; /* 2^64-2^32 */;
-					}
-					/* Convert to per second, then use multiplier */
-					temp_double = temp_double/duration*rate_multiplier;
+					/* Per second, then use multiplier */
+					temp_double = temp_double*rate_multiplier;
 					iresult = get_status(temp_double, thlds[i]);
 					xasprintf (&show, conv, temp_double);
 				}
@@ -626,7 +602,7 @@ main (int argc, char **argv)
 			if (strpbrk(temp_string, " ='\"") == NULL) {
 
 				/* if it doesn't have any - we can just use it as the label */
-				strncat(perfstr, temp_string, sizeof(perfstr) - strlen(perfstr) - 1);
+				np_buf_puts(&perfstr, temp_string);
 
 			} else {
 
@@ -638,63 +614,54 @@ main (int argc, char **argv)
 					quote_string="\"";
 				}
 
-				strncat(perfstr, quote_string, sizeof(perfstr) - strlen(perfstr) - 1);
-				strncat(perfstr, temp_string, sizeof(perfstr) - strlen(perfstr) - 1);
-				strncat(perfstr, quote_string, sizeof(perfstr) - strlen(perfstr) - 1);
+				np_buf_puts(&perfstr, quote_string);
+				np_buf_puts(&perfstr, temp_string);
+				np_buf_puts(&perfstr, quote_string);
 			}
 
 			/* append the equal */
-			strncat(perfstr, "=", sizeof(perfstr) - strlen(perfstr) - 1);
-			len = sizeof(perfstr) - strlen(perfstr) - 1;
+			np_buf_puts(&perfstr, "=");
 
 			/* and then the data itself from the response */
-			strncat(perfstr, show, (len > ptr - show) ? ptr - show : len);
+			np_buf_append(&perfstr, show, ptr - show);
 
 			/* now append the unit of measurement */
 			if ((nunits > (size_t)0) 
 				&& ((size_t)i < nunits) 
 				&& (unitv[i] != NULL)) {
 
-					xasprintf(&temp_string, "%s", unitv[i]);
-					strncat(perfstr, temp_string, sizeof(perfstr) - strlen(perfstr) - 1);
+					np_buf_puts(&perfstr, unitv[i]);
 			}
 
 			/* and the type, if any */
 			if (type) {
-				strncat(perfstr, type, sizeof(perfstr) - strlen(perfstr) - 1);
+				np_buf_puts(&perfstr, type);
 			}
 
 			/* add warn/crit to perfdata */
 			if (thlds[i]->warning || thlds[i]->critical) {
 
-				strncat(perfstr, ";", sizeof(perfstr) - strlen(perfstr) - 1);
+				np_buf_puts(&perfstr, ";");
 
 				/* print the warning string if it exists */
-				if (thlds[i]->warning_string) {
-
-					xasprintf(&temp_string, "%s", thlds[i]->warning_string);
-					strncat(perfstr, temp_string, sizeof(perfstr) - strlen(perfstr) - 1);
-				}
-				strncat(perfstr, ";", sizeof(perfstr)-strlen(perfstr)-1);
+				if (thlds[i]->warning_string)
+					np_buf_puts(&perfstr, thlds[i]->warning_string);
+				np_buf_puts(&perfstr, ";");
 
 				/* print the critical string if it exists */
-				if (thlds[i]->critical_string) {
-
-					xasprintf(&temp_string, "%s", thlds[i]->critical_string);
-					strncat(perfstr, temp_string, sizeof(perfstr) - strlen(perfstr) - 1);
-				}
-				strncat(perfstr, ";", sizeof(perfstr) - strlen(perfstr) - 1);
+				if (thlds[i]->critical_string)
+					np_buf_puts(&perfstr, thlds[i]->critical_string);
+				np_buf_puts(&perfstr, ";");
 			}
 
 			/* remove trailing semi-colons for guideline adherence */
-			len = strlen(perfstr) - 1;
-			if (perfstr[len] == ';') {
-				perfstr[len] = '\0';
+			if (perfstr.data[perfstr.len - 1] == ';') {
+				perfstr.data[--perfstr.len] = '\0';
 			}
 
 			/* we do not add any min/max value */
 
-			strncat(perfstr, " ", sizeof(perfstr) - strlen(perfstr) - 1);
+			np_buf_puts(&perfstr, " ");
 		}
 
 	} /* for (line=0, i=0; line < chld_out.lines; line++, i++) */
@@ -703,42 +670,29 @@ main (int argc, char **argv)
 
 	/* Save state data, as all data collected now */
 	if(calculate_rate) {
-		string_length=1024;
-		state_string=malloc(string_length);
-		if(state_string==NULL)
-			die(STATE_UNKNOWN, _("Cannot malloc"));
-
-		current_length=0;
-		for(i=0; i<total_oids; i++) {
-			xasprintf(&temp_string,"%.0f",response_value[i]);
-			if(temp_string==NULL)
-				die(STATE_UNKNOWN,_("Cannot asprintf()"));
-			response_length = strlen(temp_string);
-			if(current_length+response_length>string_length) {
-				string_length=current_length+1024;
-				state_string=realloc(state_string,string_length);
-				if(state_string==NULL)
-					die(STATE_UNKNOWN, _("Cannot realloc()"));
-			}
-			strcpy(&state_string[current_length],temp_string);
-			current_length=current_length+response_length;
-			state_string[current_length]=':';
-			current_length++;
-			free(temp_string);
+		/* One value per OID, those without a response as 0 */
+		while (numoids > response_size) {
+			response_size += OID_COUNT_STEP;
+			response_value = realloc(response_value, response_size * sizeof(*response_value));
+		}
+		for(i=total_oids; i<numoids; i++)
+			response_value[i]=0.0;
+		if (verbose > 2) {
+			for(i=0; i<numoids; i++)
+				printf("State for %d=%.0f\n", i, response_value[i]);
 		}
-		state_string[--current_length]='\0';
-		if (verbose > 2)
-			printf("State string=%s\n",state_string);
 
 		/* This is not strictly the same as time now, but any subtle variations will cancel out */
-		np_state_write_string(current_time, state_string );
-		if(previous_state==NULL) {
+		i = previous->count;
+		np_series_add(previous, current_time, response_value);
+		np_state_write_series(previous);
+		if(i==0) {
 			/* Or should this be highest state? */
 			die( STATE_OK, _("No previous data to calculate rate - assume okay" ) );
 		}
 	}
 	
-	printf ("%s %s -%s %s\n", label, state_text (result), outbuff, perfstr);
+	printf ("%s %s -%s | %s\n", label, state_text (result), outbuff, np_buf_str (&perfstr));
 	if (mult_resp) printf ("%s", mult_resp);
 
 	return result;
@@ -1015,7 +969,7 @@ process_arguments (int argc, char **argv)
 			break;
 		case L_CALCULATE_RATE:
 			if(calculate_rate==0)
-				np_enable_state(NULL, 1);
+				np_enable_state(NULL, 2);
 			calculate_rate = 1;
 			break;
 		case L_RATE_MULTIPLIER:
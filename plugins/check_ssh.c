@@ -48,6 +48,7 @@ char *server_name = NULL;
 char *remote_version = NULL;
 char *remote_protocol = NULL;
 int verbose = FALSE;
+int extended_perfdata = FALSE;
 
 int process_arguments (int, char **);
 int validate_arguments (void);
@@ -94,6 +95,10 @@ process_arguments (int argc, char **argv)
 {
 	int c;
 
+	enum {
+		EXTENDED_PERFDATA_OPTION = CHAR_MAX + 1
+	};
+
 	int option = 0;
 	static struct option longopts[] = {
 		{"help", no_argument, 0, 'h'},
@@ -107,6 +112,7 @@ process_arguments (int argc, char **argv)
 		{"verbose", no_argument, 0, 'v'},
 		{"remote-version", required_argument, 0, 'r'},
 		{"remote-protocol", required_argument, 0, 'P'},
+		{"extended-perfdata", no_argument, 0, EXTENDED_PERFDATA_OPTION},
 		{0, 0, 0, 0}
 	};
 
@@ -154,6 +160,9 @@ process_arguments (int argc, char **argv)
 		case 'P':									/* remote version */
 			remote_protocol = optarg;
 			break;
+		case EXTENDED_PERFDATA_OPTION:
+			extended_perfdata = TRUE;
+			break;
 		case 'H':									/* host */
 			if (is_host (optarg) == FALSE)
 				usage2 (_("Invalid hostname/address"), optarg);
@@ -229,7 +238,7 @@ ssh_connect (char *haddr, int hport, char *remote_version, char *remote_protocol
 
 	output = (char *) malloc (BUFF_SZ + 1);
 	memset (output, 0, BUFF_SZ + 1);
-	recv (sd, output, BUFF_SZ, 0);
+	np_net_timing_recv (recv (sd, output, BUFF_SZ, 0));
 	if (strncmp (output, "SSH", 3)) {
 		printf (_("Server answer: %s"), output);
 		close(sd);
@@ -267,9 +276,11 @@ ssh_connect (char *haddr, int hport, char *remote_version, char *remote_protocol
 		elapsed_time = (double)deltime(tv) / 1.0e6;
 
 		printf
-			(_("SSH OK - %s (protocol %s) | %s\n"),
+			(_("SSH OK - %s (protocol %s) | %s%s%s\n"),
 			 ssh_server, ssh_proto, fperfdata("time", elapsed_time, "s",
-			 FALSE, 0, FALSE, 0, TRUE, 0, TRUE, (int)timeout_interval));
+			 FALSE, 0, FALSE, 0, TRUE, 0, TRUE, (int)timeout_interval),
+			 extended_perfdata ? " " : "",
+			 extended_perfdata ? np_net_timing_perfdata () : "");
 		close(sd);
 		exit (STATE_OK);
 	}
@@ -309,6 +320,8 @@ print_help (void)
 	printf (" %s\n", "-P, --remote-protocol=STRING");
   printf ("    %s\n", _("Alert if protocol doesn't match expected protocol version (ex: 2.0)"));
 
+	printf (UT_EXTENDED_PERFDATA);
+
 	printf (UT_VERBOSE);
 
 	printf (UT_SUPPORT);
@@ -320,6 +333,7 @@ void
 print_usage (void)
 {
   printf ("%s\n", _("Usage:"));
-	printf ("%s  [-4|-6] [-t <timeout>] [-r <remote version>] [-p <port>] <host>\n", progname);
+	printf ("%s  [-4|-6] [-t <timeout>] [-r <remote version>] [-p <port>]\n", progname);
+	printf ("[--extended-perfdata] <host>\n");
 }
 
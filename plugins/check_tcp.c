@@ -38,10 +38,14 @@ const char *email = "devel@nagios-plugins.org";
 #include "utils_tcp.h"
 
 #include <ctype.h>
+#include <fcntl.h>
 #include <sys/select.h>
 
 #ifdef HAVE_SSL
 static int check_cert = FALSE;
+static int check_chain = FALSE;
+static int show_ssl_info = FALSE;
+static char *ssl_info = NULL;
 static int days_till_exp_warn, days_till_exp_crit;
 # define my_recv(buf, len) ((flags & FLAG_SSL) ? np_net_ssl_read(buf, len) : read(sd, buf, len))
 # define my_send(buf, len) ((flags & FLAG_SSL) ? np_net_ssl_write(buf, len) : send(sd, buf, len, 0))
@@ -52,6 +56,9 @@ static int days_till_exp_warn, days_till_exp_crit;
 
 /* int my_recv(char *, size_t); */
 static int process_arguments (int, char **);
+static void add_target (const char *);
+static void add_target_file (const char *);
+static int run_targets (void);
 void print_help (void);
 void print_usage (void);
 
@@ -92,8 +99,50 @@ static int match_flags = NP_MATCH_EXACT;
 #define FLAG_TIME_WARN 0x04
 #define FLAG_TIME_CRIT 0x08
 #define FLAG_HIDE_OUTPUT 0x10
+#define FLAG_EXTENDED_PERFDATA 0x20
 static size_t flags;
 
+/* --target batch mode: many host:port probes driven from one poll() loop */
+#define DEFAULT_CONCURRENCY 64
+enum {
+	TARGET_PENDING,
+	TARGET_CONNECTING,
+	TARGET_SENDING,
+	TARGET_READING,
+	TARGET_DONE
+};
+
+typedef struct tcp_target {
+	char *host;
+	int port;
+	char *send;
+	char **expect;
+	size_t expect_count;
+	int match_flags;
+	np_expect_matcher *matcher;
+	int phase;
+	int sd;
+	/* the addresses of host, raced like np_net_connect() does */
+	struct addrinfo *res;
+	struct addrinfo **addrs;
+	int naddrs;
+	int started;	/* addresses connected to so far */
+	int *fds;	/* their sockets, -1 once failed */
+	int pending;	/* connects in flight */
+	long next_attempt;	/* milliseconds after start */
+	int last_error;
+	int gai_error;	/* of getaddrinfo(), res is NULL then */
+	size_t sent;	/* bytes of send written */
+	struct timeval start;
+	long deadline;	/* milliseconds after start */
+	char *status;
+	size_t len;
+} tcp_target;
+
+static tcp_target *targets = NULL;
+static size_t target_count = 0;
+static int concurrency = DEFAULT_CONCURRENCY;
+
 int
 main (int argc, char **argv)
 {
@@ -104,6 +153,8 @@ main (int argc, char **argv)
 	struct timeval timeout;
 	size_t len;
 	int match = -1;
+	np_expect_matcher *matcher;
+	size_t status_size = 0;
 	fd_set rfds;
 
 	FD_ZERO(&rfds);
@@ -230,6 +281,12 @@ main (int argc, char **argv)
 		usage(_("With UDP checks, a send/expect string must be specified."));
 	}
 
+	if (target_count > 0) {
+		if (PROTOCOL != IPPROTO_TCP || (flags & FLAG_SSL))
+			usage4 (_("Targets can only be checked with plain TCP"));
+		return run_targets ();
+	}
+
 	/* set up the timer */
 	signal (SIGALRM, socket_timeout_alarm_handler);
 	alarm (timeout_interval);
@@ -243,8 +300,13 @@ main (int argc, char **argv)
 #ifdef HAVE_SSL
 	if (flags & FLAG_SSL){
 		result = np_net_ssl_init_with_hostname(sd, server_name);
+		if (result == STATE_OK && show_ssl_info == TRUE)
+			ssl_info = np_net_ssl_info();
 		if (result == STATE_OK && check_cert == TRUE) {
-			result = np_net_ssl_check_cert(days_till_exp_warn, days_till_exp_crit);
+			if (check_chain == TRUE)
+				result = np_net_ssl_check_chain(days_till_exp_warn, days_till_exp_crit);
+			else
+				result = np_net_ssl_check_cert(days_till_exp_warn, days_till_exp_crit);
 		}
 	}
 	if(result != STATE_OK){
@@ -279,9 +341,18 @@ main (int argc, char **argv)
 	len = 0;
 	if (server_expect_count) {
 
+		matcher = np_expect_matcher_new(server_expect, server_expect_count, match_flags);
+		if (matcher == NULL)
+			die (STATE_UNKNOWN, _("Could not allocate memory for expect strings\n"));
+
 		/* watch for the expect string */
 		while ((i = my_recv(buffer, sizeof(buffer))) > 0) {
-			status = realloc(status, len + i + 1);
+			np_net_timing_recv(i);
+			if (len + i + 1 > status_size) {
+				status_size = (len + i + 1) * 2;
+				if ((status = realloc(status, status_size)) == NULL)
+					die (STATE_UNKNOWN, _("Could not allocate memory for response\n"));
+			}
 			memcpy(&status[len], buffer, i);
 			len += i;
 			status[len] = '\0';
@@ -290,10 +361,8 @@ main (int argc, char **argv)
 			if (maxbytes && len >= maxbytes)
 				break;
 
-			if ((match = np_expect_match(status,
-			    server_expect,
-			    server_expect_count,
-			    match_flags)) != NP_MATCH_RETRY)
+			/* only the new bytes are scanned, the matcher keeps its state */
+			if ((match = np_expect_matcher_feed(matcher, buffer, i)) != NP_MATCH_RETRY)
 				break;
 
 			/* some protocols wait for further input, so make sure we don't wait forever */
@@ -303,6 +372,7 @@ main (int argc, char **argv)
 			if(select(sd + 1, &rfds, NULL, NULL, &timeout) <= 0)
 				break;
 		}
+		np_expect_matcher_free(matcher);
 		if (match == NP_MATCH_RETRY)
 			match = NP_MATCH_FAILURE;
 
@@ -368,6 +438,11 @@ main (int argc, char **argv)
 	if (match != NP_MATCH_FAILURE && !(flags & FLAG_HIDE_OUTPUT) && len)
 		printf (" [%s]", status);
 
+#ifdef HAVE_SSL
+	if (ssl_info != NULL)
+		printf (" (%s)", ssl_info);
+#endif
+
 	/* perf-data doesn't apply when server doesn't talk properly,
 	 * so print all zeroes on warn and crit. Use fperfdata since
 	 * localisation settings can make different outputs */
@@ -388,6 +463,9 @@ main (int argc, char **argv)
 				TRUE, timeout_interval)
 			);
 
+	if (flags & FLAG_EXTENDED_PERFDATA)
+		printf (" %s", np_net_timing_perfdata ());
+
 	putchar('\n');
 	return result;
 }
@@ -400,8 +478,19 @@ process_arguments (int argc, char **argv)
 {
 	int c;
 	int escape = 0;
+	size_t i;
 	char *temp;
 
+	enum {
+		EXTENDED_PERFDATA_OPTION = CHAR_MAX + 1,
+		TARGET_OPTION,
+		TARGET_FILE_OPTION,
+		CONCURRENCY_OPTION,
+		CHECK_CHAIN_OPTION,
+		ALPN_OPTION,
+		SSL_INFO_OPTION
+	};
+
 	int option = 0;
 	static struct option longopts[] = {
 		{"hostname", required_argument, 0, 'H'},
@@ -430,6 +519,13 @@ process_arguments (int argc, char **argv)
 		{"ssl", no_argument, 0, 'S'},
 		{"certificate", required_argument, 0, 'D'},
 		{"sni", required_argument, 0, 'N'},
+		{"extended-perfdata", no_argument, 0, EXTENDED_PERFDATA_OPTION},
+		{"target", required_argument, 0, TARGET_OPTION},
+		{"target-file", required_argument, 0, TARGET_FILE_OPTION},
+		{"concurrency", required_argument, 0, CONCURRENCY_OPTION},
+		{"check-chain", no_argument, 0, CHECK_CHAIN_OPTION},
+		{"alpn", required_argument, 0, ALPN_OPTION},
+		{"ssl-info", no_argument, 0, SSL_INFO_OPTION},
 		{0, 0, 0, 0}
 	};
 
@@ -608,6 +704,39 @@ process_arguments (int argc, char **argv)
 		case 'N':                 /* Server Name Indication */
 			server_name = optarg;
 			break;
+		case EXTENDED_PERFDATA_OPTION:
+			flags |= FLAG_EXTENDED_PERFDATA;
+			break;
+		case TARGET_OPTION:
+			add_target (optarg);
+			break;
+		case TARGET_FILE_OPTION:
+			add_target_file (optarg);
+			break;
+		case CONCURRENCY_OPTION:
+			if (!is_intpos (optarg))
+				usage4 (_("Concurrency must be a positive integer"));
+			concurrency = atoi (optarg);
+			break;
+#ifdef HAVE_SSL
+		case CHECK_CHAIN_OPTION:
+			check_chain = TRUE;
+			break;
+		case ALPN_OPTION:
+			ssl_alpn = optarg;
+			flags |= FLAG_SSL;
+			break;
+		case SSL_INFO_OPTION:
+			show_ssl_info = TRUE;
+			ssl_verify_chain = TRUE;
+			flags |= FLAG_SSL;
+			break;
+#else
+		case CHECK_CHAIN_OPTION:
+		case ALPN_OPTION:
+		case SSL_INFO_OPTION:
+			die (STATE_UNKNOWN, _("Invalid option - SSL is not available"));
+#endif
 		}
 	}
 
@@ -615,6 +744,15 @@ process_arguments (int argc, char **argv)
 	if(host_specified == FALSE && c < argc)
 		server_address = strdup (argv[c++]);
 
+	if (target_count > 0) {
+		/* -E applies to the send strings of all targets, wherever it is */
+		for (i = 0; escape && i < target_count; i++) {
+			if (targets[i].send)
+				targets[i].send = np_escaped_string (targets[i].send);
+		}
+		return TRUE;
+	}
+
 	if (server_address == NULL)
 		usage4 (_("You must provide a server address"));
 	else if (server_address[0] != '/' && is_host (server_address) == FALSE)
@@ -624,6 +762,430 @@ process_arguments (int argc, char **argv)
 }
 
 
+/* parses HOST:PORT[:SEND[:EXPECT]]; IPv6 addresses go in brackets.  A
+ * target without its own send or expect string uses -s and -e. */
+static void
+add_target (const char *spec)
+{
+	tcp_target *t;
+	char *copy, *host, *port, *send = NULL, *expect = NULL, *p;
+
+	copy = strdup (spec);
+	host = copy;
+	if (*host == '[') {
+		host++;
+		if ((p = strchr (host, ']')) == NULL || p[1] != ':')
+			usage2 (_("Invalid target"), spec);
+		*p = '\0';
+		port = p + 2;
+	} else {
+		if ((p = strchr (host, ':')) == NULL)
+			usage2 (_("Invalid target"), spec);
+		*p = '\0';
+		port = p + 1;
+	}
+	if ((p = strchr (port, ':')) != NULL) {
+		*p = '\0';
+		send = p + 1;
+		if ((p = strchr (send, ':')) != NULL) {
+			*p = '\0';
+			expect = p + 1;
+		}
+	}
+	if (*host == '\0' || !is_intpos (port) || atoi (port) > 65535)
+		usage2 (_("Invalid target"), spec);
+
+	targets = realloc (targets, (target_count + 1) * sizeof (tcp_target));
+	if (targets == NULL)
+		die (STATE_UNKNOWN, _("Could not allocate memory for targets\n"));
+	t = &targets[target_count++];
+	memset (t, 0, sizeof (*t));
+	t->host = host;
+	t->port = atoi (port);
+	t->sd = -1;
+	if (send && *send)
+		t->send = send;
+	if (expect && *expect) {
+		t->expect = malloc (sizeof (char *));
+		t->expect[0] = expect;
+		t->expect_count = 1;
+	}
+}
+
+/* one target per line, blank lines and lines starting with '#' are skipped */
+static void
+add_target_file (const char *filename)
+{
+	FILE *fp;
+	char line[MAX_INPUT_BUFFER];
+	size_t len;
+
+	if (strcmp (filename, "-") == 0)
+		fp = stdin;
+	else if ((fp = fopen (filename, "r")) == NULL)
+		die (STATE_UNKNOWN, _("Cannot open target file %s: %s\n"), filename, strerror (errno));
+
+	while (fgets (line, sizeof (line), fp) != NULL) {
+		len = strlen (line);
+		while (len > 0 && isspace (line[len - 1]))
+			line[--len] = '\0';
+		if (len == 0 || line[0] == '#')
+			continue;
+		add_target (line);
+	}
+	if (fp != stdin)
+		fclose (fp);
+}
+
+/* starts a non-blocking connect to the next address of a target; FALSE
+ * if none is left */
+static int
+target_attempt (tcp_target *t)
+{
+	struct addrinfo *ai;
+	int fd, flags_fd;
+
+	while (t->started < t->naddrs) {
+		ai = t->addrs[t->started];
+		t->fds[t->started++] = -1;
+		if ((fd = socket (ai->ai_family, SOCK_STREAM, ai->ai_protocol)) < 0) {
+			t->last_error = errno;
+			continue;
+		}
+		flags_fd = fcntl (fd, F_GETFL, 0);
+		fcntl (fd, F_SETFL, flags_fd | O_NONBLOCK);
+		if (connect (fd, ai->ai_addr, ai->ai_addrlen) < 0 && errno != EINPROGRESS) {
+			t->last_error = errno;
+			close (fd);
+			continue;
+		}
+		t->fds[t->started - 1] = fd;
+		t->pending++;
+		t->next_attempt = deltime (t->start) / 1000 + NP_CONNECT_ATTEMPT_DELAY;
+		return TRUE;
+	}
+	return FALSE;
+}
+
+/* closes the connects of a target still in flight */
+static void
+target_close_attempts (tcp_target *t)
+{
+	int i;
+
+	for (i = 0; i < t->started; i++) {
+		if (t->fds[i] >= 0)
+			close (t->fds[i]);
+		t->fds[i] = -1;
+	}
+	t->pending = 0;
+}
+
+/* prints one result line for a finished target and returns its state */
+static int
+target_finish (tcp_target *t, int result, const char *error, int match)
+{
+	double elapsed = (double)deltime (t->start) / 1.0e6;
+
+	if (t->sd >= 0) {
+		if (error == NULL && server_quit != NULL)
+			send (t->sd, server_quit, strlen (server_quit), 0);
+		close (t->sd);
+		t->sd = -1;
+	}
+	if (t->fds) {
+		target_close_attempts (t);
+		free (t->fds);
+		t->fds = NULL;
+	}
+	free (t->addrs);
+	t->addrs = NULL;
+	if (t->res)
+		freeaddrinfo (t->res);
+	t->res = NULL;
+	t->phase = TARGET_DONE;
+
+	if (error == NULL) {
+		if (flags & FLAG_TIME_CRIT && elapsed > critical_time)
+			result = STATE_CRITICAL;
+		else if (flags & FLAG_TIME_WARN && elapsed > warning_time)
+			result = STATE_WARNING;
+		if (match == NP_MATCH_FAILURE && result != STATE_CRITICAL)
+			result = expect_mismatch_state;
+	}
+
+	while (t->len > 0 && isspace (t->status[t->len - 1]))
+		t->status[--t->len] = '\0';
+
+	printf ("%s %s - %s port %d: ", SERVICE, state_text (result), t->host, t->port);
+	if (error != NULL)
+		printf ("%s", error);
+	else if (match == NP_MATCH_FAILURE)
+		printf ("%s", _("Unexpected response from host"));
+	else
+		printf (_("%.3f second response time"), elapsed);
+	if (t->len && !(flags & FLAG_HIDE_OUTPUT))
+		printf (" [%s]", t->status);
+	printf ("|%s\n", fperfdata ("time", elapsed, "s",
+	        (flags & FLAG_TIME_WARN ? TRUE : FALSE), warning_time,
+	        (flags & FLAG_TIME_CRIT ? TRUE : FALSE), critical_time,
+	        TRUE, 0, TRUE, timeout_interval));
+	fflush (stdout);
+
+	free (t->status);
+	t->status = NULL;
+	np_expect_matcher_free (t->matcher);
+	t->matcher = NULL;
+	return result;
+}
+
+/* writes what is left of the send string of a connected target, and then
+ * finishes it or starts reading; returns its state if it is done, -1
+ * otherwise */
+static int
+target_send (tcp_target *t)
+{
+	size_t len = t->send ? strlen (t->send) : 0;
+	ssize_t n;
+
+	while (t->sent < len) {
+		n = send (t->sd, t->send + t->sent, len - t->sent, 0);
+		if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+			t->phase = TARGET_SENDING;
+			return -1;
+		}
+		if (n <= 0)
+			return target_finish (t, STATE_UNKNOWN, _("No data sent to host"), -1);
+		t->sent += n;
+	}
+	if (t->expect_count == 0)
+		return target_finish (t, STATE_OK, NULL, -1);
+	t->matcher = np_expect_matcher_new (t->expect, t->expect_count, t->match_flags);
+	if (t->matcher == NULL)
+		die (STATE_UNKNOWN, _("Could not allocate memory for expect strings\n"));
+	t->phase = TARGET_READING;
+	return -1;
+}
+
+/* resolves a target, before any connection is in flight, so that a slow
+ * name server does not use up the time of the others */
+static void
+target_resolve (tcp_target *t)
+{
+	struct addrinfo hints;
+	char port_str[6];
+
+	memset (&hints, 0, sizeof (hints));
+	hints.ai_family = address_family;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+	snprintf (port_str, sizeof (port_str), "%d", t->port);
+	if ((t->gai_error = getaddrinfo (t->host, port_str, &hints, &t->res)) != 0)
+		t->res = NULL;
+}
+
+/* starts connecting to the first address of a resolved target; returns its
+ * state if it is done already, -1 otherwise */
+static int
+target_connect (tcp_target *t)
+{
+	if (t->res == NULL)
+		return target_finish (t, STATE_CRITICAL, gai_strerror (t->gai_error), -1);
+
+	t->addrs = np_net_interleave_addrinfo (t->res, &t->naddrs);
+	if ((t->fds = malloc (t->naddrs * sizeof (int))) == NULL)
+		die (STATE_UNKNOWN, _("Could not allocate memory for targets\n"));
+	t->last_error = ETIMEDOUT;
+	t->phase = TARGET_CONNECTING;
+	if (!target_attempt (t))
+		return target_finish (t, t->last_error == ECONNREFUSED ? econn_refuse_state : STATE_CRITICAL,
+		                      strerror (t->last_error), -1);
+	return -1;
+}
+
+/* checks all --target entries with at most `concurrency' connections in
+ * flight, each bounded by timeout_interval, and prints one line per target
+ * as it completes followed by a summary line */
+static int
+run_targets (void)
+{
+	struct pollfd *pfds = NULL;
+	tcp_target **active, *t;
+	size_t next = 0, done = 0, i, k, nactive = 0, npfds, pfds_size = 0, *first;
+	int result = STATE_OK, state, so_error, match, ready, wait, j;
+	int counts[STATE_DEPENDENT + 1] = { 0 };
+	socklen_t optlen;
+	ssize_t n;
+	long left;
+
+	if (concurrency > (int)target_count)
+		concurrency = target_count;
+	active = calloc (concurrency, sizeof (tcp_target *));
+	first = calloc (concurrency + 1, sizeof (size_t));
+	if (active == NULL || first == NULL)
+		die (STATE_UNKNOWN, _("Could not allocate memory for targets\n"));
+
+	for (i = 0; i < target_count; i++)
+		target_resolve (&targets[i]);
+
+	while (done < target_count) {
+		/* fill free slots */
+		while (nactive < (size_t)concurrency && next < target_count) {
+			t = &targets[next++];
+			gettimeofday (&t->start, NULL);
+			t->deadline = timeout_interval * 1000L;
+			if (t->send == NULL)
+				t->send = server_send;
+			if (t->expect_count == 0) {
+				t->expect = server_expect;
+				t->expect_count = server_expect_count;
+				t->match_flags = match_flags;
+			}
+			else	/* like -e, a target's own expect string may match anywhere */
+				t->match_flags = match_flags & ~NP_MATCH_EXACT;
+			if ((state = target_connect (t)) >= 0) {
+				counts[state]++;
+				result = max_state_alt (result, state);
+				done++;
+				continue;
+			}
+			active[nactive++] = t;
+		}
+		if (nactive == 0)
+			continue;
+
+		/* the connects of a target in flight, or the socket it reads,
+		 * are pfds[first[i]] up to pfds[first[i + 1]] */
+		wait = -1;
+		for (i = 0, npfds = 0; i < nactive; i++) {
+			t = active[i];
+			if (npfds + t->naddrs > pfds_size) {
+				pfds_size = 2 * (npfds + t->naddrs);
+				if ((pfds = realloc (pfds, pfds_size * sizeof (struct pollfd))) == NULL)
+					die (STATE_UNKNOWN, _("Could not allocate memory for targets\n"));
+			}
+			first[i] = npfds;
+			if (t->phase == TARGET_CONNECTING) {
+				for (j = 0; j < t->started; j++) {
+					if (t->fds[j] < 0)
+						continue;
+					pfds[npfds].fd = t->fds[j];
+					pfds[npfds].events = POLLOUT;
+					pfds[npfds++].revents = 0;
+				}
+			} else {
+				pfds[npfds].fd = t->sd;
+				pfds[npfds].events = t->phase == TARGET_SENDING ? POLLOUT : POLLIN;
+				pfds[npfds++].revents = 0;
+			}
+			left = t->deadline - deltime (t->start) / 1000;
+			if (t->phase == TARGET_CONNECTING && t->started < t->naddrs &&
+			    t->next_attempt - deltime (t->start) / 1000 < left)
+				left = t->next_attempt - deltime (t->start) / 1000;
+			if (left < 0)
+				left = 0;
+			if (wait < 0 || left < wait)
+				wait = left;
+		}
+		first[nactive] = npfds;
+
+		ready = poll (pfds, npfds, wait);
+		if (ready < 0 && errno != EINTR)
+			die (STATE_UNKNOWN, "poll: %s\n", strerror (errno));
+
+		for (i = 0; i < nactive; i++) {
+			t = active[i];
+			state = -1;
+
+			if (t->phase == TARGET_CONNECTING) {
+				/* the first address to connect wins, as in np_net_connect() */
+				for (k = first[i]; k < first[i + 1] && t->sd < 0; k++) {
+					if (pfds[k].revents == 0)
+						continue;
+					for (j = 0; t->fds[j] != pfds[k].fd; j++)
+						;
+					so_error = 0;
+					optlen = sizeof (so_error);
+					if (getsockopt (t->fds[j], SOL_SOCKET, SO_ERROR, &so_error, &optlen) < 0)
+						so_error = errno;
+					if (so_error == 0) {
+						t->sd = t->fds[j];
+						t->fds[j] = -1;
+						target_close_attempts (t);
+					} else {
+						t->last_error = so_error;
+						close (t->fds[j]);
+						t->fds[j] = -1;
+						t->pending--;
+					}
+				}
+				if (t->sd < 0) {
+					if ((t->pending == 0 || deltime (t->start) / 1000 >= t->next_attempt) &&
+					    !target_attempt (t) && t->pending == 0)
+						state = target_finish (t, t->last_error == ECONNREFUSED ? econn_refuse_state : STATE_CRITICAL,
+						                       strerror (t->last_error), -1);
+				}
+				else
+					state = target_send (t);
+			}
+			else if (pfds[first[i]].revents && t->phase == TARGET_SENDING)
+				state = target_send (t);
+			else if (pfds[first[i]].revents && t->phase == TARGET_READING) {
+				n = read (t->sd, buffer, sizeof (buffer));
+				if (n > 0) {
+					t->status = realloc (t->status, t->len + n + 1);
+					memcpy (&t->status[t->len], buffer, n);
+					t->len += n;
+					t->status[t->len] = '\0';
+					match = np_expect_matcher_feed (t->matcher, buffer, n);
+					if (match != NP_MATCH_RETRY)
+						state = target_finish (t, STATE_OK, NULL, match);
+					else if (maxbytes && t->len >= maxbytes)
+						state = target_finish (t, STATE_OK, NULL, NP_MATCH_FAILURE);
+				}
+				else if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+					if (t->len == 0)
+						state = target_finish (t, STATE_CRITICAL, _("No data received from host"), -1);
+					else
+						state = target_finish (t, STATE_OK, NULL, NP_MATCH_FAILURE);
+				}
+			}
+
+			if (state < 0 && deltime (t->start) / 1000 >= t->deadline) {
+				if (t->phase == TARGET_READING && t->len > 0)
+					state = target_finish (t, STATE_OK, NULL, NP_MATCH_FAILURE);
+				else
+					state = target_finish (t, timeout_state, _("Socket timeout"), -1);
+			}
+
+			if (state >= 0) {
+				counts[state]++;
+				result = max_state_alt (result, state);
+				done++;
+			}
+		}
+
+		/* compact the active list */
+		for (i = 0; i < nactive; ) {
+			if (active[i]->phase == TARGET_DONE)
+				active[i] = active[--nactive];
+			else
+				i++;
+		}
+	}
+
+	printf (_("%s %s - %lu targets: %d ok, %d warning, %d critical, %d unknown\n"),
+	        SERVICE, state_text (result), (unsigned long)target_count,
+	        counts[STATE_OK], counts[STATE_WARNING], counts[STATE_CRITICAL],
+	        counts[STATE_UNKNOWN]);
+
+	free (pfds);
+	free (active);
+	free (first);
+	return result;
+}
+
+
 void
 print_help (void)
 {
@@ -672,14 +1234,36 @@ print_help (void)
   printf ("    %s\n", _("1st is #days for warning, 2nd is critical (if not specified - 0)."));
   printf (" %s\n", "-S, --ssl");
   printf ("    %s\n", _("Use SSL for the connection."));
+  printf (" %s\n", "--check-chain");
+  printf ("    %s\n", _("Apply -D to every certificate the server sends, not only its own"));
+  printf (" %s\n", "--alpn=PROTOCOLS");
+  printf ("    %s\n", _("Comma separated ALPN protocols to offer (implies -S)"));
+  printf (" %s\n", "--ssl-info");
+  printf ("    %s\n", _("Show protocol, cipher, ALPN, chain verification and stapled OCSP"));
+  printf ("    %s\n", _("status of the connection (implies -S)"));
 #endif
 
 	printf (UT_WARN_CRIT);
 
 	printf (UT_CONN_TIMEOUT, DEFAULT_SOCKET_TIMEOUT);
 
+	printf (UT_EXTENDED_PERFDATA);
+
+	printf (" %s\n", "--target=HOST:PORT[:SEND[:EXPECT]]");
+  printf ("    %s\n", _("Check this target instead of -H/-p (may be repeated). Targets without"));
+  printf ("    %s\n", _("their own send or expect string use -s and -e"));
+  printf (" %s\n", "--target-file=FILE");
+  printf ("    %s\n", _("Read targets from FILE, one per line (\"-\" for stdin)"));
+  printf (" %s\n", "--concurrency=INTEGER");
+  printf ("    %s %d)\n", _("Number of targets checked at the same time (default:"), DEFAULT_CONCURRENCY);
+
 	printf (UT_VERBOSE);
 
+	printf ("\n");
+	printf ("%s\n", _("With --target, one line is printed per target as soon as it completes,"));
+	printf ("%s\n", _("followed by a summary line; the exit code is the worst target state."));
+	printf ("%s\n", _("-t applies to each target separately."));
+
 	printf (UT_SUPPORT);
 }
 
@@ -692,5 +1276,7 @@ print_usage (void)
   printf ("[-e <expect string>] [-q <quit string>][-m <maximum bytes>] [-d <delay>]\n");
   printf ("[-t <timeout seconds>] [-r <refuse state>] [-M <mismatch state>] [-v] [-4|-6] [-j]\n");
   printf ("[-D <warn days cert expire>[,<crit days cert expire>]] [-S <use SSL>] [-E]\n");
-  printf ("[-N <server name indication>]\n");
+  printf ("[-N <server name indication>] [--check-chain] [--alpn=<protocols>] [--ssl-info]\n");
+  printf ("[--extended-perfdata]\n");
+  printf ("[--target=<host:port[:send:expect]> ...] [--target-file=<file>] [--concurrency=<n>]\n");
 }
@@ -44,12 +44,39 @@ const char *email = "devel@nagios-plugins.org";
 # define ERROR -1
 #elif HAVE_UTMPX_H
 # include <utmpx.h>
+# include <fcntl.h>
+# include <sys/stat.h>
 #else
 # include "popen.h"
 #endif
 
 #define possibly_set(a,b) ((a) == 0 ? (b) : 0)
 
+/* what the thresholds are for */
+enum {
+	MODE_SESSIONS,
+	MODE_USERS,
+	MODE_PER_USER,
+	MODE_LOGINS
+};
+
+#if HAVE_UTMPX_H && !HAVE_WTSAPI32_H
+# ifndef WTMPX_FILE
+#  define WTMPX_FILE "/var/log/wtmp"
+# endif
+
+/* wtmp records read at a time, from the end of the file back */
+# define WTMP_BLOCK 128
+
+typedef struct session {
+	char user[sizeof (((struct utmpx *) 0)->ut_user) + 1];
+	char line[sizeof (((struct utmpx *) 0)->ut_line) + 1];
+} session;
+
+int read_sessions (session **);
+int count_logins (const char *, time_t);
+#endif
+
 int process_arguments (int, char **);
 void print_help (void);
 void print_usage (void);
@@ -57,6 +84,11 @@ void print_usage (void);
 char *warning_range = NULL;
 char *critical_range = NULL;
 thresholds *thlds = NULL;
+int verbose = 0;
+int mode = MODE_SESSIONS;
+int window_minutes = 60;
+char *utmp_file = NULL;
+char *wtmp_file = NULL;
 
 int
 main (int argc, char **argv)
@@ -68,7 +100,10 @@ main (int argc, char **argv)
 	DWORD wtscount;
 	DWORD index;
 #elif HAVE_UTMPX_H
-	struct utmpx *putmpx;
+	session *sessions = NULL;
+	char *line = NULL;
+	int distinct = 0, most = 0, i, j, k;
+	const char *busiest = "";
 #else
 	char input_buffer[MAX_INPUT_BUFFER];
 #endif
@@ -85,6 +120,11 @@ main (int argc, char **argv)
 
 	users = 0;
 
+#if !HAVE_UTMPX_H || HAVE_WTSAPI32_H
+	if (mode != MODE_SESSIONS)
+		die (STATE_UNKNOWN, "%s\n", _("Only sessions can be counted without utmpx"));
+#endif
+
 #if HAVE_WTSAPI32_H
 	if (!WTSEnumerateSessions(WTS_CURRENT_SERVER_HANDLE,
 	  0, 1, &wtsinfo, &wtscount)) {
@@ -115,14 +155,36 @@ main (int argc, char **argv)
 
 	WTSFreeMemory(wtsinfo);
 #elif HAVE_UTMPX_H
-	/* get currently logged users from utmpx */
-	setutxent ();
-
-	while ((putmpx = getutxent ()) != NULL)
-		if (putmpx->ut_type == USER_PROCESS)
-			users++;
-
-	endutxent ();
+	if (mode == MODE_LOGINS) {
+		/* count the logins of the window in wtmp */
+		users = count_logins (wtmp_file ? wtmp_file : WTMPX_FILE,
+		                      time (NULL) - window_minutes * 60);
+		if (users < 0)
+			die (STATE_UNKNOWN, _("Could not read %s: %s\n"),
+			     wtmp_file ? wtmp_file : WTMPX_FILE, strerror (errno));
+	} else {
+		/* get currently logged users from utmpx */
+		users = read_sessions (&sessions);
+
+		/* the sessions are sorted by user, so each user is a run of them */
+		for (i = 0; i < users; i = j) {
+			for (j = i; j < users && !strcmp (sessions[j].user, sessions[i].user); j++)
+				;
+			distinct++;
+			if (j - i > most) {
+				most = j - i;
+				busiest = sessions[i].user;
+			}
+			if (verbose) {
+				xasprintf (&line, "%s%s: ", line ? line : "", sessions[i].user);
+				xasprintf (&line, ngettext ("%s%d session on %s", "%s%d sessions on %s", j - i),
+				           line, j - i, sessions[i].line);
+				for (k = i + 1; k < j; k++)
+					xasprintf (&line, "%s, %s", line, sessions[k].line);
+				xasprintf (&line, "%s\n", line);
+			}
+		}
+	}
 #else
 	/* run the command */
 	child_process = spopen (WHO_COMMAND);
@@ -157,6 +219,35 @@ main (int argc, char **argv)
 		result = possibly_set (result, STATE_UNKNOWN);
 #endif
 
+#if HAVE_UTMPX_H && !HAVE_WTSAPI32_H
+	if (mode != MODE_SESSIONS) {
+		result = get_status ((double) (mode == MODE_USERS ? distinct : mode == MODE_PER_USER ? most : users), thlds);
+		if (mode == MODE_LOGINS) {
+			printf (_("USERS %s - %d logins in the last %d minutes |%s\n"),
+			        state_text (result), users, window_minutes,
+			        sperfdata_int ("logins", users, "", warning_range,
+			                       critical_range, TRUE, 0, FALSE, 0));
+			return result;
+		}
+		if (mode == MODE_USERS)
+			printf (_("USERS %s - %d distinct users logged in, %d sessions"),
+			        state_text (result), distinct, users);
+		else
+			printf (_("USERS %s - at most %d sessions per user (%s), %d sessions"),
+			        state_text (result), most, busiest, users);
+		printf (" |%s %s %s\n%s",
+		        sperfdata_int ("distinct_users", distinct, "",
+		                       mode == MODE_USERS ? warning_range : NULL,
+		                       mode == MODE_USERS ? critical_range : NULL, TRUE, 0, FALSE, 0),
+		        sperfdata_int ("max_sessions", most, "",
+		                       mode == MODE_PER_USER ? warning_range : NULL,
+		                       mode == MODE_PER_USER ? critical_range : NULL, TRUE, 0, FALSE, 0),
+		        sperfdata_int ("users", users, "", NULL, NULL, TRUE, 0, FALSE, 0),
+		        line ? line : "");
+		return result;
+	}
+#endif
+
 	/* check the user count against warning and critical thresholds */
 	result = get_status((double)users, thlds);
 
@@ -167,11 +258,118 @@ main (int argc, char **argv)
 				state_text(result), users,
 				sperfdata_int("users", users, "", warning_range,
 							critical_range, TRUE, 0, FALSE, 0));
+#if HAVE_UTMPX_H && !HAVE_WTSAPI32_H
+		if (line)
+			printf ("%s", line);
+#endif
 	}
 
 	return result;
 }
 
+#if HAVE_UTMPX_H && !HAVE_WTSAPI32_H
+static int
+session_cmp (const void *a, const void *b)
+{
+	const session *x = a, *y = b;
+	int c = strcmp (x->user, y->user);
+
+	return c ? c : strcmp (x->line, y->line);
+}
+
+/* The user processes in utmpx, in one pass, sorted by user and line */
+int
+read_sessions (session **sessions)
+{
+	struct utmpx *putmpx;
+	int count = 0, size = 0;
+
+	*sessions = NULL;
+#ifdef HAVE_UTMPXNAME
+	if (utmp_file != NULL && utmpxname (utmp_file) != 0)
+		die (STATE_UNKNOWN, _("Could not use %s\n"), utmp_file);
+#endif
+	setutxent ();
+
+	while ((putmpx = getutxent ()) != NULL) {
+		if (putmpx->ut_type != USER_PROCESS)
+			continue;
+		if (count == size) {
+			size = size ? size * 2 : 64;
+			*sessions = realloc (*sessions, size * sizeof (session));
+			if (*sessions == NULL)
+				die (STATE_UNKNOWN, _("Could not allocate memory for the sessions\n"));
+		}
+		/* neither is null terminated when it fills the field */
+		strncpy ((*sessions)[count].user, putmpx->ut_user, sizeof (putmpx->ut_user));
+		(*sessions)[count].user[sizeof (putmpx->ut_user)] = '\0';
+		strncpy ((*sessions)[count].line, putmpx->ut_line, sizeof (putmpx->ut_line));
+		(*sessions)[count].line[sizeof (putmpx->ut_line)] = '\0';
+		count++;
+	}
+
+	endutxent ();
+
+	if (count > 1)
+		qsort (*sessions, count, sizeof (session), session_cmp);
+	return count;
+}
+
+/*
+ * The logins in wtmp since the time given, or -1.  The records are
+ * appended as they happen, so with glibc, whose wtmp is an array of struct
+ * utmpx, they are read from the end back and only until an older one.
+ * Elsewhere the file is read forwards through utmpxname().
+ */
+int
+count_logins (const char *file, time_t since)
+{
+	int logins = 0;
+#ifdef __GLIBC__
+	struct utmpx block[WTMP_BLOCK];
+	struct stat st;
+	off_t end, start;
+	int fd, i;
+
+	if ((fd = open (file, O_RDONLY)) < 0 || fstat (fd, &st) < 0)
+		return -1;
+
+	/* a record being appended is not counted yet */
+	end = st.st_size - st.st_size % sizeof (struct utmpx);
+	for (; end > 0; end = start) {
+		start = (end > (off_t) sizeof (block)) ? end - (off_t) sizeof (block) : 0;
+		if (pread (fd, block, end - start, start) != end - start) {
+			close (fd);
+			return -1;
+		}
+		for (i = (end - start) / sizeof (struct utmpx) - 1; i >= 0; i--) {
+			if (block[i].ut_tv.tv_sec < since)
+				break;
+			if (block[i].ut_type == USER_PROCESS)
+				logins++;
+		}
+		if (i >= 0)
+			break;
+	}
+	close (fd);
+#elif defined(HAVE_UTMPXNAME)
+	struct utmpx *putmpx;
+
+	if (access (file, R_OK) != 0 || utmpxname (file) != 0)
+		return -1;
+	setutxent ();
+	while ((putmpx = getutxent ()) != NULL) {
+		if (putmpx->ut_type == USER_PROCESS && putmpx->ut_tv.tv_sec >= since)
+			logins++;
+	}
+	endutxent ();
+#else
+	die (STATE_UNKNOWN, "%s\n", _("Logins can not be counted without utmpxname()"));
+#endif
+	return logins;
+}
+#endif
+
 /* process command-line arguments */
 int
 process_arguments (int argc, char **argv)
@@ -181,6 +379,11 @@ process_arguments (int argc, char **argv)
 	static struct option longopts[] = {
 		{"critical", required_argument, 0, 'c'},
 		{"warning", required_argument, 0, 'w'},
+		{"mode", required_argument, 0, 'm'},
+		{"window", required_argument, 0, 'W'},
+		{"utmp-file", required_argument, 0, 'f'},
+		{"wtmp-file", required_argument, 0, 'F'},
+		{"verbose", no_argument, 0, 'v'},
 		{"version", no_argument, 0, 'V'},
 		{"help", no_argument, 0, 'h'},
 		{0, 0, 0, 0}
@@ -190,7 +393,7 @@ process_arguments (int argc, char **argv)
 		usage ("\n");
 
 	while (1) {
-		c = getopt_long (argc, argv, "+hVvc:w:", longopts, &option);
+		c = getopt_long (argc, argv, "+hVvc:w:m:W:f:F:", longopts, &option);
 
 		if (c == -1 || c == EOF || c == 1)
 			break;
@@ -210,6 +413,32 @@ process_arguments (int argc, char **argv)
 		case 'w':									/* warning */
 			warning_range = optarg;
 			break;
+		case 'm':									/* what to check */
+			if (!strcmp (optarg, "sessions"))
+				mode = MODE_SESSIONS;
+			else if (!strcmp (optarg, "users"))
+				mode = MODE_USERS;
+			else if (!strcmp (optarg, "per-user"))
+				mode = MODE_PER_USER;
+			else if (!strcmp (optarg, "logins"))
+				mode = MODE_LOGINS;
+			else
+				usage2 (_("Invalid mode"), optarg);
+			break;
+		case 'W':									/* login window */
+			if (!is_intpos (optarg))
+				usage2 (_("Window must be a positive integer"), optarg);
+			window_minutes = atoi (optarg);
+			break;
+		case 'f':
+			utmp_file = optarg;
+			break;
+		case 'F':
+			wtmp_file = optarg;
+			break;
+		case 'v':									/* verbose */
+			verbose++;
+			break;
 		}
 	}
 
@@ -252,6 +481,17 @@ print_help (void)
 	printf ("    %s\n", _("Set WARNING status if more than INTEGER users are logged in"));
 	printf (" %s\n", "-c, --critical=INTEGER");
 	printf ("    %s\n", _("Set CRITICAL status if more than INTEGER users are logged in"));
+	printf (" %s\n", "-m, --mode=sessions|users|per-user|logins");
+	printf ("    %s\n", _("What the thresholds are for: the sessions (the default), the distinct"));
+	printf ("    %s\n", _("users, the most sessions of any one user, or the logins recorded in wtmp"));
+	printf (" %s\n", "-W, --window=MINUTES");
+	printf ("    %s\n", _("Count the logins of the last MINUTES (default: 60)"));
+	printf (" %s\n", "-f, --utmp-file=FILE");
+	printf ("    %s\n", _("Read the sessions from FILE instead of the system utmpx"));
+	printf (" %s\n", "-F, --wtmp-file=FILE");
+	printf ("    %s\n", _("Read the logins from FILE instead of the system wtmp"));
+	printf (" %s\n", "-v, --verbose");
+	printf ("    %s\n", _("List the sessions of each user and their terminals"));
 
 	printf (UT_SUPPORT);
 }
@@ -260,5 +500,6 @@ void
 print_usage (void)
 {
 	printf ("%s\n", _("Usage:"));
-	printf ("%s -w <users> -c <users>\n", progname);
+	printf ("%s -w <users> -c <users> [-m sessions|users|per-user|logins]\n", progname);
+	printf ("[-W minutes] [-f utmp_file] [-F wtmp_file] [-v]\n");
 }
@@ -29,9 +29,13 @@
 
 #include "common.h"
 #include "netutils.h"
+#include <fcntl.h>
+
+#define NP_CONNECT_SOCKET_FAILED -2
 
 int econn_refuse_state = STATE_CRITICAL;
 int was_refused = FALSE;
+np_net_timing np_timing;
 #if USE_IPV6
 int address_family = AF_UNSPEC;
 #else
@@ -71,6 +75,77 @@ socket_timeout_alarm_handler (int sig)
 	exit (timeout_state);
 }
 
+/* records the current monotonic time for one of the np_timing phases */
+void
+np_net_timing_mark (struct timespec *phase)
+{
+	struct timeval now;
+
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+	if (clock_gettime (CLOCK_MONOTONIC, phase) == 0)
+		return;
+#endif
+	gettimeofday (&now, NULL);
+	phase->tv_sec = now.tv_sec;
+	phase->tv_nsec = now.tv_usec * 1000L;
+}
+
+/* to be called with the result of every read from the peer */
+void
+np_net_timing_recv (int bytes)
+{
+	if (bytes <= 0)
+		return;
+	if (np_timing.first_byte.tv_sec == 0 && np_timing.first_byte.tv_nsec == 0)
+		np_net_timing_mark (&np_timing.first_byte);
+	np_net_timing_mark (&np_timing.last_byte);
+}
+
+/* seconds between two recorded phases, or -1 if either was not reached */
+double
+np_net_timing_elapsed (const struct timespec *from, const struct timespec *to)
+{
+	if ((from->tv_sec == 0 && from->tv_nsec == 0) ||
+	    (to->tv_sec == 0 && to->tv_nsec == 0))
+		return -1.0;
+	return (double)(to->tv_sec - from->tv_sec) +
+	       (double)(to->tv_nsec - from->tv_nsec) / 1.0e9;
+}
+
+static void
+np_net_timing_append (char **perf, const char *label, const struct timespec *from,
+	const struct timespec *to)
+{
+	double elapsed = np_net_timing_elapsed (from, to);
+
+	if (elapsed < 0)
+		return;
+	xasprintf (perf, "%s%s%s", *perf, **perf ? " " : "",
+	           fperfdata (label, elapsed, "s", FALSE, 0, FALSE, 0, FALSE, 0, FALSE, 0));
+}
+
+/* perfdata for all recorded phases: time_dns, time_connect, time_ssl (from
+ * connect or the STARTTLS reply), time_firstbyte (from connect or handshake)
+ * and time_transfer */
+char *
+np_net_timing_perfdata (void)
+{
+	char *perf = strdup ("");
+	const struct timespec *ready = &np_timing.connected;
+
+	np_net_timing_append (&perf, "time_dns", &np_timing.start, &np_timing.resolved);
+	np_net_timing_append (&perf, "time_connect", &np_timing.resolved, &np_timing.connected);
+	if (np_timing.upgraded.tv_sec != 0 || np_timing.upgraded.tv_nsec != 0)
+		ready = &np_timing.upgraded;
+	np_net_timing_append (&perf, "time_ssl", ready, &np_timing.handshake);
+	ready = &np_timing.connected;
+	if (np_timing.handshake.tv_sec != 0 || np_timing.handshake.tv_nsec != 0)
+		ready = &np_timing.handshake;
+	np_net_timing_append (&perf, "time_firstbyte", ready, &np_timing.first_byte);
+	np_net_timing_append (&perf, "time_transfer", &np_timing.first_byte, &np_timing.last_byte);
+	return perf;
+}
+
 /* connects to a host on a specified tcp port, sends a string, and gets a
 	 response. loops on select-recv until timeout or eof to get all of a
 	 multi-packet answer */
@@ -134,6 +209,7 @@ process_tcp_request2 (const char *server_address, int server_port,
 				break;
 			}
 			else {										/* we got data! */
+				np_net_timing_recv (recv_result);
 				recv_length += recv_result;
 				if (recv_length >= recv_size - 1) {
 					/* buffer full, we're done */
@@ -172,12 +248,167 @@ process_request (const char *server_address, int server_port, int proto,
 }
 
 
+/* reorders a getaddrinfo() result so that address families alternate,
+ * starting with the family the resolver preferred and keeping the resolver's
+ * order within each family (RFC 8305, section 4) */
+struct addrinfo **
+np_net_interleave_addrinfo (struct addrinfo *res, int *count)
+{
+	struct addrinfo *ai, **list, **first, **other;
+	int n = 0, nfirst = 0, nother = 0, i;
+
+	for (ai = res; ai; ai = ai->ai_next)
+		n++;
+
+	list = malloc (3 * n * sizeof (*list));
+	if (list == NULL)
+		die (STATE_UNKNOWN, _("Could not allocate memory for address list\n"));
+	first = list + n;
+	other = list + 2 * n;
+
+	for (ai = res; ai; ai = ai->ai_next) {
+		if (ai->ai_family == res->ai_family)
+			first[nfirst++] = ai;
+		else
+			other[nother++] = ai;
+	}
+
+	for (n = 0, i = 0; i < nfirst || i < nother; i++) {
+		if (i < nfirst)
+			list[n++] = first[i];
+		if (i < nother)
+			list[n++] = other[i];
+	}
+
+	*count = n;
+	return list;
+}
+
+static void
+np_net_connect_failed (int error, int *last_error)
+{
+	if (error == ECONNREFUSED)
+		was_refused = TRUE;
+	*last_error = error;
+}
+
+/* races non-blocking connects to every address in res, starting a new one
+ * each NP_CONNECT_ATTEMPT_DELAY ms (or as soon as all pending ones failed),
+ * until one succeeds or timeout_interval runs out.  The winning socket is
+ * handed back in blocking mode, all others are closed.  Returns 0 on
+ * success, -1 with errno set on failure. */
+static int
+np_net_connect_race (struct addrinfo *res, int socktype, int *sd)
+{
+	struct addrinfo **candidates;
+	struct pollfd *pfds;
+	struct timeval start;
+	long elapsed, next_attempt = 0, budget = timeout_interval * 1000L;
+	int ncandidates, started = 0, pending = 0, last_error = ETIMEDOUT;
+	int i, fd, flags, ready, so_error, wait;
+	socklen_t optlen;
+
+	*sd = -1;
+	candidates = np_net_interleave_addrinfo (res, &ncandidates);
+	pfds = calloc (ncandidates, sizeof (*pfds));
+	if (pfds == NULL)
+		die (STATE_UNKNOWN, _("Could not allocate memory for address list\n"));
+	gettimeofday (&start, NULL);
+
+	while (*sd < 0) {
+		elapsed = deltime (start) / 1000;
+		if (budget > 0 && elapsed >= budget) {
+			last_error = ETIMEDOUT;
+			break;
+		}
+
+		if (started < ncandidates && (pending == 0 || elapsed >= next_attempt)) {
+			fd = socket (candidates[started]->ai_family, socktype,
+			             candidates[started]->ai_protocol);
+			if (fd < 0) {
+				printf ("%s\n", _("Socket creation failed"));
+				last_error = NP_CONNECT_SOCKET_FAILED;
+				break;
+			}
+			pfds[started].fd = -1;
+			flags = fcntl (fd, F_GETFL, 0);
+			fcntl (fd, F_SETFL, flags | O_NONBLOCK);
+
+			if (connect (fd, candidates[started]->ai_addr,
+			             candidates[started]->ai_addrlen) == 0) {
+				*sd = fd;
+			} else if (errno == EINPROGRESS) {
+				pfds[started].fd = fd;
+				pfds[started].events = POLLOUT;
+				pending++;
+			} else {
+				np_net_connect_failed (errno, &last_error);
+				close (fd);
+			}
+			started++;
+			next_attempt = elapsed + NP_CONNECT_ATTEMPT_DELAY;
+			continue;
+		}
+
+		if (pending == 0)
+			break;
+
+		wait = budget > 0 ? budget - elapsed : -1;
+		if (started < ncandidates && (wait < 0 || next_attempt - elapsed < wait))
+			wait = next_attempt - elapsed;
+
+		ready = poll (pfds, started, wait);
+		if (ready < 0) {
+			if (errno == EINTR)
+				continue;
+			last_error = errno;
+			break;
+		}
+
+		for (i = 0; i < started && ready > 0 && *sd < 0; i++) {
+			if (pfds[i].fd < 0 || pfds[i].revents == 0)
+				continue;
+			ready--;
+			so_error = 0;
+			optlen = sizeof (so_error);
+			if (getsockopt (pfds[i].fd, SOL_SOCKET, SO_ERROR, &so_error, &optlen) < 0)
+				so_error = errno;
+			if (so_error == 0) {
+				*sd = pfds[i].fd;
+				pfds[i].fd = -1;
+			} else {
+				np_net_connect_failed (so_error, &last_error);
+				close (pfds[i].fd);
+				pfds[i].fd = -1;
+				pending--;
+			}
+		}
+	}
+
+	for (i = 0; i < started; i++)
+		if (pfds[i].fd >= 0)
+			close (pfds[i].fd);
+	free (pfds);
+	free (candidates);
+
+	if (*sd >= 0) {
+		was_refused = FALSE;
+		flags = fcntl (*sd, F_GETFL, 0);
+		fcntl (*sd, F_SETFL, flags & ~O_NONBLOCK);
+		return 0;
+	}
+	if (last_error == NP_CONNECT_SOCKET_FAILED)
+		return NP_CONNECT_SOCKET_FAILED;
+	errno = last_error;
+	return -1;
+}
+
 /* opens a tcp or udp connection to a remote host or local socket */
 int
 np_net_connect (const char *host_name, int port, int *sd, int proto)
 {
 	struct addrinfo hints;
-	struct addrinfo *res, *orig_res;
+	struct addrinfo *orig_res;
 	struct sockaddr_un su;
 	char port_str[6], host[MAX_HOST_ADDRESS_LENGTH];
 	size_t len;
@@ -185,6 +416,8 @@ np_net_connect (const char *host_name, int port, int *sd, int proto)
 	short is_socket = (host_name[0] == '/');
 
 	socktype = (proto == IPPROTO_UDP) ? SOCK_DGRAM : SOCK_STREAM;
+	memset (&np_timing, 0, sizeof (np_timing));
+	np_net_timing_mark (&np_timing.start);
 
 	/* as long as it doesn't start with a '/', it's assumed a host or ip */
 	if (!is_socket){
@@ -205,6 +438,7 @@ np_net_connect (const char *host_name, int port, int *sd, int proto)
 		host[len] = '\0';
 		snprintf (port_str, sizeof (port_str), "%d", port);
 		result = getaddrinfo (host, port_str, &hints, &orig_res);
+		np_net_timing_mark (&np_timing.resolved);
 
 		if (result != 0) {
 			if (result == EAI_NONAME)
@@ -214,37 +448,11 @@ np_net_connect (const char *host_name, int port, int *sd, int proto)
 			return STATE_UNKNOWN;
 		}
 
-		res = orig_res;
-		while (res) {
-			/* attempt to create a socket */
-			*sd = socket (res->ai_family, socktype, res->ai_protocol);
-
-			if (*sd < 0) {
-				printf ("%s\n", _("Socket creation failed"));
-				freeaddrinfo (orig_res);
-				return STATE_UNKNOWN;
-			}
-
-			/* attempt to open a connection */
-			result = connect (*sd, res->ai_addr, res->ai_addrlen);
-
-			if (result == 0) {
-				was_refused = FALSE;
-				break;
-			}
-
-			if (result < 0) {
-				switch (errno) {
-				case ECONNREFUSED:
-					was_refused = TRUE;
-					break;
-				}
-			}
-
-			close (*sd);
-			res = res->ai_next;
-		}
+		/* attempt to open a connection, racing all addresses */
+		result = np_net_connect_race (orig_res, socktype, sd);
 		freeaddrinfo (orig_res);
+		if (result == NP_CONNECT_SOCKET_FAILED)
+			return STATE_UNKNOWN;
 	}
 	/* else the hostname is interpreted as a path to a unix socket */
 	else {
@@ -263,8 +471,10 @@ np_net_connect (const char *host_name, int port, int *sd, int proto)
 			was_refused = TRUE;
 	}
 
-	if (result == 0)
+	if (result == 0) {
+		np_net_timing_mark (&np_timing.connected);
 		return STATE_OK;
+	}
 	else if (was_refused) {
 		switch (econn_refuse_state) { /* a user-defined expected outcome */
 		case STATE_OK:
@@ -332,8 +542,10 @@ send_request (int sd, int proto, const char *send_buffer, char *recv_buffer, int
 				printf ("%s\n", _("Receive failed"));
 			result = STATE_WARNING;
 		}
-		else
+		else {
+			np_net_timing_recv (recv_result);
 			recv_buffer[recv_result] = 0;
+		}
 
 		/* die returned string */
 		recv_buffer[recv_size - 1] = 0;
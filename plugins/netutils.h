@@ -60,6 +60,13 @@ int process_request (const char *address, int port, int proto,
 #define my_udp_connect(addr, port, s) np_net_connect(addr, port, s, IPPROTO_UDP)
 int np_net_connect(const char *address, int port, int *sd, int proto);
 
+/* RFC 8305 "Connection Attempt Delay": the head start each address gets
+ * before the next candidate is raced against it */
+#define NP_CONNECT_ATTEMPT_DELAY 250	/* milliseconds */
+/* the addresses of a getaddrinfo() result in the order to race them, in a
+ * malloc()ed array of *count entries */
+struct addrinfo **np_net_interleave_addrinfo (struct addrinfo *res, int *count);
+
 /* send_request and wrapper macros */
 #define send_tcp_request(s, sbuf, rbuf, rsize) \
 	send_request(s, IPPROTO_TCP, sbuf, rbuf, rsize)
@@ -81,6 +88,27 @@ void host_or_die(const char *str);
 #  define is_hostname(addr) resolve_host_or_addr(addr, AF_INET)
 #endif
 
+/* connect-phase timestamps on the monotonic clock.  np_net_connect() records
+ * start, resolved and connected, np_net_ssl_init*() the handshake, and
+ * np_net_timing_recv() the first and last byte of the response.  Plugins
+ * that switch to TLS with STARTTLS record upgraded once the server agreed.
+ * Phases that did not happen stay zeroed. */
+typedef struct np_net_timing {
+	struct timespec start;
+	struct timespec resolved;
+	struct timespec connected;
+	struct timespec upgraded;
+	struct timespec handshake;
+	struct timespec first_byte;
+	struct timespec last_byte;
+} np_net_timing;
+
+extern np_net_timing np_timing;
+void np_net_timing_mark (struct timespec *phase);
+void np_net_timing_recv (int bytes);
+double np_net_timing_elapsed (const struct timespec *from, const struct timespec *to);
+char *np_net_timing_perfdata (void);
+
 extern int econn_refuse_state;
 extern int was_refused;
 extern int address_family;
@@ -103,6 +131,9 @@ RETSIGTYPE socket_timeout_alarm_handler (int) __attribute__((noreturn));
 #  define MP_TLSv1_1_OR_NEWER 10
 #  define MP_TLSv1_2_OR_NEWER 11
 #  define MP_TLSv1_3_OR_NEWER 12
+extern int check_hostname;
+extern char *ssl_alpn;	/* comma separated ALPN protocols to offer */
+extern int ssl_verify_chain;	/* verify the chain for np_net_ssl_info() */
 /* maybe this could be merged with the above np_net_connect, via some flags */
 int np_net_ssl_init(int sd);
 int np_net_ssl_init_with_hostname(int sd, char *host_name);
@@ -113,6 +144,15 @@ int np_net_ssl_write(const void *buf, int num);
 int np_net_ssl_read(void *buf, int num);
 int np_net_ssl_check_cert(int days_till_exp_warn, int days_till_exp_crit);
 int np_net_ssl_check_cert_real(SSL *ssl, int days_till_exp_warn, int days_till_exp_crit);
+int np_net_ssl_check_chain(int days_till_exp_warn, int days_till_exp_crit);
+int np_net_ssl_check_chain_real(SSL *ssl, int days_till_exp_warn, int days_till_exp_crit);
+char *np_net_ssl_info(void);
+char *np_net_ssl_info_real(SSL *ssl);
+/* shared client context and independent connections on top of it, for
+ * plugins that need more than the one connection of np_net_ssl_init() */
+int np_net_ssl_ctx(int version, char *cert, char *privkey, SSL_CTX **ctx);
+int np_net_ssl_connect(SSL_CTX *ctx, int sd, char *host_name, SSL **ssl);
+void np_net_ssl_close(SSL *ssl);
 #endif /* HAVE_SSL */
 
 #endif /* NAGIOS_NETUGILS_H_INCLUDED_ */
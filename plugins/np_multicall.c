@@ -0,0 +1,93 @@
+/*****************************************************************************
+*
+* Nagios np_multicall
+*
+* License: GPL
+* Copyright (c) 2018 Nagios Plugins Development Team
+*
+* Description:
+*
+* This file contains np_multicall, a single binary holding the plugins of
+* plugin_worker that runs the one named by argv[0], so check_load can be a
+* symlink to it.  "np_multicall check_load -w ..." works as well.  It is
+* only built as plugins/tests/np_multicall, by "make bench" or for
+* tools/bench_exec, and not installed while it execs slower than the
+* separate binaries.
+*
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*
+*****************************************************************************/
+
+#include "common.h"
+
+/* generated from WORKER_PLUGINS and check_tcp_programs in Makefile.am */
+#define NP_WORKER_PLUGIN(name, entry) int np_main_##entry (int, char **);
+#include "plugin_worker_list.h"
+#undef NP_WORKER_PLUGIN
+
+static const struct {
+	const char *name;
+	int (*entry) (int, char **);
+} plugins[] = {
+#define NP_WORKER_PLUGIN(name, entry) { #name, np_main_##entry },
+#include "plugin_worker_list.h"
+#undef NP_WORKER_PLUGIN
+	{ NULL, NULL }
+};
+
+/* the plugins set up the locale themselves, this is only for our own
+ * messages, so it is not paid for on every call */
+static void
+multicall_locale (void)
+{
+	setlocale (LC_ALL, "");
+	bindtextdomain (PACKAGE, LOCALEDIR);
+	textdomain (PACKAGE);
+}
+
+int
+main (int argc, char **argv)
+{
+	const char *name;
+	int i;
+
+	name = strrchr (argv[0], '/');
+	name = name ? name + 1 : argv[0];
+
+	/* called by its own name, the plugin is the first argument */
+	if (strcmp (name, "np_multicall") == 0) {
+		if (argc < 2) {
+			multicall_locale ();
+			printf ("%s\n%s\n\n%s\n", _("Usage:"), _("np_multicall plugin [arguments]"), _("Plugins:"));
+			for (i = 0; plugins[i].name != NULL; i++)
+				printf ("  %s\n", plugins[i].name);
+			return STATE_UNKNOWN;
+		}
+		argc--;
+		argv++;
+		name = strrchr (argv[0], '/');
+		name = name ? name + 1 : argv[0];
+	}
+
+	for (i = 0; plugins[i].name != NULL; i++) {
+		if (strcmp (plugins[i].name, name) == 0)
+			return plugins[i].entry (argc, argv);
+	}
+
+	multicall_locale ();
+	printf (_("UNKNOWN - %s is not built into np_multicall\n"), name);
+	return STATE_UNKNOWN;
+}
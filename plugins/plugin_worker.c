@@ -0,0 +1,459 @@
+/*****************************************************************************
+*
+* Nagios plugin_worker
+*
+* License: GPL
+* Copyright (c) 2018 Nagios Plugins Development Team
+*
+* Description:
+*
+* This file contains plugin_worker, a resident process that runs the
+* compiled-in plugins on request.  Each plugin object is linked in with its
+* own private copy of the plugin libraries and its main() renamed to
+* np_main_<plugin> (see Makefile.am), so the plugins keep their globals,
+* die() and exit() paths unchanged.  Every check runs in a child forked from
+* the warm worker: there is no exec, no dynamic linking, and locale and SSL
+* library setup has already been done once by the worker.  The same plugins
+* are still built as standalone binaries.
+*
+* Protocol, on stdin/stdout or on every connection to --socket:
+*
+*   request:  "<timeout> <argc>\n" followed by argc NUL terminated arguments,
+*             argv[0] being the plugin name.  A timeout of 0 uses -t.
+*   response: "<state> <length>\n" followed by length bytes of plugin output.
+*
+* Requests on one connection are run one after the other; use several
+* connections to run checks in parallel.
+*
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*
+*****************************************************************************/
+
+const char *progname = "plugin_worker";
+const char *copyright = "2018";
+const char *email = "devel@nagios-plugins.org";
+
+#include "common.h"
+#include "utils.h"
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <fcntl.h>
+
+/* generated from WORKER_PLUGINS and check_tcp_programs in Makefile.am */
+#define NP_WORKER_PLUGIN(name, entry) int np_main_##entry (int, char **);
+#include "plugin_worker_list.h"
+#undef NP_WORKER_PLUGIN
+
+typedef struct worker_plugin {
+	const char *name;
+	int (*entry) (int, char **);
+} worker_plugin;
+
+static const worker_plugin plugins[] = {
+#define NP_WORKER_PLUGIN(name, entry) { #name, np_main_##entry },
+#include "plugin_worker_list.h"
+#undef NP_WORKER_PLUGIN
+	{ NULL, NULL }
+};
+
+#define MAX_ARGS 256
+#define MAX_REQUEST 65536
+#define MAX_OUTPUT (1024 * 1024)
+
+/* buffered reads from a connection */
+typedef struct worker_conn {
+	int in;
+	int out;
+	char buf[4096];
+	size_t pos;
+	size_t len;
+} worker_conn;
+
+int process_arguments (int, char **);
+void print_help (void);
+void print_usage (void);
+
+char *socket_path = NULL;
+int list_plugins = FALSE;
+
+
+static int
+conn_getc (worker_conn *conn)
+{
+	ssize_t n;
+
+	if (conn->pos == conn->len) {
+		do {
+			n = read (conn->in, conn->buf, sizeof (conn->buf));
+		} while (n < 0 && errno == EINTR);
+		if (n <= 0)
+			return EOF;
+		conn->pos = 0;
+		conn->len = n;
+	}
+	return (unsigned char)conn->buf[conn->pos++];
+}
+
+
+static int
+write_all (int fd, const char *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		n = write (fd, buf, len);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return ERROR;
+		buf += n;
+		len -= n;
+	}
+	return OK;
+}
+
+
+static const worker_plugin *
+find_plugin (const char *name)
+{
+	const char *base = strrchr (name, '/');
+	int i;
+
+	base = base ? base + 1 : name;
+	for (i = 0; plugins[i].name != NULL; i++) {
+		if (strcmp (plugins[i].name, base) == 0)
+			return &plugins[i];
+	}
+	return NULL;
+}
+
+
+/*
+ * Runs one plugin in a forked child, with its stdout collected in output.
+ * The child is killed once timeout seconds have passed, whatever the
+ * plugin's own timeout handling does.
+ */
+static int
+run_plugin (const worker_plugin *plugin, int argc, char **argv, int timeout,
+            char **output, size_t *len)
+{
+	struct pollfd pfd;
+	struct timeval start;
+	size_t size = 4096;
+	long remaining;
+	int fds[2], status, result = STATE_UNKNOWN, timed_out = FALSE;
+	ssize_t n;
+	pid_t pid;
+
+	*len = 0;
+	*output = malloc (size);
+	if (*output == NULL || pipe (fds) < 0)
+		die (STATE_UNKNOWN, _("Could not allocate memory for output\n"));
+
+	if ((pid = fork ()) < 0) {
+		close (fds[0]);
+		close (fds[1]);
+		*len = snprintf (*output, size, "%s\n", _("UNKNOWN - Could not fork the plugin"));
+		return STATE_UNKNOWN;
+	}
+	if (pid == 0) {
+		close (fds[0]);
+		dup2 (fds[1], STDOUT_FILENO);
+		close (fds[1]);
+		close (STDIN_FILENO);
+		open ("/dev/null", O_RDONLY);
+		signal (SIGPIPE, SIG_DFL);
+		signal (SIGCHLD, SIG_DFL);
+		signal (SIGALRM, SIG_DFL);
+		alarm (0);
+		/* getopt state left behind by our own arguments */
+		optind = 1;
+		exit (plugin->entry (argc, argv));
+	}
+
+	close (fds[1]);
+	pfd.fd = fds[0];
+	pfd.events = POLLIN;
+	gettimeofday (&start, NULL);
+	while (1) {
+		remaining = timeout * 1000L - deltime (start) / 1000;
+		if (remaining <= 0) {
+			kill (pid, SIGKILL);
+			timed_out = TRUE;
+			break;
+		}
+		if (poll (&pfd, 1, remaining) <= 0)
+			continue;
+		if (*len + 1 >= size) {
+			if (size >= MAX_OUTPUT) {
+				/* drop the rest rather than blocking the plugin */
+				char discard[4096];
+				if (read (fds[0], discard, sizeof (discard)) == 0)
+					break;
+				continue;
+			}
+			size *= 2;
+			*output = realloc (*output, size);
+			if (*output == NULL)
+				die (STATE_UNKNOWN, _("Could not allocate memory for output\n"));
+		}
+		n = read (fds[0], *output + *len, size - *len - 1);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		*len += n;
+	}
+	close (fds[0]);
+
+	while (waitpid (pid, &status, 0) < 0 && errno == EINTR)
+		;
+	if (timed_out) {
+		*len = snprintf (*output, size, _("CRITICAL - Plugin timed out after %d seconds\n"), timeout);
+		result = STATE_CRITICAL;
+	}
+	else if (WIFEXITED (status)) {
+		result = WEXITSTATUS (status);
+	}
+	else if (WIFSIGNALED (status) && *len + 64 < size) {
+		*len += snprintf (*output + *len, size - *len, _("UNKNOWN - Plugin killed by signal %d\n"),
+		                  WTERMSIG (status));
+	}
+	return result;
+}
+
+
+/* reads and runs requests until the other side closes the connection */
+static void
+serve (worker_conn *conn)
+{
+	char *args = malloc (MAX_REQUEST), *argv[MAX_ARGS + 1];
+	char header[64], *output;
+	const worker_plugin *plugin;
+	int timeout, argc, result, c, i;
+	size_t len, pos;
+
+	if (args == NULL)
+		die (STATE_UNKNOWN, _("Could not allocate memory for requests\n"));
+
+	while (1) {
+		for (pos = 0; (c = conn_getc (conn)) != '\n'; ) {
+			if (c == EOF)
+				goto done;
+			if (pos < sizeof (header) - 1)
+				header[pos++] = c;
+		}
+		header[pos] = '\0';
+		if (sscanf (header, "%d %d", &timeout, &argc) != 2 ||
+		    timeout < 0 || argc < 1 || argc > MAX_ARGS)
+			goto done;
+		if (timeout == 0)
+			timeout = timeout_interval;
+
+		for (i = 0, pos = 0; i < argc; i++) {
+			argv[i] = args + pos;
+			do {
+				if ((c = conn_getc (conn)) == EOF || pos >= MAX_REQUEST)
+					goto done;
+				args[pos++] = c;
+			} while (c != '\0');
+		}
+		argv[argc] = NULL;
+
+		if ((plugin = find_plugin (argv[0])) == NULL) {
+			result = STATE_UNKNOWN;
+			len = xasprintf (&output, _("UNKNOWN - %s is not built into %s\n"), argv[0], progname);
+		}
+		else {
+			result = run_plugin (plugin, argc, argv, timeout, &output, &len);
+		}
+
+		snprintf (header, sizeof (header), "%d %lu\n", result, (unsigned long)len);
+		if (write_all (conn->out, header, strlen (header)) != OK ||
+		    write_all (conn->out, output, len) != OK) {
+			free (output);
+			goto done;
+		}
+		free (output);
+	}
+done:
+	free (args);
+}
+
+
+int
+main (int argc, char **argv)
+{
+	struct sockaddr_un addr;
+	worker_conn conn;
+	int sd, client, i;
+
+	setlocale (LC_ALL, "");
+	bindtextdomain (PACKAGE, LOCALEDIR);
+	textdomain (PACKAGE);
+
+	timeout_interval = DEFAULT_SOCKET_TIMEOUT;
+
+	if (process_arguments (argc, argv) == ERROR)
+		usage4 (_("Could not parse arguments"));
+
+	if (list_plugins) {
+		for (i = 0; plugins[i].name != NULL; i++)
+			printf ("%s\n", plugins[i].name);
+		return STATE_OK;
+	}
+
+#ifdef HAVE_SSL
+	/* done once here instead of in every check */
+	SSLeay_add_ssl_algorithms ();
+	SSL_load_error_strings ();
+	OpenSSL_add_all_algorithms ();
+#endif
+
+	signal (SIGPIPE, SIG_IGN);
+	memset (&conn, 0, sizeof (conn));
+
+	if (socket_path == NULL) {
+		conn.in = STDIN_FILENO;
+		conn.out = STDOUT_FILENO;
+		serve (&conn);
+		return STATE_OK;
+	}
+
+	if (strlen (socket_path) >= sizeof (addr.sun_path))
+		usage4 (_("Socket path is too long"));
+	memset (&addr, 0, sizeof (addr));
+	addr.sun_family = AF_UNIX;
+	strcpy (addr.sun_path, socket_path);
+	unlink (socket_path);
+	if ((sd = socket (AF_UNIX, SOCK_STREAM, 0)) < 0 ||
+	    bind (sd, (struct sockaddr *)&addr, sizeof (addr)) < 0 ||
+	    listen (sd, SOMAXCONN) < 0)
+		die (STATE_UNKNOWN, _("Could not listen on %s: %s\n"), socket_path, strerror (errno));
+
+	/* every connection gets its own process, which in turn forks the checks */
+	signal (SIGCHLD, SIG_IGN);
+	while (1) {
+		if ((client = accept (sd, NULL, NULL)) < 0) {
+			if (errno == EINTR || errno == ECONNABORTED)
+				continue;
+			die (STATE_UNKNOWN, _("Could not accept connection: %s\n"), strerror (errno));
+		}
+		if (fork () == 0) {
+			close (sd);
+			signal (SIGCHLD, SIG_DFL);
+			conn.in = conn.out = client;
+			serve (&conn);
+			exit (STATE_OK);
+		}
+		close (client);
+	}
+}
+
+
+/* process command-line arguments */
+int
+process_arguments (int argc, char **argv)
+{
+	int c;
+	int option = 0;
+	static struct option longopts[] = {
+		{"socket", required_argument, 0, 's'},
+		{"timeout", required_argument, 0, 't'},
+		{"list", no_argument, 0, 'l'},
+		{"version", no_argument, 0, 'V'},
+		{"help", no_argument, 0, 'h'},
+		{0, 0, 0, 0}
+	};
+
+	while (1) {
+		c = getopt_long (argc, argv, "s:t:lVh", longopts, &option);
+
+		if (c == -1 || c == EOF)
+			break;
+
+		switch (c) {
+		case 's':
+			socket_path = optarg;
+			break;
+		case 't':
+			if (!is_intpos (optarg))
+				usage4 (_("Timeout interval must be a positive integer"));
+			timeout_interval = atoi (optarg);
+			break;
+		case 'l':
+			list_plugins = TRUE;
+			break;
+		case 'V':
+			print_revision (progname, NP_VERSION);
+			exit (STATE_OK);
+		case 'h':
+			print_help ();
+			exit (STATE_OK);
+		default:
+			usage5 ();
+		}
+	}
+
+	if (optind < argc)
+		return ERROR;
+
+	return OK;
+}
+
+
+void
+print_help (void)
+{
+	print_revision (progname, NP_VERSION);
+
+	printf (COPYRIGHT, copyright, email);
+
+	printf ("%s\n", _("Runs the plugins built into it on request, without exec'ing a new program"));
+	printf ("%s\n", _("for every check.  Requests are read from stdin, or from the connections to"));
+	printf ("%s\n", _("a Unix socket."));
+
+	printf ("\n\n");
+
+	print_usage ();
+
+	printf (UT_HELP_VRSN);
+
+	printf (" %s\n", "-s, --socket=PATH");
+	printf ("    %s\n", _("Listen on the Unix socket PATH instead of reading stdin"));
+	printf (" %s\n", "-t, --timeout=INTEGER");
+	printf ("    %s (%s %d)\n", _("Seconds before a check is killed, when the request does not set one"),
+	        _("default:"), DEFAULT_SOCKET_TIMEOUT);
+	printf (" %s\n", "-l, --list");
+	printf ("    %s\n", _("List the plugins built into the worker and exit"));
+
+	printf ("\n");
+	printf ("%s\n", _("A request is a line \"<timeout> <argc>\" followed by argc arguments, each"));
+	printf ("%s\n", _("terminated by a NUL byte, the first being the plugin name.  The answer is a"));
+	printf ("%s\n", _("line \"<state> <length>\" followed by length bytes of plugin output."));
+
+	printf (UT_SUPPORT);
+}
+
+
+void
+print_usage (void)
+{
+	printf ("%s\n", _("Usage:"));
+	printf ("%s [-s socket] [-t timeout] [-l]\n", progname);
+}
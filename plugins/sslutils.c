@@ -31,8 +31,29 @@
 #include "netutils.h"
 
 int check_hostname = 0;
+char *ssl_alpn = NULL;
+int ssl_verify_chain = 0;
 #ifdef HAVE_SSL
+#  if defined(USE_OPENSSL) && !defined(OPENSSL_NO_OCSP)
+#    include <openssl/ocsp.h>
+#  endif
+
+/* Sessions of earlier connections, so that repeated connections to the same
+ * server (redirects, batch modes) can resume instead of doing a full
+ * handshake.  Keyed by SNI host name, or by peer address without one. */
+#define NP_SSL_SESSION_CACHE_SIZE 32
+static struct {
+	char *key;
+	SSL_SESSION *session;
+} session_cache[NP_SSL_SESSION_CACHE_SIZE];
+static int session_cache_next = 0;
+
+/* The client context is shared by all connections of a process and only
+ * rebuilt when a different protocol version or client certificate is
+ * asked for. */
 static SSL_CTX *c=NULL;
+static int ctx_version = -1;
+static char *ctx_cert = NULL, *ctx_privkey = NULL;
 static SSL *s=NULL;
 static int initialized=0;
 
@@ -50,9 +71,30 @@ int np_net_ssl_init_with_hostname_and_version(int sd, char *host_name, int versi
 }
 
 int np_net_ssl_init_with_hostname_version_and_cert(int sd, char *host_name, int version, char *cert, char *privkey) {
+	SSL_CTX *ctx;
+	int result;
+
+	if ((result = np_net_ssl_ctx(version, cert, privkey, &ctx)) != STATE_OK)
+		return result;
+	if (s)
+		np_net_ssl_close(s);
+	return np_net_ssl_connect(ctx, sd, host_name, &s);
+}
+
+static int same_string(const char *a, const char *b) {
+	return (a == NULL && b == NULL) || (a && b && !strcmp(a, b));
+}
+
+int np_net_ssl_ctx(int version, char *cert, char *privkey, SSL_CTX **ctx) {
 	const SSL_METHOD *method = NULL;
 	long options = 0;	/*SSL_OP_ALL | SSL_OP_SINGLE_DH_USE;*/
 
+	if (c && ctx_version == version && same_string(ctx_cert, cert) &&
+	    same_string(ctx_privkey, privkey)) {
+		*ctx = c;
+		return STATE_OK;
+	}
+
 	switch (version) {
 	case MP_SSLv2: /* SSLv2 protocol */
 #if defined(USE_GNUTLS) || defined(OPENSSL_NO_SSL2)
@@ -156,6 +198,10 @@ int np_net_ssl_init_with_hostname_version_and_cert(int sd, char *host_name, int
 		OpenSSL_add_all_algorithms();
 		initialized = 1;
 	}
+	if (c) {
+		SSL_CTX_free(c);
+		c = NULL;
+	}
 	if ((c = SSL_CTX_new(method)) == NULL) {
 		printf("%s\n", _("CRITICAL - Cannot create SSL context."));
 		return STATE_CRITICAL;
@@ -166,6 +212,8 @@ int np_net_ssl_init_with_hostname_version_and_cert(int sd, char *host_name, int
 #ifdef USE_OPENSSL
 		if (!SSL_CTX_check_private_key(c)) {
 			printf ("%s\n", _("CRITICAL - Private key does not seem to match certificate!\n"));
+			SSL_CTX_free(c);
+			c = NULL;
 			return STATE_CRITICAL;
 		}
 #endif
@@ -178,17 +226,129 @@ int np_net_ssl_init_with_hostname_version_and_cert(int sd, char *host_name, int
 	SSL_CTX_set_post_handshake_auth(c, 1);
 #endif
 	SSL_CTX_set_mode(c, SSL_MODE_AUTO_RETRY);
-	if ((s = SSL_new(c)) != NULL) {
+#ifdef USE_OPENSSL
+	/* the chain is verified for np_net_ssl_info(), but never enforced;
+	 * loading the CA paths is not free, so only when it is reported */
+	if (ssl_verify_chain)
+		SSL_CTX_set_default_verify_paths(c);
+	SSL_CTX_set_session_cache_mode(c, SSL_SESS_CACHE_CLIENT);
+#endif
+
+	ctx_version = version;
+	free(ctx_cert);
+	free(ctx_privkey);
+	ctx_cert = cert ? strdup(cert) : NULL;
+	ctx_privkey = privkey ? strdup(privkey) : NULL;
+	*ctx = c;
+	return STATE_OK;
+}
+
+/* the session cache key for a connection, or NULL if it has none */
+static char *session_key(SSL *ssl) {
+	struct sockaddr_storage addr;
+	socklen_t len = sizeof(addr);
+	char host[INET6_ADDRSTRLEN], *key = NULL;
+	const char *name = NULL;
+
+#ifdef SSL_set_tlsext_host_name
+	name = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+#endif
+	if (getpeername(SSL_get_fd(ssl), (struct sockaddr *)&addr, &len) != 0)
+		return NULL;
+	if (getnameinfo((struct sockaddr *)&addr, len, host, sizeof(host), NULL, 0, NI_NUMERICHOST) != 0)
+		return NULL;
+	xasprintf(&key, "%s@%s:%d", name ? name : "", host,
+	          addr.ss_family == AF_INET6 ? ntohs(((struct sockaddr_in6 *)&addr)->sin6_port)
+	                                     : ntohs(((struct sockaddr_in *)&addr)->sin_port));
+	return key;
+}
+
+static SSL_SESSION *session_lookup(const char *key) {
+	int i;
+
+	for (i = 0; key && i < NP_SSL_SESSION_CACHE_SIZE; i++)
+		if (session_cache[i].key && !strcmp(session_cache[i].key, key))
+			return session_cache[i].session;
+	return NULL;
+}
+
+static void session_store(SSL *ssl) {
+	SSL_SESSION *session;
+	char *key;
+	int i;
+
+	if ((session = SSL_get1_session(ssl)) == NULL)
+		return;
+	if ((key = session_key(ssl)) == NULL) {
+		SSL_SESSION_free(session);
+		return;
+	}
+	for (i = 0; i < NP_SSL_SESSION_CACHE_SIZE; i++)
+		if (session_cache[i].key && !strcmp(session_cache[i].key, key))
+			break;
+	if (i == NP_SSL_SESSION_CACHE_SIZE) {
+		i = session_cache_next;
+		session_cache_next = (session_cache_next + 1) % NP_SSL_SESSION_CACHE_SIZE;
+	}
+	free(session_cache[i].key);
+	if (session_cache[i].session)
+		SSL_SESSION_free(session_cache[i].session);
+	session_cache[i].key = key;
+	session_cache[i].session = session;
+}
+
+/* sets ssl_alpn ("h2,http/1.1") on a connection in wire format */
+static void set_alpn(SSL *ssl) {
+#if defined(USE_OPENSSL) && OPENSSL_VERSION_NUMBER >= 0x10002000L
+	unsigned char wire[256];
+	const char *p = ssl_alpn, *end;
+	size_t len = 0, n;
+
+	while (p && *p) {
+		end = strchr(p, ',');
+		n = end ? (size_t)(end - p) : strlen(p);
+		if (n > 0 && n < 256 && len + n + 1 <= sizeof(wire)) {
+			wire[len++] = (unsigned char)n;
+			memcpy(wire + len, p, n);
+			len += n;
+		}
+		p = end ? end + 1 : NULL;
+	}
+	if (len)
+		SSL_set_alpn_protos(ssl, wire, len);
+#endif
+}
+
+int np_net_ssl_connect(SSL_CTX *ctx, int sd, char *host_name, SSL **ssl) {
+	SSL_SESSION *session;
+	char *key;
+
+	if ((*ssl = SSL_new(ctx)) != NULL) {
 #ifdef SSL_set_tlsext_host_name
 		if (host_name != NULL)
-			SSL_set_tlsext_host_name(s, host_name);
+			SSL_set_tlsext_host_name(*ssl, host_name);
+#endif
+#if defined(USE_OPENSSL) && !defined(OPENSSL_NO_OCSP)
+		SSL_set_tlsext_status_type(*ssl, TLSEXT_STATUSTYPE_ocsp);
 #endif
-		SSL_set_fd(s, sd);
-		if (SSL_connect(s) == 1) {
+		set_alpn(*ssl);
+		SSL_set_fd(*ssl, sd);
+		if ((key = session_key(*ssl)) != NULL) {
+			if ((session = session_lookup(key)) != NULL)
+				SSL_set_session(*ssl, session);
+			free(key);
+		}
+		if (SSL_connect(*ssl) == 1) {
+			np_net_timing_mark(&np_timing.handshake);
+			/* after STARTTLS the plaintext greeting was the first byte;
+			 * count the response from the encrypted stream instead */
+			memset(&np_timing.first_byte, 0, sizeof(np_timing.first_byte));
+			memset(&np_timing.last_byte, 0, sizeof(np_timing.last_byte));
 #if OPENSSL_VERSION_NUMBER >= 0x10002000L
 			if (check_hostname && host_name && *host_name) {
-				X509 *certificate=SSL_get_peer_certificate(s);
+				X509 *certificate=SSL_get_peer_certificate(*ssl);
 				int rc = X509_check_host(certificate, host_name, 0, 0, NULL);
+				X509_free(certificate);
 				if (rc != 1) {
 					printf("%s\n", _("CRITICAL - Hostname mismatch."));
 					return STATE_CRITICAL;
@@ -208,19 +368,22 @@ int np_net_ssl_init_with_hostname_version_and_cert(int sd, char *host_name, int
 	return STATE_CRITICAL;
 }
 
-void np_net_ssl_cleanup() {
-	if (s) {
+void np_net_ssl_close(SSL *ssl) {
+	if (ssl == NULL)
+		return;
+	/* tickets may arrive after the handshake, so remember the session now */
+	if (SSL_is_init_finished(ssl))
+		session_store(ssl);
 #ifdef SSL_set_tlsext_host_name
-		SSL_set_tlsext_host_name(s, NULL);
+	SSL_set_tlsext_host_name(ssl, NULL);
 #endif
-		SSL_shutdown(s);
-		SSL_free(s);
-		if (c) {
-			SSL_CTX_free(c);
-			c=NULL;
-		}
-		s=NULL;
-	}
+	SSL_shutdown(ssl);
+	SSL_free(ssl);
+}
+
+void np_net_ssl_cleanup() {
+	np_net_ssl_close(s);
+	s=NULL;
 }
 
 int np_net_ssl_write(const void *buf, int num) {
@@ -228,7 +391,10 @@ int np_net_ssl_write(const void *buf, int num) {
 }
 
 int np_net_ssl_read(void *buf, int num) {
-	return SSL_read(s, buf, num);
+	int bytes = SSL_read(s, buf, num);
+
+	np_net_timing_recv(bytes);
+	return bytes;
 }
 
 int np_net_ssl_check_cert(int days_till_exp_warn, int days_till_exp_crit){
@@ -240,33 +406,68 @@ int np_net_ssl_check_cert(int days_till_exp_warn, int days_till_exp_crit){
 #  endif /* USE_OPENSSL */
 }
 
-int np_net_ssl_check_cert_real(SSL *ssl, int days_till_exp_warn, int days_till_exp_crit){
 #  ifdef USE_OPENSSL
-	X509 *certificate=NULL;
+/* notAfter of a certificate as time_t, or -1 if it cannot be parsed */
+static time_t cert_not_after(X509 *certificate) {
+	ASN1_STRING *tm;
+	struct tm stamp;
+#    if OPENSSL_VERSION_NUMBER < 0x10101000L
+	int offset;
+#    endif
+
+	memset(&stamp, 0, sizeof(stamp));
+	tm = X509_get_notAfter(certificate);
+#    if OPENSSL_VERSION_NUMBER >= 0x10101000L
+	if (!ASN1_TIME_to_tm(tm, &stamp))
+		return (time_t)-1;
+	return timegm(&stamp);
+#    else
+	/* Generate tm structure to process timestamp */
+	if (tm->type == V_ASN1_UTCTIME) {
+		if (tm->length < 10)
+			return (time_t)-1;
+		stamp.tm_year = (tm->data[0] - '0') * 10 + (tm->data[1] - '0');
+		if (stamp.tm_year < 50)
+			stamp.tm_year += 100;
+		offset = 0;
+	} else {
+		if (tm->length < 12)
+			return (time_t)-1;
+		stamp.tm_year =
+			(tm->data[0] - '0') * 1000 + (tm->data[1] - '0') * 100 +
+			(tm->data[2] - '0') * 10 + (tm->data[3] - '0');
+		stamp.tm_year -= 1900;
+		offset = 2;
+	}
+	stamp.tm_mon =
+		(tm->data[2 + offset] - '0') * 10 + (tm->data[3 + offset] - '0') - 1;
+	stamp.tm_mday =
+		(tm->data[4 + offset] - '0') * 10 + (tm->data[5 + offset] - '0');
+	stamp.tm_hour =
+		(tm->data[6 + offset] - '0') * 10 + (tm->data[7 + offset] - '0');
+	stamp.tm_min =
+		(tm->data[8 + offset] - '0') * 10 + (tm->data[9 + offset] - '0');
+	stamp.tm_sec =
+		(tm->data[10 + offset] - '0') * 10 + (tm->data[11 + offset] - '0');
+	stamp.tm_isdst = -1;
+	return timegm(&stamp);
+#    endif
+}
+
+/* prints the expiry status of one certificate and returns its state */
+static int check_cert_expiry(X509 *certificate, const char *which, int days_till_exp_warn, int days_till_exp_crit) {
 	X509_NAME *subj=NULL;
 	char timestamp[50] = "";
 	char cn[MAX_CN_LENGTH]= "";
-	
+
 	int cnlen =-1;
 	int status=STATE_UNKNOWN;
 
-	ASN1_STRING *tm;
-	int offset;
-	struct tm stamp;
 	float time_left;
 	int days_left;
 	int time_remaining;
 	time_t tm_t;
 
-	// Prefix whatever we're about to print with SSL
-	printf("SSL ");
-
-	certificate=SSL_get_peer_certificate(ssl);
-	if (!certificate) {
-		printf("%s\n",_("CRITICAL - Cannot retrieve server certificate."));
-		return STATE_CRITICAL;
-	}
-
 	/* Extract CN from certificate subject */
 	subj=X509_get_subject_name(certificate);
 
@@ -279,50 +480,17 @@ int np_net_ssl_check_cert_real(SSL *ssl, int days_till_exp_warn, int days_till_e
 		strncpy(cn, _("Unknown CN\0"), 12);
 
 	/* Retrieve timestamp of certificate */
-	tm = X509_get_notAfter(certificate);
-
-	/* Generate tm structure to process timestamp */
-	if (tm->type == V_ASN1_UTCTIME) {
-		if (tm->length < 10) {
-			printf("%s\n", _("CRITICAL - Wrong time format in certificate."));
-			return STATE_CRITICAL;
-		} else {
-			stamp.tm_year = (tm->data[0] - '0') * 10 + (tm->data[1] - '0');
-			if (stamp.tm_year < 50)
-				stamp.tm_year += 100;
-			offset = 0;
-		}
-	} else {
-		if (tm->length < 12) {
-			printf("%s\n", _("CRITICAL - Wrong time format in certificate."));
-			return STATE_CRITICAL;
-		} else {
-			stamp.tm_year =
-				(tm->data[0] - '0') * 1000 + (tm->data[1] - '0') * 100 +
-				(tm->data[2] - '0') * 10 + (tm->data[3] - '0');
-			stamp.tm_year -= 1900;
-			offset = 2;
-		}
+	if ((tm_t = cert_not_after(certificate)) == (time_t)-1) {
+		printf("%s\n", _("CRITICAL - Wrong time format in certificate."));
+		return STATE_CRITICAL;
 	}
-	stamp.tm_mon =
-		(tm->data[2 + offset] - '0') * 10 + (tm->data[3 + offset] - '0') - 1;
-	stamp.tm_mday =
-		(tm->data[4 + offset] - '0') * 10 + (tm->data[5 + offset] - '0');
-	stamp.tm_hour =
-		(tm->data[6 + offset] - '0') * 10 + (tm->data[7 + offset] - '0');
-	stamp.tm_min =
-		(tm->data[8 + offset] - '0') * 10 + (tm->data[9 + offset] - '0');
-	stamp.tm_sec =
-		(tm->data[10 + offset] - '0') * 10 + (tm->data[11 + offset] - '0');
-	stamp.tm_isdst = -1;
 
-	tm_t = timegm(&stamp);
 	time_left = difftime(tm_t, time(NULL));
 	days_left = time_left / 86400;
 	strftime(timestamp, 50, "%F %R %z/%Z", localtime(&tm_t));
 
 	if (days_left > 0 && days_left <= days_till_exp_warn) {
-		printf (_("%s - Certificate '%s' expires in %d day(s) (%s).\n"), (days_left>days_till_exp_crit)?"WARNING":"CRITICAL", cn, days_left, timestamp);
+		printf (_("%s - %s '%s' expires in %d day(s) (%s).\n"), (days_left>days_till_exp_crit)?"WARNING":"CRITICAL", which, cn, days_left, timestamp);
 		if (days_left > days_till_exp_crit)
 			status = STATE_WARNING;
 		else
@@ -333,8 +501,8 @@ int np_net_ssl_check_cert_real(SSL *ssl, int days_till_exp_warn, int days_till_e
 		else
 			time_remaining = (int) time_left / 60;
 
-		printf (_("%s - Certificate '%s' expires in %u %s (%s)\n"),
-			(days_left>days_till_exp_crit) ? "WARNING" : "CRITICAL", cn, time_remaining,
+		printf (_("%s - %s '%s' expires in %u %s (%s)\n"),
+			(days_left>days_till_exp_crit) ? "WARNING" : "CRITICAL", which, cn, time_remaining,
 			time_left >= 3600 ? "hours" : "minutes", timestamp);
 
 		if ( days_left > days_till_exp_crit)
@@ -342,18 +510,37 @@ int np_net_ssl_check_cert_real(SSL *ssl, int days_till_exp_warn, int days_till_e
 		else
 			status = STATE_CRITICAL;
 	} else if (time_left < 0) {
-		printf(_("CRITICAL - Certificate '%s' expired on %s.\n"), cn, timestamp);
+		printf(_("CRITICAL - %s '%s' expired on %s.\n"), which, cn, timestamp);
 		status=STATE_CRITICAL;
 	} else if (days_left == 0) {
-		printf (_("%s - Certificate '%s' just expired (%s).\n"), (days_left>days_till_exp_crit)?"WARNING":"CRITICAL", cn, timestamp);
+		printf (_("%s - %s '%s' just expired (%s).\n"), (days_left>days_till_exp_crit)?"WARNING":"CRITICAL", which, cn, timestamp);
 		if (days_left > days_till_exp_crit)
 			status = STATE_WARNING;
 		else
 			status = STATE_CRITICAL;
 	} else {
-		printf(_("OK - Certificate '%s' will expire in %u days on %s.\n"), cn, days_left, timestamp);
+		printf(_("OK - %s '%s' will expire in %u days on %s.\n"), which, cn, days_left, timestamp);
 		status = STATE_OK;
 	}
+	return status;
+}
+#  endif /* USE_OPENSSL */
+
+int np_net_ssl_check_cert_real(SSL *ssl, int days_till_exp_warn, int days_till_exp_crit){
+#  ifdef USE_OPENSSL
+	X509 *certificate=NULL;
+	int status;
+
+	// Prefix whatever we're about to print with SSL
+	printf("SSL ");
+
+	certificate=SSL_get_peer_certificate(ssl);
+	if (!certificate) {
+		printf("%s\n",_("CRITICAL - Cannot retrieve server certificate."));
+		return STATE_CRITICAL;
+	}
+
+	status = check_cert_expiry(certificate, _("Certificate"), days_till_exp_warn, days_till_exp_crit);
 	X509_free(certificate);
 	return status;
 #  else /* ifndef USE_OPENSSL */
@@ -362,4 +549,139 @@ int np_net_ssl_check_cert_real(SSL *ssl, int days_till_exp_warn, int days_till_e
 #  endif /* USE_OPENSSL */
 }
 
+int np_net_ssl_check_chain(int days_till_exp_warn, int days_till_exp_crit){
+	return np_net_ssl_check_chain_real(s, days_till_exp_warn, days_till_exp_crit);
+}
+
+/* like np_net_ssl_check_cert_real(), but for the certificate of the peer's
+ * chain that expires first */
+int np_net_ssl_check_chain_real(SSL *ssl, int days_till_exp_warn, int days_till_exp_crit){
+#  ifdef USE_OPENSSL
+	STACK_OF(X509) *chain;
+	X509 *certificate, *first = NULL;
+	time_t expiry, first_expiry = 0;
+	char which[64];
+	int i, n, position = 0;
+
+	chain = SSL_get_peer_cert_chain(ssl);
+	if (chain == NULL || (n = sk_X509_num(chain)) == 0)
+		return np_net_ssl_check_cert_real(ssl, days_till_exp_warn, days_till_exp_crit);
+
+	for (i = 0; i < n; i++) {
+		certificate = sk_X509_value(chain, i);
+		expiry = cert_not_after(certificate);
+		if (expiry == (time_t)-1 || first == NULL || expiry < first_expiry) {
+			first = certificate;
+			first_expiry = expiry;
+			position = i;
+			if (expiry == (time_t)-1)
+				break;
+		}
+	}
+
+	printf("SSL ");
+	if (position == 0)
+		snprintf(which, sizeof(which), "%s", _("Certificate"));
+	else
+		snprintf(which, sizeof(which), _("Chain certificate %d/%d"), position + 1, n);
+	return check_cert_expiry(first, which, days_till_exp_warn, days_till_exp_crit);
+#  else /* ifndef USE_OPENSSL */
+	printf("%s\n", _("WARNING - Plugin does not support checking certificates."));
+	return STATE_WARNING;
+#  endif /* USE_OPENSSL */
+}
+
+#  if defined(USE_OPENSSL) && !defined(OPENSSL_NO_OCSP)
+/* seconds of clock difference allowed around thisUpdate and nextUpdate */
+#    define OCSP_VALIDITY_SKEW 300
+
+/* status of the stapled OCSP response for the peer certificate: "none",
+ * "invalid" if it is not signed for the chain, "stale" outside its validity
+ * window, else "good", "revoked" or "unknown" */
+static const char *ocsp_status(SSL *ssl) {
+	const unsigned char *p;
+	long len;
+	OCSP_RESPONSE *response;
+	OCSP_BASICRESP *basic = NULL;
+	OCSP_CERTID *id = NULL;
+	STACK_OF(X509) *chain;
+	X509 *certificate, *issuer = NULL;
+	ASN1_GENERALIZEDTIME *this_update = NULL, *next_update = NULL;
+	const char *status = "unknown";
+	int i, cert_status = -1;
+
+	if ((len = SSL_get_tlsext_status_ocsp_resp(ssl, &p)) <= 0 || p == NULL)
+		return "none";
+	if ((response = d2i_OCSP_RESPONSE(NULL, &p, len)) == NULL)
+		return "invalid";
+	if (OCSP_response_status(response) != OCSP_RESPONSE_STATUS_SUCCESSFUL ||
+	    (basic = OCSP_response_get1_basic(response)) == NULL) {
+		OCSP_RESPONSE_free(response);
+		return "invalid";
+	}
+
+	certificate = SSL_get_peer_certificate(ssl);
+	chain = SSL_get_peer_cert_chain(ssl);
+	for (i = 0; certificate && chain && i < sk_X509_num(chain); i++)
+		if (X509_check_issued(sk_X509_value(chain, i), certificate) == X509_V_OK)
+			issuer = sk_X509_value(chain, i);
+	/* signed by the issuer or a responder it delegated to, against the
+	 * CA paths loaded for the chain verification */
+	if (OCSP_basic_verify(basic, chain, SSL_CTX_get_cert_store(SSL_get_SSL_CTX(ssl)), 0) <= 0)
+		status = "invalid";
+	else if (issuer && (id = OCSP_cert_to_id(NULL, certificate, issuer)) != NULL &&
+	         OCSP_resp_find_status(basic, id, &cert_status, NULL, NULL, &this_update, &next_update)) {
+		if (!OCSP_check_validity(this_update, next_update, OCSP_VALIDITY_SKEW, -1))
+			status = "stale";
+		else if (cert_status == V_OCSP_CERTSTATUS_GOOD)
+			status = "good";
+		else if (cert_status == V_OCSP_CERTSTATUS_REVOKED)
+			status = "revoked";
+	}
+	ERR_clear_error();
+
+	if (id)
+		OCSP_CERTID_free(id);
+	if (certificate)
+		X509_free(certificate);
+	OCSP_BASICRESP_free(basic);
+	OCSP_RESPONSE_free(response);
+	return status;
+}
+#  endif
+
+char *np_net_ssl_info(void) {
+	return np_net_ssl_info_real(s);
+}
+
+/* one line describing a connection: protocol, cipher, ALPN, whether the
+ * session was resumed, chain verification and stapled OCSP status */
+char *np_net_ssl_info_real(SSL *ssl) {
+	char *info = NULL;
+#  ifdef USE_OPENSSL
+	const unsigned char *alpn = NULL;
+	unsigned int alpn_len = 0;
+	long verify;
+
+#    if OPENSSL_VERSION_NUMBER >= 0x10002000L
+	SSL_get0_alpn_selected(ssl, &alpn, &alpn_len);
+#    endif
+	verify = SSL_get_verify_result(ssl);
+	xasprintf(&info, "%s %s, ALPN %.*s, %s, chain %s, OCSP %s",
+	          SSL_get_version(ssl), SSL_get_cipher_name(ssl),
+	          alpn_len ? (int)alpn_len : 4, alpn_len ? (const char *)alpn : "none",
+	          SSL_session_reused(ssl) ? "resumed" : "full handshake",
+	          verify == X509_V_OK ? "verified" : X509_verify_cert_error_string(verify),
+#    ifndef OPENSSL_NO_OCSP
+	          ocsp_status(ssl)
+#    else
+	          "unsupported"
+#    endif
+	          );
+#  else /* ifndef USE_OPENSSL */
+	xasprintf(&info, "%s", SSL_get_cipher_name(ssl));
+#  endif /* USE_OPENSSL */
+	return info;
+}
+
 #endif /* HAVE_SSL */
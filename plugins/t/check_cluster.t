@@ -5,8 +5,10 @@
 #
 
 use strict;
-use Test::More tests => 15;
+use Test::More tests => 34;
 use NPTest;
+use IO::Socket::UNIX;
+use POSIX qw(_exit);
 
 my $result;
 
@@ -80,3 +82,106 @@ $result = NPTest->testCmd(
 	"./check_cluster -h -w 0 -c 1 -d 0,0,1,1"
 	);
 cmp_ok( $result->return_code, '==', 2, "Exit Critical if non-ok hosts exceed critical warning (no ranges)" );
+
+
+#
+# From a status.dat
+#
+my $status = "t/check_cluster.status.dat";
+
+$result = NPTest->testCmd(
+	"./check_cluster -s -f $status -w 0 -c 1"
+	);
+cmp_ok( $result->return_code, '==', 2, "Exit CRITICAL for all services in status.dat" );
+like( $result->output, qr/1 ok, 1 warning, 1 unknown, 1 critical/, "Services counted from status.dat");
+
+$result = NPTest->testCmd(
+	"./check_cluster -s -f $status -m '^web' -M '^HTTP\$' -w 0 -c 1"
+	);
+cmp_ok( $result->return_code, '==', 1, "Exit WARNING for the HTTP services of the web hosts" );
+like( $result->output, qr/1 ok, 0 warning, 0 unknown, 1 critical/, "Only the matching services counted");
+
+$result = NPTest->testCmd(
+	"./check_cluster -h -f $status -m '^web' -w 0 -c 1"
+	);
+cmp_ok( $result->return_code, '==', 1, "Exit WARNING for the web hosts" );
+like( $result->output, qr/1 up, 1 down, 0 unreachable/, "Hosts counted from status.dat");
+
+$result = NPTest->testCmd(
+	"./check_cluster -s -f $status -m '^nosuchhost' -w 0 -c 1"
+	);
+cmp_ok( $result->return_code, '==', 3, "Exit UNKNOWN when no host in status.dat matches" );
+like( $result->output, qr/no members matched/, "No members reported for status.dat");
+
+$result = NPTest->testCmd(
+	"./check_cluster -h -f t/check_cluster.missing -w 0 -c 1"
+	);
+cmp_ok( $result->return_code, '==', 3, "Exit UNKNOWN for a missing status file" );
+
+
+#
+# From a file of states
+#
+$result = NPTest->testCmd(
+	"./check_cluster -s -F t/check_cluster.states -M HTTP -w 0 -c 1"
+	);
+cmp_ok( $result->return_code, '==', 2, "Exit CRITICAL for the HTTP services in the state file" );
+like( $result->output, qr/2 ok, 0 warning, 1 unknown, 1 critical/, "Services counted from the state file");
+
+$result = NPTest->testCmd(
+	"printf '0\n0\n1\n' | ./check_cluster -h -F - -w 0 -c 1"
+	);
+like( $result->output, qr/2 up, 1 down, 0 unreachable/, "Bare states read from stdin");
+
+$result = NPTest->testCmd(
+	"./check_cluster -s -F t/check_cluster.states -M '^NoSuchService\$' -w 0 -c 1"
+	);
+cmp_ok( $result->return_code, '==', 3, "Exit UNKNOWN when no service in the state file matches" );
+like( $result->output, qr/no members matched/, "No members reported for the state file");
+
+
+#
+# From a livestatus socket, answered by a stand-in
+#
+my $socket = "/tmp/check_cluster.$$.sock";
+unlink $socket;
+my $server = IO::Socket::UNIX->new( Local => $socket, Type => SOCK_STREAM, Listen => 1 )
+	or die "Cannot listen on $socket: $!";
+my $pid = fork();
+if ($pid == 0) {
+	while (my $client = $server->accept()) {
+		my $query = "";
+		while (my $line = <$client>) {
+			last if $line eq "\n";
+			$query .= $line;
+		}
+		if ($query =~ /^GET hosts\nColumns: name state\n$/) {
+			print $client "web1;0\nweb2;1\nweb3;2\ndb1;1\n";
+		} elsif ($query =~ /^GET services\nColumns: host_name description state\n$/) {
+			print $client "web1;HTTP;0\nweb2;HTTP;0\ndb1;MySQL;2\n";
+		}
+		close $client;
+	}
+	_exit(0);
+}
+
+$result = NPTest->testCmd(
+	"./check_cluster -h -S $socket -m '^web' -w 0 -c 1"
+	);
+cmp_ok( $result->return_code, '==', 2, "Exit CRITICAL for the web hosts from livestatus" );
+like( $result->output, qr/1 up, 1 down, 1 unreachable/, "Hosts counted from livestatus");
+
+$result = NPTest->testCmd(
+	"./check_cluster -s -S $socket -m '^web' -w 0 -c 1"
+	);
+cmp_ok( $result->return_code, '==', 0, "Exit OK for the services of the web hosts from livestatus" );
+
+$result = NPTest->testCmd(
+	"./check_cluster -s -S $socket -m '^web' -M '^MySQL\$' -w 0 -c 1"
+	);
+cmp_ok( $result->return_code, '==', 3, "Exit UNKNOWN when no service from livestatus matches" );
+like( $result->output, qr/^CLUSTER UNKNOWN: Service cluster: no members matched/, "No members reported for livestatus");
+
+kill 'TERM', $pid;
+waitpid($pid, 0);
+unlink $socket;
@@ -0,0 +1,93 @@
+#! /usr/bin/perl -w -I ..
+#
+# check_log tests
+#
+#
+
+use strict;
+use Test::More tests => 22;
+use NPTest;
+use File::Temp qw(tempdir);
+
+my $dir = tempdir( CLEANUP => 1 );
+my $log = "$dir/test.log";
+my $check = "NAGIOS_PLUGIN_STATE_DIRECTORY=$dir/state ./check_log -F $log -q 'ERROR [0-9]+' -l FATAL -w 2";
+my $result;
+
+sub append {
+	open( my $fh, '>>', $log ) or die "Cannot write $log: $!";
+	print $fh @_;
+	close $fh;
+}
+
+append( "start\nERROR 1 before the first run\n" );
+$result = NPTest->testCmd( $check );
+cmp_ok( $result->return_code, '==', 0, "First run is OK" );
+like( $result->output, qr/initialized/, "First run only initializes" );
+
+$result = NPTest->testCmd( $check );
+cmp_ok( $result->return_code, '==', 0, "OK without new lines" );
+like( $result->output, qr/^Log check ok - 0 pattern matches found\|match=0;;;0 /, "No matches" );
+
+append( "ERROR 2 first\nnothing\nFATAL second\n" );
+$result = NPTest->testCmd( $check );
+cmp_ok( $result->return_code, '==', 1, "WARNING for up to max_warning matches" );
+like( $result->output, qr/^\(2\) FATAL second\|/, "Count and last match" );
+like( $result->output, qr/match=2;;;0 'ERROR \[0-9\]\+'=1;;;0 FATAL=1;;;0$/, "Perfdata for each query" );
+
+append( "ERROR 3\nERROR 3b\nERROR 4\nERROR 5 and a partial FA" );
+$result = NPTest->testCmd( $check );
+cmp_ok( $result->return_code, '==', 2, "CRITICAL for more than max_warning matches" );
+like( $result->output, qr/^\(3\) ERROR 4\|/, "A line without its newline is left for the next run" );
+
+append( "TAL line\n" );
+$result = NPTest->testCmd( $check );
+like( $result->output, qr/^\(1\) ERROR 5 and a partial FATAL line\|.*FATAL=1;;;0$/, "The whole line is read on the next run" );
+
+$result = NPTest->testCmd( "NAGIOS_PLUGIN_STATE_DIRECTORY=$dir/state ./check_log -F $log -l FATAL" );
+like( $result->output, qr/initialized/, "Other arguments have their own state" );
+
+# rotation: the rest of the old log is read, then the new one
+append( "ERROR 6 before rotation\n" );
+rename( $log, "$log.1" ) or die "Cannot rename $log: $!";
+append( "FATAL after rotation\n" );
+$result = NPTest->testCmd( $check );
+like( $result->output, qr/^\(2\) FATAL after rotation\|/, "Rotated log read to its end" );
+
+append( "ERROR 7\n" );
+$result = NPTest->testCmd( $check );
+like( $result->output, qr/^\(1\) ERROR 7\|/, "New log followed after rotation" );
+
+# copytruncate: the log is emptied and written again
+open( my $fh, '>', $log ) or die "Cannot truncate $log: $!";
+close $fh;
+append( "ERROR 8\n" );
+$result = NPTest->testCmd( $check );
+like( $result->output, qr/^\(1\) ERROR 8\|/, "Truncated log read from the start" );
+
+# a log rewritten to the same length is not taken for the same log
+open( $fh, '>', $log ) or die "Cannot truncate $log: $!";
+print $fh "ERROR 9\n";
+close $fh;
+$result = NPTest->testCmd( $check );
+like( $result->output, qr/^\(1\) ERROR 9\|/, "Rewritten log read from the start" );
+
+$result = NPTest->testCmd( "$check -i -q 'error 10'" );
+like( $result->output, qr/initialized/, "Case insensitive check initialized" );
+append( "error 10\n" );
+$result = NPTest->testCmd( "$check -i -q 'error 10'" );
+like( $result->output, qr/^\(1\) error 10\|/, "Case ignored" );
+
+# a query without a literal is tried on every line, the others still are not
+$result = NPTest->testCmd( "$check -q '^[0-9]+\$'" );
+like( $result->output, qr/initialized/, "Check with a query without literals initialized" );
+append( "12345\nnothing\nERROR 11\n" );
+$result = NPTest->testCmd( "$check -q '^[0-9]+\$'" );
+like( $result->output, qr/^\(2\) ERROR 11\|.* \^\[0-9\]\+\$=1;;;0$/, "Queries with and without literals" );
+
+$result = NPTest->testCmd( "./check_log -F $dir/missing.log -q ERROR" );
+cmp_ok( $result->return_code, '==', 3, "UNKNOWN for a missing log" );
+like( $result->output, qr/does not exist/, "Missing log reported" );
+
+$result = NPTest->testCmd( "./check_log -F $log" );
+cmp_ok( $result->return_code, '==', 3, "UNKNOWN without a query" );
@@ -0,0 +1,69 @@
+#! /usr/bin/perl -w -I ..
+#
+# check_mrtg and check_mrtgtraf tests
+#
+#
+
+use strict;
+use Test::More tests => 17;
+use NPTest;
+use File::Temp qw(tempfile);
+
+my $result;
+my $now = time;
+
+# An MRTG log with a sample every five minutes, newest first: the average
+# of the first variable rising by ten a sample back in time from 10, its
+# maximum falling from 1000, the second variable at 5 and 7
+sub mrtg_log {
+	my ($newest) = @_;
+	my ($fh, $file) = tempfile( UNLINK => 1 );
+	print $fh "$newest 123456789 987654321\n";
+	for my $i (0 .. 599) {
+		printf $fh "%d %d 5 %d 7\n", $newest - 300 * $i, 10 * ($i + 1), 1000 - $i;
+	}
+	close $fh;
+	return $file;
+}
+
+my $log = mrtg_log($now);
+
+$result = NPTest->testCmd( "./check_mrtg -F $log -v 1 -w 50 -c 100" );
+cmp_ok( $result->return_code, '==', 0, "Newest sample OK" );
+like( $result->output, '/^OK - Avg\. value = 10 /', "Newest average" );
+
+$result = NPTest->testCmd( "./check_mrtg -F $log -v 1 -w 50 -c 100 -W 15" );
+cmp_ok( $result->return_code, '==', 0, "Average of a window OK" );
+like( $result->output, '/^OK - Avg over 15 minutes\. value = 20 /', "Average of three samples" );
+
+$result = NPTest->testCmd( "./check_mrtg -F $log -v 1 -w 100 -c 200 -W 60" );
+like( $result->output, '/value = 65 /', "Average of an hour" );
+
+$result = NPTest->testCmd( "./check_mrtg -F $log -v 1 -w 50 -c 100 -W 15 -a MAX" );
+cmp_ok( $result->return_code, '==', 2, "Maximum of a window CRITICAL" );
+like( $result->output, '/^CRITICAL - Max over 15 minutes\. value = 1000 /', "Maximum of three samples" );
+
+$result = NPTest->testCmd( "./check_mrtg -F $log -v 1 -w 100 -c 200 -W 60 -a P90" );
+cmp_ok( $result->return_code, '==', 1, "Percentile of a window WARNING" );
+like( $result->output, '/^WARNING - 90th percentile over 60 minutes\. value = 110 /', "90th percentile of an hour" );
+
+$result = NPTest->testCmd( "./check_mrtg -F $log -v 2 -w 50 -c 100 -W 1440 -l out -u B" );
+like( $result->output, '/out = 5 B\|out=5B;50;100/', "Second variable with label and units" );
+
+my $old = mrtg_log($now - 3600);
+$result = NPTest->testCmd( "./check_mrtg -F $old -v 1 -w 50 -c 100 -e 30 -W 15" );
+cmp_ok( $result->return_code, '==', 1, "Expired data WARNING" );
+like( $result->output, '/^MRTG data has expired \(60 minutes old\)/', "Expired data output" );
+
+$result = NPTest->testCmd( "./check_mrtg -F /nonexistent/mrtg.log -v 1 -w 50 -c 100" );
+cmp_ok( $result->return_code, '==', 3, "Missing log UNKNOWN" );
+
+$result = NPTest->testCmd( "./check_mrtgtraf -F $log -w 100,100 -c 200,200" );
+like( $result->output, '/^Traffic OK - Avg\. In = 10\.0 B\/s, Avg\. Out = 5\.0 B\/s/', "Newest traffic" );
+
+$result = NPTest->testCmd( "./check_mrtgtraf -F $log -w 15,100 -c 200,200 -W 15" );
+cmp_ok( $result->return_code, '==', 1, "Traffic average of a window WARNING" );
+like( $result->output, '/^Traffic WARNING - Avg over 15 minutes\. In = 20\.0 B\/s/', "Traffic average of three samples" );
+
+$result = NPTest->testCmd( "./check_mrtgtraf -F $log -w 100,100 -c 200,200 -W 15 -a MAX" );
+like( $result->output, '/^Traffic CRITICAL - Max over 15 minutes\. In = 1000\.0 B\/s, Max over 15 minutes\. Out = 7\.0 B\/s/', "Traffic maximum of a window" );
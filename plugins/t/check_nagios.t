@@ -11,7 +11,7 @@ use NPTest;
 if (`uname -s` eq "SunOS\n") {
         plan skip_all => "Ignoring tests on solaris because of pst3";
 } else {
-        plan tests => 13;
+        plan tests => 17;
 }
 
 my $successOutput = '/^NAGIOS OK: /';
@@ -23,11 +23,18 @@ my $nagios2 = "t/check_nagios.nagios2.status.dat";
 
 my $result;
 
-# Did use init, but MacOSX 10.4 replaces init with launchd
-# Alternative is to insist that nagios is running to run this test
-# Reasonable to expect cron because build servers will 
-# invoke cron to run a build
-my $procname = "cron";
+# Did use init, but MacOSX 10.4 replaces init with launchd, and cron
+# is not running everywhere a build is, so start a process of our own
+# with a name nothing else has in its arguments
+my $procname = "check_nagios_test_$$";
+my $pid = fork;
+die "Cannot fork: $!" unless defined $pid;
+if ($pid == 0) {
+	exec "perl", "-e", "sleep 300", $procname;
+	exit 1;
+}
+END { kill 'TERM', $pid if $pid; }
+sleep 1;
 
 $result = NPTest->testCmd(
 	"./check_nagios -F $nagios1 -e 5 -C $procname"
@@ -90,3 +97,32 @@ $result = NPTest->testCmd(
 cmp_ok( $result->return_code, "==", 2, "Invalid log file" );
 
 
+
+# created= is looked for at the top of status.dat first, but found
+# further down as well
+my $created = "created" . "=";
+open(my $in, "<", "$nagios2.tmp") or die "Cannot read $nagios2.tmp: $!";
+my $status = do { local $/; <$in> };
+close $in;
+open(my $out, ">", "$nagios2.tmp") or die "Cannot write $nagios2.tmp: $!";
+print $out "# padding\n" x 10000;
+print $out $status;
+close $out;
+$result = NPTest->testCmd(
+	"./check_nagios -F $nagios2.tmp -e 1 -C $procname"
+	);
+cmp_ok( $result->return_code, "==", 1, "Nagios2 log with $created past the header scan" );
+($age) = ($_ = $result->output) =~ /status log updated (\d+) seconds ago/;
+like( $age, '/^6[0-9]$/', "Time read from the $created line" );
+
+$result = NPTest->testCmd(
+	"./check_nagios -vv -F $nagios2.tmp -e 5 -C $procname"
+	);
+like( $result->output, "/Found process: .*$procname/", "Own process found" );
+
+open($out, ">", "$nagios1.tmp") or die "Cannot write $nagios1.tmp: $!";
+close $out;
+$result = NPTest->testCmd(
+	"./check_nagios -F $nagios1.tmp -e 5 -C $procname"
+	);
+cmp_ok( $result->return_code, "==", 2, "Empty log file" );
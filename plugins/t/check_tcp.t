@@ -6,12 +6,13 @@
 
 use strict;
 use Test;
+use IO::Socket::INET;
 
 use vars qw($tests $has_ipv6);
 BEGIN {
     use NPTest;
     $has_ipv6 = NPTest::has_ipv6();
-    $tests = $has_ipv6 ? 14 : 11;
+    $tests = $has_ipv6 ? 20 : 17;
 }
 
 
@@ -52,6 +53,38 @@ if($internet_access ne "no") {
 # so that perl doesn't interpret the \r\n and is passed onto command line correctly
 $t += checkCmd( "./check_tcp $host_tcp_http      -p 80 -E -s ".'"GET / HTTP/1.1\r\n\r\n"'." -e 'ThisShouldntMatch' -j", 1, $failedExpect );
 
+# --target batch mode against a local server answering "got " and the line it reads
+my $server = IO::Socket::INET->new(Listen => 5, LocalAddr => '127.0.0.1', LocalPort => 0, ReuseAddr => 1)
+    or die "Cannot listen: $!";
+my $port = $server->sockport;
+my $closed = IO::Socket::INET->new(Listen => 1, LocalAddr => '127.0.0.1', LocalPort => 0)
+    or die "Cannot listen: $!";
+my $closed_port = $closed->sockport;
+close $closed;
+my $server_pid = fork;
+if ($server_pid == 0) {
+    $SIG{CHLD} = 'IGNORE';
+    while (my $client = $server->accept) {
+        if (fork == 0) {
+            my $line = <$client>;
+            print $client "got $line" if defined $line;
+            exit 0;
+        }
+        close $client;
+    }
+    exit 0;
+}
+close $server;
+
+# -E escapes the send strings of targets given before it
+$t += checkCmd( "./check_tcp -t 5 --target 'localhost:$port:hello\\n:got hello' -E", 0, "/TCP OK - localhost port $port: .* \\[got hello\\]/" );
+$t += checkCmd( "./check_tcp -t 5 --target 'localhost:$port:hello\\n:got hello' --target 127.0.0.1:$closed_port -E", 2,
+                "/1 ok, 0 warning, 1 critical, 0 unknown/" );
+# resolver errors are reported as such
+$t += checkCmd( "./check_tcp -t 5 --target nosuchhost.invalid:80", 2, "/^TCP CRITICAL - nosuchhost.invalid port 80: (?!No route to host)/" );
+kill 'TERM', $server_pid;
+waitpid $server_pid, 0;
+
 # IPv6 checks
 if($has_ipv6) {
   $t += checkCmd( "./check_tcp $host_tcp_http      -p 80 -wt 300 -ct 600 -6 ",   0, $successOutput );
@@ -13,7 +13,8 @@ use Test;
 use NPTest;
 
 use vars qw($tests);
-BEGIN {$tests = 4; plan tests => $tests}
+# the utmp and wtmp files below are written as glibc lays them out
+BEGIN {$tests = ($^O eq "linux") ? 20 : 4; plan tests => $tests}
 
 my $successOutput = '/^USERS OK - [0-9]+ users currently logged in/';
 my $failureOutput = '/^USERS CRITICAL - [0-9]+ users currently logged in/';
@@ -23,6 +24,54 @@ my $t;
 $t += checkCmd( "./check_users 1000 1000", 0, $successOutput );
 $t += checkCmd( "./check_users    0    0", 2, $failureOutput );
 
+if ($^O eq "linux") {
+	my $now = time;
+	my ($utmp, $wtmp) = ("/tmp/check_users_utmp.$$", "/tmp/check_users_wtmp.$$");
+
+	# struct utmpx: type, pid, line, id, user, host, exit, session, time, address
+	sub utmpx {
+		my ($type, $line, $user, $time) = @_;
+		return pack("s x2 l a32 a4 a32 a256 s s l l l l4 x20",
+			$type, 1000, $line, "", $user, "localhost", 0, 0, 0, $time, 0, 0, 0, 0, 0);
+	}
+
+	open(my $fh, ">", $utmp) or die "Cannot write $utmp: $!";
+	print $fh utmpx(2, "~", "reboot", $now - 86400);
+	print $fh utmpx(7, "pts/1", "alice", $now);
+	print $fh utmpx(7, "pts/0", "alice", $now);
+	print $fh utmpx(6, "tty2", "LOGIN", $now);
+	print $fh utmpx(7, "pts/2", "bob", $now);
+	print $fh utmpx(8, "pts/3", "carol", $now);
+	print $fh utmpx(7, "tty1", "alice", $now);
+	close $fh;
+
+	# a day of old logins, then one every ten minutes up to now, and a
+	# record still being written
+	open($fh, ">", $wtmp) or die "Cannot write $wtmp: $!";
+	for my $i (reverse 0 .. 999) {
+		print $fh utmpx(7, "pts/9", "old", $now - 7200 - 60 * $i);
+		print $fh utmpx(8, "pts/9", "", $now - 7200 - 60 * $i);
+	}
+	for my $i (reverse 0 .. 4) {
+		print $fh utmpx(7, "pts/8", "new", $now - 600 * $i);
+		print $fh utmpx(8, "pts/8", "", $now - 600 * $i);
+	}
+	print $fh substr(utmpx(7, "pts/7", "partial", $now), 0, 100);
+	close $fh;
+
+	$t += checkCmd( "./check_users -f $utmp -w 10 -c 20", 0, '/^USERS OK - 4 users currently logged in \|users=4;10;20;0$/' );
+	$t += checkCmd( "./check_users -f $utmp -w 1 -c 5 -m users", 1,
+		'/^USERS WARNING - 2 distinct users logged in, 4 sessions \|distinct_users=2;1;5;0 max_sessions=3;;;0 users=4;;;0$/' );
+	$t += checkCmd( "./check_users -f $utmp -w 2 -c 3 -m per-user", 1, '/^USERS WARNING - at most 3 sessions per user \(alice\), 4 sessions/' );
+	$t += checkCmd( "./check_users -f $utmp -w 10 -c 20 -v", 0, '/\nalice: 3 sessions on pts\/0, pts\/1, tty1\nbob: 1 session on pts\/2$/' );
+	$t += checkCmd( "./check_users -F $wtmp -w 3 -c 10 -m logins", 1, '/^USERS WARNING - 5 logins in the last 60 minutes \|logins=5;3;10;0$/' );
+	$t += checkCmd( "./check_users -F $wtmp -w 3 -c 10 -m logins -W 15", 0, '/^USERS OK - 2 logins in the last 15 minutes/' );
+	$t += checkCmd( "./check_users -F $wtmp -w 3 -c 10 -m logins -W 1440", 2, '/ 1005 logins in the last 1440 minutes/' );
+
+	unlink $utmp, $wtmp;
+	$t += checkCmd( "./check_users -F $wtmp -w 3 -c 10 -m logins", 3, '/^Could not read/' );
+}
+
 exit(0) if defined($Test::Harness::VERSION);
 exit($tests - $t);
 
@@ -0,0 +1,185 @@
+#! /usr/bin/perl -w -I ..
+#
+# Startup latency and resource use of the plugins, run against local
+# stand-ins: TCP, SMTP and HTTP listeners forked here, the input files under t/
+# and tests/var, and snmpd with tests/conf/snmpd.conf when it is installed.
+#
+# Usage: perl tests/bench.pl [-n runs] [-o results.json] [-b baseline.json]
+#                            [-t tolerance] [name ...]
+#
+# Run from the plugins build directory, or with "make bench".  The results
+# are written as JSON; with -b, every benchmark whose median wall time, CPU
+# time, maximum RSS, system calls or allocations grew by more than the
+# tolerance (default 20%) over the baseline is reported and the exit status
+# is 1.
+#
+
+use strict;
+use Getopt::Std;
+use IO::Socket::INET;
+use JSON::PP;
+use POSIX qw(strftime);
+
+my %opts;
+getopts('n:o:b:t:', \%opts)
+	or die "Usage: $0 [-n runs] [-o results.json] [-b baseline.json] [-t tolerance] [name ...]\n";
+my $runs = $opts{n} || 100;
+my $results_file = $opts{o} || "bench-results.json";
+my $tolerance = defined $opts{t} ? $opts{t} : 20;
+
+my $runner = "./tests/bench_run";
+my $alloc = "./tests/bench_alloc.so";
+-x $runner or die "$runner not found, run 'make bench'\n";
+
+# stand-ins the benchmarks can ask for, started on demand
+my %servers;
+my @pids;
+
+END {
+	kill "TERM", @pids if @pids;
+}
+
+sub listener {
+	my ($reply) = @_;
+	my $sock = IO::Socket::INET->new(Listen => 128, LocalAddr => "127.0.0.1",
+	                                 LocalPort => 0, ReuseAddr => 1, Proto => "tcp")
+		or die "Cannot listen: $!\n";
+	my $pid = fork;
+	die "fork: $!\n" unless defined $pid;
+	if ($pid == 0) {
+		while (my $client = $sock->accept) {
+			$reply->($client);
+			close $client;
+		}
+		exit 0;
+	}
+	push @pids, $pid;
+	return $sock->sockport;
+}
+
+my %start = (
+	# a banner, then whatever the client says is ignored
+	tcp => sub {
+		return listener(sub { print { $_[0] } "220 bench ready\r\n" });
+	},
+	# 250 to every command until QUIT
+	smtp => sub {
+		return listener(sub {
+			my $client = shift;
+			print $client "220 bench ESMTP\r\n";
+			while (defined(my $line = <$client>)) {
+				if ($line =~ /^QUIT/i) {
+					print $client "221 bye\r\n";
+					last;
+				}
+				print $client "250 ok\r\n";
+			}
+		});
+	},
+	http => sub {
+		return listener(sub {
+			my $client = shift;
+			while (defined(my $line = <$client>)) {
+				last if $line =~ /^\r?\n$/;
+			}
+			print $client "HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\n" .
+			              "Content-Length: 3\r\nConnection: close\r\n\r\nok\n";
+		});
+	},
+	snmp => sub {
+		return undef unless system("snmpd -v >/dev/null 2>&1") == 0;
+		my $port = 16100 + int(rand(100));
+		my $pid = fork;
+		die "fork: $!\n" unless defined $pid;
+		if ($pid == 0) {
+			open(STDOUT, ">", "/dev/null");
+			open(STDERR, ">", "/dev/null");
+			exec("snmpd -c tests/conf/snmpd.conf -C -f -r udp:$port");
+			exit 127;
+		}
+		push @pids, $pid;
+		sleep(1);
+		return $port;
+	},
+);
+
+# name, plugin, arguments (%PORT% is the stand-in's port), stand-in
+my @benchmarks = (
+	[ "dummy", "check_dummy", "0 ok" ],
+	[ "load", "check_load", "-w 99,99,99 -c 99,99,99" ],
+	[ "users", "check_users", "-w 1000 -c 2000" ],
+	[ "disk", "check_disk", "-w 1% -c 1% -p /" ],
+	[ "procs", "check_procs", "--input-file=tests/var/ps_axwo.debian" ],
+	[ "apt", "check_apt", "--input-file=t/check_apt_input/debian1" ],
+	[ "nagios", "check_nagios", "-F t/check_nagios.nagios2.status.dat -e 99999999 -C perl" ],
+	[ "tcp", "check_tcp", "-H 127.0.0.1 -p %PORT% -e 220", "tcp" ],
+	[ "smtp", "check_smtp", "-H 127.0.0.1 -p %PORT%", "smtp" ],
+	[ "http", "check_http", "-H 127.0.0.1 -p %PORT% -u / -s ok", "http" ],
+	[ "http_multicall", "tests/np_multicall", "check_http -H 127.0.0.1 -p %PORT% -u /", "http" ],
+	[ "snmp", "check_snmp", "-H 127.0.0.1 -C public -p %PORT% -o sysContact.0", "snmp" ],
+);
+
+my %only = map { $_ => 1 } @ARGV;
+my %results;
+
+printf "%-15s %6s %9s %9s %8s %8s %8s %8s %9s\n",
+	"benchmark", "status", "median", "p95", "user", "sys", "maxrss", "syscalls", "allocs";
+
+foreach my $b (@benchmarks) {
+	my ($name, $plugin, $args, $server) = @$b;
+	next if %only && !$only{$name};
+	unless (-x "./$plugin") {
+		print "$name: skipped, no $plugin compiled\n";
+		next;
+	}
+	if ($server) {
+		$servers{$server} = $start{$server}->() unless exists $servers{$server};
+		unless (defined $servers{$server}) {
+			print "$name: skipped, no $server stand-in\n";
+			next;
+		}
+		$args =~ s/%PORT%/$servers{$server}/g;
+	}
+
+	my $line = `$runner -n $runs -s @{[ -f $alloc ? "-a $alloc" : "" ]} ./$plugin $args`;
+	my %r = $line =~ /(\w+)=(-?\d+)/g;
+	$r{command} = "$plugin $args";
+	$results{$name} = \%r;
+
+	printf "%-15s %6d %9d %9d %8d %8d %8d %8s %9s\n", $name,
+		@r{qw(status wall_median wall_p95 user sys maxrss)},
+		defined $r{syscalls} ? $r{syscalls} : "-", defined $r{allocs} ? $r{allocs} : "-";
+}
+print "(times in microseconds, maxrss in kB)\n";
+
+my $json = JSON::PP->new->canonical->pretty;
+open(my $fh, ">", $results_file) or die "Cannot write $results_file: $!\n";
+print $fh $json->encode({
+	date => strftime("%Y-%m-%dT%H:%M:%SZ", gmtime),
+	runs => $runs,
+	benchmarks => \%results,
+});
+close $fh;
+print "results written to $results_file\n";
+
+exit 0 unless $opts{b};
+
+open($fh, "<", $opts{b}) or die "Cannot read $opts{b}: $!\n";
+my $baseline = $json->decode(do { local $/; <$fh> })->{benchmarks};
+close $fh;
+
+my $regressions = 0;
+foreach my $name (sort keys %results) {
+	next unless $baseline->{$name};
+	foreach my $key (qw(wall_median user sys maxrss syscalls allocs)) {
+		my ($old, $new) = ($baseline->{$name}{$key}, $results{$name}{$key});
+		next unless defined $old && defined $new && $old > 0;
+		my $change = ($new - $old) * 100 / $old;
+		if ($change > $tolerance) {
+			printf "REGRESSION %s %s: %d -> %d (+%.0f%%)\n", $name, $key, $old, $new, $change;
+			$regressions++;
+		}
+	}
+}
+print $regressions ? "$regressions regressions over $tolerance%\n" : "no regressions over $tolerance%\n";
+exit($regressions ? 1 : 0);
@@ -0,0 +1,84 @@
+/*****************************************************************************
+*
+* bench_alloc - allocation counter preloaded by bench_run -a
+*
+* License: GPL
+* Copyright (c) 2018 Nagios Plugins Development Team
+*
+* Counts the malloc, calloc and realloc calls of a program and the bytes
+* asked for, and writes "allocs=N alloc_bytes=N" at exit to the descriptor
+* in NP_BENCH_ALLOC_FD.  Only the preloaded process itself is counted: the
+* programs it runs do not inherit the preload.  glibc only, as it relies on
+* the __libc_* allocator entry points.
+*
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*
+*****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+extern void *__libc_malloc (size_t);
+extern void *__libc_calloc (size_t, size_t);
+extern void *__libc_realloc (void *, size_t);
+
+static unsigned long allocs, alloc_bytes;
+static pid_t counted_pid;
+static int report_fd = -1;
+
+void *
+malloc (size_t size)
+{
+	allocs++;
+	alloc_bytes += size;
+	return __libc_malloc (size);
+}
+
+void *
+calloc (size_t nmemb, size_t size)
+{
+	allocs++;
+	alloc_bytes += nmemb * size;
+	return __libc_calloc (nmemb, size);
+}
+
+void *
+realloc (void *ptr, size_t size)
+{
+	allocs++;
+	alloc_bytes += size;
+	return __libc_realloc (ptr, size);
+}
+
+__attribute__((constructor)) static void
+bench_alloc_init (void)
+{
+	char *fd = getenv ("NP_BENCH_ALLOC_FD");
+
+	counted_pid = getpid ();
+	if (fd != NULL)
+		report_fd = atoi (fd);
+	unsetenv ("LD_PRELOAD");
+	unsetenv ("NP_BENCH_ALLOC_FD");
+}
+
+__attribute__((destructor)) static void
+bench_alloc_report (void)
+{
+	if (report_fd >= 0 && getpid () == counted_pid)
+		dprintf (report_fd, "allocs=%lu alloc_bytes=%lu\n", allocs, alloc_bytes);
+}
@@ -0,0 +1,121 @@
+#! /usr/bin/perl -w
+#
+# Throughput of check_log over a synthetic log, with and without the
+# literal prefilter that picks the lines worth running the regular
+# expressions on (NAGIOS_PLUGIN_LOG_PREFILTER=no turns it off).
+#
+# Usage: perl tests/bench_log.pl [-s megabytes] [-n runs] [-d directory]
+#
+# Run from the plugins build directory, or with "make bench-log".  The log
+# (1024 MB by default) is written to a temporary directory under -d, or
+# $TMPDIR, and removed afterwards.  Both runs must report the same matches.
+#
+
+use strict;
+use Getopt::Std;
+use File::Temp qw(tempdir);
+use Time::HiRes qw(time);
+
+my %opts;
+getopts('s:n:d:', \%opts)
+	or die "Usage: $0 [-s megabytes] [-n runs] [-d directory]\n";
+my $size = ($opts{s} || 1024) * 1024 * 1024;
+my $runs = $opts{n} || 1;
+-x "./check_log" or die "./check_log not found, run 'make bench-log'\n";
+
+my $dir = tempdir("bench_log.XXXXXX", DIR => $opts{d} || $ENV{TMPDIR} || "/tmp", CLEANUP => 1);
+my $log = "$dir/app.log";
+my $data = "$dir/app.log.data";
+
+# error signatures, as a service might be set up to look for
+my @queries = (
+	"-q 'ERROR .*connection refused'",
+	"-q 'FATAL'",
+	"-q 'java\\.lang\\.OutOfMemoryError'",
+	"-q 'segfault at [0-9a-f]+ ip'",
+	"-q 'Timeout after [0-9]+ ms'",
+	"-l 'No space left on device'",
+	"-q 'deadlock detected|lock wait timeout'",
+	"-q 'authentication failure for user [a-z]+'",
+);
+
+# mostly ordinary lines, and about one in ten thousand with a signature
+my @ordinary = map {
+	sprintf("2026-10-19T12:%02d:%02d.%03dZ %-5s [worker-%d] %s", $_ % 60, ($_ * 7) % 60, $_ % 1000,
+		(qw(INFO DEBUG INFO WARN TRACE))[$_ % 5], $_ % 32,
+		(
+			"GET /api/v1/orders/$_ 200 12ms user=customer$_",
+			"cache hit ratio 0.97 for region eu-west-$_, 1532 entries evicted",
+			"scheduled job report-$_ finished in 1834 ms, next run in 300 s",
+			"POST /api/v1/login 302 4ms session=5f2c1a$_ remote=10.0.$_.12",
+			"pool stats: active=12 idle=4 waiting=0 max=32 connection reuse=$_",
+		)[$_ % 5])
+} 1 .. 1000;
+my @signatures = (
+	"ERROR [db] connection refused by 10.0.0.5:5432",
+	"FATAL worker crashed, restarting",
+	"Exception in thread main java.lang.OutOfMemoryError: Java heap space",
+	"kernel: app[1234]: segfault at 7f3a2c ip 0000 sp 0000 error 4",
+	"Timeout after 30000 ms waiting for upstream",
+	"write failed: No space left on device",
+	"ERROR: deadlock detected while updating orders",
+	"sshd: authentication failure for user admin",
+);
+
+print "writing a ", $size / 1024 / 1024, " MB log\n";
+open(my $fh, ">", $data) or die "Cannot write $data: $!\n";
+my ($written, $expected) = (0, 0);
+srand(1);
+while ($written < $size) {
+	my $block = "";
+	for (1 .. 10000) {
+		if (rand() < 0.0001) {
+			$block .= $signatures[int(rand(@signatures))] . "\n";
+			$expected++;
+		} else {
+			$block .= $ordinary[int(rand(@ordinary))] . "\n";
+		}
+	}
+	print $fh $block;
+	$written += length($block);
+}
+close $fh;
+
+my $check = "./check_log -t 3600 -F $log @queries";
+
+# the state says the log was empty, then the data is put in its place
+sub run {
+	my ($env) = @_;
+	system("rm -rf $dir/state");
+	open(my $empty, ">", $log) or die "Cannot write $log: $!\n";
+	close $empty;
+	`NAGIOS_PLUGIN_STATE_DIRECTORY=$dir/state $env $check`;
+	rename($data, $log) or die "Cannot rename $data: $!\n";
+	my $start = time;
+	my $output = `NAGIOS_PLUGIN_STATE_DIRECTORY=$dir/state $env $check`;
+	my $elapsed = time - $start;
+	rename($log, $data) or die "Cannot rename $log: $!\n";
+	return ($elapsed, $output);
+}
+
+my %results;
+foreach my $mode ([ "regexec", "NAGIOS_PLUGIN_LOG_PREFILTER=no" ], [ "prefilter", "" ]) {
+	my ($name, $env) = @$mode;
+	my ($best, $output);
+	for (1 .. $runs) {
+		my ($elapsed, $out) = run($env);
+		$best = $elapsed if !defined $best || $elapsed < $best;
+		$output = $out;
+	}
+	$results{$name} = [ $best, $output ];
+	printf "%-10s %8.2f s %9.1f MB/s\n", $name, $best, $written / 1024 / 1024 / $best;
+}
+
+my ($matches) = $results{prefilter}[1] =~ /^\((\d+)\)/;
+printf "speedup    %8.1fx\n", $results{regexec}[0] / $results{prefilter}[0];
+printf "%d matching lines of %d written\n", $matches || 0, $expected;
+if ($results{regexec}[1] ne $results{prefilter}[1]) {
+	print "MISMATCH\n  regexec:   $results{regexec}[1]  prefilter: $results{prefilter}[1]";
+	exit 1;
+}
+exit 0;
@@ -0,0 +1,211 @@
+/*****************************************************************************
+*
+* bench_run - resource use of a plugin, for tests/bench.pl
+*
+* License: GPL
+* Copyright (c) 2018 Nagios Plugins Development Team
+*
+* Usage: bench_run [-n runs] [-s] [-a bench_alloc.so] command [args...]
+*
+* Runs the command the given number of times with its output thrown away
+* and prints one line of key=value pairs: the exit status of the last run,
+* the median, 95th percentile and minimum wall time, the mean user and
+* system CPU time (all in microseconds) and the largest maximum RSS (kB).
+*
+* The timed runs are not instrumented.  -s adds one run under ptrace that
+* counts the system calls of the command itself, not of the programs it
+* starts; -a adds one run with the allocation counter preloaded.
+*
+*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*
+*****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#ifdef __linux__
+# include <sys/ptrace.h>
+#endif
+
+static char **command;
+
+static long
+usec (struct timeval tv)
+{
+	return tv.tv_sec * 1000000L + tv.tv_usec;
+}
+
+static int
+cmp_long (const void *a, const void *b)
+{
+	long x = *(const long *)a, y = *(const long *)b;
+	return x < y ? -1 : x > y;
+}
+
+/* in the child: output to /dev/null, then exec the command */
+static void
+child_exec (void)
+{
+	int null = open ("/dev/null", O_RDWR);
+
+	if (null >= 0) {
+		dup2 (null, STDIN_FILENO);
+		dup2 (null, STDOUT_FILENO);
+		dup2 (null, STDERR_FILENO);
+		close (null);
+	}
+	execv (command[0], command);
+	_exit (127);
+}
+
+#ifdef __linux__
+/* system calls made by one run of the command, or -1 */
+static long
+count_syscalls (void)
+{
+	long stops = 0;
+	int status, sig = 0;
+	pid_t pid;
+
+	if ((pid = fork ()) < 0)
+		return -1;
+	if (pid == 0) {
+		ptrace (PTRACE_TRACEME, 0, NULL, NULL);
+		child_exec ();
+	}
+
+	/* stopped at the exec */
+	if (waitpid (pid, &status, 0) < 0 || !WIFSTOPPED (status))
+		return -1;
+	ptrace (PTRACE_SETOPTIONS, pid, NULL, (void *)(long)(PTRACE_O_TRACESYSGOOD | PTRACE_O_EXITKILL));
+
+	while (ptrace (PTRACE_SYSCALL, pid, NULL, (void *)(long)sig) == 0) {
+		if (waitpid (pid, &status, 0) < 0 || WIFEXITED (status) || WIFSIGNALED (status))
+			break;
+		sig = 0;
+		if (WSTOPSIG (status) == (SIGTRAP | 0x80))
+			stops++;
+		else if (WSTOPSIG (status) != SIGTRAP)
+			sig = WSTOPSIG (status);
+	}
+	/* one stop on entry and one on exit, except for the final exit */
+	return (stops + 1) / 2;
+}
+#endif
+
+/* "allocs=N alloc_bytes=N" from one run with the counter preloaded */
+static int
+count_allocs (const char *preload, char *out, size_t size)
+{
+	char fd[16];
+	int fds[2], status;
+	ssize_t n;
+	pid_t pid;
+
+	if (pipe (fds) < 0 || (pid = fork ()) < 0)
+		return -1;
+	if (pid == 0) {
+		close (fds[0]);
+		snprintf (fd, sizeof (fd), "%d", fds[1]);
+		setenv ("NP_BENCH_ALLOC_FD", fd, 1);
+		setenv ("LD_PRELOAD", preload, 1);
+		child_exec ();
+	}
+	close (fds[1]);
+	n = read (fds[0], out, size - 1);
+	close (fds[0]);
+	waitpid (pid, &status, 0);
+	if (n <= 0)
+		return -1;
+	out[n] = '\0';
+	out[strcspn (out, "\n")] = '\0';
+	return 0;
+}
+
+int
+main (int argc, char **argv)
+{
+	struct timeval start, end;
+	struct rusage ru;
+	long *wall, user = 0, sys = 0, maxrss = 0;
+	char *preload = NULL, allocs[128];
+	int runs = 100, syscalls = 0, status = 0, c, i;
+	pid_t pid;
+
+	while ((c = getopt (argc, argv, "+n:sa:")) != -1) {
+		switch (c) {
+		case 'n':
+			runs = atoi (optarg);
+			break;
+		case 's':
+			syscalls = 1;
+			break;
+		case 'a':
+			preload = optarg;
+			break;
+		default:
+			fprintf (stderr, "Usage: %s [-n runs] [-s] [-a bench_alloc.so] command [args...]\n", argv[0]);
+			return 2;
+		}
+	}
+	if (optind >= argc || runs < 1) {
+		fprintf (stderr, "Usage: %s [-n runs] [-s] [-a bench_alloc.so] command [args...]\n", argv[0]);
+		return 2;
+	}
+	command = argv + optind;
+
+	if ((wall = calloc (runs, sizeof (long))) == NULL)
+		return 2;
+
+	for (i = 0; i < runs; i++) {
+		gettimeofday (&start, NULL);
+		if ((pid = fork ()) < 0) {
+			perror ("fork");
+			return 2;
+		}
+		if (pid == 0)
+			child_exec ();
+		if (wait4 (pid, &status, 0, &ru) < 0) {
+			perror ("wait4");
+			return 2;
+		}
+		gettimeofday (&end, NULL);
+		wall[i] = usec (end) - usec (start);
+		user += usec (ru.ru_utime);
+		sys += usec (ru.ru_stime);
+		if (ru.ru_maxrss > maxrss)
+			maxrss = ru.ru_maxrss;
+	}
+	qsort (wall, runs, sizeof (long), cmp_long);
+
+	printf ("status=%d runs=%d wall_median=%ld wall_p95=%ld wall_min=%ld user=%ld sys=%ld maxrss=%ld",
+	        WIFEXITED (status) ? WEXITSTATUS (status) : -1, runs,
+	        wall[runs / 2], wall[runs * 95 / 100], wall[0], user / runs, sys / runs, maxrss);
+#ifdef __linux__
+	if (syscalls)
+		printf (" syscalls=%ld", count_syscalls ());
+#endif
+	if (preload && count_allocs (preload, allocs, sizeof (allocs)) == 0)
+		printf (" %s", allocs);
+	printf ("\n");
+	return 0;
+}
@@ -118,7 +118,8 @@ like($res->output, '/'.quotemeta('SNMP OK - And now have fun with with this: \"C
 "And now have fun with with this: \"C:\\\\\"
 because we\'re not done yet!"').'/m', "Attempt to confuse parser No.3");
 
-system("rm -f ".$ENV{'NAGIOS_PLUGIN_STATE_DIRECTORY'}."/check_snmp/*");
+# the state files and the state store of this user
+system("rm -rf ".$ENV{'NAGIOS_PLUGIN_STATE_DIRECTORY'}."/$>/check_snmp ".$ENV{'NAGIOS_PLUGIN_STATE_DIRECTORY'}."/$>/np_state.db");
 $res = NPTest->testCmd( "./check_snmp -H 127.0.0.1 -C public -p $port_snmp -o .1.3.6.1.4.1.8072.3.2.67.10 --rate -w 600" );
 is($res->return_code, 0, "Returns OK");
 is($res->output, "No previous data to calculate rate - assume okay");
@@ -637,7 +637,103 @@ xasprintf (char **strp, const char *fmt, ...)
  *
  ******************************************************************************/
 
-char *perfdata (const char *label,
+static void
+np_buf_grow (np_buf *buf, size_t len)
+{
+	if (buf->len + len < buf->size)
+		return;
+	if (buf->size == 0)
+		buf->size = 256;
+	while (buf->len + len >= buf->size)
+		buf->size *= 2;
+	buf->data = realloc (buf->data, buf->size);
+	if (buf->data == NULL)
+		die (STATE_UNKNOWN, _("failed realloc in np_buf_grow\n"));
+}
+
+void
+np_buf_append (np_buf *buf, const char *str, size_t len)
+{
+	np_buf_grow (buf, len);
+	memcpy (buf->data + buf->len, str, len);
+	buf->len += len;
+	buf->data[buf->len] = '\0';
+}
+
+void
+np_buf_puts (np_buf *buf, const char *str)
+{
+	np_buf_append (buf, str, strlen (str));
+}
+
+void
+np_buf_printf (np_buf *buf, const char *fmt, ...)
+{
+	va_list ap;
+	int len;
+
+	np_buf_grow (buf, 0);
+	va_start (ap, fmt);
+	len = vsnprintf (buf->data + buf->len, buf->size - buf->len, fmt, ap);
+	va_end (ap);
+	if (len < 0)
+		die (STATE_UNKNOWN, _("failed vsnprintf in np_buf_printf\n"));
+
+	if ((size_t)len >= buf->size - buf->len) {
+		np_buf_grow (buf, len);
+		va_start (ap, fmt);
+		vsnprintf (buf->data + buf->len, buf->size - buf->len, fmt, ap);
+		va_end (ap);
+	}
+	buf->len += len;
+}
+
+/* Labels with a space, '=' or ' are quoted, with each ' doubled */
+void
+np_buf_label (np_buf *buf, const char *label)
+{
+	const char *quote;
+
+	if (!strpbrk (label, "'= ")) {
+		np_buf_puts (buf, label);
+		return;
+	}
+	np_buf_append (buf, "'", 1);
+	while ((quote = strchr (label, '\'')) != NULL) {
+		np_buf_append (buf, label, quote - label + 1);
+		np_buf_append (buf, "'", 1);
+		label = quote + 1;
+	}
+	np_buf_puts (buf, label);
+	np_buf_append (buf, "'", 1);
+}
+
+const char *
+np_buf_str (const np_buf *buf)
+{
+	return buf->data ? buf->data : "";
+}
+
+void
+np_buf_free (np_buf *buf)
+{
+	free (buf->data);
+	buf->data = NULL;
+	buf->len = buf->size = 0;
+}
+
+/* label=, after a space if there is performance data before */
+static void
+perfdata_label (np_buf *buf, const char *label)
+{
+	if (buf->len)
+		np_buf_append (buf, " ", 1);
+	np_buf_label (buf, label);
+	np_buf_append (buf, "=", 1);
+}
+
+void perfdata_append (np_buf *buf,
+ const char *label,
  long int val,
  const char *uom,
  int warnp,
@@ -649,34 +745,26 @@ char *perfdata (const char *label,
  int maxp,
  long int maxv)
 {
-	char *data = NULL;
-
-	if (strpbrk (label, "'= "))
-		xasprintf (&data, "'%s'=%ld%s;", label, val, uom);
-	else
-		xasprintf (&data, "%s=%ld%s;", label, val, uom);
+	perfdata_label (buf, label);
+	np_buf_printf (buf, "%ld%s;", val, uom);
 
 	if (warnp)
-		xasprintf (&data, "%s%ld;", data, warn);
-	else
-		xasprintf (&data, "%s;", data);
+		np_buf_printf (buf, "%ld", warn);
+	np_buf_append (buf, ";", 1);
 
 	if (critp)
-		xasprintf (&data, "%s%ld;", data, crit);
-	else
-		xasprintf (&data, "%s;", data);
+		np_buf_printf (buf, "%ld", crit);
+	np_buf_append (buf, ";", 1);
 
 	if (minp)
-		xasprintf (&data, "%s%ld", data, minv);
+		np_buf_printf (buf, "%ld", minv);
 
 	if (maxp)
-		xasprintf (&data, "%s;%ld", data, maxv);
-
-	return data;
+		np_buf_printf (buf, ";%ld", maxv);
 }
 
-
-char *fperfdata (const char *label,
+void fperfdata_append (np_buf *buf,
+ const char *label,
  double val,
  const char *uom,
  int warnp,
@@ -688,38 +776,26 @@ char *fperfdata (const char *label,
  int maxp,
  double maxv)
 {
-	char *data = NULL;
-
-	if (strpbrk (label, "'= "))
-		xasprintf (&data, "'%s'=", label);
-	else
-		xasprintf (&data, "%s=", label);
-
-	xasprintf (&data, "%s%f", data, val);
-	xasprintf (&data, "%s%s;", data, uom);
+	perfdata_label (buf, label);
+	np_buf_printf (buf, "%f%s;", val, uom);
 
 	if (warnp)
-		xasprintf (&data, "%s%f", data, warn);
-
-	xasprintf (&data, "%s;", data);
+		np_buf_printf (buf, "%f", warn);
+	np_buf_append (buf, ";", 1);
 
 	if (critp)
-		xasprintf (&data, "%s%f", data, crit);
-
-	xasprintf (&data, "%s;", data);
+		np_buf_printf (buf, "%f", crit);
+	np_buf_append (buf, ";", 1);
 
 	if (minp)
-		xasprintf (&data, "%s%f", data, minv);
-
-	if (maxp) {
-		xasprintf (&data, "%s;", data);
-		xasprintf (&data, "%s%f", data, maxv);
-	}
+		np_buf_printf (buf, "%f", minv);
 
-	return data;
+	if (maxp)
+		np_buf_printf (buf, ";%f", maxv);
 }
 
-char *sperfdata (const char *label,
+void sperfdata_append (np_buf *buf,
+ const char *label,
  double val,
  const char *uom,
  char *warn,
@@ -729,37 +805,26 @@ char *sperfdata (const char *label,
  int maxp,
  double maxv)
 {
-	char *data = NULL;
-	if (strpbrk (label, "'= "))
-		xasprintf (&data, "'%s'=", label);
-	else
-		xasprintf (&data, "%s=", label);
-
-	xasprintf (&data, "%s%f", data, val);
-	xasprintf (&data, "%s%s;", data, uom);
+	perfdata_label (buf, label);
+	np_buf_printf (buf, "%f%s;", val, uom);
 
 	if (warn!=NULL)
-		xasprintf (&data, "%s%s", data, warn);
-
-	xasprintf (&data, "%s;", data);
+		np_buf_puts (buf, warn);
+	np_buf_append (buf, ";", 1);
 
 	if (crit!=NULL)
-		xasprintf (&data, "%s%s", data, crit);
-
-	xasprintf (&data, "%s;", data);
+		np_buf_puts (buf, crit);
+	np_buf_append (buf, ";", 1);
 
 	if (minp)
-		xasprintf (&data, "%s%f", data, minv);
+		np_buf_printf (buf, "%f", minv);
 
-	if (maxp) {
-		xasprintf (&data, "%s;", data);
-		xasprintf (&data, "%s%f", data, maxv);
-	}
-
-	return data;
+	if (maxp)
+		np_buf_printf (buf, ";%f", maxv);
 }
 
-char *sperfdata_int (const char *label,
+void sperfdata_int_append (np_buf *buf,
+ const char *label,
  int val,
  const char *uom,
  char *warn,
@@ -769,34 +834,91 @@ char *sperfdata_int (const char *label,
  int maxp,
  int maxv)
 {
-	char *data = NULL;
-	if (strpbrk (label, "'= "))
-		xasprintf (&data, "'%s'=", label);
-	else
-		xasprintf (&data, "%s=", label);
-
-	xasprintf (&data, "%s%d", data, val);
-	xasprintf (&data, "%s%s;", data, uom);
+	perfdata_label (buf, label);
+	np_buf_printf (buf, "%d%s;", val, uom);
 
 	if (warn!=NULL)
-		xasprintf (&data, "%s%s", data, warn);
-
-	xasprintf (&data, "%s;", data);
+		np_buf_puts (buf, warn);
+	np_buf_append (buf, ";", 1);
 
 	if (crit!=NULL)
-		xasprintf (&data, "%s%s", data, crit);
-
-	xasprintf (&data, "%s;", data);
+		np_buf_puts (buf, crit);
+	np_buf_append (buf, ";", 1);
 
 	if (minp)
-		xasprintf (&data, "%s%d", data, minv);
+		np_buf_printf (buf, "%d", minv);
 
-	if (maxp) {
-		xasprintf (&data, "%s;", data);
-		xasprintf (&data, "%s%d", data, maxv);
-	}
+	if (maxp)
+		np_buf_printf (buf, ";%d", maxv);
+}
+
+char *perfdata (const char *label,
+ long int val,
+ const char *uom,
+ int warnp,
+ long int warn,
+ int critp,
+ long int crit,
+ int minp,
+ long int minv,
+ int maxp,
+ long int maxv)
+{
+	np_buf buf = NP_BUF_INIT;
+
+	perfdata_append (&buf, label, val, uom, warnp, warn, critp, crit, minp, minv, maxp, maxv);
+	return buf.data;
+}
+
+
+char *fperfdata (const char *label,
+ double val,
+ const char *uom,
+ int warnp,
+ double warn,
+ int critp,
+ double crit,
+ int minp,
+ double minv,
+ int maxp,
+ double maxv)
+{
+	np_buf buf = NP_BUF_INIT;
+
+	fperfdata_append (&buf, label, val, uom, warnp, warn, critp, crit, minp, minv, maxp, maxv);
+	return buf.data;
+}
+
+char *sperfdata (const char *label,
+ double val,
+ const char *uom,
+ char *warn,
+ char *crit,
+ int minp,
+ double minv,
+ int maxp,
+ double maxv)
+{
+	np_buf buf = NP_BUF_INIT;
+
+	sperfdata_append (&buf, label, val, uom, warn, crit, minp, minv, maxp, maxv);
+	return buf.data;
+}
+
+char *sperfdata_int (const char *label,
+ int val,
+ const char *uom,
+ char *warn,
+ char *crit,
+ int minp,
+ int minv,
+ int maxp,
+ int maxv)
+{
+	np_buf buf = NP_BUF_INIT;
 
-	return data;
+	sperfdata_int_append (&buf, label, val, uom, warn, crit, minp, minv, maxp, maxv);
+	return buf.data;
 }
 
 /* set entire string to lower, no need to return as it works on string in place */
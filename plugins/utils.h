@@ -20,8 +20,9 @@ suite of plugins. */
 /* Include extra-opts functions if compiled in */
 #include "extra_opts.h"
 #else
-/* else, fake np_extra_opts */
-#define np_extra_opts(acptr,av,pr) av
+/* else, fake np_extra_opts, which still handles --output-format */
+#include "utils_output.h"
+#define np_extra_opts(acptr,av,pr) np_output_opts(acptr,av,pr)
 #endif
 
 /* Standardize version information, termination */
@@ -100,6 +101,26 @@ int parse_timeout_string (char *timeout_str);
 #define max(a,b) (((a)>(b))?(a):(b))
 #define min(a,b) (((a)<(b))?(a):(b))
 
+/* A growing buffer to build output and performance data in, instead of
+   reformatting the whole string with xasprintf for every piece added */
+typedef struct np_buf {
+	char *data;     /* NUL terminated, NULL until something is added */
+	size_t len;
+	size_t size;
+} np_buf;
+
+#define NP_BUF_INIT { NULL, 0, 0 }
+
+void np_buf_append (np_buf *, const char *, size_t);
+void np_buf_puts (np_buf *, const char *);
+void np_buf_printf (np_buf *, const char *, ...)
+	__attribute__((format(printf, 2, 3)));
+/* the label of a performance data value, quoted if needed */
+void np_buf_label (np_buf *, const char *);
+/* the contents, "" if empty */
+const char *np_buf_str (const np_buf *);
+void np_buf_free (np_buf *);
+
 char *perfdata (const char *, long int, const char *, int, long int,
                 int, long int, int, long int, int, long int);
 
@@ -112,6 +133,19 @@ char *sperfdata (const char *, double, const char *, char *, char *,
 char *sperfdata_int (const char *, int, const char *, char *, char *,
                      int, int, int, int);
 
+/* The same, appended to a buffer after a space if it is not empty */
+void perfdata_append (np_buf *, const char *, long int, const char *, int, long int,
+                      int, long int, int, long int, int, long int);
+
+void fperfdata_append (np_buf *, const char *, double, const char *, int, double,
+                       int, double, int, double, int, double);
+
+void sperfdata_append (np_buf *, const char *, double, const char *, char *, char *,
+                       int, double, int, double);
+
+void sperfdata_int_append (np_buf *, const char *, int, const char *, char *, char *,
+                           int, int, int, int);
+
 /* string case changes */
 void strntoupper (char * test_char, int size);
 void strntolower (char * test_char, int size);
@@ -155,6 +189,11 @@ void strntolower (char * test_char, int size);
  -6, --use-ipv6\n\
     Use IPv6 connection\n")
 
+#define UT_EXTENDED_PERFDATA _("\
+ --extended-perfdata\n\
+    Print additional perfdata for the DNS, connect, SSL, first byte and\n\
+    transfer phases of the connection\n")
+
 #define UT_VERBOSE _("\
  -v, --verbose\n\
     Show details for command-line debugging (Nagios may truncate output)\n")
@@ -185,9 +224,15 @@ void strntolower (char * test_char, int size);
  --extra-opts=[section][@file]\n\
     Read options from an ini file. See\n\
     https://www.nagios-plugins.org/doc/extra-opts.html\n\
-    for usage and examples.\n")
+    for usage and examples.\n\
+ --output-format=classic|json|openmetrics\n\
+    Print the state, output and performance data as JSON or OpenMetrics\n\
+    instead of plugin output. The exit status is the same.\n")
 #else
-#define UT_EXTRA_OPTS " \b"
+#define UT_EXTRA_OPTS _("\
+ --output-format=classic|json|openmetrics\n\
+    Print the state, output and performance data as JSON or OpenMetrics\n\
+    instead of plugin output. The exit status is the same.\n")
 #endif
 
 #define UT_THRESHOLDS_NOTES _("\